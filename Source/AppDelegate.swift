@@ -190,6 +190,10 @@ class AppDelegate: NSObject, NSApplicationDelegate, NonModalAlertWindowControlle
         checkForUpdate()
     }
 
+    func applicationWillTerminate(_ notification: Notification) {
+        LanguageModelManager.saveUserOverrideModel(waitUntilWritten: true)
+    }
+
     @objc func showPreferences() {
         if preferencesWindowController == nil {
             preferencesWindowController = PreferencesWindowController(windowNibName: "preferences")
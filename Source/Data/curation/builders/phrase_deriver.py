@@ -6,6 +6,7 @@ from typing import List, Tuple
 import unicodedata
 
 PRAGMA = "# format org.openvanilla.mcbopomofo.sorted"
+SCORE_GROUPED_PRAGMA = "# format org.openvanilla.mcbopomofo.sorted.score-grouped"
 MAX_ENTRIES_PER_PREFIX = 60
 EMOJI_SCORE = -8.0
 
@@ -70,11 +71,31 @@ class Entry:
         return cls(reading, value, float(score))
 
 
+def score_grouped_sort_key(line: str):
+    """Returns the sort key of a line in the score-grouped layout.
+
+    The lines are grouped by their first value and reading, such as `四-ㄙˋ-`,
+    and the groups are sorted by the bytes of that group key. Within a group,
+    the lines are ordered by descending score, and lines with the same score
+    are ordered by their bytes, which is the order the engine gives them in
+    the sorted layout. The engine can then read the best phrases of a prefix
+    first and stop early.
+    """
+    phrase, score = line.rsplit(" ", 1)
+    group_key = "".join(p + "-" for p in phrase.split("-")[:2])
+    return (group_key.encode("utf-8"), -float(score), line.encode("utf-8"))
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("source", help="source file")
     parser.add_argument("target", help="target file")
     parser.add_argument("punctuation", help="punctuation file")
+    parser.add_argument(
+        "--score_grouped",
+        action="store_true",
+        help="group the rows by their first value and reading, best first",
+    )
     args = parser.parse_args()
 
     source_file = args.source
@@ -110,11 +131,16 @@ def main():
         )
 
     output_lines += punctuation_lines
-    byte_sorted_output_lines = sorted(output_lines, key=lambda x: x.encode("utf-8"))
+    if args.score_grouped:
+        pragma = SCORE_GROUPED_PRAGMA
+        sorted_output_lines = sorted(output_lines, key=score_grouped_sort_key)
+    else:
+        pragma = PRAGMA
+        sorted_output_lines = sorted(output_lines, key=lambda x: x.encode("utf-8"))
 
     with open(target_file, "w") as f:
-        print(PRAGMA, file=f)
-        for line in byte_sorted_output_lines:
+        print(pragma, file=f)
+        for line in sorted_output_lines:
             print(line, file=f)
 
 
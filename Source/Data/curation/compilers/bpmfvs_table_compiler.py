@@ -0,0 +1,137 @@
+"""Compiles the bpmfvs variants and PUA databases into a binary table.
+
+The table is the one read by the engine's BopomofoVariantTable: an
+open-addressing hash table keyed by a character's Unicode scalar value and a
+packed Bopomofo reading, which maps to the character's variant selector for the
+reading, or, for the PUA entries, whose scalar value is 0, to the code point of
+the reading's combined Bopomofo block. The output must stay byte-for-byte
+identical to BopomofoVariantTable::Compile().
+"""
+
+import argparse
+import struct
+
+from .compiler_utils import HEADER
+
+MAGIC = b"McBPVSTB"
+VERSION = 1
+BYTE_ORDER_MARK = 0x01020304
+MIN_SLOT_COUNT = 16
+FIBONACCI_MULTIPLIER = 0x9E3779B97F4A7C15
+UINT64_MASK = (1 << 64) - 1
+
+UNANNOTATED_READING = "na"
+PACKED_UNANNOTATED_READING = 0xFFFF
+
+# The component values of Formosa::Mandarin::BopomofoSyllable.
+CONSONANTS = "ㄅㄆㄇㄈㄉㄊㄋㄌㄍㄎㄏㄐㄑㄒㄓㄔㄕㄖㄗㄘㄙ"
+MIDDLE_VOWELS = "ㄧㄨㄩ"
+VOWELS = "ㄚㄛㄜㄝㄞㄟㄠㄡㄢㄣㄤㄥㄦ"
+TONE_MARKERS = {"ˊ": 0x0800, "ˇ": 0x1000, "ˋ": 0x1800, "˙": 0x2000}
+
+
+def component(c):
+    """Returns the component value and the class of a Bopomofo character."""
+    if c in CONSONANTS:
+        return CONSONANTS.index(c) + 1, 0
+    if c in MIDDLE_VOWELS:
+        return (MIDDLE_VOWELS.index(c) + 1) << 5, 1
+    if c in VOWELS:
+        return (VOWELS.index(c) + 1) << 7, 2
+    if c in TONE_MARKERS:
+        return TONE_MARKERS[c], 3
+    raise ValueError(f"Not a Bopomofo component: {c}")
+
+
+def pack_reading(reading):
+    """Packs a reading the way BopomofoVariantTable::PackReading() does."""
+    if reading == UNANNOTATED_READING:
+        return PACKED_UNANNOTATED_READING
+    if not reading:
+        raise ValueError("Empty reading")
+
+    syllable = 0
+    last_class = -1
+    for c in reading:
+        value, component_class = component(c)
+        if component_class <= last_class:
+            raise ValueError(f"Malformed reading: {reading}")
+        syllable |= value
+        last_class = component_class
+    return syllable
+
+
+def read_rows(path):
+    with open(path, "r", encoding="utf-8") as f:
+        if f.readline() != HEADER:
+            raise ValueError(f"Invalid header: {path}")
+        return [line.rstrip("\n") for line in f if line.rstrip("\n")]
+
+
+def compile_table(variants_path, pua_path):
+    entries = []
+
+    for row in read_rows(variants_path):
+        key, variant = row.split(" ", 1)
+        character, reading = key.rsplit("-", 1)
+        if len(character) != 1 or not variant.startswith(character):
+            raise ValueError(f"Malformed variant row: {row}")
+        selector = variant[len(character) :]
+        if len(selector) > 1:
+            raise ValueError(f"Malformed variant row: {row}")
+        entries.append(
+            ((ord(character) << 16) | pack_reading(reading), ord(selector or "\0"))
+        )
+
+    for row in read_rows(pua_path):
+        reading, block = row.split(" ", 1)
+        packed = pack_reading(reading)
+        if packed == PACKED_UNANNOTATED_READING or len(block) != 1:
+            raise ValueError(f"Malformed PUA row: {row}")
+        entries.append((packed, ord(block)))
+
+    # The first row of a key wins, and the entries are inserted in the order
+    # of their keys.
+    first_entries = {}
+    for key, code_point in entries:
+        first_entries.setdefault(key, code_point)
+    entries = sorted(first_entries.items())
+
+    slot_count = MIN_SLOT_COUNT
+    while slot_count < len(entries) * 2:
+        slot_count *= 2
+    shift = 64 - (slot_count.bit_length() - 1)
+
+    slots = [None] * slot_count
+    for key, code_point in entries:
+        slot = ((key * FIBONACCI_MULTIPLIER) & UINT64_MASK) >> shift
+        while slots[slot] is not None:
+            slot = (slot + 1) & (slot_count - 1)
+        slots[slot] = (key, code_point)
+
+    output = bytearray(MAGIC)
+    output += struct.pack("<IIII", VERSION, BYTE_ORDER_MARK, slot_count, len(entries))
+    for slot in slots:
+        if slot is None:
+            output += bytes(12)
+        else:
+            key, code_point = slot
+            output += struct.pack("<IHHI", key >> 16, key & 0xFFFF, 1, code_point)
+    return bytes(output)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="compile the bpmfvs variants and PUA dbs into a binary table"
+    )
+    parser.add_argument("--variants", default="bpmfvs-variants.txt")
+    parser.add_argument("--pua", default="bpmfvs-pua.txt")
+    parser.add_argument("--output", default="bpmfvs-table.bin")
+    args = parser.parse_args()
+
+    with open(args.output, "wb") as f:
+        f.write(compile_table(args.variants, args.pua))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,265 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Puts allocation budgets on the hot paths of typing, so that a change that
+// makes them allocate more fails the tests like a correctness regression
+// does. Each path is called once to warm up memoized state, then measured.
+// The budgets are the counts at the time they were set; lower them when a
+// path gets cheaper.
+//
+// The counts were taken with libstdc++ and have not been confirmed with
+// libc++. Its vectors also double their capacity and its strings keep more
+// characters inline, so the counts should be no higher there, but the nonzero
+// budgets allow it kLibraryHeadroom more allocations until they are checked.
+// The zero budgets stay zero on every library.
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "McBopomofoLM.h"
+#include "ParselessLM.h"
+#include "ParselessPhraseDB.h"
+#include "UserOverrideModel.h"
+#include "VariantAnnotator.h"
+#include "gramambular2/reading_grid.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+using Formosa::Gramambular2::ReadingGrid;
+
+namespace {
+
+constexpr char kLMData[] = R"(# format org.openvanilla.mcbopomofo.sorted
+ㄇㄧㄥˊ 明 -3.07936356
+ㄇㄧㄥˊ 名 -3.12166252
+ㄇㄧㄥˊ 銘 -4.43019121
+ㄇㄧㄥˊ-ㄘˊ 名詞 -4.61364867
+ㄇㄧㄥˊ-ㄘˋ 名次 -5.47446950
+ㄉㄨㄥˋ 動 -2.83459585
+ㄉㄨㄥˋ 洞 -4.31757780
+ㄉㄨㄥˋ-ㄗㄨㄛˋ 動作 -4.17449149
+ㄔㄥˊ 成 -2.90000000
+ㄔㄥˊ-ㄕˋ 城市 -3.98856498
+ㄔㄥˊ-ㄕˋ 程式 -4.07624939
+ㄔㄥˊ-ㄕˋ 成事 -5.88664994
+ㄕˋ 是 -2.10000000
+ㄗㄨㄛˋ 作 -3.10000000
+ㄘˊ 詞 -3.50000000
+)";
+
+constexpr char kUserPhrasesData[] = R"(
+茗 ㄇㄧㄥˊ
+程式 ㄔㄥˊ-ㄕˋ
+)";
+
+static const auto* kVariantsData =
+    u8"# format org.openvanilla.mcbopomofo.sorted\n"
+    u8"個-na 個\U000E01E0\n"
+    u8"個-ㄍㄜˋ 個\n";
+
+static const auto* kPUAData =
+    u8"# format org.openvanilla.mcbopomofo.sorted\n"
+    u8"ㄍㄚˋ \uF145\n";
+
+constexpr const char* kReadings[] = {"ㄇㄧㄥˊ", "ㄘˊ", "ㄉㄨㄥˋ",
+                                     "ㄗㄨㄛˋ", "ㄔㄥˊ", "ㄕˋ"};
+
+#if defined(_LIBCPP_VERSION)
+constexpr size_t kLibraryHeadroom = 2;
+#else
+constexpr size_t kLibraryHeadroom = 0;
+#endif
+
+std::unique_ptr<ParselessPhraseDB> MakeDB() {
+  return std::make_unique<ParselessPhraseDB>(kLMData, sizeof(kLMData) - 1);
+}
+
+std::shared_ptr<McBopomofoLM> MakeLM() {
+  auto lm = std::make_shared<McBopomofoLM>();
+  lm->loadLanguageModel(MakeDB());
+  lm->loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  return lm;
+}
+
+template <typename F>
+size_t CountAllocations(F&& f) {
+  AllocationCounter counter;
+  f();
+  return counter.allocations();
+}
+
+}  // namespace
+
+TEST(AllocationCounterTest, CountsAllocationsInScope) {
+  AllocationCounter outer;
+  auto p = std::make_unique<int>(1);
+  std::vector<int> v(16);
+  EXPECT_EQ(outer.allocations(), 2);
+  EXPECT_GE(outer.allocatedBytes(), sizeof(int) + 16 * sizeof(int));
+
+  AllocationCounter inner;
+  EXPECT_EQ(inner.allocations(), 0);
+  p.reset();
+  EXPECT_EQ(inner.deallocations(), 1);
+  EXPECT_EQ(outer.deallocations(), 1);
+}
+
+TEST(AllocationCounterTest, CountsOnlyTheCurrentThread) {
+  AllocationCounter counter;
+  // Starting a thread allocates its state on this thread, so only what the
+  // thread allocates itself is checked.
+  std::thread thread([] {
+    AllocationCounter threadCounter;
+    std::vector<std::string> strings(100, std::string(100, 'x'));
+    // The prototype string, the vector and the copies.
+    EXPECT_EQ(threadCounter.allocations(), 102);
+  });
+  thread.join();
+  EXPECT_LT(counter.allocations(), 100);
+}
+
+TEST(AllocationBudgetTest, ParselessPhraseDBFindFirstMatchingLine) {
+  auto db = MakeDB();
+  const char* line = db->findFirstMatchingLine("ㄔㄥˊ-ㄕˋ ");
+  EXPECT_EQ(CountAllocations(
+                [&] { line = db->findFirstMatchingLine("ㄔㄥˊ-ㄕˋ "); }),
+            0);
+  EXPECT_NE(line, nullptr);
+  EXPECT_EQ(CountAllocations(
+                [&] { line = db->findFirstMatchingLine("ㄅㄚ "); }),
+            0);
+  EXPECT_EQ(line, nullptr);
+}
+
+TEST(AllocationBudgetTest, ParselessLMLookUps) {
+  ParselessLM lm;
+  ASSERT_TRUE(lm.open(MakeDB()));
+  const std::string key = "ㄔㄥˊ-ㄕˋ";
+  (void)lm.getUnigrams(key);
+
+  bool found = false;
+  EXPECT_EQ(CountAllocations([&] { found = lm.hasUnigrams(key); }), 0);
+  EXPECT_TRUE(found);
+
+  // The rows found and the unigrams returned, each in a vector that grows
+  // one row at a time.
+  constexpr size_t kGetUnigramsBudget = 6 + kLibraryHeadroom;
+  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> unigrams;
+  EXPECT_LE(CountAllocations([&] { unigrams = lm.getUnigrams(key); }),
+            kGetUnigramsBudget);
+  EXPECT_EQ(unigrams.size(), 3);
+}
+
+TEST(AllocationBudgetTest, McBopomofoLMLookUps) {
+  auto lm = MakeLM();
+  const std::string key = "ㄔㄥˊ-ㄕˋ";
+  (void)lm->getUnigrams(key);
+
+  bool found = false;
+  EXPECT_EQ(CountAllocations([&] { found = lm->hasUnigrams(key); }), 0);
+  EXPECT_TRUE(found);
+
+  // On top of the lookups of the underlying models, the sets used to filter
+  // and deduplicate the unigrams.
+  constexpr size_t kGetUnigramsBudget = 16 + kLibraryHeadroom;
+  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> unigrams;
+  EXPECT_LE(CountAllocations([&] { unigrams = lm->getUnigrams(key); }),
+            kGetUnigramsBudget);
+  EXPECT_EQ(unigrams.size(), 3);
+}
+
+TEST(AllocationBudgetTest, ReadingGridWalk) {
+  ReadingGrid grid(MakeLM());
+  for (const char* reading : kReadings) {
+    ASSERT_TRUE(grid.insertReading(reading));
+  }
+  (void)grid.walk();
+
+  // The Viterbi table, and the walk's node vector growing one node at a time.
+  constexpr size_t kWalkBudget = 4 + kLibraryHeadroom;
+  ReadingGrid::WalkResult result;
+  EXPECT_LE(CountAllocations([&] { result = grid.walk(); }), kWalkBudget);
+  EXPECT_EQ(result.valuesAsStrings(),
+            (std::vector<std::string>{"名詞", "動作", "程式"}));
+}
+
+TEST(AllocationBudgetTest, UserOverrideModelSuggest) {
+  ReadingGrid grid(MakeLM());
+  for (const char* reading : kReadings) {
+    ASSERT_TRUE(grid.insertReading(reading));
+  }
+  ReadingGrid::WalkResult walk = grid.walk();
+
+  constexpr double kNow = 1000;
+  UserOverrideModel uom(500, 5400);
+  std::string keyString = UserOverrideModel::ObservationKeyString(walk, 3);
+  UserOverrideModel::ObservationKey key =
+      UserOverrideModel::MakeObservationKey(keyString);
+  uom.observe(key, "洞", kNow);
+
+  UserOverrideModel::Suggestion suggestion;
+  EXPECT_EQ(CountAllocations([&] { suggestion = uom.suggest(key, kNow); }), 0);
+  EXPECT_EQ(suggestion.candidate, "洞");
+  EXPECT_EQ(CountAllocations([&] { suggestion = uom.suggest(walk, 3, kNow); }),
+            0);
+  EXPECT_EQ(suggestion.candidate, "洞");
+}
+
+TEST(AllocationBudgetTest, VariantAnnotatorAnnotate) {
+  VariantAnnotator annotator;
+  const char* variantsData = reinterpret_cast<const char*>(kVariantsData);
+  const char* puaData = reinterpret_cast<const char*>(kPUAData);
+  annotator.loadVariantsMap(
+      ParselessPhraseDB::CreateValidatedDB(variantsData, strlen(variantsData)));
+  annotator.loadPUAMap(
+      ParselessPhraseDB::CreateValidatedDB(puaData, strlen(puaData)));
+  ASSERT_TRUE(annotator.loaded());
+
+  const std::vector<std::string> values{"個", "個"};
+  const std::vector<std::string> readings{"ㄍㄜˋ", "ㄍㄚˋ"};
+  (void)annotator.annotate(values, readings);
+
+  // A memoized character short enough for the small string buffer.
+  VariantAnnotator::Result singleResult;
+  EXPECT_EQ(CountAllocations([&] {
+              singleResult = annotator.annotateSingleCharacter("個", "ㄍㄜˋ");
+            }),
+            0);
+  EXPECT_EQ(singleResult.annotatedString, "個");
+
+  // The combined string and the accumulated lengths as they grow.
+  constexpr size_t kAnnotateBudget = 3 + kLibraryHeadroom;
+  VariantAnnotator::CombinedResult result;
+  EXPECT_LE(CountAllocations(
+                [&] { result = annotator.annotate(values, readings); }),
+            kAnnotateBudget);
+  EXPECT_TRUE(result.hasPUACodePoints);
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,159 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Plain integers, so that they need no dynamic initialization and can be
+// used from operator new on any thread at any time.
+thread_local size_t tAllocations = 0;
+thread_local size_t tAllocatedBytes = 0;
+thread_local size_t tDeallocations = 0;
+
+void* CountedAllocate(size_t size, size_t alignment) {
+  ++tAllocations;
+  tAllocatedBytes += size;
+  if (size == 0) {
+    size = 1;
+  }
+  void* ptr = nullptr;
+  if (alignment <= alignof(std::max_align_t)) {
+    ptr = std::malloc(size);
+  } else if (posix_memalign(&ptr, alignment, size) != 0) {
+    ptr = nullptr;
+  }
+  return ptr;
+}
+
+void* CountedAllocateOrThrow(size_t size, size_t alignment) {
+  void* ptr = CountedAllocate(size, alignment);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void CountedDeallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  ++tDeallocations;
+  std::free(ptr);
+}
+
+}  // namespace
+
+namespace McBopomofo {
+
+AllocationCounter::AllocationCounter()
+    : startAllocations_(tAllocations),
+      startAllocatedBytes_(tAllocatedBytes),
+      startDeallocations_(tDeallocations) {}
+
+size_t AllocationCounter::allocations() const {
+  return tAllocations - startAllocations_;
+}
+
+size_t AllocationCounter::allocatedBytes() const {
+  return tAllocatedBytes - startAllocatedBytes_;
+}
+
+size_t AllocationCounter::deallocations() const {
+  return tDeallocations - startDeallocations_;
+}
+
+}  // namespace McBopomofo
+
+// The replaceable global allocation functions. Every form is replaced so that
+// none of them bypasses the counters, whichever one the standard library
+// forwards to.
+
+void* operator new(size_t size) {
+  return CountedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size) {
+  return CountedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return CountedAllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return CountedAllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept { CountedDeallocate(ptr); }
+
+void operator delete[](void* ptr) noexcept { CountedDeallocate(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { CountedDeallocate(ptr); }
+
+void operator delete[](void* ptr, size_t) noexcept { CountedDeallocate(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  CountedDeallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  CountedDeallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  CountedDeallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  CountedDeallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  CountedDeallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  CountedDeallocate(ptr);
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_ALLOCATIONCOUNTER_H_
+#define SRC_ENGINE_ALLOCATIONCOUNTER_H_
+
+#include <cstddef>
+
+namespace McBopomofo {
+
+// Counts the heap allocations made by the current thread while the counter is
+// alive. Only available in the binaries that link AllocationCounter.cpp,
+// which replaces the global operator new and operator delete to keep
+// per-thread totals: AllocationBudgetTest and
+// ByteBlockBackedDictionaryBenchmark. Counters may be nested; each one sees the allocations
+// made since it was constructed.
+//
+//   AllocationCounter counter;
+//   db.findFirstMatchingLine("ㄇㄚ");
+//   EXPECT_EQ(counter.allocations(), 0);
+class AllocationCounter {
+ public:
+  AllocationCounter();
+
+  // The number of calls to operator new (of any form) since construction.
+  [[nodiscard]] size_t allocations() const;
+
+  // The bytes requested by those calls.
+  [[nodiscard]] size_t allocatedBytes() const;
+
+  // The number of calls to operator delete with a non-null pointer since
+  // construction.
+  [[nodiscard]] size_t deallocations() const;
+
+ private:
+  size_t startAllocations_;
+  size_t startAllocatedBytes_;
+  size_t startDeallocations_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_ALLOCATIONCOUNTER_H_
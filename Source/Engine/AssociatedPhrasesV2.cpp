@@ -24,12 +24,13 @@
 #include "AssociatedPhrasesV2.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <limits>
 #include <memory>
-#include <sstream>
 #include <string>
-#include <unordered_set>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -44,34 +45,47 @@ namespace {
 enum class RowParseState { kParsingValue, kParsingReading };
 }  // namespace
 
-// Find the score in a string of the form /^(.+?)\s((-?)\d+(\.?)\d+)$/.
-static double GetScoreInRow(const std::string_view& v) {
-  const auto* it = v.cbegin();
-  const auto* end = v.cend();
+// The number of rows ranked at a time, at least. Ranking a few more rows
+// than asked for saves another pass when some of them turn out to be
+// duplicates.
+static constexpr size_t kMinRankedRows = 16;
 
-  while (it != end) {
-    if (*it == ' ') {
-      ++it;
-      break;
-    }
-    ++it;
+// Find the score in a string of the form /^(.+?)\s((-?)\d+(\.?)\d+)$/.
+static double GetScoreInRow(std::string_view v) {
+  size_t space = v.find(' ');
+  if (space == std::string_view::npos || space + 1 == v.size()) {
+    return std::numeric_limits<double>::lowest();
   }
-
-  if (it == end) {
+  std::string_view score = v.substr(space + 1);
+
+  // strtod needs a null-terminated string, which a row in the database is
+  // not.
+  char buffer[32];
+  std::string copy;
+  const char* start = buffer;
+  if (score.size() < sizeof(buffer)) {
+    memcpy(buffer, score.data(), score.size());
+    buffer[score.size()] = 0;
+  } else {
+    copy = std::string(score);
+    start = copy.c_str();
+  }
+  char* end = nullptr;
+  double result = strtod(start, &end);
+  if (end == start) {
     return std::numeric_limits<double>::lowest();
   }
-
-  return std::stod(std::string(it, end));
+  return result;
 }
 
-// Parse an associated phrases entry to the Phrase struct.
-static AssociatedPhrasesV2::Phrase PhraseFromRow(const std::string_view& v) {
+// Calls onValue and onReading with the alternating value and reading segments
+// of an associated phrases entry, up to the score.
+template <typename ValueFn, typename ReadingFn>
+static void ParseRow(std::string_view v, ValueFn onValue,
+                     ReadingFn onReading) {
   const auto* it = v.cbegin();
   const auto* end = v.cend();
 
-  std::stringstream sst;
-  std::vector<std::string> readings;
-
   RowParseState state = RowParseState::kParsingValue;
   const auto* prev = it;
   while (it != end) {
@@ -80,12 +94,12 @@ static AssociatedPhrasesV2::Phrase PhraseFromRow(const std::string_view& v) {
         case RowParseState::kParsingValue:
           // Switch to parsing readings.
           state = RowParseState::kParsingReading;
-          sst << std::string{prev, it};
+          onValue(std::string_view(prev, static_cast<size_t>(it - prev)));
           break;
         case RowParseState::kParsingReading:
           // Switch to parsing values.
           state = RowParseState::kParsingValue;
-          readings.emplace_back(std::string{prev, it});
+          onReading(std::string_view(prev, static_cast<size_t>(it - prev)));
           break;
       }
 
@@ -99,8 +113,100 @@ static AssociatedPhrasesV2::Phrase PhraseFromRow(const std::string_view& v) {
 
     ++it;
   }
+}
+
+std::string AssociatedPhrasesV2::PhraseRow::value() const {
+  std::string value;
+  ParseRow(
+      row_, [&value](std::string_view s) { value.append(s); },
+      [](std::string_view) {});
+  return value;
+}
+
+std::vector<std::string> AssociatedPhrasesV2::PhraseRow::readings() const {
+  std::vector<std::string> readings;
+  ParseRow(
+      row_, [](std::string_view) {},
+      [&readings](std::string_view s) { readings.emplace_back(s); });
+  return readings;
+}
+
+std::vector<AssociatedPhrasesV2::PhraseRow>
+AssociatedPhrasesV2::PhraseResults::page(size_t start, size_t count) {
+  if (count == 0) {
+    return {};
+  }
+  const size_t end = count > SIZE_MAX - start ? SIZE_MAX : start + count;
+  rankPast(end - 1);
+  std::vector<PhraseRow> rows;
+  for (size_t i = start; i < end && i < phrases_.size(); ++i) {
+    const ScoredRow& row = rows_[phrases_[i]];
+    rows.emplace_back(row.row, row.score);
+  }
+  return rows;
+}
+
+bool AssociatedPhrasesV2::PhraseResults::hasPhraseAt(size_t index) {
+  rankPast(index);
+  return index < phrases_.size();
+}
+
+size_t AssociatedPhrasesV2::PhraseResults::matchingRowCount() {
+  while (readRow()) {
+  }
+  return rows_.size();
+}
+
+bool AssociatedPhrasesV2::PhraseResults::readRow() {
+  while (nextRow_ != nullptr) {
+    std::string_view row = db_->rowAt(nextRow_);
+    if (!row.starts_with(groupKey_)) {
+      nextRow_ = nullptr;
+      break;
+    }
+    nextRow_ = row.data() + row.size() + 1;
+
+    if (row.starts_with(prefix_)) {
+      // The rows of a group are already ranked.
+      rows_.push_back(ScoredRow{row, GetScoreInRow(row), rows_.size()});
+      ranked_ = rows_.size();
+      return true;
+    }
+  }
+  return false;
+}
+
+void AssociatedPhrasesV2::PhraseResults::rankPast(size_t phraseCount) {
+  // Higher scores first, and for the same score, the order in the database,
+  // which is what a stable sort by score gives.
+  auto order = [](const ScoredRow& a, const ScoredRow& b) {
+    return a.score != b.score ? a.score > b.score : a.index < b.index;
+  };
+
+  while (phrases_.size() <= phraseCount) {
+    if (scanned_ == rows_.size() && !readRow()) {
+      break;
+    }
 
-  return {sst.str(), readings};
+    if (scanned_ == ranked_) {
+      const size_t wanted = phraseCount - phrases_.size() + 1;
+      const size_t chunk = std::min(
+          rows_.size() - ranked_,
+          wanted > rows_.size() ? rows_.size()
+                                : std::max(wanted * 2, kMinRankedRows));
+      auto first = rows_.begin() + static_cast<ptrdiff_t>(ranked_);
+      std::partial_sort(first, first + static_cast<ptrdiff_t>(chunk),
+                        rows_.end(), order);
+      ranked_ += chunk;
+    }
+
+    // Since the rows are now ranked, higher-ranking values are retained.
+    const ScoredRow& row = rows_[scanned_];
+    if (values_.insert(PhraseRow(row.row, row.score).value()).second) {
+      phrases_.push_back(scanned_);
+    }
+    ++scanned_;
+  }
 }
 
 AssociatedPhrasesV2::~AssociatedPhrasesV2() { close(); }
@@ -115,89 +221,126 @@ bool AssociatedPhrasesV2::open(const char* path) {
     return false;
   }
 
-  db_ = std::make_unique<ParselessPhraseDB>(
-      mmapedFile_.data(), mmapedFile_.length(), /*validate_pragma=*/true);
+  const char* data = mmapedFile_.data();
+  size_t length = mmapedFile_.length();
+  if (std::string_view(data, length).starts_with(SCORE_GROUPED_PRAGMA_HEADER) &&
+      length > SCORE_GROUPED_PRAGMA_HEADER.length()) {
+    layout_ = Layout::kScoreGrouped;
+    db_ = std::make_unique<ParselessPhraseDB>(
+        data + SCORE_GROUPED_PRAGMA_HEADER.length(),
+        length - SCORE_GROUPED_PRAGMA_HEADER.length());
+    return true;
+  }
+
+  db_ = std::make_unique<ParselessPhraseDB>(data, length,
+                                            /*validate_pragma=*/true);
   return true;
 }
 
 void AssociatedPhrasesV2::close() {
   db_ = nullptr;
+  layout_ = Layout::kSorted;
   mmapedFile_.close();
 }
 
 bool AssociatedPhrasesV2::isLoaded() const { return db_ != nullptr; }
 
-bool AssociatedPhrasesV2::open(std::unique_ptr<ParselessPhraseDB> db) {
+MemoryUsage AssociatedPhrasesV2::memoryUsage() const {
+  MemoryUsage usage = mmapedFile_.memoryUsage();
+  if (db_ != nullptr) {
+    usage.heapBytes += sizeof(ParselessPhraseDB);
+  }
+  return usage;
+}
+
+bool AssociatedPhrasesV2::open(std::unique_ptr<ParselessPhraseDB> db,
+                               Layout layout) {
   if (db_ != nullptr) {
     return false;
   }
 
   db_ = std::move(db);
+  layout_ = layout;
   return true;
 }
 
 std::vector<AssociatedPhrasesV2::Phrase> AssociatedPhrasesV2::findPhrases(
     const std::string& prefixValue,
     const std::vector<std::string>& prefixReadings) const {
+  std::vector<Phrase> phrases;
+  for (const PhraseRow& row :
+       findPhraseResults(prefixValue, prefixReadings).page(0, SIZE_MAX)) {
+    phrases.emplace_back(row.phrase());
+  }
+  return phrases;
+}
+
+AssociatedPhrasesV2::PhraseResults AssociatedPhrasesV2::findPhraseResults(
+    const std::string& prefixValue,
+    const std::vector<std::string>& prefixReadings) const {
+  std::string internalPrefix = InternalPrefix(prefixValue, prefixReadings);
+  if (internalPrefix.empty()) {
+    return {};
+  }
+  return findPhraseResults(internalPrefix);
+}
+
+std::string AssociatedPhrasesV2::InternalPrefix(
+    const std::string& prefixValue,
+    const std::vector<std::string>& prefixReadings) {
   if (prefixValue.empty()) {
     return {};
   }
 
   if (prefixReadings.empty()) {
-    std::string internalPrefix = prefixValue + kSeparatorChar;
-    return findPhrases(internalPrefix);
+    return prefixValue + kSeparatorChar;
   }
 
-  std::vector<std::string> values = Split(prefixValue);
+  std::vector<std::string_view> values = SplitViews(prefixValue);
   if (values.size() != prefixReadings.size()) {
     return {};
   }
 
-  std::stringstream sst;
+  std::string prefix;
   for (size_t i = 0, s = values.size(); i < s; ++i) {
-    sst << values[i];
-    sst << kSeparatorChar;
-    sst << prefixReadings[i];
-    sst << kSeparatorChar;
+    prefix += values[i];
+    prefix += kSeparatorChar;
+    prefix += prefixReadings[i];
+    prefix += kSeparatorChar;
   }
-  return findPhrases(sst.str());
+  return prefix;
 }
 
-std::vector<AssociatedPhrasesV2::Phrase> AssociatedPhrasesV2::findPhrases(
+AssociatedPhrasesV2::PhraseResults AssociatedPhrasesV2::findPhraseResults(
     const std::string& internalPrefix) const {
+  PhraseResults results;
   if (db_ == nullptr) {
-    return {};
+    return results;
   }
 
-  std::vector<std::string_view> matchingRows = db_->findRows(internalPrefix);
-  if (matchingRows.empty()) {
-    return {};
+  // A prefix of at least one value and reading, such as "輸-ㄕㄨ-", finds its
+  // rows in one group. A prefix of only a value, such as "輸-", may span
+  // several groups, whose rows are then ranked like those of a sorted
+  // database.
+  size_t groupKeyEnd = internalPrefix.find(kSeparatorChar);
+  if (groupKeyEnd != std::string::npos) {
+    groupKeyEnd = internalPrefix.find(kSeparatorChar, groupKeyEnd + 1);
   }
-
-  using RowScorePair = std::pair<std::string_view, double>;
-
-  std::vector<RowScorePair> scoredRows;
-  for (const auto& strviews : matchingRows) {
-    scoredRows.emplace_back(strviews, GetScoreInRow(strviews));
+  if (layout_ == Layout::kScoreGrouped && groupKeyEnd != std::string::npos) {
+    results.groupKey_ = internalPrefix.substr(0, groupKeyEnd + 1);
+    results.db_ = db_.get();
+    results.nextRow_ = db_->findFirstMatchingLine(results.groupKey_);
+    results.prefix_ = internalPrefix;
+    return results;
   }
 
-  std::stable_sort(
-      scoredRows.begin(), scoredRows.end(),
-      [](const auto& r1, const auto& r2) { return r1.second > r2.second; });
-
-  // Dedup the phrases with the same value. Since the vector is now ranked,
-  // higher-ranking values will be retained.
-  std::unordered_set<std::string> dedupSet;
-  std::vector<AssociatedPhrasesV2::Phrase> phrases;
-  for (const auto& rspair : scoredRows) {
-    Phrase p = PhraseFromRow(rspair.first);
-    if (dedupSet.find(p.value) != dedupSet.cend()) {
-      continue;
-    }
-    dedupSet.insert(p.value);
-    phrases.emplace_back(std::move(p));
+  std::vector<std::string_view> matchingRows = db_->findRows(internalPrefix);
+  results.rows_.reserve(matchingRows.size());
+  for (size_t i = 0, s = matchingRows.size(); i < s; ++i) {
+    results.rows_.push_back(PhraseResults::ScoredRow{
+        matchingRows[i], GetScoreInRow(matchingRows[i]), i});
   }
-  return phrases;
+  return results;
 }
 
 std::string AssociatedPhrasesV2::Phrase::combinedReading() const {
@@ -241,14 +384,14 @@ std::vector<std::string> AssociatedPhrasesV2::SplitReadings(
 
 std::string AssociatedPhrasesV2::CombineReadings(
     const std::vector<std::string>& readings) {
-  std::stringstream sst;
+  std::string combined;
   for (size_t i = 0, s = readings.size(); i < s; ++i) {
-    sst << readings[i];
+    combined += readings[i];
     if (i + 1 < s) {
-      sst << kSeparatorChar;
+      combined += kSeparatorChar;
     }
   }
-  return sst.str();
+  return combined;
 }
 
 }  // namespace McBopomofo
@@ -24,26 +24,53 @@
 #ifndef SRC_ENGINE_ASSOCIATEDPHRASESV2_H_
 #define SRC_ENGINE_ASSOCIATEDPHRASESV2_H_
 
+#include <cstddef>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "MemoryMappedFile.h"
+#include "MemoryUsage.h"
 #include "ParselessPhraseDB.h"
 
 namespace McBopomofo {
 
+// Marks an associated phrases database whose rows are grouped by the first
+// value and reading of their keys, such as "輸-ㄕㄨ-", with the groups sorted
+// by the byte value of that group key and the rows within a group ordered by
+// descending score. See AssociatedPhrasesV2::Layout.
+constexpr std::string_view SCORE_GROUPED_PRAGMA_HEADER =
+    "# format org.openvanilla.mcbopomofo.sorted.score-grouped\n";
+
 class AssociatedPhrasesV2 {
  public:
   ~AssociatedPhrasesV2();
 
+  // Opens a database with either SORTED_PRAGMA_HEADER or
+  // SCORE_GROUPED_PRAGMA_HEADER.
   bool open(const char* path);
   void close();
   bool isLoaded() const;
 
+  // The mapped file. A db passed to open() is not counted.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
+  enum class Layout {
+    // The rows are sorted by the byte value of their keys, so all the rows
+    // matching a prefix have to be read and ranked by their scores.
+    kSorted,
+    // The rows are grouped as described by SCORE_GROUPED_PRAGMA_HEADER. A
+    // prefix with at least one value and reading finds its rows in one group,
+    // already ranked, so the top phrases are read without reading the rest.
+    kScoreGrouped,
+  };
+
   // Allows the use of existing in-memory db.
-  bool open(std::unique_ptr<ParselessPhraseDB> db);
+  bool open(std::unique_ptr<ParselessPhraseDB> db,
+            Layout layout = Layout::kSorted);
 
   // An associated phrase entry that includes its prefix. For example if an
   // entry is found with the prefix "輸-ㄕㄨ", the entry's value may be
@@ -59,6 +86,79 @@ class AssociatedPhrasesV2 {
     const std::vector<std::string> readings;
   };
 
+  // A row of an associated phrase, decoded on access. It refers to the
+  // database's rows, and so is only valid while the database stays open.
+  class PhraseRow {
+   public:
+    PhraseRow(std::string_view row, double score) : row_(row), score_(score) {}
+
+    [[nodiscard]] std::string value() const;
+    [[nodiscard]] std::vector<std::string> readings() const;
+    [[nodiscard]] double score() const { return score_; }
+    [[nodiscard]] Phrase phrase() const { return {value(), readings()}; }
+
+   private:
+    std::string_view row_;
+    double score_;
+  };
+
+  // The associated phrases found for a prefix, in the same order and with
+  // the same duplicate values removed as findPhrases() returns them. Only
+  // the scores are read upfront; rows are ranked and decoded as pages are
+  // requested, so the first page of K phrases costs O(N log K) comparisons
+  // and K decoded rows rather than a full sort and N decoded rows. With a
+  // score-grouped database, the rows are also read as pages are requested,
+  // and the first page costs about K rows. Like PhraseRow, it is only valid
+  // while the database stays open.
+  class PhraseResults {
+   public:
+    // The number of rows that matched, including those with duplicate
+    // values. This reads all the matching rows.
+    [[nodiscard]] size_t matchingRowCount();
+
+    // Returns the phrases ranked [start, start + count), or fewer if there
+    // are not as many.
+    std::vector<PhraseRow> page(size_t start, size_t count);
+
+    // Whether there are phrases ranked at or after the index.
+    bool hasPhraseAt(size_t index);
+
+   private:
+    friend class AssociatedPhrasesV2;
+
+    struct ScoredRow {
+      std::string_view row;
+      double score;
+      // The position in the database, which breaks ties in score.
+      size_t index;
+    };
+
+    // Ranks and deduplicates rows until there are more than the given number
+    // of phrases or no more rows.
+    void rankPast(size_t phraseCount);
+
+    // Reads the next matching row of the group into rows_. Returns false if
+    // there are no more rows to read.
+    bool readRow();
+
+    // For a score-grouped database, the group being read, the next row to
+    // read, or nullptr once the group is read, and the prefix the rows must
+    // match.
+    const ParselessPhraseDB* db_ = nullptr;
+    const char* nextRow_ = nullptr;
+    std::string groupKey_;
+    std::string prefix_;
+
+    std::vector<ScoredRow> rows_;
+    // rows_[0, ranked_) are in their final order.
+    size_t ranked_ = 0;
+    // rows_[0, scanned_) have been checked for duplicate values.
+    size_t scanned_ = 0;
+    // Indices into rows_ of the phrases found so far.
+    std::vector<size_t> phrases_;
+    std::unordered_set<std::string> values_;
+  };
+
   // Returns associated phrases using the prefix value and readings. It assumes
   // that the prefix value consists of the same number of Unicode code points
   // as the number of the readings. For example, a prefixValue of 輸入 should
@@ -73,6 +173,11 @@ class AssociatedPhrasesV2 {
       const std::string& prefixValue,
       const std::vector<std::string>& prefixReadings) const;
 
+  // Same as findPhrases(), but returns lazily ranked and decoded results.
+  PhraseResults findPhraseResults(
+      const std::string& prefixValue,
+      const std::vector<std::string>& prefixReadings) const;
+
   // Convenience for splitting reading, e.g. "ㄕㄨ-ㄖㄨˋ" to ["ㄕㄨ", "ㄖㄨˋ"].
   static std::vector<std::string> SplitReadings(
       const std::string& combinedReading);
@@ -81,10 +186,14 @@ class AssociatedPhrasesV2 {
   static std::string CombineReadings(const std::vector<std::string>& readings);
 
  protected:
-  std::vector<Phrase> findPhrases(const std::string& internalPrefix) const;
+  PhraseResults findPhraseResults(const std::string& internalPrefix) const;
+  static std::string InternalPrefix(
+      const std::string& prefixValue,
+      const std::vector<std::string>& prefixReadings);
 
   MemoryMappedFile mmapedFile_;
   std::unique_ptr<ParselessPhraseDB> db_;
+  Layout layout_ = Layout::kSorted;
 };
 
 }  // namespace McBopomofo
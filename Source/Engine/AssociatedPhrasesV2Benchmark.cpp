@@ -0,0 +1,190 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "AssociatedPhrasesV2.h"
+
+namespace {
+
+using AssociatedPhrasesV2 = McBopomofo::AssociatedPhrasesV2;
+
+constexpr size_t kRowCount = 500;
+constexpr size_t kPageSize = 9;
+
+// Set this to the path of a built associated-phrases-v2.txt, in either layout,
+// to also benchmark the real data.
+constexpr char kDataPathVariable[] = "ASSOCIATED_PHRASES_V2_PATH";
+
+// Common prefixes in the real data.
+const std::vector<std::pair<std::string, std::vector<std::string>>>&
+RealPrefixes() {
+  static const std::vector<std::pair<std::string, std::vector<std::string>>>
+      prefixes = {
+          {"一", {"ㄧ"}},  {"不", {"ㄅㄨˋ"}}, {"的", {"ㄉㄜ˙"}},
+          {"是", {"ㄕˋ"}}, {"我", {"ㄨㄛˇ"}}, {"大", {"ㄉㄚˋ"}},
+      };
+  return prefixes;
+}
+
+// Rows that all begin with 一-ㄧ, with random scores, in either layout.
+std::string MakeRows(AssociatedPhrasesV2::Layout layout) {
+  std::mt19937 random(std::mt19937::default_seed);
+  std::uniform_real_distribution<double> score(-8.0, -2.0);
+
+  std::vector<std::pair<double, std::string>> rows;
+  for (size_t i = 0; i < kRowCount; ++i) {
+    std::ostringstream stream;
+    double s = score(random);
+    stream << "一-ㄧ-" << std::setfill('0') << std::setw(4) << i
+           << "-ㄒㄧㄝ " << std::fixed << std::setprecision(4) << s;
+    rows.emplace_back(s, stream.str());
+  }
+
+  std::ostringstream stream;
+  if (layout == AssociatedPhrasesV2::Layout::kScoreGrouped) {
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+      return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    stream << McBopomofo::SCORE_GROUPED_PRAGMA_HEADER;
+  } else {
+    stream << McBopomofo::SORTED_PRAGMA_HEADER;
+  }
+  for (const auto& row : rows) {
+    stream << row.second << '\n';
+  }
+  return stream.str();
+}
+
+class BenchmarkDataset {
+ public:
+  BenchmarkDataset()
+      : sortedRows_(MakeRows(AssociatedPhrasesV2::Layout::kSorted)),
+        groupedRows_(MakeRows(AssociatedPhrasesV2::Layout::kScoreGrouped)) {
+    sorted_.open(std::make_unique<McBopomofo::ParselessPhraseDB>(
+        sortedRows_.data(), sortedRows_.size(), /*validate_pragma=*/true));
+
+    std::string_view rows(groupedRows_);
+    rows.remove_prefix(McBopomofo::SCORE_GROUPED_PRAGMA_HEADER.length());
+    grouped_.open(
+        std::make_unique<McBopomofo::ParselessPhraseDB>(rows.data(),
+                                                        rows.size()),
+        AssociatedPhrasesV2::Layout::kScoreGrouped);
+
+    const char* path = getenv(kDataPathVariable);
+    if (path != nullptr) {
+      real_.open(path);
+    }
+  }
+
+  const AssociatedPhrasesV2& sorted() const { return sorted_; }
+  const AssociatedPhrasesV2& grouped() const { return grouped_; }
+  const AssociatedPhrasesV2& real() const { return real_; }
+
+ private:
+  std::string sortedRows_;
+  std::string groupedRows_;
+  AssociatedPhrasesV2 sorted_;
+  AssociatedPhrasesV2 grouped_;
+  AssociatedPhrasesV2 real_;
+};
+
+const BenchmarkDataset& Dataset() {
+  static const BenchmarkDataset dataset;
+  return dataset;
+}
+
+static void BM_FindAllPhrases(benchmark::State& state) {
+  const AssociatedPhrasesV2& phrases = Dataset().sorted();
+  for (auto _ : state) {
+    auto results = phrases.findPhrases("一", {"ㄧ"});
+    benchmark::DoNotOptimize(results);
+  }
+}
+BENCHMARK(BM_FindAllPhrases);
+
+static void BM_FindFirstPageOfPhrases(benchmark::State& state) {
+  const AssociatedPhrasesV2& phrases = Dataset().sorted();
+  for (auto _ : state) {
+    auto results = phrases.findPhraseResults("一", {"ㄧ"});
+    auto page = results.page(0, kPageSize);
+    benchmark::DoNotOptimize(page);
+  }
+}
+BENCHMARK(BM_FindFirstPageOfPhrases);
+
+static void BM_FindFirstPageOfScoreGroupedPhrases(benchmark::State& state) {
+  const AssociatedPhrasesV2& phrases = Dataset().grouped();
+  for (auto _ : state) {
+    auto results = phrases.findPhraseResults("一", {"ㄧ"});
+    auto page = results.page(0, kPageSize);
+    benchmark::DoNotOptimize(page);
+  }
+}
+BENCHMARK(BM_FindFirstPageOfScoreGroupedPhrases);
+
+static void BM_FindAllPhrasesInRealData(benchmark::State& state) {
+  const AssociatedPhrasesV2& phrases = Dataset().real();
+  if (!phrases.isLoaded()) {
+    state.SkipWithError("ASSOCIATED_PHRASES_V2_PATH not set");
+    return;
+  }
+  for (auto _ : state) {
+    for (const auto& [value, readings] : RealPrefixes()) {
+      auto results = phrases.findPhrases(value, readings);
+      benchmark::DoNotOptimize(results);
+    }
+  }
+}
+BENCHMARK(BM_FindAllPhrasesInRealData);
+
+static void BM_FindFirstPageOfPhrasesInRealData(benchmark::State& state) {
+  const AssociatedPhrasesV2& phrases = Dataset().real();
+  if (!phrases.isLoaded()) {
+    state.SkipWithError("ASSOCIATED_PHRASES_V2_PATH not set");
+    return;
+  }
+  for (auto _ : state) {
+    for (const auto& [value, readings] : RealPrefixes()) {
+      auto results = phrases.findPhraseResults(value, readings);
+      auto page = results.page(0, kPageSize);
+      benchmark::DoNotOptimize(page);
+    }
+  }
+}
+BENCHMARK(BM_FindFirstPageOfPhrasesInRealData);
+
+};  // namespace
+
+BENCHMARK_MAIN();
@@ -21,6 +21,8 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <filesystem>
+#include <fstream>
 #include <memory>
 #include <string>
 #include <utility>
@@ -51,6 +53,26 @@ constexpr char kSample[] = R"(
 文-ㄨㄣˊ-書-ㄕㄨ-處-ㄔㄨˋ-理-ㄌㄧˇ -5.7488
 )";
 
+// kSample in the score-grouped layout, without the pragma.
+constexpr char kScoreGroupedSample[] = R"(
+一-ㄧ-個-ㄍㄜ˙ -2.9779
+一-ㄧ-些-ㄒㄧㄝ -3.3862
+一-ㄧ-下-ㄒㄧㄚˋ -3.6225
+一-ㄧ-九-ㄐㄧㄡˇ-九-ㄐㄧㄡˇ -4.1645
+一-ㄧ-位-ㄨㄟˋ -4.1953
+一-ㄧ-個-ㄍㄜ˙-人-ㄖㄣˊ -4.2035
+一-ㄧ-一-ㄧ -4.3849
+一-ㄧ-九-ㄐㄧㄡˇ-八-ㄅㄚ -4.4382
+一-ㄧ-件-ㄐㄧㄢˋ -4.4434
+一-ㄧ-個-ㄍㄜ˙-月-ㄩㄝˋ -4.4501
+一-ㄧ-份-ㄈㄣˋ -4.5500
+不-ㄅㄨˋ-可-ㄎㄜˇ -3.6897
+不-ㄅㄨˋ-只-ㄓˇ -4.2502
+不-ㄅㄨˋ-只-ㄓˇ-是-ㄕˋ -4.5019
+文-ㄨㄣˊ-書-ㄕㄨ-處-ㄔㄨˇ-理-ㄌㄧˇ -5.7488
+文-ㄨㄣˊ-書-ㄕㄨ-處-ㄔㄨˋ-理-ㄌㄧˇ -5.7488
+)";
+
 TEST(AssociatedPhrasesV2Test, IdempotentClose) {
   auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
 
@@ -232,4 +254,135 @@ TEST(AssociatedPhrasesV2Test, ReturnsDeduplicatedResults) {
             (std::vector<std::string>{"ㄨㄣˊ", "ㄕㄨ", "ㄔㄨˇ", "ㄌㄧˇ"}));
 }
 
+TEST(AssociatedPhrasesV2Test, PagedResultsMatchFindPhrases) {
+  AssociatedPhrasesV2 phrases;
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_TRUE(phrases.open(std::move(db)));
+
+  std::vector<AssociatedPhrasesV2::Phrase> expected =
+      phrases.findPhrases("一", {});
+  ASSERT_EQ(expected.size(), 11);
+
+  AssociatedPhrasesV2::PhraseResults results =
+      phrases.findPhraseResults("一", {});
+  EXPECT_EQ(results.matchingRowCount(), 11);
+  std::vector<AssociatedPhrasesV2::Phrase> paged;
+  for (size_t start = 0; results.hasPhraseAt(start); start += 3) {
+    for (const auto& row : results.page(start, 3)) {
+      paged.emplace_back(row.phrase());
+    }
+  }
+  ASSERT_EQ(paged.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(paged[i].value, expected[i].value);
+    EXPECT_EQ(paged[i].readings, expected[i].readings);
+  }
+
+  std::vector<AssociatedPhrasesV2::PhraseRow> first =
+      phrases.findPhraseResults("一", {}).page(0, 1);
+  ASSERT_EQ(first.size(), 1);
+  EXPECT_EQ(first[0].value(), "一個");
+  EXPECT_DOUBLE_EQ(first[0].score(), -2.9779);
+  EXPECT_TRUE(results.page(11, 3).empty());
+  EXPECT_TRUE(results.page(0, 0).empty());
+}
+
+TEST(AssociatedPhrasesV2Test, PagedResultsAreDeduplicated) {
+  AssociatedPhrasesV2 phrases;
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_TRUE(phrases.open(std::move(db)));
+
+  AssociatedPhrasesV2::PhraseResults results =
+      phrases.findPhraseResults("文", {});
+  EXPECT_EQ(results.matchingRowCount(), 2);
+  EXPECT_TRUE(results.hasPhraseAt(0));
+  EXPECT_FALSE(results.hasPhraseAt(1));
+  std::vector<AssociatedPhrasesV2::PhraseRow> page = results.page(0, 9);
+  ASSERT_EQ(page.size(), 1);
+  EXPECT_EQ(page[0].readings(),
+            (std::vector<std::string>{"ㄨㄣˊ", "ㄕㄨ", "ㄔㄨˇ", "ㄌㄧˇ"}));
+}
+
+TEST(AssociatedPhrasesV2Test, PagedResultsAreEmptyForInvalidPrefixes) {
+  AssociatedPhrasesV2 phrases;
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_TRUE(phrases.open(std::move(db)));
+
+  EXPECT_EQ(phrases.findPhraseResults("", {}).matchingRowCount(), 0);
+  EXPECT_EQ(phrases.findPhraseResults("一個", {"ㄧ"}).matchingRowCount(), 0);
+  EXPECT_FALSE(phrases.findPhraseResults("二", {}).hasPhraseAt(0));
+}
+
+TEST(AssociatedPhrasesV2Test, ScoreGroupedLayoutGivesTheSameResults) {
+  AssociatedPhrasesV2 sorted;
+  EXPECT_TRUE(sorted.open(
+      std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample))));
+  AssociatedPhrasesV2 grouped;
+  EXPECT_TRUE(grouped.open(std::make_unique<ParselessPhraseDB>(
+                               kScoreGroupedSample, sizeof(kScoreGroupedSample)),
+                           AssociatedPhrasesV2::Layout::kScoreGrouped));
+
+  std::vector<std::pair<std::string, std::vector<std::string>>> prefixes = {
+      {"一", {}},
+      {"一", {"ㄧ"}},
+      {"一個", {"ㄧ", "ㄍㄜ˙"}},
+      {"一九", {"ㄧ", "ㄐㄧㄡˇ"}},
+      {"不", {"ㄅㄨˋ"}},
+      {"不只", {"ㄅㄨˋ", "ㄓˇ"}},
+      {"文", {"ㄨㄣˊ"}},
+      {"文", {"ㄨㄣˋ"}},
+      {"二", {"ㄦˋ"}},
+  };
+  for (const auto& [value, readings] : prefixes) {
+    std::vector<AssociatedPhrasesV2::Phrase> expected =
+        sorted.findPhrases(value, readings);
+    std::vector<AssociatedPhrasesV2::Phrase> results =
+        grouped.findPhrases(value, readings);
+    ASSERT_EQ(results.size(), expected.size()) << value;
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(results[i].value, expected[i].value);
+      EXPECT_EQ(results[i].readings, expected[i].readings);
+    }
+  }
+}
+
+TEST(AssociatedPhrasesV2Test, ScoreGroupedLayoutReadsRowsAsNeeded) {
+  AssociatedPhrasesV2 phrases;
+  EXPECT_TRUE(phrases.open(std::make_unique<ParselessPhraseDB>(
+                               kScoreGroupedSample, sizeof(kScoreGroupedSample)),
+                           AssociatedPhrasesV2::Layout::kScoreGrouped));
+
+  AssociatedPhrasesV2::PhraseResults results =
+      phrases.findPhraseResults("一個", {"ㄧ", "ㄍㄜ˙"});
+  std::vector<AssociatedPhrasesV2::PhraseRow> page = results.page(0, 1);
+  ASSERT_EQ(page.size(), 1);
+  EXPECT_EQ(page[0].value(), "一個人");
+  EXPECT_TRUE(results.hasPhraseAt(1));
+  EXPECT_FALSE(results.hasPhraseAt(2));
+  EXPECT_EQ(results.matchingRowCount(), 2);
+
+  results = phrases.findPhraseResults("文", {"ㄨㄣˊ"});
+  EXPECT_EQ(results.matchingRowCount(), 2);
+  EXPECT_EQ(results.page(0, 9).size(), 1);
+}
+
+TEST(AssociatedPhrasesV2Test, OpensScoreGroupedFiles) {
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() /
+      "org.openvanilla.mcbopomofo.associatedphrasesv2test-score-grouped";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << SCORE_GROUPED_PRAGMA_HEADER << (kScoreGroupedSample + 1);
+  }
+
+  AssociatedPhrasesV2 phrases;
+  EXPECT_TRUE(phrases.open(path.c_str()));
+  std::vector<AssociatedPhrasesV2::Phrase> results =
+      phrases.findPhrases("不", {"ㄅㄨˋ"});
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_EQ(results[0].value, "不可");
+  phrases.close();
+  std::filesystem::remove(path);
+}
+
 }  // namespace McBopomofo
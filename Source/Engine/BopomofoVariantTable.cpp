@@ -0,0 +1,365 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "BopomofoVariantTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace McBopomofo {
+
+namespace {
+
+constexpr uint64_t kFibonacciMultiplier = 0x9E3779B97F4A7C15ULL;
+constexpr std::string_view kUnannotatedReadingString = "na";
+constexpr uint32_t kMinSlotCount = 16;
+
+// The components of a syllable, in the order they are written.
+enum class ComponentClass { kConsonant, kMiddleVowel, kVowel, kToneMarker };
+
+// Decodes the code point at the start of s and returns it along with its
+// length in bytes, or returns std::nullopt if s does not start with a valid
+// UTF-8 sequence.
+std::optional<std::pair<uint32_t, size_t>> DecodeCodePoint(std::string_view s) {
+  if (s.empty()) {
+    return std::nullopt;
+  }
+  auto byte = [&s](size_t i) { return static_cast<uint8_t>(s[i]); };
+  uint8_t lead = byte(0);
+  size_t length;
+  uint32_t codePoint;
+  if (lead < 0x80) {
+    return std::make_pair(static_cast<uint32_t>(lead), size_t{1});
+  } else if ((lead & 0xe0) == 0xc0) {
+    length = 2;
+    codePoint = lead & 0x1f;
+  } else if ((lead & 0xf0) == 0xe0) {
+    length = 3;
+    codePoint = lead & 0x0f;
+  } else if ((lead & 0xf8) == 0xf0) {
+    length = 4;
+    codePoint = lead & 0x07;
+  } else {
+    return std::nullopt;
+  }
+  if (s.size() < length) {
+    return std::nullopt;
+  }
+  for (size_t i = 1; i < length; ++i) {
+    if ((byte(i) & 0xc0) != 0x80) {
+      return std::nullopt;
+    }
+    codePoint = (codePoint << 6) | (byte(i) & 0x3f);
+  }
+  return std::make_pair(codePoint, length);
+}
+
+// Returns the code point if s consists of exactly one code point.
+std::optional<uint32_t> DecodeSingleCodePoint(std::string_view s) {
+  auto decoded = DecodeCodePoint(s);
+  if (!decoded.has_value() || decoded->second != s.size()) {
+    return std::nullopt;
+  }
+  return decoded->first;
+}
+
+void AppendCodePoint(uint32_t codePoint, std::string* out) {
+  if (codePoint < 0x80) {
+    out->push_back(static_cast<char>(codePoint));
+  } else if (codePoint < 0x800) {
+    out->push_back(static_cast<char>(0xc0 | (codePoint >> 6)));
+    out->push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+  } else if (codePoint < 0x10000) {
+    out->push_back(static_cast<char>(0xe0 | (codePoint >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+  } else {
+    out->push_back(static_cast<char>(0xf0 | (codePoint >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+  }
+}
+
+// Returns the component of a Bopomofo code point and its class. The values
+// are those of Formosa::Mandarin::BopomofoSyllable.
+std::optional<std::pair<uint16_t, ComponentClass>> BopomofoComponent(
+    uint32_t codePoint) {
+  // ㄅ to ㄙ.
+  if (codePoint >= 0x3105 && codePoint <= 0x3119) {
+    return std::make_pair(static_cast<uint16_t>(codePoint - 0x3104),
+                          ComponentClass::kConsonant);
+  }
+  // ㄚ to ㄦ.
+  if (codePoint >= 0x311a && codePoint <= 0x3126) {
+    return std::make_pair(static_cast<uint16_t>((codePoint - 0x3119) << 7),
+                          ComponentClass::kVowel);
+  }
+  // ㄧ, ㄨ, and ㄩ.
+  if (codePoint >= 0x3127 && codePoint <= 0x3129) {
+    return std::make_pair(static_cast<uint16_t>((codePoint - 0x3126) << 5),
+                          ComponentClass::kMiddleVowel);
+  }
+  switch (codePoint) {
+    case 0x02ca:  // ˊ
+      return std::make_pair(uint16_t{0x0800}, ComponentClass::kToneMarker);
+    case 0x02c7:  // ˇ
+      return std::make_pair(uint16_t{0x1000}, ComponentClass::kToneMarker);
+    case 0x02cb:  // ˋ
+      return std::make_pair(uint16_t{0x1800}, ComponentClass::kToneMarker);
+    case 0x02d9:  // ˙
+      return std::make_pair(uint16_t{0x2000}, ComponentClass::kToneMarker);
+    default:
+      return std::nullopt;
+  }
+}
+
+uint64_t MakeKey(uint32_t scalar, uint16_t reading) {
+  return (static_cast<uint64_t>(scalar) << 16) | reading;
+}
+
+template <typename T>
+void AppendInteger(T value, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T ReadInteger(const char* data) {
+  T value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+std::optional<uint16_t> BopomofoVariantTable::PackReading(
+    std::string_view reading) {
+  if (reading == kUnannotatedReadingString) {
+    return kUnannotatedReading;
+  }
+  if (reading.empty()) {
+    return std::nullopt;
+  }
+
+  uint16_t syllable = 0;
+  int lastClass = -1;
+  while (!reading.empty()) {
+    auto decoded = DecodeCodePoint(reading);
+    if (!decoded.has_value()) {
+      return std::nullopt;
+    }
+    auto component = BopomofoComponent(decoded->first);
+    // Each class of components appears at most once, in order.
+    if (!component.has_value() ||
+        static_cast<int>(component->second) <= lastClass) {
+      return std::nullopt;
+    }
+    syllable |= component->first;
+    lastClass = static_cast<int>(component->second);
+    reading.remove_prefix(decoded->second);
+  }
+  return syllable;
+}
+
+bool BopomofoVariantTable::open(const char* data, size_t length) {
+  close();
+  if (data == nullptr || length < kHeaderSize ||
+      memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    return false;
+  }
+
+  const char* header = data + sizeof(kMagic);
+  uint32_t version = ReadInteger<uint32_t>(header);
+  uint32_t byteOrderMark = ReadInteger<uint32_t>(header + 4);
+  uint32_t slotCount = ReadInteger<uint32_t>(header + 8);
+  uint32_t entryCount = ReadInteger<uint32_t>(header + 12);
+  if (version != kVersion || byteOrderMark != kByteOrderMark ||
+      slotCount < 2 || !std::has_single_bit(slotCount) ||
+      entryCount >= slotCount ||
+      length != kHeaderSize + static_cast<size_t>(slotCount) * kSlotSize) {
+    return false;
+  }
+
+  slots_ = data + kHeaderSize;
+  slotCount_ = slotCount;
+  shift_ = 64 - std::countr_zero(slotCount);
+  return true;
+}
+
+void BopomofoVariantTable::close() {
+  slots_ = nullptr;
+  slotCount_ = 0;
+  shift_ = 0;
+}
+
+std::optional<uint32_t> BopomofoVariantTable::find(uint32_t scalar,
+                                                   uint16_t reading) const {
+  if (slots_ == nullptr) {
+    return std::nullopt;
+  }
+
+  uint32_t slot = static_cast<uint32_t>(
+      (MakeKey(scalar, reading) * kFibonacciMultiplier) >> shift_);
+  for (uint32_t probes = 0; probes < slotCount_; ++probes) {
+    const char* p = slots_ + static_cast<size_t>(slot) * kSlotSize;
+    if (ReadInteger<uint16_t>(p + 6) == 0) {
+      return std::nullopt;
+    }
+    if (ReadInteger<uint32_t>(p) == scalar &&
+        ReadInteger<uint16_t>(p + 4) == reading) {
+      return ReadInteger<uint32_t>(p + 8);
+    }
+    slot = (slot + 1) & (slotCount_ - 1);
+  }
+  return std::nullopt;
+}
+
+bool BopomofoVariantTable::appendVariant(std::string_view character,
+                                         uint16_t reading,
+                                         std::string* out) const {
+  std::optional<uint32_t> scalar = DecodeSingleCodePoint(character);
+  if (!scalar.has_value() || *scalar == 0) {
+    return false;
+  }
+  std::optional<uint32_t> selector = find(*scalar, reading);
+  if (!selector.has_value()) {
+    return false;
+  }
+  out->append(character);
+  if (*selector != 0) {
+    AppendCodePoint(*selector, out);
+  }
+  return true;
+}
+
+bool BopomofoVariantTable::appendPUABlock(uint16_t reading,
+                                          std::string* out) const {
+  std::optional<uint32_t> codePoint = find(0, reading);
+  if (!codePoint.has_value()) {
+    return false;
+  }
+  AppendCodePoint(*codePoint, out);
+  return true;
+}
+
+bool BopomofoVariantTable::Compile(const ParselessPhraseDB& variants,
+                                   const ParselessPhraseDB& pua,
+                                   std::string* out) {
+  std::vector<std::pair<uint64_t, uint32_t>> entries;
+
+  // Rows are "character-reading variant".
+  for (std::string_view row : variants.findRows("")) {
+    if (row.empty()) {
+      continue;
+    }
+    size_t space = row.find(' ');
+    size_t separator = row.rfind('-', space);
+    if (space == std::string_view::npos || separator == std::string_view::npos) {
+      return false;
+    }
+    std::string_view character = row.substr(0, separator);
+    std::optional<uint32_t> scalar = DecodeSingleCodePoint(character);
+    std::optional<uint16_t> reading =
+        PackReading(row.substr(separator + 1, space - separator - 1));
+    std::string_view variant = row.substr(space + 1);
+    if (!scalar.has_value() || *scalar == 0 || !reading.has_value() ||
+        !variant.starts_with(character)) {
+      return false;
+    }
+    variant.remove_prefix(character.size());
+    uint32_t selector = 0;
+    if (!variant.empty()) {
+      std::optional<uint32_t> decoded = DecodeSingleCodePoint(variant);
+      if (!decoded.has_value() || *decoded == 0) {
+        return false;
+      }
+      selector = *decoded;
+    }
+    entries.emplace_back(MakeKey(*scalar, *reading), selector);
+  }
+
+  // Rows are "reading block".
+  for (std::string_view row : pua.findRows("")) {
+    if (row.empty()) {
+      continue;
+    }
+    size_t space = row.find(' ');
+    if (space == std::string_view::npos) {
+      return false;
+    }
+    std::optional<uint16_t> reading = PackReading(row.substr(0, space));
+    std::optional<uint32_t> block = DecodeSingleCodePoint(row.substr(space + 1));
+    if (!reading.has_value() || *reading == kUnannotatedReading ||
+        !block.has_value()) {
+      return false;
+    }
+    entries.emplace_back(MakeKey(0, *reading), *block);
+  }
+
+  // Like a look-up of the text databases, the first row of a key wins. The
+  // entries are inserted in the order of their keys, so that the layout only
+  // depends on the rows.
+  std::stable_sort(
+      entries.begin(), entries.end(),
+      [](const auto& a, const auto& b) { return a.first < b.first; });
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](const auto& a, const auto& b) {
+                              return a.first == b.first;
+                            }),
+                entries.end());
+
+  uint32_t slotCount = std::max(
+      kMinSlotCount, std::bit_ceil(static_cast<uint32_t>(entries.size() * 2)));
+  int shift = 64 - std::countr_zero(slotCount);
+  std::vector<char> slots(static_cast<size_t>(slotCount) * kSlotSize, 0);
+  for (const auto& [key, codePoint] : entries) {
+    uint32_t slot =
+        static_cast<uint32_t>((key * kFibonacciMultiplier) >> shift);
+    while (ReadInteger<uint16_t>(&slots[slot * kSlotSize + 6]) != 0) {
+      slot = (slot + 1) & (slotCount - 1);
+    }
+    char* p = &slots[slot * kSlotSize];
+    auto scalar = static_cast<uint32_t>(key >> 16);
+    auto reading = static_cast<uint16_t>(key & 0xffff);
+    uint16_t occupied = 1;
+    memcpy(p, &scalar, sizeof(scalar));
+    memcpy(p + 4, &reading, sizeof(reading));
+    memcpy(p + 6, &occupied, sizeof(occupied));
+    memcpy(p + 8, &codePoint, sizeof(codePoint));
+  }
+
+  out->clear();
+  out->reserve(kHeaderSize + slots.size());
+  out->append(kMagic, sizeof(kMagic));
+  AppendInteger(kVersion, out);
+  AppendInteger(kByteOrderMark, out);
+  AppendInteger(slotCount, out);
+  AppendInteger(static_cast<uint32_t>(entries.size()), out);
+  out->append(slots.data(), slots.size());
+  return true;
+}
+
+}  // namespace McBopomofo
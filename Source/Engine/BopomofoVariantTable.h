@@ -0,0 +1,113 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_BOPOMOFOVARIANTTABLE_H_
+#define SRC_ENGINE_BOPOMOFOVARIANTTABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "ParselessPhraseDB.h"
+
+namespace McBopomofo {
+
+// A compiled form of the bpmfvs variants and PUA databases used by
+// VariantAnnotator. It is an open-addressing hash table keyed by a character's
+// Unicode scalar value and a packed Bopomofo reading, and it maps a key to the
+// variant selector of the character for the reading, or, for a reading alone,
+// to the code point of the reading's combined Bopomofo block in the PUA. The
+// table is used in place, typically from a memory-mapped file, so a look-up
+// neither allocates nor searches text.
+//
+// The file is laid out as follows, in native byte order:
+//
+//   magic "McBPVSTB", u32 version, u32 byte order mark, u32 slot count (a
+//   power of two), u32 entry count
+//   slots: u32 scalar value, u16 reading, u16 occupied, u32 code point
+//
+// A key is hashed with Fibonacci hashing of (scalar value << 16 | reading),
+// and collisions are resolved by linear probing. The PUA entries use the
+// scalar value 0. Source/Data/curation/compilers/bpmfvs_table_compiler.py
+// produces the same bytes as Compile().
+class BopomofoVariantTable {
+ public:
+  BopomofoVariantTable() = default;
+
+  BopomofoVariantTable(const BopomofoVariantTable&) = delete;
+  BopomofoVariantTable(BopomofoVariantTable&&) = delete;
+  BopomofoVariantTable& operator=(const BopomofoVariantTable&) = delete;
+  BopomofoVariantTable& operator=(BopomofoVariantTable&&) = delete;
+
+  // The reading "na" of the variants database, which stands for the variant
+  // of a character without any Bopomofo annotation.
+  static constexpr uint16_t kUnannotatedReading = 0xffff;
+
+  // Packs a reading such as "ㄍㄜ˙" the way Formosa::Mandarin::BopomofoSyllable
+  // does, or returns std::nullopt if the reading is not a well-formed
+  // syllable. "na" is packed as kUnannotatedReading.
+  static std::optional<uint16_t> PackReading(std::string_view reading);
+
+  // Uses the compiled table in the buffer, which must outlive the use of this
+  // table. Returns false, and leaves the table closed, if the buffer does not
+  // hold a valid table.
+  bool open(const char* data, size_t length);
+  void close();
+  [[nodiscard]] bool isOpen() const { return slots_ != nullptr; }
+
+  // Appends the variant of the character for the packed reading, which is
+  // the character followed by a variant selector if any, and returns whether
+  // there is one. The character must be a single code point to be found.
+  bool appendVariant(std::string_view character, uint16_t reading,
+                     std::string* out) const;
+
+  // Appends the combined Bopomofo block in the PUA of the packed reading, and
+  // returns whether there is one.
+  bool appendPUABlock(uint16_t reading, std::string* out) const;
+
+  // Compiles the text databases. Returns false if a row cannot be
+  // represented in the table.
+  static bool Compile(const ParselessPhraseDB& variants,
+                      const ParselessPhraseDB& pua, std::string* out);
+
+  static constexpr char kMagic[8] = {'M', 'c', 'B', 'P', 'V', 'S', 'T', 'B'};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kByteOrderMark = 0x01020304;
+  static constexpr size_t kHeaderSize = sizeof(kMagic) + 4 * sizeof(uint32_t);
+  static constexpr size_t kSlotSize = 12;
+
+ private:
+  // Returns the code point of the key, or std::nullopt.
+  [[nodiscard]] std::optional<uint32_t> find(uint32_t scalar,
+                                             uint16_t reading) const;
+
+  const char* slots_ = nullptr;
+  uint32_t slotCount_ = 0;
+  int shift_ = 0;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_BOPOMOFOVARIANTTABLE_H_
@@ -0,0 +1,177 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BopomofoVariantTable.h"
+#include "Mandarin/Mandarin.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+
+constexpr char kVariantsData[] =
+    "# format org.openvanilla.mcbopomofo.sorted\n"
+    "一-na 一\U000E01E0\n"
+    "一-ㄧ 一\n"
+    "一-ㄧˊ 一\U000E01E1\n"
+    "個-na 個\U000E01E0\n"
+    "個-ㄍㄜˋ 個\n"
+    "個-ㄍㄜ˙ 個\U000E01E1\n";
+
+constexpr char kPUAData[] =
+    "# format org.openvanilla.mcbopomofo.sorted\n"
+    "ㄍㄚˋ \uF145\n"
+    "ㄧㄚˊ \uF4BB\n";
+
+std::string Compile(const char* variants, const char* pua) {
+  auto variantsDB =
+      ParselessPhraseDB::CreateValidatedDB(variants, strlen(variants));
+  auto puaDB = ParselessPhraseDB::CreateValidatedDB(pua, strlen(pua));
+  std::string table;
+  EXPECT_TRUE(BopomofoVariantTable::Compile(*variantsDB, *puaDB, &table));
+  return table;
+}
+
+uint16_t Pack(const std::string& reading) {
+  return BopomofoVariantTable::PackReading(reading).value_or(0);
+}
+
+}  // namespace
+
+TEST(BopomofoVariantTableTest, PackReadingAgreesWithMandarin) {
+  using Formosa::Mandarin::BPMF;
+  const std::vector<std::string> consonants = {
+      "",   "ㄅ", "ㄆ", "ㄇ", "ㄈ", "ㄉ", "ㄊ", "ㄋ", "ㄌ", "ㄍ", "ㄎ",
+      "ㄏ", "ㄐ", "ㄑ", "ㄒ", "ㄓ", "ㄔ", "ㄕ", "ㄖ", "ㄗ", "ㄘ", "ㄙ"};
+  const std::vector<std::string> middleVowels = {"", "ㄧ", "ㄨ", "ㄩ"};
+  const std::vector<std::string> vowels = {"",   "ㄚ", "ㄛ", "ㄜ", "ㄝ",
+                                           "ㄞ", "ㄟ", "ㄠ", "ㄡ", "ㄢ",
+                                           "ㄣ", "ㄤ", "ㄥ", "ㄦ"};
+  const std::vector<std::string> tones = {"", "ˊ", "ˇ", "ˋ", "˙"};
+
+  size_t count = 0;
+  for (const auto& c : consonants) {
+    for (const auto& m : middleVowels) {
+      for (const auto& v : vowels) {
+        for (const auto& t : tones) {
+          std::string reading = c + m + v + t;
+          if (reading.empty()) {
+            continue;
+          }
+          std::optional<uint16_t> packed =
+              BopomofoVariantTable::PackReading(reading);
+          ASSERT_TRUE(packed.has_value()) << reading;
+          EXPECT_EQ(BPMF(*packed), BPMF::FromComposedString(reading))
+              << reading;
+          ++count;
+        }
+      }
+    }
+  }
+  EXPECT_EQ(count, 22 * 4 * 14 * 5 - 1);
+}
+
+TEST(BopomofoVariantTableTest, PackReadingRejectsMalformedReadings) {
+  EXPECT_EQ(BopomofoVariantTable::PackReading("na"),
+            BopomofoVariantTable::kUnannotatedReading);
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("").has_value());
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("ㄍㄍ").has_value());
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("ㄜㄍ").has_value());
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("˙ㄍㄜ").has_value());
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("ㄍㄜ-").has_value());
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("_punctuation_,").has_value());
+  EXPECT_FALSE(BopomofoVariantTable::PackReading("\xe3\x84").has_value());
+}
+
+TEST(BopomofoVariantTableTest, CompileAndLookUp) {
+  std::string data = Compile(kVariantsData, kPUAData);
+  BopomofoVariantTable table;
+  ASSERT_TRUE(table.open(data.data(), data.size()));
+
+  std::string out;
+  EXPECT_TRUE(table.appendVariant("個", Pack("ㄍㄜ˙"), &out));
+  EXPECT_EQ(out, "個\U000E01E1");
+
+  out.clear();
+  EXPECT_TRUE(table.appendVariant("個", Pack("ㄍㄜˋ"), &out));
+  EXPECT_EQ(out, "個");
+
+  out.clear();
+  EXPECT_TRUE(table.appendVariant(
+      "一", BopomofoVariantTable::kUnannotatedReading, &out));
+  EXPECT_EQ(out, "一\U000E01E0");
+
+  out.clear();
+  EXPECT_FALSE(table.appendVariant("個", Pack("ㄍㄜˇ"), &out));
+  EXPECT_FALSE(table.appendVariant("人", Pack("ㄖㄣˊ"), &out));
+  EXPECT_FALSE(table.appendVariant("一個", Pack("ㄧ"), &out));
+  EXPECT_FALSE(table.appendVariant("", Pack("ㄧ"), &out));
+  EXPECT_TRUE(out.empty());
+
+  EXPECT_TRUE(table.appendPUABlock(Pack("ㄍㄚˋ"), &out));
+  EXPECT_EQ(out, "\uF145");
+  EXPECT_FALSE(table.appendPUABlock(Pack("ㄍㄜ˙"), &out));
+}
+
+TEST(BopomofoVariantTableTest, CompileRejectsMalformedRows) {
+  const char* variants =
+      "# format org.openvanilla.mcbopomofo.sorted\n"
+      "一二-ㄧ 一二\n";
+  auto variantsDB =
+      ParselessPhraseDB::CreateValidatedDB(variants, strlen(variants));
+  auto puaDB = ParselessPhraseDB::CreateValidatedDB(kPUAData, strlen(kPUAData));
+  std::string table;
+  EXPECT_FALSE(BopomofoVariantTable::Compile(*variantsDB, *puaDB, &table));
+
+  const char* pua =
+      "# format org.openvanilla.mcbopomofo.sorted\n"
+      "ㄍㄚˋ \uF145\uF145\n";
+  variantsDB =
+      ParselessPhraseDB::CreateValidatedDB(kVariantsData, strlen(kVariantsData));
+  puaDB = ParselessPhraseDB::CreateValidatedDB(pua, strlen(pua));
+  EXPECT_FALSE(BopomofoVariantTable::Compile(*variantsDB, *puaDB, &table));
+}
+
+TEST(BopomofoVariantTableTest, OpenRejectsDamagedTables) {
+  std::string data = Compile(kVariantsData, kPUAData);
+  BopomofoVariantTable table;
+  EXPECT_FALSE(table.open(data.data(), data.size() - 1));
+  EXPECT_FALSE(table.isOpen());
+  EXPECT_FALSE(table.open(data.data(), BopomofoVariantTable::kHeaderSize));
+
+  std::string damaged = data;
+  damaged[0] = 'X';
+  EXPECT_FALSE(table.open(damaged.data(), damaged.size()));
+
+  EXPECT_TRUE(table.open(data.data(), data.size()));
+  table.close();
+  std::string out;
+  EXPECT_FALSE(table.appendPUABlock(Pack("ㄍㄚˋ"), &out));
+}
+
+}  // namespace McBopomofo
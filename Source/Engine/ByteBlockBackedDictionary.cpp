@@ -41,12 +41,71 @@
 #endif
 #endif
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <thread>
+
 #include "ByteBlockBackedDictionary.h"
 
 namespace McBopomofo {
 
 namespace {
 
+constexpr uint64_t kLowBits = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+// The hash table is probed in groups of this many slots, whose control bytes
+// are loaded as one 64-bit word.
+constexpr size_t kGroupWidth = 8;
+constexpr uint8_t kEmptyControl = 0x80;
+
+// The table is kept at most 7/8 full.
+size_t MaxKeysForCapacity(size_t capacity) { return capacity / 8 * 7; }
+
+uint64_t LoadControlGroup(const uint8_t* controls) {
+  uint64_t word;
+  memcpy(&word, controls, sizeof(word));
+  if constexpr (std::endian::native == std::endian::big) {
+    word = __builtin_bswap64(word);
+  }
+  return word;
+}
+
+// Returns a word with the high bit set in every byte that equals b. A byte
+// right after a match may also be reported, so the caller must check the
+// key; empty bytes are never reported.
+uint64_t MatchControlByte(uint64_t word, uint8_t b) {
+  const uint64_t x = word ^ (kLowBits * b);
+  return (x - kLowBits) & ~x & kHighBits;
+}
+
+size_t SlotInGroup(uint64_t mask) { return std::countr_zero(mask) / 8; }
+
+// Counts the line feeds eight bytes at a time.
+size_t CountLineFeeds(const char* ptr, const char* end) {
+  size_t count = 0;
+  constexpr uint64_t lineFeeds = kLowBits * '\n';
+  constexpr uint64_t lowSevenBits = ~kHighBits;
+  while (end - ptr >= 8) {
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    const uint64_t x = word ^ lineFeeds;
+    // The high bit of a byte is set iff the byte in x is zero.
+    const uint64_t zeros = ~(((x & lowSevenBits) + lowSevenBits) | x) &
+                           kHighBits;
+    count += std::popcount(zeros);
+    ptr += 8;
+  }
+  while (ptr != end) {
+    if (*ptr == '\n') {
+      ++count;
+    }
+    ++ptr;
+  }
+  return count;
+}
+
 const char* AdvanceToNextNonWhitespace(const char* ptr, const char* end) {
   while (ptr != end) {
     if (const char c = *ptr; c != ' ' && c != '\t') {
@@ -280,6 +339,17 @@ const char* AVX512_FindFirstNULL(const char* ptr, const char* end,
   return i;
 }
 
+size_t AVX512_CountLineFeeds(const char* ptr, const char* end) {
+  size_t count = 0;
+  const __m512i linefeeds = _mm512_set1_epi8('\n');
+  while (end - ptr >= 64) {
+    const __m512i block = _mm512_loadu_si512(ptr);
+    count += _mm_popcnt_u64(_mm512_cmpeq_epi8_mask(block, linefeeds));
+    ptr += 64;
+  }
+  return count + CountLineFeeds(ptr, end);
+}
+
 #endif
 
 #ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
@@ -462,13 +532,34 @@ const char* NEON_FindFirstNULL(const char* ptr, const char* end,
   return i;
 }
 
+size_t NEON_CountLineFeeds(const char* ptr, const char* end) {
+  size_t count = 0;
+  const uint8x16_t linefeeds = vdupq_n_u8(static_cast<uint8_t>('\n'));
+  while (end - ptr >= 16) {
+    const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(ptr));
+    const uint8x16_t match = vceqq_u8(block, linefeeds);
+    count += vaddvq_u8(vshrq_n_u8(match, 7));
+    ptr += 16;
+  }
+  return count + CountLineFeeds(ptr, end);
+}
+
 #endif
 
 }  // namespace
 
 void ByteBlockBackedDictionary::clear() {
-  dict_.clear();
+  controls_ = std::vector<uint8_t>();
+  slots_ = std::vector<uint32_t>();
+  entries_ = std::vector<Entry>();
+  values_ = std::vector<std::string_view>();
+  overflows_ = std::vector<std::vector<std::string_view>>();
   issues_.clear();
+  nextLineNumber_ = 1;
+  arena_.clear();
+  arenaBytes_ = 0;
+  partialLine_.clear();
+  streamFailed_ = false;
 }
 
 bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
@@ -482,16 +573,203 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
   }
 
   clear();
+  return parseBlock(block, size, columnOrder, 1);
+}
+
+bool ByteBlockBackedDictionary::parseInParallel(const char* block, size_t size,
+                                                ColumnOrder columnOrder,
+                                                size_t threadCount) {
+  if (block == nullptr) {
+    return false;
+  }
+
+  if (size == 0) {
+    return false;
+  }
+
+  if (threadCount == 0) {
+    threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  clear();
+  return parseBlock(block, size, columnOrder, threadCount);
+}
+
+bool ByteBlockBackedDictionary::parseAppended(const char* block, size_t size,
+                                              ColumnOrder columnOrder) {
+  if (block == nullptr) {
+    return false;
+  }
+
+  if (size == 0) {
+    return false;
+  }
+
+  return parseBlock(block, size, columnOrder, 1);
+}
+
+void ByteBlockBackedDictionary::beginStream(ColumnOrder columnOrder) {
+  clear();
+  streamColumnOrder_ = columnOrder;
+}
 
+bool ByteBlockBackedDictionary::appendChunk(const char* chunk, size_t size) {
+  if (streamFailed_) {
+    return false;
+  }
+  if (chunk == nullptr || size == 0) {
+    return true;
+  }
+
+  // Everything up to the last line feed forms complete lines.
+  const char* lastLineFeed = nullptr;
+  for (const char* p = chunk + size; p != chunk; --p) {
+    if (*(p - 1) == '\n') {
+      lastLineFeed = p - 1;
+      break;
+    }
+  }
+  if (lastLineFeed == nullptr) {
+    partialLine_.append(chunk, size);
+    return true;
+  }
+
+  const size_t completeSize = lastLineFeed + 1 - chunk;
+  bool result;
+  if (partialLine_.empty()) {
+    result = parseOwnedCopy(chunk, completeSize);
+  } else {
+    partialLine_.append(chunk, completeSize);
+    result = parseOwnedCopy(partialLine_.data(), partialLine_.size());
+    partialLine_.clear();
+  }
+  partialLine_.append(lastLineFeed + 1, size - completeSize);
+  return result;
+}
+
+bool ByteBlockBackedDictionary::endStream() {
+  if (streamFailed_) {
+    return false;
+  }
+  bool result = true;
+  if (!partialLine_.empty()) {
+    result = parseOwnedCopy(partialLine_.data(), partialLine_.size());
+    partialLine_.clear();
+  }
+  return result;
+}
+
+bool ByteBlockBackedDictionary::parseOwnedCopy(const char* text, size_t size) {
+  auto copy = std::make_unique<char[]>(size);
+  memcpy(copy.get(), text, size);
+  const char* block = copy.get();
+  arena_.push_back(std::move(copy));
+  arenaBytes_ += size;
+
+  // Parse with an empty issue list, so that a NUL character is reported even
+  // if the earlier lines have used up MAX_ISSUES.
+  std::vector<Issue> issues = std::move(issues_);
+  issues_.clear();
+  if (!parseBlock(block, size, streamColumnOrder_, 1)) {
+    // Same as parse() of the whole text: only the NUL character issue is
+    // kept.
+    issues = std::move(issues_);
+    clear();
+    issues_ = std::move(issues);
+    streamFailed_ = true;
+    return false;
+  }
+
+  for (const auto& issue : issues_) {
+    if (issues.size() >= MAX_ISSUES) {
+      break;
+    }
+    issues.push_back(issue);
+  }
+  issues_ = std::move(issues);
+  return true;
+}
+
+bool ByteBlockBackedDictionary::parseBlock(const char* block, size_t size,
+                                           ColumnOrder columnOrder,
+                                           size_t threadCount) {
   // Special case if block is a null-ended C string. This is the only place
   // NUL is allowed.
   if (block[size - 1] == 0) {
     --size;
   }
 
-  const char* ptr = block;
-  const char* end = ptr + size;
+  const char* end = block + size;
+
+  // Split the block after line feeds into chunks of similar sizes, so that
+  // no line spans two chunks.
+  size_t chunkCount = std::min(threadCount, size / kMinParallelChunkSize);
+  chunkCount = std::max<size_t>(chunkCount, 1);
+  std::vector<const char*> boundaries;
+  boundaries.push_back(block);
+  for (size_t i = 1; i < chunkCount; ++i) {
+    const char* target = block + size / chunkCount * i;
+    if (target < boundaries.back()) {
+      continue;
+    }
+    const auto* lf =
+        static_cast<const char*>(memchr(target, '\n', end - target));
+    if (lf == nullptr) {
+      break;
+    }
+    boundaries.push_back(lf + 1);
+  }
+  boundaries.push_back(end);
+
+  std::vector<ParsedChunk> chunks(boundaries.size() - 1);
+  {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+      threads.emplace_back(ParseChunk, boundaries[i], boundaries[i + 1],
+                           columnOrder, &chunks[i]);
+    }
+    ParseChunk(boundaries[0], boundaries[1], columnOrder, &chunks[0]);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  // Merge the chunks in order, turning their line numbers into line numbers
+  // of the whole text.
+  size_t linesBefore = nextLineNumber_ - 1;
+  for (const auto& chunk : chunks) {
+    if (chunk.nullCharacterLine != 0) {
+      if (issues_.size() < MAX_ISSUES) {
+        issues_.emplace_back(Issue::Type::NULL_CHARACTER_IN_TEXT,
+                             linesBefore + chunk.nullCharacterLine);
+      }
+      return false;
+    }
+    linesBefore += chunk.lineFeeds;
+  }
 
+  linesBefore = nextLineNumber_ - 1;
+  size_t maxLines = 0;
+  for (const auto& chunk : chunks) {
+    for (const auto& issue : chunk.issues) {
+      if (issues_.size() >= MAX_ISSUES) {
+        break;
+      }
+      issues_.emplace_back(issue.type, linesBefore + issue.lineNumber);
+    }
+    linesBefore += chunk.lineFeeds;
+    maxLines += chunk.keyValues.capacity();
+  }
+
+  reserve(entries_.size() + maxLines);
+  addKeyValues(chunks);
+  nextLineNumber_ = linesBefore + 1;
+  return true;
+}
+
+void ByteBlockBackedDictionary::ParseChunk(const char* ptr, const char* end,
+                                           ColumnOrder columnOrder,
+                                           ParsedChunk* result) {
 #ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_AVX512
   const char* unaligned32End =
       reinterpret_cast<const char*>(reinterpret_cast<uintptr_t>(end) - 32);
@@ -517,10 +795,21 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 #endif
 
   if (ctrlCharPtr != end) {
-    issues_.emplace_back(Issue::Type::NULL_CHARACTER_IN_TEXT, errorAtLine);
-    return false;
+    result->nullCharacterLine = errorAtLine;
+    return;
   }
 
+  // Size the output for the number of lines up front, which is at most one
+  // more than the number of line feeds.
+#if defined(ENABLE_EXPERIMENTAL_SIMD_SUPPORT_AVX512)
+  result->lineFeeds = AVX512_CountLineFeeds(ptr, end);
+#elif defined(ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON)
+  result->lineFeeds = NEON_CountLineFeeds(ptr, end);
+#else
+  result->lineFeeds = CountLineFeeds(ptr, end);
+#endif
+  result->keyValues.reserve(result->lineFeeds + 1);
+
   size_t lineCounter = 1;
 
   if (columnOrder == ColumnOrder::KEY_THEN_VALUE) {
@@ -553,10 +842,10 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
       ptr = AdvanceToNextNonWhitespace(ptr, end);
       if (ptr == end || IsCRLF(*ptr)) {
-        if (issues_.size() < MAX_ISSUES) {
-          issues_.emplace_back(Issue::Type::MISSING_SECOND_COLUMN, lineCounter);
+        if (result->issues.size() < MAX_ISSUES) {
+          result->issues.emplace_back(Issue::Type::MISSING_SECOND_COLUMN,
+                                      lineCounter);
         }
-
         continue;
       }
 
@@ -571,8 +860,9 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
       const char* valueEnd = ptr;
 
       if (valueEnd == valueStart) {
-        if (issues_.size() < MAX_ISSUES) {
-          issues_.emplace_back(Issue::Type::MISSING_SECOND_COLUMN, lineCounter);
+        if (result->issues.size() < MAX_ISSUES) {
+          result->issues.emplace_back(Issue::Type::MISSING_SECOND_COLUMN,
+                                      lineCounter);
         }
         continue;
       }
@@ -592,9 +882,9 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
         // This may be an assertion, but let's just be safe.
         if (valuePtr == valueStart) {
-          if (issues_.size() < MAX_ISSUES) {
-            issues_.emplace_back(Issue::Type::MISSING_SECOND_COLUMN,
-                                 lineCounter);
+          if (result->issues.size() < MAX_ISSUES) {
+            result->issues.emplace_back(Issue::Type::MISSING_SECOND_COLUMN,
+                                        lineCounter);
           }
           continue;
         }
@@ -602,7 +892,7 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
       std::string_view key(keyStart, keyEnd - keyStart);
       std::string_view value(valueStart, valueEnd - valueStart);
-      dict_[key].emplace_back(value);
+      result->keyValues.emplace_back(key, value);
     }
   } else {
     while (ptr != end) {
@@ -634,8 +924,9 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
       ptr = AdvanceToNextNonWhitespace(ptr, end);
       if (ptr == end || IsCRLF(*ptr)) {
-        if (issues_.size() < MAX_ISSUES) {
-          issues_.emplace_back(Issue::Type::MISSING_SECOND_COLUMN, lineCounter);
+        if (result->issues.size() < MAX_ISSUES) {
+          result->issues.emplace_back(Issue::Type::MISSING_SECOND_COLUMN,
+                                      lineCounter);
         }
         continue;
       }
@@ -650,8 +941,9 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 #endif
       const char* maybeKeyEnd = ptr;
       if (maybeKeyStart == maybeKeyEnd) {
-        if (issues_.size() < MAX_ISSUES) {
-          issues_.emplace_back(Issue::Type::MISSING_SECOND_COLUMN, lineCounter);
+        if (result->issues.size() < MAX_ISSUES) {
+          result->issues.emplace_back(Issue::Type::MISSING_SECOND_COLUMN,
+                                      lineCounter);
         }
         continue;
       }
@@ -682,24 +974,229 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
       std::string_view key(maybeKeyStart, maybeKeyEnd - maybeKeyStart);
       std::string_view value(valueStart, valueEnd - valueStart);
-      dict_[key].emplace_back(value);
+      result->keyValues.emplace_back(key, value);
     }
   }
+}
 
-  return true;
+void ByteBlockBackedDictionary::addKeyValues(
+    const std::vector<ParsedChunk>& chunks) {
+  // First count the values of each new key, then lay the values out grouped
+  // by key. Keys that already have values get the new ones in an overflow
+  // array, so that the existing values do not move.
+  const uint32_t firstNewEntry = static_cast<uint32_t>(entries_.size());
+  size_t keyValueCount = 0;
+  for (const auto& chunk : chunks) {
+    keyValueCount += chunk.keyValues.size();
+  }
+  std::vector<uint32_t> entryIndices;
+  entryIndices.reserve(keyValueCount);
+  for (const auto& chunk : chunks) {
+    for (const auto& [key, value] : chunk.keyValues) {
+      uint32_t index = findOrInsert(key);
+      entryIndices.push_back(index);
+      Entry& entry = entries_[index];
+      if (index >= firstNewEntry) {
+        ++entry.valueCount;
+        continue;
+      }
+      if (entry.overflow == kNotFound) {
+        entry.overflow = static_cast<uint32_t>(overflows_.size());
+        overflows_.emplace_back();
+      }
+      overflows_[entry.overflow].push_back(value);
+    }
+  }
+
+  uint32_t nextValue = static_cast<uint32_t>(values_.size());
+  for (size_t i = firstNewEntry; i < entries_.size(); ++i) {
+    Entry& entry = entries_[i];
+    entry.firstValue = nextValue;
+    nextValue += entry.valueCount;
+    entry.valueCount = 0;
+  }
+  values_.resize(nextValue);
+  size_t i = 0;
+  for (const auto& chunk : chunks) {
+    for (const auto& [key, value] : chunk.keyValues) {
+      if (const uint32_t index = entryIndices[i++]; index >= firstNewEntry) {
+        Entry& entry = entries_[index];
+        values_[entry.firstValue + entry.valueCount] = value;
+        ++entry.valueCount;
+      }
+    }
+  }
+
+  // The table was sized for one key per line. Shrink it if the keys turned
+  // out to have many values each.
+  size_t capacity = kGroupWidth;
+  while (MaxKeysForCapacity(capacity) < entries_.size()) {
+    capacity *= 2;
+  }
+  if (controls_.size() >= capacity * 4) {
+    rehash(capacity);
+  }
+}
+
+uint32_t ByteBlockBackedDictionary::find(std::string_view key) const {
+  if (controls_.empty()) {
+    return kNotFound;
+  }
+
+  const size_t hash = std::hash<std::string_view>()(key);
+  const auto h2 = static_cast<uint8_t>(hash & 0x7f);
+  const size_t groupMask = controls_.size() / kGroupWidth - 1;
+  size_t group = (hash >> 7) & groupMask;
+  for (size_t probe = 1;; ++probe) {
+    const size_t base = group * kGroupWidth;
+    const uint64_t word = LoadControlGroup(&controls_[base]);
+    for (uint64_t m = MatchControlByte(word, h2); m != 0; m &= m - 1) {
+      const uint32_t index = slots_[base + SlotInGroup(m)];
+      if (entries_[index].key == key) {
+        return index;
+      }
+    }
+    if ((word & kHighBits) != 0) {
+      return kNotFound;
+    }
+    // Triangular probing visits every group of a power-of-two table.
+    group = (group + probe) & groupMask;
+  }
+}
+
+uint32_t ByteBlockBackedDictionary::findOrInsert(std::string_view key) {
+  if (entries_.size() + 1 > MaxKeysForCapacity(controls_.size())) {
+    reserve(entries_.size() + 1);
+  }
+
+  const size_t hash = std::hash<std::string_view>()(key);
+  const auto h2 = static_cast<uint8_t>(hash & 0x7f);
+  const size_t groupMask = controls_.size() / kGroupWidth - 1;
+  size_t group = (hash >> 7) & groupMask;
+  for (size_t probe = 1;; ++probe) {
+    const size_t base = group * kGroupWidth;
+    const uint64_t word = LoadControlGroup(&controls_[base]);
+    for (uint64_t m = MatchControlByte(word, h2); m != 0; m &= m - 1) {
+      const uint32_t index = slots_[base + SlotInGroup(m)];
+      if (entries_[index].key == key) {
+        return index;
+      }
+    }
+    if (const uint64_t empties = word & kHighBits; empties != 0) {
+      const size_t slot = base + SlotInGroup(empties);
+      const auto index = static_cast<uint32_t>(entries_.size());
+      controls_[slot] = h2;
+      slots_[slot] = index;
+      entries_.push_back(Entry{key, 0, 0, kNotFound});
+      return index;
+    }
+    group = (group + probe) & groupMask;
+  }
+}
+
+void ByteBlockBackedDictionary::reserve(size_t keyCount) {
+  size_t capacity = kGroupWidth;
+  while (MaxKeysForCapacity(capacity) < keyCount) {
+    capacity *= 2;
+  }
+  if (capacity > controls_.size()) {
+    rehash(capacity);
+  }
+}
+
+void ByteBlockBackedDictionary::rehash(size_t capacity) {
+  controls_.assign(capacity, kEmptyControl);
+  controls_.shrink_to_fit();
+  slots_.assign(capacity, 0);
+  slots_.shrink_to_fit();
+
+  const size_t groupMask = capacity / kGroupWidth - 1;
+  for (uint32_t index = 0; index < entries_.size(); ++index) {
+    const size_t hash = std::hash<std::string_view>()(entries_[index].key);
+    size_t group = (hash >> 7) & groupMask;
+    for (size_t probe = 1;; ++probe) {
+      const size_t base = group * kGroupWidth;
+      const uint64_t empties =
+          LoadControlGroup(&controls_[base]) & kHighBits;
+      if (empties != 0) {
+        const size_t slot = base + SlotInGroup(empties);
+        controls_[slot] = static_cast<uint8_t>(hash & 0x7f);
+        slots_[slot] = index;
+        break;
+      }
+      group = (group + probe) & groupMask;
+    }
+  }
 }
 
 bool ByteBlockBackedDictionary::hasKey(const std::string_view& key) const {
-  return dict_.find(key) != dict_.end();
+  return find(key) != kNotFound;
 }
 
 std::vector<std::string_view> ByteBlockBackedDictionary::getValues(
     const std::string_view& key) const {
-  const auto it = dict_.find(key);
-  if (it == dict_.cend()) {
+  const uint32_t index = find(key);
+  if (index == kNotFound) {
     return {};
   }
-  return it->second;
+  const Entry& entry = entries_[index];
+  const auto first = values_.begin() + entry.firstValue;
+  std::vector<std::string_view> result(first, first + entry.valueCount);
+  if (entry.overflow != kNotFound) {
+    const auto& overflow = overflows_[entry.overflow];
+    result.insert(result.end(), overflow.begin(), overflow.end());
+  }
+  return result;
+}
+
+bool ByteBlockBackedDictionary::hasValue(const std::string_view& key,
+                                         const std::string_view& value) const {
+  const uint32_t index = find(key);
+  if (index == kNotFound) {
+    return false;
+  }
+  const Entry& entry = entries_[index];
+  const auto first = values_.begin() + entry.firstValue;
+  if (std::find(first, first + entry.valueCount, value) !=
+      first + entry.valueCount) {
+    return true;
+  }
+  if (entry.overflow == kNotFound) {
+    return false;
+  }
+  const auto& overflow = overflows_[entry.overflow];
+  return std::find(overflow.begin(), overflow.end(), value) != overflow.end();
+}
+
+void ByteBlockBackedDictionary::forEach(
+    const std::function<void(std::string_view,
+                             std::span<const std::string_view>)>& fn) const {
+  std::vector<std::string_view> merged;
+  for (const Entry& entry : entries_) {
+    std::span<const std::string_view> values(values_.data() + entry.firstValue,
+                                             entry.valueCount);
+    if (entry.overflow == kNotFound) {
+      fn(entry.key, values);
+      continue;
+    }
+    const auto& overflow = overflows_[entry.overflow];
+    merged.assign(values.begin(), values.end());
+    merged.insert(merged.end(), overflow.begin(), overflow.end());
+    fn(entry.key, merged);
+  }
+}
+
+MemoryUsage ByteBlockBackedDictionary::memoryUsage() const {
+  MemoryUsage usage;
+  usage.heapBytes = VectorHeapBytes(issues_) + VectorHeapBytes(controls_) +
+                    VectorHeapBytes(slots_) + VectorHeapBytes(entries_) +
+                    VectorHeapBytes(values_) + VectorHeapBytes(overflows_) +
+                    VectorHeapBytes(arena_) + arenaBytes_ +
+                    StringHeapBytes(partialLine_);
+  for (const auto& overflow : overflows_) {
+    usage.heapBytes += VectorHeapBytes(overflow);
+  }
+  return usage;
 }
 
 }  // namespace McBopomofo
@@ -24,10 +24,18 @@
 #ifndef SRC_ENGINE_BYTEBLOCKBACKEDDICTIONARY_H_
 #define SRC_ENGINE_BYTEBLOCKBACKEDDICTIONARY_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
 #include <string_view>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "MemoryUsage.h"
+
 namespace McBopomofo {
 
 // A dictionary backed by a block of bytes, usually read or mapped from a file
@@ -64,6 +72,11 @@ namespace McBopomofo {
 // uses std::string_view instead of copying key and value strings out of the
 // text. Therefore, the dictionary must not be used if the block of bytes is
 // gone! You can call clear() to clear all such dangling references to the text.
+//
+// Internally, keys are stored in a flat open-addressing hash table with one
+// control byte per slot, probed eight slots at a time. The values of all keys
+// are kept in one array, grouped by key, so a parse only allocates a handful
+// of arrays no matter how many keys there are.
 class ByteBlockBackedDictionary {
  public:
   struct Issue {
@@ -89,17 +102,132 @@ class ByteBlockBackedDictionary {
   bool parse(const char* block, size_t size,
              ColumnOrder columnOrder = ColumnOrder::KEY_THEN_VALUE);
 
+  // Same as parse(), but splits the block at line breaks into up to
+  // threadCount chunks that are parsed concurrently, which gives the same
+  // result, including the issues and their line numbers. A threadCount of 0
+  // uses one thread per core. Small blocks are parsed on the calling thread.
+  bool parseInParallel(const char* block, size_t size,
+                       ColumnOrder columnOrder = ColumnOrder::KEY_THEN_VALUE,
+                       size_t threadCount = 0);
+
+  // Parses a block that continues the text parsed so far, such as the bytes
+  // appended to a file after it was parsed, and adds its entries to the
+  // existing ones. Line numbers in issues continue from the previous blocks,
+  // and so the previous block is expected to end with a line break. The same
+  // memory safety rule applies: all blocks must outlive the dictionary.
+  bool parseAppended(const char* block, size_t size,
+                     ColumnOrder columnOrder = ColumnOrder::KEY_THEN_VALUE);
+
+  // The line number at which the next appended block starts. Setting it lets
+  // an empty dictionary continue text that was parsed elsewhere, such as
+  // into a DictionarySnapshot.
+  [[nodiscard]] size_t nextLineNumber() const { return nextLineNumber_; }
+  void setNextLineNumber(size_t lineNumber) { nextLineNumber_ = lineNumber; }
+
+  // Parses text that arrives in chunks, such as from a pipe or a
+  // decompressor, while the rest is still being read. Unlike with parse(),
+  // the chunks need not outlive the dictionary: the complete lines of each
+  // chunk are copied into memory owned by the dictionary and parsed right
+  // away, and a line split across chunks is parsed once its end arrives.
+  // beginStream() clears the dictionary, and endStream() parses the last line
+  // if it has no line break. The result is the same as parsing the whole text
+  // with parse(): if a NUL character is found, the dictionary is left empty
+  // except for the issue, and the remaining chunks are ignored.
+  void beginStream(ColumnOrder columnOrder = ColumnOrder::KEY_THEN_VALUE);
+  bool appendChunk(const char* chunk, size_t size);
+  bool endStream();
+
   [[nodiscard]] bool hasKey(const std::string_view& key) const;
   [[nodiscard]] std::vector<std::string_view> getValues(
       const std::string_view& key) const;
 
+  // Whether the key has the value; stops at the first match.
+  [[nodiscard]] bool hasValue(const std::string_view& key,
+                              const std::string_view& value) const;
+
+  // Calls fn with every key and its values, in the order the keys first
+  // appear in the text.
+  void forEach(const std::function<void(std::string_view,
+                                        std::span<const std::string_view>)>&
+                   fn) const;
+
   const std::vector<Issue>& issues() const { return issues_; }
 
+  // The heap taken by the hash table, the value lists and the copies of
+  // streamed text. The parsed block itself belongs to the caller.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
  private:
   static constexpr size_t MAX_ISSUES = 100;
 
+  using KeyValue = std::pair<std::string_view, std::string_view>;
+
+  // A key, whose values are values_[firstValue, firstValue + valueCount),
+  // followed by overflows_[overflow] if an appended block added more values
+  // to the key.
+  struct Entry {
+    std::string_view key;
+    uint32_t firstValue;
+    uint32_t valueCount;
+    uint32_t overflow;
+  };
+
+  static constexpr uint32_t kNotFound = UINT32_MAX;
+
+  // Blocks are not split into chunks smaller than this.
+  static constexpr size_t kMinParallelChunkSize = 256 * 1024;
+
+  // The result of parsing a chunk of lines. The line numbers are relative to
+  // the start of the chunk.
+  struct ParsedChunk {
+    std::vector<KeyValue> keyValues;
+    std::vector<Issue> issues;
+    size_t lineFeeds = 0;
+    // The line of the first NUL character, or 0 if there is none.
+    size_t nullCharacterLine = 0;
+  };
+
+  bool parseBlock(const char* block, size_t size, ColumnOrder columnOrder,
+                  size_t threadCount);
+
+  static void ParseChunk(const char* ptr, const char* end,
+                         ColumnOrder columnOrder, ParsedChunk* result);
+
+  // Copies the text into the arena and parses it as an appended block.
+  bool parseOwnedCopy(const char* text, size_t size);
+
+  // Adds the key-value pairs of the chunks, in their order, to the table.
+  void addKeyValues(const std::vector<ParsedChunk>& chunks);
+
+  // Returns the index of the key's entry, or kNotFound.
+  uint32_t find(std::string_view key) const;
+
+  // Returns the index of the key's entry, which is created if not found.
+  uint32_t findOrInsert(std::string_view key);
+
+  // Makes room for the number of keys without rehashing.
+  void reserve(size_t keyCount);
+  void rehash(size_t capacity);
+
+  // The line number at which the next appended block starts.
+  size_t nextLineNumber_ = 1;
+
   std::vector<Issue> issues_;
-  std::unordered_map<std::string_view, std::vector<std::string_view>> dict_;
+
+  // The control byte of each slot is either kEmptyControl or the low seven
+  // bits of the key's hash. The slots hold indices into entries_.
+  std::vector<uint8_t> controls_;
+  std::vector<uint32_t> slots_;
+  std::vector<Entry> entries_;
+  std::vector<std::string_view> values_;
+  std::vector<std::vector<std::string_view>> overflows_;
+
+  // The text copied by the streaming API, and the streaming state.
+  std::vector<std::unique_ptr<char[]>> arena_;
+  size_t arenaBytes_ = 0;
+  std::string partialLine_;
+  ColumnOrder streamColumnOrder_ = ColumnOrder::KEY_THEN_VALUE;
+  bool streamFailed_ = false;
 };
 
 }  // namespace McBopomofo
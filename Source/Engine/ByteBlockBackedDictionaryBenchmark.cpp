@@ -25,7 +25,9 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include "AllocationCounter.h"
 #include "ByteBlockBackedDictionary.h"
 
 namespace {
@@ -80,6 +82,100 @@ void BM_ByteBlockBackedDictionaryValueColumnFirstParseTest(
 }
 BENCHMARK(BM_ByteBlockBackedDictionaryValueColumnFirstParseTest);
 
+constexpr int kUserFileLines = 100000;
+constexpr int kUserFileReadings = 60000;
+
+std::string UserFileReading(int i) {
+  return "ㄅ" + std::to_string(i % kUserFileReadings) + "-ㄆ";
+}
+
+// A user phrases file in the value-then-key format, with readings that have
+// one or more values.
+const std::string& GetUserFileData() {
+  static const std::string data = []() {
+    std::stringstream sst;
+    for (int i = 0; i < kUserFileLines; ++i) {
+      sst << "詞" << i << " " << UserFileReading(i) << "\n";
+    }
+    return sst.str();
+  }();
+  return data;
+}
+
+void BM_ByteBlockBackedDictionaryParseUserFile(benchmark::State& state) {
+  const std::string& testData = GetUserFileData();
+  size_t bytes = 0;
+  size_t allocations = 0;
+  for (auto _ : state) {
+    McBopomofo::AllocationCounter counter;
+    McBopomofo::ByteBlockBackedDictionary dictionary;
+    dictionary.parse(
+        testData.c_str(), testData.size(),
+        McBopomofo::ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY);
+    bytes = dictionary.memoryUsage().heapBytes;
+    allocations = counter.allocations();
+  }
+  state.counters["heap_bytes"] = static_cast<double>(bytes);
+  state.counters["allocations"] = static_cast<double>(allocations);
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryParseUserFile)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_ByteBlockBackedDictionaryLookupUserFile(benchmark::State& state) {
+  const std::string& testData = GetUserFileData();
+  McBopomofo::ByteBlockBackedDictionary dictionary;
+  dictionary.parse(
+      testData.c_str(), testData.size(),
+      McBopomofo::ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY);
+
+  // Half of the lookups are misses, as most readings have no user phrase.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1024; ++i) {
+    int n = static_cast<int>((i * 7919L) % (kUserFileReadings * 2));
+    keys.push_back(n < kUserFileReadings ? UserFileReading(n)
+                                         : "ㄇ" + std::to_string(n) + "-ㄆ");
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& key = keys[i++ % keys.size()];
+    if (dictionary.hasKey(key)) {
+      auto values = dictionary.getValues(key);
+      benchmark::DoNotOptimize(values);
+    }
+  }
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryLookupUserFile);
+
+// A multi-megabyte file, such as a large imported user dictionary, parsed
+// with the given number of threads.
+void BM_ByteBlockBackedDictionaryParseInParallel(benchmark::State& state) {
+  static const std::string data = []() {
+    std::stringstream sst;
+    for (int i = 0; i < kUserFileLines * 5; ++i) {
+      sst << "詞" << i << " " << UserFileReading(i) << "\n";
+    }
+    return sst.str();
+  }();
+
+  for (auto _ : state) {
+    McBopomofo::ByteBlockBackedDictionary dictionary;
+    dictionary.parseInParallel(
+        data.c_str(), data.size(),
+        McBopomofo::ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY,
+        static_cast<size_t>(state.range(0)));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(data.size()));
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryParseInParallel)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
 };  // namespace
 
 BENCHMARK_MAIN();
@@ -21,6 +21,13 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <algorithm>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 #include "ByteBlockBackedDictionary.h"
 #include "gtest/gtest.h"
 
@@ -281,4 +288,267 @@ TEST(ByteBlockBackedDictionaryTest, ComplexEntriesValueThenKey) {
   ASSERT_EQ(dict.getValues("comment").at(0), "value1 \t key1  #");
 }
 
+TEST(ByteBlockBackedDictionaryTest, ParseAppended) {
+  constexpr char data[] = "key1 value1\nkey2\n";
+  constexpr char appended[] = "key1 value2\n\nkey3 value3\nkey4\n";
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data, sizeof(data) - 1));
+  ASSERT_TRUE(dict.parseAppended(appended, sizeof(appended) - 1));
+
+  ASSERT_EQ(dict.getValues("key1").size(), 2);
+  ASSERT_EQ(dict.getValues("key1").at(0), "value1");
+  ASSERT_EQ(dict.getValues("key1").at(1), "value2");
+  ASSERT_EQ(dict.getValues("key3").at(0), "value3");
+
+  ASSERT_EQ(dict.issues().size(), 2);
+  ASSERT_EQ(dict.issues().at(0).lineNumber, 2);
+  ASSERT_EQ(dict.issues().at(1).lineNumber, 6);
+}
+
+TEST(ByteBlockBackedDictionaryTest, ParseAppendedNullCharacterLineNumber) {
+  constexpr char data[] = "key1 value1\nkey2 value2\n";
+  constexpr char appended[] = "key3 value3\nkey4 \0value4\n";
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data, sizeof(data) - 1));
+  ASSERT_FALSE(dict.parseAppended(appended, sizeof(appended) - 1));
+  ASSERT_EQ(dict.issues().size(), 1);
+  ASSERT_EQ(dict.issues().at(0).type,
+            ByteBlockBackedDictionary::Issue::Type::NULL_CHARACTER_IN_TEXT);
+  ASSERT_EQ(dict.issues().at(0).lineNumber, 4);
+  ASSERT_TRUE(dict.hasKey("key2"));
+  ASSERT_FALSE(dict.hasKey("key3"));
+}
+
+TEST(ByteBlockBackedDictionaryTest, ManyKeysWithManyValues) {
+  std::string data;
+  for (int v = 0; v < 3; ++v) {
+    for (int k = 0; k < 5000; ++k) {
+      data += "key" + std::to_string(k) + " value" + std::to_string(k) + "_" +
+              std::to_string(v) + "\n";
+    }
+  }
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data.c_str(), data.size()));
+  for (int k = 0; k < 5000; ++k) {
+    std::string key = "key" + std::to_string(k);
+    ASSERT_TRUE(dict.hasKey(key));
+    auto values = dict.getValues(key);
+    ASSERT_EQ(values.size(), 3);
+    for (int v = 0; v < 3; ++v) {
+      ASSERT_EQ(values[v], "value" + std::to_string(k) + "_" +
+                               std::to_string(v));
+    }
+    ASSERT_TRUE(dict.hasValue(key, "value" + std::to_string(k) + "_2"));
+    ASSERT_FALSE(dict.hasValue(key, "value" + std::to_string(k) + "_3"));
+  }
+  ASSERT_FALSE(dict.hasKey("key5000"));
+  ASSERT_FALSE(dict.hasKey("key"));
+  ASSERT_TRUE(dict.getValues("value0_0").empty());
+}
+
+TEST(ByteBlockBackedDictionaryTest, ParseAppendedManyKeys) {
+  std::string data;
+  for (int k = 0; k < 100; ++k) {
+    data += "key" + std::to_string(k) + " first\n";
+  }
+  std::string appended;
+  for (int k = 0; k < 1000; k += 2) {
+    appended += "key" + std::to_string(k) + " second\n";
+  }
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data.c_str(), data.size()));
+  ASSERT_TRUE(dict.parseAppended(appended.c_str(), appended.size()));
+
+  ASSERT_EQ(dict.getValues("key0"),
+            (std::vector<std::string_view>{"first", "second"}));
+  ASSERT_EQ(dict.getValues("key1"), (std::vector<std::string_view>{"first"}));
+  ASSERT_EQ(dict.getValues("key998"),
+            (std::vector<std::string_view>{"second"}));
+  ASSERT_FALSE(dict.hasKey("key999"));
+}
+
+TEST(ByteBlockBackedDictionaryTest, ForEachVisitsKeysInOrder) {
+  constexpr char data[] = "b 1\na 2\nb 3\n";
+  constexpr char appended[] = "c 4\na 5\n";
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data, sizeof(data) - 1));
+  ASSERT_TRUE(dict.parseAppended(appended, sizeof(appended) - 1));
+
+  std::vector<std::pair<std::string_view, std::vector<std::string_view>>> seen;
+  dict.forEach([&seen](std::string_view key,
+                       std::span<const std::string_view> values) {
+    seen.emplace_back(key, std::vector<std::string_view>(values.begin(),
+                                                         values.end()));
+  });
+  ASSERT_EQ(seen.size(), 3);
+  ASSERT_EQ(seen[0].first, "b");
+  ASSERT_EQ(seen[0].second, (std::vector<std::string_view>{"1", "3"}));
+  ASSERT_EQ(seen[1].first, "a");
+  ASSERT_EQ(seen[1].second, (std::vector<std::string_view>{"2", "5"}));
+  ASSERT_EQ(seen[2].first, "c");
+  ASSERT_EQ(seen[2].second, (std::vector<std::string_view>{"4"}));
+}
+
+namespace {
+
+// A large text whose keys repeat across the whole text, with comments, blank
+// lines, and more lines with issues than are reported.
+std::string LargeTextWithIssues() {
+  std::string data;
+  for (int i = 0; i < 100000; ++i) {
+    if (i % 997 == 0) {
+      data += "# comment " + std::to_string(i) + "\n\n";
+    }
+    if (i % 500 == 0) {
+      data += "lonely" + std::to_string(i) + "\n";
+      continue;
+    }
+    data += "key" + std::to_string(i % 7001) + " value " + std::to_string(i) +
+            "\r\n";
+  }
+  return data;
+}
+
+std::vector<std::pair<std::string_view, std::vector<std::string_view>>>
+Entries(const ByteBlockBackedDictionary& dict) {
+  std::vector<std::pair<std::string_view, std::vector<std::string_view>>>
+      entries;
+  dict.forEach([&entries](std::string_view key,
+                          std::span<const std::string_view> values) {
+    entries.emplace_back(key, std::vector<std::string_view>(values.begin(),
+                                                            values.end()));
+  });
+  return entries;
+}
+
+}  // namespace
+
+TEST(ByteBlockBackedDictionaryTest, ParseInParallelMatchesParse) {
+  static constexpr char appended[] = "key1 appended\nlonely\n";
+  std::string data = LargeTextWithIssues();
+  for (auto order : {ByteBlockBackedDictionary::ColumnOrder::KEY_THEN_VALUE,
+                     ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY}) {
+    for (size_t threads : {1, 2, 3, 8}) {
+      ByteBlockBackedDictionary expected;
+      ASSERT_TRUE(expected.parse(data.c_str(), data.size(), order));
+      ASSERT_EQ(expected.issues().size(), 100);
+
+      ByteBlockBackedDictionary dict;
+      ASSERT_TRUE(dict.parseInParallel(data.c_str(), data.size(), order,
+                                       threads));
+      ASSERT_EQ(Entries(dict), Entries(expected));
+      ASSERT_EQ(dict.issues().size(), expected.issues().size());
+      for (size_t i = 0; i < dict.issues().size(); ++i) {
+        ASSERT_EQ(dict.issues()[i].type, expected.issues()[i].type);
+        ASSERT_EQ(dict.issues()[i].lineNumber, expected.issues()[i].lineNumber);
+      }
+
+      // Appended lines are numbered after the lines parsed in parallel.
+      ASSERT_TRUE(dict.parseAppended(appended, sizeof(appended) - 1, order));
+      ASSERT_TRUE(
+          expected.parseAppended(appended, sizeof(appended) - 1, order));
+      ASSERT_EQ(Entries(dict), Entries(expected));
+    }
+  }
+}
+
+TEST(ByteBlockBackedDictionaryTest, ParseInParallelNullCharacterLineNumber) {
+  std::string data = LargeTextWithIssues();
+  size_t pos = data.size() - 100;
+  data[pos] = '\0';
+
+  ByteBlockBackedDictionary expected;
+  ASSERT_FALSE(expected.parse(data.c_str(), data.size()));
+  ByteBlockBackedDictionary dict;
+  ASSERT_FALSE(dict.parseInParallel(data.c_str(), data.size(),
+                                    ByteBlockBackedDictionary::ColumnOrder::
+                                        KEY_THEN_VALUE,
+                                    4));
+  ASSERT_EQ(dict.issues().size(), 1);
+  ASSERT_EQ(dict.issues()[0].type,
+            ByteBlockBackedDictionary::Issue::Type::NULL_CHARACTER_IN_TEXT);
+  ASSERT_EQ(dict.issues()[0].lineNumber, expected.issues()[0].lineNumber);
+  ASSERT_FALSE(dict.hasKey("key1"));
+}
+
+namespace {
+
+// Streams the text in chunks of the given size, each from a buffer that is
+// gone once the chunk has been passed on.
+bool StreamInChunks(ByteBlockBackedDictionary& dict, const std::string& text,
+                    size_t chunkSize,
+                    ByteBlockBackedDictionary::ColumnOrder order) {
+  dict.beginStream(order);
+  bool result = true;
+  for (size_t pos = 0; pos < text.size(); pos += chunkSize) {
+    std::string chunk = text.substr(pos, chunkSize);
+    result = dict.appendChunk(chunk.data(), chunk.size()) && result;
+    std::fill(chunk.begin(), chunk.end(), 'x');
+  }
+  return dict.endStream() && result;
+}
+
+}  // namespace
+
+TEST(ByteBlockBackedDictionaryTest, StreamMatchesParse) {
+  std::string data = LargeTextWithIssues();
+  // The last line has no line break.
+  data += "lastkey lastvalue";
+  for (auto order : {ByteBlockBackedDictionary::ColumnOrder::KEY_THEN_VALUE,
+                     ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY}) {
+    ByteBlockBackedDictionary expected;
+    ASSERT_TRUE(expected.parse(data.c_str(), data.size(), order));
+
+    for (size_t chunkSize : {1, 7, 4096, 1 << 20}) {
+      ByteBlockBackedDictionary dict;
+      ASSERT_TRUE(StreamInChunks(dict, data, chunkSize, order));
+      ASSERT_EQ(Entries(dict), Entries(expected));
+      ASSERT_EQ(dict.issues().size(), expected.issues().size());
+      for (size_t i = 0; i < dict.issues().size(); ++i) {
+        ASSERT_EQ(dict.issues()[i].lineNumber, expected.issues()[i].lineNumber);
+      }
+    }
+  }
+}
+
+TEST(ByteBlockBackedDictionaryTest, StreamLinesSplitAcrossChunks) {
+  ByteBlockBackedDictionary dict;
+  dict.beginStream();
+  ASSERT_TRUE(dict.appendChunk("ke", 2));
+  ASSERT_TRUE(dict.appendChunk("y1 val", 6));
+  ASSERT_TRUE(dict.appendChunk("ue1\r", 4));
+  ASSERT_FALSE(dict.hasKey("key1"));
+  ASSERT_TRUE(dict.appendChunk("\nkey2", 5));
+  ASSERT_EQ(dict.getValues("key1"), (std::vector<std::string_view>{"value1"}));
+  ASSERT_TRUE(dict.appendChunk(" value2", 7));
+  ASSERT_FALSE(dict.hasKey("key2"));
+  ASSERT_TRUE(dict.endStream());
+  ASSERT_EQ(dict.getValues("key2"), (std::vector<std::string_view>{"value2"}));
+  ASSERT_TRUE(dict.issues().empty());
+}
+
+TEST(ByteBlockBackedDictionaryTest, StreamNullCharacter) {
+  std::string data = LargeTextWithIssues();
+  data[data.size() - 100] = '\0';
+
+  ByteBlockBackedDictionary expected;
+  ASSERT_FALSE(expected.parse(data.c_str(), data.size()));
+  ByteBlockBackedDictionary dict;
+  ASSERT_FALSE(StreamInChunks(
+      dict, data, 4096,
+      ByteBlockBackedDictionary::ColumnOrder::KEY_THEN_VALUE));
+  ASSERT_EQ(dict.issues().size(), 1);
+  ASSERT_EQ(dict.issues()[0].type,
+            ByteBlockBackedDictionary::Issue::Type::NULL_CHARACTER_IN_TEXT);
+  ASSERT_EQ(dict.issues()[0].lineNumber, expected.issues()[0].lineNumber);
+  ASSERT_FALSE(dict.hasKey("key1"));
+
+  // A new stream starts over.
+  dict.beginStream();
+  ASSERT_TRUE(dict.appendChunk("key1 value1\n", 12));
+  ASSERT_TRUE(dict.endStream());
+  ASSERT_TRUE(dict.hasKey("key1"));
+  ASSERT_TRUE(dict.issues().empty());
+}
+
 }  // namespace McBopomofo
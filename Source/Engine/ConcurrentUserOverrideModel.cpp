@@ -0,0 +1,350 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "ConcurrentUserOverrideModel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace McBopomofo {
+
+// Replaced entries are freed in batches, since each batch waits for the
+// readers of the current reading period to finish.
+static constexpr size_t kRetireBatchSize = 64;
+
+static size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+// An open-addressing table of entries, probed linearly from the low bits of
+// the key. Removed entries leave a tombstone, so that a concurrent reader
+// never misses an entry that was moved. The table has a fixed size of at
+// least four times the shard's capacity and is rebuilt without the
+// tombstones once it is half used.
+struct ConcurrentUserOverrideModel::Table {
+  explicit Table(size_t size)
+      : mask(size - 1),
+        slots(std::make_unique<std::atomic<const Entry*>[]>(size)) {
+    for (size_t i = 0; i < size; ++i) {
+      slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] size_t size() const { return mask + 1; }
+
+  const size_t mask;
+  // The number of non-null slots, including tombstones.
+  size_t used = 0;
+  std::unique_ptr<std::atomic<const Entry*>[]> slots;
+};
+
+struct ConcurrentUserOverrideModel::Shard {
+  Shard(size_t capacity, double decayConstant)
+      : model(capacity, decayConstant),
+        table(new Table(
+            RoundUpToPowerOfTwo(std::max<size_t>(capacity * 4, 8)))) {}
+
+  ~Shard() {
+    Table* t = table.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < t->size(); ++i) {
+      const Entry* e = t->slots[i].load(std::memory_order_relaxed);
+      if (e != nullptr && e != &tombstone) {
+        delete e;
+      }
+    }
+    delete t;
+    freeRetired();
+  }
+
+  Shard(const Shard&) = delete;
+  Shard(Shard&&) = delete;
+  Shard& operator=(const Shard&) = delete;
+  Shard& operator=(Shard&&) = delete;
+
+  // Replaces the published copy of the key's observation, or adds one.
+  void publish(const ObservationKey& key,
+               const UserOverrideModel::Observation& observation);
+  void remove(const ObservationKey& key);
+  void rebuild();
+  void retire(const Entry* entry);
+  // Waits until no reader can still see a retired entry or table, and frees
+  // them.
+  void synchronize();
+  void freeRetired();
+
+  struct alignas(64) ReaderCount {
+    std::atomic<uint64_t> value{0};
+  };
+
+  // Guarded by mutex. The model does the bookkeeping, the LRU order and the
+  // eviction, while readers only see the published table.
+  std::mutex mutex;
+  UserOverrideModel model;
+  std::vector<const Entry*> retiredEntries;
+  std::vector<Table*> retiredTables;
+
+  // Read without the lock.
+  const Entry tombstone{};
+  std::atomic<Table*> table;
+  alignas(64) std::atomic<uint64_t> period{0};
+  ReaderCount readers[2];
+};
+
+// Registers a reader in the shard's current reading period.
+class ConcurrentUserOverrideModel::ReadGuard {
+ public:
+  explicit ReadGuard(Shard& shard) {
+    while (true) {
+      const uint64_t period = shard.period.load();
+      auto& count = shard.readers[period & 1].value;
+      count.fetch_add(1);
+      // If the period changed in between, the writer may have already seen
+      // the count at zero; register in the new period instead.
+      if (shard.period.load() == period) {
+        count_ = &count;
+        return;
+      }
+      count.fetch_sub(1);
+    }
+  }
+
+  ~ReadGuard() { count_->fetch_sub(1, std::memory_order_release); }
+
+  ReadGuard(const ReadGuard&) = delete;
+  ReadGuard(ReadGuard&&) = delete;
+  ReadGuard& operator=(const ReadGuard&) = delete;
+  ReadGuard& operator=(ReadGuard&&) = delete;
+
+ private:
+  std::atomic<uint64_t>* count_ = nullptr;
+};
+
+void ConcurrentUserOverrideModel::Shard::publish(
+    const ObservationKey& key,
+    const UserOverrideModel::Observation& observation) {
+  Table* t = table.load(std::memory_order_relaxed);
+  const auto* entry = new Entry{key, observation};
+  size_t firstTombstone = SIZE_MAX;
+  size_t i = key.low & t->mask;
+  for (;; i = (i + 1) & t->mask) {
+    const Entry* e = t->slots[i].load(std::memory_order_relaxed);
+    if (e == nullptr) {
+      break;
+    }
+    if (e == &tombstone) {
+      if (firstTombstone == SIZE_MAX) {
+        firstTombstone = i;
+      }
+      continue;
+    }
+    if (e->key == key) {
+      t->slots[i].store(entry, std::memory_order_release);
+      retire(e);
+      return;
+    }
+  }
+
+  if (firstTombstone != SIZE_MAX) {
+    i = firstTombstone;
+  } else {
+    ++t->used;
+  }
+  t->slots[i].store(entry, std::memory_order_release);
+  if (t->used * 2 > t->size()) {
+    rebuild();
+  }
+}
+
+void ConcurrentUserOverrideModel::Shard::remove(const ObservationKey& key) {
+  Table* t = table.load(std::memory_order_relaxed);
+  for (size_t i = key.low & t->mask;; i = (i + 1) & t->mask) {
+    const Entry* e = t->slots[i].load(std::memory_order_relaxed);
+    if (e == nullptr) {
+      return;
+    }
+    if (e != &tombstone && e->key == key) {
+      t->slots[i].store(&tombstone, std::memory_order_release);
+      retire(e);
+      return;
+    }
+  }
+}
+
+void ConcurrentUserOverrideModel::Shard::rebuild() {
+  Table* old = table.load(std::memory_order_relaxed);
+  auto* t = new Table(old->size());
+  for (size_t i = 0; i < old->size(); ++i) {
+    const Entry* e = old->slots[i].load(std::memory_order_relaxed);
+    if (e == nullptr || e == &tombstone) {
+      continue;
+    }
+    size_t j = e->key.low & t->mask;
+    while (t->slots[j].load(std::memory_order_relaxed) != nullptr) {
+      j = (j + 1) & t->mask;
+    }
+    t->slots[j].store(e, std::memory_order_relaxed);
+    ++t->used;
+  }
+  table.store(t, std::memory_order_release);
+  retiredTables.push_back(old);
+}
+
+void ConcurrentUserOverrideModel::Shard::retire(const Entry* entry) {
+  retiredEntries.push_back(entry);
+  if (retiredEntries.size() >= kRetireBatchSize) {
+    synchronize();
+  }
+}
+
+void ConcurrentUserOverrideModel::Shard::synchronize() {
+  // Readers that registered in the new period started after the retired
+  // objects were unlinked, so only those of the old period are waited for.
+  const uint64_t oldPeriod = period.load(std::memory_order_relaxed);
+  period.store(oldPeriod + 1);
+  while (readers[oldPeriod & 1].value.load() != 0) {
+    std::this_thread::yield();
+  }
+  freeRetired();
+}
+
+void ConcurrentUserOverrideModel::Shard::freeRetired() {
+  for (const Entry* e : retiredEntries) {
+    delete e;
+  }
+  retiredEntries.clear();
+  for (Table* t : retiredTables) {
+    delete t;
+  }
+  retiredTables.clear();
+}
+
+ConcurrentUserOverrideModel::ConcurrentUserOverrideModel(size_t capacity,
+                                                         double decayConstant,
+                                                         size_t shardCount) {
+  shardCount = RoundUpToPowerOfTwo(std::max<size_t>(shardCount, 1));
+  shardMask_ = shardCount - 1;
+  const size_t shardCapacity =
+      std::max<size_t>((capacity + shardCount - 1) / shardCount, 1);
+  shards_.reserve(shardCount);
+  for (size_t i = 0; i < shardCount; ++i) {
+    shards_.push_back(std::make_unique<Shard>(shardCapacity, decayConstant));
+  }
+}
+
+ConcurrentUserOverrideModel::~ConcurrentUserOverrideModel() = default;
+
+void ConcurrentUserOverrideModel::observe(
+    const Formosa::Gramambular2::ReadingGrid::WalkResult&
+        walkBeforeUserOverride,
+    const Formosa::Gramambular2::ReadingGrid::WalkResult& walkAfterUserOverride,
+    size_t cursor, double timestamp) {
+  auto inferred = UserOverrideModel::InferObservation(
+      walkBeforeUserOverride, walkAfterUserOverride, cursor);
+  if (inferred.has_value()) {
+    observe(inferred->key, inferred->candidate, timestamp,
+            inferred->forceHighScoreOverride);
+  }
+}
+
+ConcurrentUserOverrideModel::Suggestion ConcurrentUserOverrideModel::suggest(
+    const Formosa::Gramambular2::ReadingGrid::WalkResult& currentWalk,
+    size_t cursor, double timestamp) const {
+  auto key = UserOverrideModel::MakeObservationKey(currentWalk, cursor);
+  if (!key.has_value()) {
+    return Suggestion{};
+  }
+  return suggest(*key, timestamp);
+}
+
+void ConcurrentUserOverrideModel::observe(const ObservationKey& key,
+                                          const std::string& candidate,
+                                          double timestamp,
+                                          bool forceHighScoreOverride) {
+  Shard& shard = shardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  std::optional<ObservationKey> evicted;
+  if (shard.model.findObservation(key) == nullptr) {
+    evicted = shard.model.evictionCandidate();
+  }
+  shard.model.observe(key, candidate, timestamp, forceHighScoreOverride);
+  if (evicted.has_value()) {
+    shard.remove(*evicted);
+  }
+  shard.publish(key, *shard.model.findObservation(key));
+}
+
+ConcurrentUserOverrideModel::Suggestion ConcurrentUserOverrideModel::suggest(
+    const ObservationKey& key, double timestamp) const {
+  Shard& shard = shardFor(key);
+  ReadGuard guard(shard);
+  const Table* t = shard.table.load(std::memory_order_acquire);
+  for (size_t i = key.low & t->mask;; i = (i + 1) & t->mask) {
+    const Entry* e = t->slots[i].load(std::memory_order_acquire);
+    if (e == nullptr) {
+      return Suggestion{};
+    }
+    if (e != &shard.tombstone && e->key == key) {
+      return shard.model.suggest(e->observation, timestamp);
+    }
+  }
+}
+
+size_t ConcurrentUserOverrideModel::evictExpired(double timestamp) {
+  size_t removed = 0;
+  std::vector<ObservationKey> removedKeys;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    removedKeys.clear();
+    removed += shard->model.evictExpired(timestamp, &removedKeys);
+    for (const auto& key : removedKeys) {
+      shard->remove(key);
+    }
+  }
+  return removed;
+}
+
+size_t ConcurrentUserOverrideModel::size() const {
+  size_t size = 0;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    size += shard->model.size();
+  }
+  return size;
+}
+
+ConcurrentUserOverrideModel::Shard& ConcurrentUserOverrideModel::shardFor(
+    const ObservationKey& key) const {
+  return *shards_[key.high & shardMask_];
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,119 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_CONCURRENTUSEROVERRIDEMODEL_H_
+#define SRC_ENGINE_CONCURRENTUSEROVERRIDEMODEL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "UserOverrideModel.h"
+#include "gramambular2/reading_grid.h"
+
+namespace McBopomofo {
+
+// A UserOverrideModel that can be shared by many input sessions on different
+// threads, such as in a multi-session host.
+//
+// The observations are split into shards by key hash, each shard holding an
+// equal part of the capacity and doing its own LRU eviction, so the model as
+// a whole only approximates a global LRU. observe() takes the shard's lock.
+// suggest() takes no lock: each shard publishes its observations as
+// immutable copies in an open-addressing table of atomic pointers, which
+// observe() replaces rather than modifies. A replaced copy is freed once no
+// reader that might have seen it is still running, which the shard tracks
+// with two reader counts that alternate between reading periods.
+class ConcurrentUserOverrideModel {
+ public:
+  using ObservationKey = UserOverrideModel::ObservationKey;
+  using Suggestion = UserOverrideModel::Suggestion;
+
+  static constexpr size_t kDefaultShardCount = 16;
+
+  // shardCount is rounded up to a power of two.
+  ConcurrentUserOverrideModel(size_t capacity, double decayConstant,
+                              size_t shardCount = kDefaultShardCount);
+  ~ConcurrentUserOverrideModel();
+  ConcurrentUserOverrideModel(const ConcurrentUserOverrideModel&) = delete;
+  ConcurrentUserOverrideModel(ConcurrentUserOverrideModel&&) = delete;
+  ConcurrentUserOverrideModel& operator=(const ConcurrentUserOverrideModel&) =
+      delete;
+  ConcurrentUserOverrideModel& operator=(ConcurrentUserOverrideModel&&) =
+      delete;
+
+  void observe(const Formosa::Gramambular2::ReadingGrid::WalkResult&
+                   walkBeforeUserOverride,
+               const Formosa::Gramambular2::ReadingGrid::WalkResult&
+                   walkAfterUserOverride,
+               size_t cursor, double timestamp);
+
+  Suggestion suggest(
+      const Formosa::Gramambular2::ReadingGrid::WalkResult& currentWalk,
+      size_t cursor, double timestamp) const;
+
+  void observe(const ObservationKey& key, const std::string& candidate,
+               double timestamp, bool forceHighScoreOverride = false);
+
+  Suggestion suggest(const ObservationKey& key, double timestamp) const;
+
+  void observe(const std::string& key, const std::string& candidate,
+               double timestamp, bool forceHighScoreOverride = false) {
+    observe(UserOverrideModel::MakeObservationKey(key), candidate, timestamp,
+            forceHighScoreOverride);
+  }
+
+  Suggestion suggest(const std::string& key, double timestamp) const {
+    return suggest(UserOverrideModel::MakeObservationKey(key), timestamp);
+  }
+
+  // Removes the observations whose candidates have all fully decayed, one
+  // shard at a time, and returns the number removed.
+  size_t evictExpired(double timestamp);
+
+  // The number of observations held. This takes the lock of every shard.
+  [[nodiscard]] size_t size() const;
+
+ private:
+  struct Entry {
+    ObservationKey key;
+    UserOverrideModel::Observation observation;
+  };
+
+  struct Table;
+  struct Shard;
+  class ReadGuard;
+
+  Shard& shardFor(const ObservationKey& key) const;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  size_t shardMask_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_CONCURRENTUSEROVERRIDEMODEL_H_
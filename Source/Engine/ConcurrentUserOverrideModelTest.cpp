@@ -0,0 +1,163 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "ConcurrentUserOverrideModel.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+constexpr double kFakeNow = 1657772432;
+constexpr double kHalflife = 5400.0;  // 1.5 hr.
+
+std::string Key(int i) { return "(k" + std::to_string(i) + ",v)"; }
+}  // namespace
+
+TEST(ConcurrentUserOverrideModelTest, BasicOperation) {
+  ConcurrentUserOverrideModel uom(10, kHalflife);
+  uom.observe("abc", "x", kFakeNow);
+  uom.observe("abc", "y", kFakeNow + 1);
+  uom.observe("abc", "y", kFakeNow + 2, true);
+  auto s = uom.suggest("abc", kFakeNow + 2);
+  EXPECT_EQ(s.candidate, "y");
+  EXPECT_TRUE(s.forceHighScoreOverride);
+  EXPECT_TRUE(uom.suggest("def", kFakeNow).empty());
+  EXPECT_TRUE(uom.suggest("abc", kFakeNow + kHalflife * 21).empty());
+  EXPECT_EQ(uom.size(), 1);
+}
+
+TEST(ConcurrentUserOverrideModelTest, SingleShardIsAnLRU) {
+  constexpr int kCapacity = 5;
+  ConcurrentUserOverrideModel uom(kCapacity, kHalflife, 1);
+  for (int i = 0; i < kCapacity; ++i) {
+    uom.observe(Key(i), "v", kFakeNow);
+  }
+  uom.observe(Key(0), "v", kFakeNow);
+  uom.observe(Key(kCapacity), "v", kFakeNow);
+  EXPECT_EQ(uom.size(), kCapacity);
+  EXPECT_EQ(uom.suggest(Key(0), kFakeNow).candidate, "v");
+  EXPECT_TRUE(uom.suggest(Key(1), kFakeNow).empty());
+  EXPECT_EQ(uom.suggest(Key(kCapacity), kFakeNow).candidate, "v");
+}
+
+TEST(ConcurrentUserOverrideModelTest, EvictsPerShard) {
+  constexpr int kCapacity = 64;
+  ConcurrentUserOverrideModel uom(kCapacity, kHalflife, 4);
+  for (int i = 0; i < 10000; ++i) {
+    uom.observe(Key(i), "v" + std::to_string(i), kFakeNow);
+  }
+  EXPECT_EQ(uom.size(), kCapacity);
+  int found = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto s = uom.suggest(Key(i), kFakeNow);
+    if (!s.empty()) {
+      EXPECT_EQ(s.candidate, "v" + std::to_string(i));
+      ++found;
+    }
+  }
+  EXPECT_EQ(found, kCapacity);
+  // The most recent key of each shard is always kept.
+  EXPECT_EQ(uom.suggest(Key(9999), kFakeNow).candidate, "v9999");
+}
+
+TEST(ConcurrentUserOverrideModelTest, EvictExpired) {
+  ConcurrentUserOverrideModel uom(64, kHalflife, 4);
+  const double later = kFakeNow + kHalflife * 30;
+  for (int i = 0; i < 32; ++i) {
+    uom.observe(Key(i), "v", i % 2 == 0 ? kFakeNow : later);
+  }
+  EXPECT_EQ(uom.evictExpired(later), 16);
+  EXPECT_EQ(uom.size(), 16);
+  for (int i = 0; i < 32; ++i) {
+    EXPECT_EQ(uom.suggest(Key(i), later).empty(), i % 2 == 0);
+  }
+}
+
+TEST(ConcurrentUserOverrideModelTest, ConcurrentObserveAndSuggest) {
+  constexpr int kCapacity = 64;
+  constexpr int kKeys = 256;
+  constexpr int kWriters = 4;
+  constexpr int kReaders = 4;
+  constexpr int kIterations = 20000;
+  ConcurrentUserOverrideModel uom(kCapacity, kHalflife, 4);
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeys; ++i) {
+    keys.push_back(Key(i));
+  }
+
+  // Every candidate of a key starts with the key, so that a reader can tell
+  // whether it saw a torn or misplaced observation.
+  std::atomic<bool> stop = false;
+  std::atomic<int> badSuggestions = 0;
+  std::atomic<int> hits = 0;
+  std::vector<std::thread> threads;
+  for (int w = 0; w < kWriters; ++w) {
+    threads.emplace_back([&, w] {
+      for (int i = 0; i < kIterations; ++i) {
+        const int k = (i * 7 + w * 13) % kKeys;
+        uom.observe(keys[k], keys[k] + std::to_string(i % 3),
+                    kFakeNow + i, i % 2 == 0);
+      }
+    });
+  }
+  for (int r = 0; r < kReaders; ++r) {
+    threads.emplace_back([&, r] {
+      for (int i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+        const int k = (i * 5 + r) % kKeys;
+        auto s = uom.suggest(keys[k], kFakeNow + kIterations);
+        if (s.empty()) {
+          continue;
+        }
+        hits.fetch_add(1, std::memory_order_relaxed);
+        if (s.candidate.size() != keys[k].size() + 1 ||
+            s.candidate.compare(0, keys[k].size(), keys[k]) != 0) {
+          badSuggestions.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+  for (int w = 0; w < kWriters; ++w) {
+    threads[w].join();
+  }
+  stop = true;
+  for (int r = 0; r < kReaders; ++r) {
+    threads[kWriters + r].join();
+  }
+
+  EXPECT_EQ(badSuggestions.load(), 0);
+  EXPECT_GT(hits.load(), 0);
+  EXPECT_EQ(uom.size(), kCapacity);
+
+  uom.observe(Key(kKeys), "final", kFakeNow + kIterations);
+  EXPECT_EQ(uom.suggest(Key(kKeys), kFakeNow + kIterations).candidate,
+            "final");
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,389 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "DictionarySnapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace McBopomofo {
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'c', 'B', 'P', 'M', 'F', 'D', 'S'};
+constexpr uint32_t kVersion = 2;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// If the source was modified within this window before the snapshot was
+// built, a later change may have kept the same modification time, since some
+// file systems only have a resolution of one or two seconds.
+constexpr int64_t kRacyWindowNanoseconds = 2'000'000'000;
+
+uint64_t Fnv1a64(const char* data, size_t length,
+                 uint64_t seed = DictionarySnapshot::kContentHashSeed) {
+  uint64_t hash = seed;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+int64_t ModificationTimeNanoseconds(const struct stat& sb) {
+#if defined(__APPLE__)
+  const struct timespec& ts = sb.st_mtimespec;
+#else
+  const struct timespec& ts = sb.st_mtim;
+#endif
+  return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+struct IssueRecord {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t lineNumber;
+};
+
+}  // namespace
+
+struct DictionarySnapshot::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrderMark;
+  uint32_t columnOrder;
+  uint32_t reserved;
+  uint64_t sourceSize;
+  int64_t sourceMtimeNanoseconds;
+  uint64_t sourceDevice;
+  uint64_t sourceInode;
+  uint64_t sourceContentHash;
+  uint64_t sourceNextLineNumber;
+  int64_t createdAtNanoseconds;
+  // A power of two.
+  uint32_t slotCount;
+  uint32_t valueCount;
+  uint32_t issueCount;
+  uint32_t stringsLength;
+  uint64_t totalLength;
+};
+
+// An empty slot has a zero keyLength, since keys are never empty.
+struct DictionarySnapshot::Slot {
+  uint32_t keyOffset;
+  uint32_t keyLength;
+  uint32_t firstValue;
+  uint32_t valueCount;
+};
+
+struct DictionarySnapshot::Value {
+  uint32_t offset;
+  uint32_t length;
+};
+
+static uint64_t TotalLength(uint64_t slotCount, uint64_t valueCount,
+                            uint64_t issueCount, uint64_t stringsLength) {
+  return sizeof(DictionarySnapshot::Header) +
+         slotCount * 4 * sizeof(uint32_t) + valueCount * 2 * sizeof(uint32_t) +
+         issueCount * sizeof(IssueRecord) + stringsLength;
+}
+
+bool DictionarySnapshot::Write(
+    const std::filesystem::path& snapshotPath,
+    const ByteBlockBackedDictionary& dictionary,
+    ByteBlockBackedDictionary::ColumnOrder columnOrder,
+    const struct stat& sourceStat, const char* sourceData,
+    size_t sourceLength) {
+  std::vector<std::pair<std::string_view, std::span<const std::string_view>>>
+      entries;
+  dictionary.forEach(
+      [&entries](std::string_view key,
+                 std::span<const std::string_view> values) {
+        entries.emplace_back(key, values);
+      });
+  // Sorting makes the output deterministic.
+  std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  uint32_t slotCount = 8;
+  while (slotCount < entries.size() * 2) {
+    slotCount <<= 1;
+  }
+
+  std::vector<Slot> slots(slotCount, Slot{0, 0, 0, 0});
+  std::vector<Value> values;
+  std::string strings;
+  for (const auto& [key, keyValues] : entries) {
+    uint32_t index =
+        static_cast<uint32_t>(Fnv1a64(key.data(), key.size())) &
+        (slotCount - 1);
+    while (slots[index].keyLength != 0) {
+      index = (index + 1) & (slotCount - 1);
+    }
+    Slot& slot = slots[index];
+    slot.keyOffset = static_cast<uint32_t>(strings.size());
+    slot.keyLength = static_cast<uint32_t>(key.size());
+    slot.firstValue = static_cast<uint32_t>(values.size());
+    slot.valueCount = static_cast<uint32_t>(keyValues.size());
+    strings.append(key);
+    for (const auto& value : keyValues) {
+      values.push_back(Value{static_cast<uint32_t>(strings.size()),
+                             static_cast<uint32_t>(value.size())});
+      strings.append(value);
+    }
+  }
+
+  // The format uses 32-bit offsets.
+  if (strings.size() > UINT32_MAX || values.size() > UINT32_MAX) {
+    return false;
+  }
+
+  std::vector<IssueRecord> issues;
+  for (const auto& issue : dictionary.issues()) {
+    issues.push_back(IssueRecord{static_cast<uint32_t>(issue.type), 0,
+                                 static_cast<uint64_t>(issue.lineNumber)});
+  }
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byteOrderMark = kByteOrderMark;
+  header.columnOrder = static_cast<uint32_t>(columnOrder);
+  header.sourceSize = static_cast<uint64_t>(sourceStat.st_size);
+  header.sourceMtimeNanoseconds = ModificationTimeNanoseconds(sourceStat);
+  header.sourceDevice = static_cast<uint64_t>(sourceStat.st_dev);
+  header.sourceInode = static_cast<uint64_t>(sourceStat.st_ino);
+  header.sourceContentHash = Fnv1a64(sourceData, sourceLength);
+  header.sourceNextLineNumber = dictionary.nextLineNumber();
+  header.createdAtNanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  header.slotCount = slotCount;
+  header.valueCount = static_cast<uint32_t>(values.size());
+  header.issueCount = static_cast<uint32_t>(issues.size());
+  header.stringsLength = static_cast<uint32_t>(strings.size());
+  header.totalLength = TotalLength(slotCount, values.size(), issues.size(),
+                                   strings.size());
+
+  std::filesystem::path tmpPath = snapshotPath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(slots.data()),
+              static_cast<std::streamsize>(slots.size() * sizeof(Slot)));
+    out.write(reinterpret_cast<const char*>(values.data()),
+              static_cast<std::streamsize>(values.size() * sizeof(Value)));
+    out.write(reinterpret_cast<const char*>(issues.data()),
+              static_cast<std::streamsize>(issues.size() *
+                                           sizeof(IssueRecord)));
+    out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+    if (!out) {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, snapshotPath, ec);
+  return !ec;
+}
+
+bool DictionarySnapshot::open(
+    const std::filesystem::path& snapshotPath,
+    const std::filesystem::path& sourcePath,
+    ByteBlockBackedDictionary::ColumnOrder columnOrder) {
+  close();
+
+  struct stat sb;
+  if (stat(sourcePath.c_str(), &sb) == -1) {
+    return false;
+  }
+
+  MemoryMappedFile file;
+  if (!file.open(snapshotPath.c_str()) || file.length() < sizeof(Header)) {
+    return false;
+  }
+
+  const auto* header = reinterpret_cast<const Header*>(file.data());
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion ||
+      header->byteOrderMark != kByteOrderMark ||
+      header->columnOrder != static_cast<uint32_t>(columnOrder) ||
+      header->slotCount == 0 ||
+      (header->slotCount & (header->slotCount - 1)) != 0 ||
+      header->totalLength != file.length() ||
+      header->totalLength != TotalLength(header->slotCount, header->valueCount,
+                                         header->issueCount,
+                                         header->stringsLength)) {
+    return false;
+  }
+
+  if (header->sourceSize != static_cast<uint64_t>(sb.st_size) ||
+      header->sourceMtimeNanoseconds != ModificationTimeNanoseconds(sb) ||
+      header->sourceDevice != static_cast<uint64_t>(sb.st_dev) ||
+      header->sourceInode != static_cast<uint64_t>(sb.st_ino)) {
+    return false;
+  }
+
+  if (header->sourceMtimeNanoseconds + kRacyWindowNanoseconds >=
+      header->createdAtNanoseconds) {
+    MemoryMappedFile source;
+    if (!source.open(sourcePath.c_str()) ||
+        Fnv1a64(source.data(), source.length()) !=
+            header->sourceContentHash) {
+      return false;
+    }
+  }
+
+  file_ = std::move(file);
+  header_ = reinterpret_cast<const Header*>(file_.data());
+  const char* ptr = file_.data() + sizeof(Header);
+  slots_ = reinterpret_cast<const Slot*>(ptr);
+  ptr += header_->slotCount * sizeof(Slot);
+  values_ = reinterpret_cast<const Value*>(ptr);
+  ptr += header_->valueCount * sizeof(Value);
+  ptr += header_->issueCount * sizeof(IssueRecord);
+  strings_ = ptr;
+  return true;
+}
+
+void DictionarySnapshot::close() {
+  header_ = nullptr;
+  slots_ = nullptr;
+  values_ = nullptr;
+  strings_ = nullptr;
+  file_.close();
+}
+
+const DictionarySnapshot::Slot* DictionarySnapshot::findSlot(
+    std::string_view key) const {
+  if (header_ == nullptr || key.empty()) {
+    return nullptr;
+  }
+
+  uint32_t mask = header_->slotCount - 1;
+  uint32_t index =
+      static_cast<uint32_t>(Fnv1a64(key.data(), key.size())) & mask;
+  // The table is at most half full, so an empty slot is always reached.
+  for (uint32_t probes = 0; probes <= mask; probes++) {
+    const Slot& slot = slots_[index];
+    if (slot.keyLength == 0) {
+      return nullptr;
+    }
+    if (slot.keyLength == key.size() &&
+        static_cast<uint64_t>(slot.keyOffset) + slot.keyLength <=
+            header_->stringsLength &&
+        memcmp(strings_ + slot.keyOffset, key.data(), key.size()) == 0) {
+      return &slot;
+    }
+    index = (index + 1) & mask;
+  }
+  return nullptr;
+}
+
+bool DictionarySnapshot::hasKey(std::string_view key) const {
+  return findSlot(key) != nullptr;
+}
+
+std::vector<std::string_view> DictionarySnapshot::getValues(
+    std::string_view key) const {
+  std::vector<std::string_view> result;
+  const Slot* slot = findSlot(key);
+  if (slot == nullptr || static_cast<uint64_t>(slot->firstValue) +
+                                 slot->valueCount >
+                             header_->valueCount) {
+    return result;
+  }
+
+  result.reserve(slot->valueCount);
+  for (uint32_t i = 0; i < slot->valueCount; i++) {
+    const Value& value = values_[slot->firstValue + i];
+    if (static_cast<uint64_t>(value.offset) + value.length >
+        header_->stringsLength) {
+      break;
+    }
+    result.emplace_back(strings_ + value.offset, value.length);
+  }
+  return result;
+}
+
+bool DictionarySnapshot::hasValue(std::string_view key,
+                                  std::string_view value) const {
+  const Slot* slot = findSlot(key);
+  if (slot == nullptr || static_cast<uint64_t>(slot->firstValue) +
+                                 slot->valueCount >
+                             header_->valueCount) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < slot->valueCount; i++) {
+    const Value& v = values_[slot->firstValue + i];
+    if (static_cast<uint64_t>(v.offset) + v.length > header_->stringsLength) {
+      return false;
+    }
+    if (std::string_view(strings_ + v.offset, v.length) == value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t DictionarySnapshot::ContentHash(const char* data, size_t length,
+                                         uint64_t seed) {
+  return Fnv1a64(data, length, seed);
+}
+
+uint64_t DictionarySnapshot::sourceContentHash() const {
+  return header_ == nullptr ? 0 : header_->sourceContentHash;
+}
+
+size_t DictionarySnapshot::nextLineNumber() const {
+  return header_ == nullptr ? 1
+                            : static_cast<size_t>(header_->sourceNextLineNumber);
+}
+
+std::vector<ByteBlockBackedDictionary::Issue> DictionarySnapshot::issues()
+    const {
+  std::vector<ByteBlockBackedDictionary::Issue> result;
+  if (header_ == nullptr) {
+    return result;
+  }
+
+  const auto* records = reinterpret_cast<const IssueRecord*>(
+      reinterpret_cast<const char*>(values_) +
+      header_->valueCount * sizeof(Value));
+  for (uint32_t i = 0; i < header_->issueCount; i++) {
+    result.emplace_back(
+        static_cast<ByteBlockBackedDictionary::Issue::Type>(records[i].type),
+        static_cast<size_t>(records[i].lineNumber));
+  }
+  return result;
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,123 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_DICTIONARYSNAPSHOT_H_
+#define SRC_ENGINE_DICTIONARYSNAPSHOT_H_
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "ByteBlockBackedDictionary.h"
+#include "MemoryMappedFile.h"
+
+namespace McBopomofo {
+
+// A compiled, self-contained binary image of a ByteBlockBackedDictionary
+// parsed from a text file. The image holds an open-addressing hash table over
+// the keys, a CSR-style array of values grouped by key, the parsing issues,
+// and the string bytes, so it can be memory-mapped and queried directly
+// without reading or parsing the text file.
+//
+// A snapshot records the size, modification time, inode and content hash of
+// the text file it was built from, and open() only accepts it if the text
+// file still has the same size, modification time and inode. The content hash
+// is only checked when the text file was modified so close to the snapshot's
+// creation that a change may not show in the modification time, so the cost
+// of opening a snapshot does not depend on the size of the text file.
+class DictionarySnapshot {
+ public:
+  DictionarySnapshot() = default;
+  DictionarySnapshot(const DictionarySnapshot&) = delete;
+  DictionarySnapshot(DictionarySnapshot&&) = delete;
+  DictionarySnapshot& operator=(const DictionarySnapshot&) = delete;
+  DictionarySnapshot& operator=(DictionarySnapshot&&) = delete;
+
+  // Writes a snapshot of the dictionary that was parsed from sourceData, the
+  // content of the text file whose stat(2) result, taken before the file was
+  // read, is sourceStat. The file is replaced atomically.
+  static bool Write(const std::filesystem::path& snapshotPath,
+                    const ByteBlockBackedDictionary& dictionary,
+                    ByteBlockBackedDictionary::ColumnOrder columnOrder,
+                    const struct stat& sourceStat, const char* sourceData,
+                    size_t sourceLength);
+
+  // Opens the snapshot if it was built, with the same column order, from the
+  // current version of the text file at sourcePath.
+  bool open(const std::filesystem::path& snapshotPath,
+            const std::filesystem::path& sourcePath,
+            ByteBlockBackedDictionary::ColumnOrder columnOrder);
+  void close();
+  [[nodiscard]] bool isOpen() const { return header_ != nullptr; }
+
+  [[nodiscard]] bool hasKey(std::string_view key) const;
+
+  // The returned views point into the mapped snapshot.
+  [[nodiscard]] std::vector<std::string_view> getValues(
+      std::string_view key) const;
+
+  // Whether the key has the value; stops at the first match.
+  [[nodiscard]] bool hasValue(std::string_view key,
+                              std::string_view value) const;
+
+  [[nodiscard]] std::vector<ByteBlockBackedDictionary::Issue> issues() const;
+
+  // The line number after the last line of the text file, at which the
+  // lines appended to the file since the snapshot was built start.
+  [[nodiscard]] size_t nextLineNumber() const;
+
+  // The content hash of the text file the snapshot was built from.
+  [[nodiscard]] uint64_t sourceContentHash() const;
+
+  // The hash that snapshots keep of their text files (64-bit FNV-1a). Passing
+  // the hash of some bytes as the seed continues it over the bytes that
+  // follow them.
+  static constexpr uint64_t kContentHashSeed = 0xcbf29ce484222325ULL;
+  static uint64_t ContentHash(const char* data, size_t length,
+                              uint64_t seed = kContentHashSeed);
+
+  // A snapshot is only mapped; nothing is copied to the heap.
+  [[nodiscard]] MemoryUsage memoryUsage() const { return file_.memoryUsage(); }
+
+  struct Header;
+
+ private:
+  struct Slot;
+  struct Value;
+
+  const Slot* findSlot(std::string_view key) const;
+
+  MemoryMappedFile file_;
+  const Header* header_ = nullptr;
+  const Slot* slots_ = nullptr;
+  const Value* values_ = nullptr;
+  const char* strings_ = nullptr;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_DICTIONARYSNAPSHOT_H_
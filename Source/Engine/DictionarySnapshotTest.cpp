@@ -0,0 +1,288 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "DictionarySnapshot.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "McBopomofoLM.h"
+#include "MemoryMappedFile.h"
+#include "PhraseReplacementMap.h"
+#include "TestTempDir.h"
+#include "UserPhrasesLM.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+
+using ColumnOrder = ByteBlockBackedDictionary::ColumnOrder;
+
+// Parses the file and writes its snapshot.
+bool BuildSnapshot(const std::filesystem::path& source,
+                   const std::filesystem::path& snapshot,
+                   ColumnOrder columnOrder) {
+  struct stat sb;
+  if (stat(source.c_str(), &sb) == -1) {
+    return false;
+  }
+  MemoryMappedFile file;
+  if (!file.open(source.c_str())) {
+    return false;
+  }
+  ByteBlockBackedDictionary dictionary;
+  dictionary.parse(file.data(), file.length(), columnOrder);
+  return DictionarySnapshot::Write(snapshot, dictionary, columnOrder, sb,
+                                   file.data(), file.length());
+}
+
+class SnapshotUserPhrasesLM : public UserPhrasesLM {
+ public:
+  bool usesSnapshot() const { return snapshot_.isOpen(); }
+
+  // Each appended reload keeps the mapping it replaced.
+  size_t appendedReloadCount() const { return retainedMappings_.size(); }
+};
+
+}  // namespace
+
+TEST(DictionarySnapshotTest, LookupsMatchTheParsedDictionary) {
+  TestTempDir dir;
+  std::string text = "# comment\nk1 v1\nk2 v2\nk1 v3\nk3\nk4 a multiword value\n";
+  for (int i = 0; i < 100; i++) {
+    text += "key" + std::to_string(i) + " value" + std::to_string(i) + "\n";
+  }
+  auto source = dir.write("source.txt", text);
+  auto snapshotPath = dir.pathOf("source.txt.snapshot");
+  ASSERT_TRUE(BuildSnapshot(source, snapshotPath, ColumnOrder::KEY_THEN_VALUE));
+
+  DictionarySnapshot snapshot;
+  ASSERT_TRUE(
+      snapshot.open(snapshotPath, source, ColumnOrder::KEY_THEN_VALUE));
+  EXPECT_TRUE(snapshot.hasKey("k1"));
+  EXPECT_FALSE(snapshot.hasKey("k3"));
+  EXPECT_FALSE(snapshot.hasKey("k"));
+  EXPECT_FALSE(snapshot.hasKey(""));
+  EXPECT_EQ(snapshot.getValues("k1"),
+            (std::vector<std::string_view>{"v1", "v3"}));
+  EXPECT_EQ(snapshot.getValues("k4"),
+            (std::vector<std::string_view>{"a multiword value"}));
+  EXPECT_TRUE(snapshot.hasValue("k1", "v3"));
+  EXPECT_FALSE(snapshot.hasValue("k1", "v2"));
+  EXPECT_FALSE(snapshot.hasValue("nonexistent", "v1"));
+  for (int i = 0; i < 100; i++) {
+    auto values = snapshot.getValues("key" + std::to_string(i));
+    ASSERT_EQ(values.size(), 1);
+    EXPECT_EQ(values[0], "value" + std::to_string(i));
+  }
+  EXPECT_TRUE(snapshot.getValues("nonexistent").empty());
+
+  auto issues = snapshot.issues();
+  ASSERT_EQ(issues.size(), 1);
+  EXPECT_EQ(issues[0].type,
+            ByteBlockBackedDictionary::Issue::Type::MISSING_SECOND_COLUMN);
+  EXPECT_EQ(issues[0].lineNumber, 5);
+
+  snapshot.close();
+  EXPECT_FALSE(snapshot.isOpen());
+  EXPECT_FALSE(snapshot.hasKey("k1"));
+}
+
+TEST(DictionarySnapshotTest, RejectsChangedSource) {
+  TestTempDir dir;
+  auto source = dir.write("source.txt", "k1 v1\n");
+  auto snapshotPath = dir.pathOf("source.txt.snapshot");
+  ASSERT_TRUE(BuildSnapshot(source, snapshotPath, ColumnOrder::KEY_THEN_VALUE));
+
+  dir.write("source.txt", "k1 v1\nk2 v2\n");
+  DictionarySnapshot snapshot;
+  EXPECT_FALSE(
+      snapshot.open(snapshotPath, source, ColumnOrder::KEY_THEN_VALUE));
+}
+
+TEST(DictionarySnapshotTest, RejectsSameSizeChangeWithSameModificationTime) {
+  TestTempDir dir;
+  auto source = dir.write("source.txt", "k1 v1\n");
+  auto snapshotPath = dir.pathOf("source.txt.snapshot");
+  struct stat before;
+  ASSERT_EQ(stat(source.c_str(), &before), 0);
+  ASSERT_TRUE(BuildSnapshot(source, snapshotPath, ColumnOrder::KEY_THEN_VALUE));
+
+  // Rewrite the file in place and restore its modification time, which is
+  // what a file system with a coarse timestamp resolution may show.
+  dir.write("source.txt", "k1 v2\n");
+#if defined(__APPLE__)
+  struct timespec times[2] = {before.st_atimespec, before.st_mtimespec};
+#else
+  struct timespec times[2] = {before.st_atim, before.st_mtim};
+#endif
+  ASSERT_EQ(utimensat(AT_FDCWD, source.c_str(), times, 0), 0);
+
+  DictionarySnapshot snapshot;
+  EXPECT_FALSE(
+      snapshot.open(snapshotPath, source, ColumnOrder::KEY_THEN_VALUE));
+}
+
+TEST(DictionarySnapshotTest, RejectsMismatchedOrDamagedSnapshots) {
+  TestTempDir dir;
+  auto source = dir.write("source.txt", "k1 v1\nk2 v2\n");
+  auto snapshotPath = dir.pathOf("source.txt.snapshot");
+  ASSERT_TRUE(BuildSnapshot(source, snapshotPath, ColumnOrder::KEY_THEN_VALUE));
+
+  DictionarySnapshot snapshot;
+  EXPECT_FALSE(
+      snapshot.open(snapshotPath, source, ColumnOrder::VALUE_THEN_KEY));
+  EXPECT_FALSE(snapshot.open(dir.pathOf("missing"), source,
+                             ColumnOrder::KEY_THEN_VALUE));
+  EXPECT_FALSE(snapshot.open(snapshotPath, dir.pathOf("missing"),
+                             ColumnOrder::KEY_THEN_VALUE));
+
+  std::filesystem::resize_file(snapshotPath,
+                               std::filesystem::file_size(snapshotPath) - 1);
+  EXPECT_FALSE(
+      snapshot.open(snapshotPath, source, ColumnOrder::KEY_THEN_VALUE));
+
+  dir.write("source.txt.snapshot", "not a snapshot");
+  EXPECT_FALSE(
+      snapshot.open(snapshotPath, source, ColumnOrder::KEY_THEN_VALUE));
+}
+
+TEST(DictionarySnapshotTest, UserPhrasesLMReusesValidSnapshot) {
+  TestTempDir dir;
+  auto source = dir.write("data.txt.user", "value1 reading1\nvalue2 reading2\n");
+  auto snapshotPath = dir.pathOf("data.txt.user.snapshot");
+
+  SnapshotUserPhrasesLM first;
+  ASSERT_TRUE(first.open(source.c_str(), snapshotPath));
+  EXPECT_FALSE(first.usesSnapshot());
+  EXPECT_TRUE(std::filesystem::exists(snapshotPath));
+
+  SnapshotUserPhrasesLM second;
+  ASSERT_TRUE(second.open(source.c_str(), snapshotPath));
+  EXPECT_TRUE(second.usesSnapshot());
+  EXPECT_TRUE(second.hasUnigrams("reading1"));
+  auto unigrams = second.getUnigrams("reading2");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "value2");
+
+  // Changes made through the overlay work with the snapshot, and the reload
+  // after the write replaces the stale snapshot.
+  second.addPhrase("reading3", "value3");
+  second.removePhrase("reading1", "value1");
+  EXPECT_TRUE(second.hasUnigrams("reading3"));
+  EXPECT_FALSE(second.hasUnigrams("reading1"));
+  second.flush();
+  ASSERT_TRUE(second.reload(source.c_str()));
+  EXPECT_FALSE(second.usesSnapshot());
+  EXPECT_TRUE(second.hasUnigrams("reading3"));
+  EXPECT_FALSE(second.hasUnigrams("reading1"));
+
+  SnapshotUserPhrasesLM third;
+  ASSERT_TRUE(third.open(source.c_str(), snapshotPath));
+  EXPECT_TRUE(third.usesSnapshot());
+  EXPECT_TRUE(third.hasUnigrams("reading3"));
+  EXPECT_FALSE(third.hasUnigrams("reading1"));
+}
+
+TEST(DictionarySnapshotTest, UserPhrasesLMParsesLinesAppendedAfterSnapshot) {
+  TestTempDir dir;
+  auto source = dir.write("data.txt.user", "value1 reading1\nvalue2\n");
+  auto snapshotPath = dir.pathOf("data.txt.user.snapshot");
+  {
+    SnapshotUserPhrasesLM first;
+    ASSERT_TRUE(first.open(source.c_str(), snapshotPath));
+  }
+
+  SnapshotUserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(source.c_str(), snapshotPath));
+  ASSERT_TRUE(lm.usesSnapshot());
+  std::ofstream(source, std::ios::binary | std::ios::app)
+      << "value3 reading1\nvalue4\n";
+  ASSERT_TRUE(lm.reload(source.c_str()));
+
+  EXPECT_TRUE(lm.usesSnapshot());
+  EXPECT_EQ(lm.appendedReloadCount(), 1);
+  EXPECT_FALSE(std::filesystem::exists(snapshotPath));
+  auto unigrams = lm.getUnigrams("reading1");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[0].value(), "value1");
+  EXPECT_EQ(unigrams[1].value(), "value3");
+  auto issues = lm.getParsingIssues();
+  ASSERT_EQ(issues.size(), 2);
+  EXPECT_EQ(issues[0].lineNumber, 2);
+  EXPECT_EQ(issues[1].lineNumber, 4);
+
+  // A phrase from the snapshot and one from the appended lines can both be
+  // removed through the overlay.
+  lm.removePhrase("reading1", "value1");
+  lm.removePhrase("reading1", "value3");
+  EXPECT_FALSE(lm.hasUnigrams("reading1"));
+}
+
+TEST(DictionarySnapshotTest, McBopomofoLMKeepsSnapshotsOfSameNamedFilesApart) {
+  TestTempDir dir;
+  std::filesystem::create_directory(dir.pathOf("a"));
+  std::filesystem::create_directory(dir.pathOf("b"));
+  std::filesystem::create_directory(dir.pathOf("snapshots"));
+  auto userPhrases = dir.write("a/phrases.txt", "value1 reading1\n");
+  auto excludedPhrases = dir.write("b/phrases.txt", "value2 reading2\n");
+
+  McBopomofoLM lm;
+  lm.setSnapshotDirectory(dir.pathOf("snapshots"));
+  lm.loadUserPhrases(userPhrases.c_str(), excludedPhrases.c_str());
+  size_t snapshotCount = 0;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(dir.pathOf("snapshots"))) {
+    EXPECT_EQ(entry.path().extension(), ".snapshot");
+    snapshotCount++;
+  }
+  EXPECT_EQ(snapshotCount, 2);
+
+  McBopomofoLM reloaded;
+  reloaded.setSnapshotDirectory(dir.pathOf("snapshots"));
+  reloaded.loadUserPhrases(userPhrases.c_str(), excludedPhrases.c_str());
+  EXPECT_TRUE(reloaded.hasUnigrams("reading1"));
+}
+
+TEST(DictionarySnapshotTest, PhraseReplacementMapUsesSnapshot) {
+  TestTempDir dir;
+  auto source = dir.write("phrase-replacement.txt", "old new\n");
+  auto snapshotPath = dir.pathOf("phrase-replacement.txt.snapshot");
+
+  PhraseReplacementMap first;
+  ASSERT_TRUE(first.open(source.c_str(), snapshotPath));
+  EXPECT_EQ(first.valueForKey("old"), "new");
+
+  PhraseReplacementMap second;
+  ASSERT_TRUE(second.open(source.c_str(), snapshotPath));
+  EXPECT_EQ(second.valueForKey("old"), "new");
+  EXPECT_EQ(second.valueForKey("new"), "");
+}
+
+}  // namespace McBopomofo
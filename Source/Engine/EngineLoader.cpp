@@ -0,0 +1,154 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "EngineLoader.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace McBopomofo {
+
+static size_t DefaultThreadCount() {
+  size_t cores = std::thread::hardware_concurrency();
+  return std::clamp<size_t>(cores, 1, EngineLoader::kMaximumDefaultThreadCount);
+}
+
+EngineLoader::EngineLoader() : EngineLoader(DefaultThreadCount()) {}
+
+EngineLoader::EngineLoader(size_t threadCount) {
+  threadCount = std::max<size_t>(threadCount, 1);
+  workers_.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; i++) {
+    workers_.emplace_back([this] { runWorker(); });
+  }
+}
+
+EngineLoader::~EngineLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  taskAvailable_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+std::shared_future<bool> EngineLoader::loadLanguageModel(McBopomofoLM* lm,
+                                                         std::string path) {
+  lm->markComponentLoading(McBopomofoLM::Component::LANGUAGE_MODEL);
+  return submit([lm, p = std::move(path)] {
+    lm->loadLanguageModel(p.c_str());
+    return lm->isDataModelLoaded();
+  });
+}
+
+std::shared_future<bool> EngineLoader::loadAssociatedPhrasesV2(
+    McBopomofoLM* lm, std::string path) {
+  lm->markComponentLoading(McBopomofoLM::Component::ASSOCIATED_PHRASES);
+  return submit([lm, p = std::move(path)] {
+    lm->loadAssociatedPhrasesV2(p.c_str());
+    return lm->isAssociatedPhrasesV2Loaded();
+  });
+}
+
+std::shared_future<bool> EngineLoader::loadUserPhrases(
+    McBopomofoLM* lm, std::optional<std::string> userPhrasesPath,
+    std::optional<std::string> excludedPhrasesPath) {
+  lm->markComponentLoading(McBopomofoLM::Component::USER_PHRASES);
+  return submit([lm, up = std::move(userPhrasesPath),
+                 ep = std::move(excludedPhrasesPath)] {
+    lm->loadUserPhrases(up ? up->c_str() : nullptr,
+                        ep ? ep->c_str() : nullptr);
+    return true;
+  });
+}
+
+std::shared_future<bool> EngineLoader::loadPhraseReplacementMap(
+    McBopomofoLM* lm, std::string path) {
+  lm->markComponentLoading(McBopomofoLM::Component::PHRASE_REPLACEMENT_MAP);
+  return submit([lm, p = std::move(path)] {
+    lm->loadPhraseReplacementMap(p.c_str());
+    return true;
+  });
+}
+
+std::shared_future<bool> EngineLoader::loadVariantAnnotator(
+    VariantAnnotator* annotator, std::filesystem::path puaPath,
+    std::filesystem::path variantsPath) {
+  if (annotator->loaded()) {
+    std::promise<bool> promise;
+    promise.set_value(true);
+    return promise.get_future().share();
+  }
+  return submit([annotator, pua = std::move(puaPath),
+                 variants = std::move(variantsPath)] {
+    return annotator->loadDatabaseFiles(pua, variants);
+  });
+}
+
+std::shared_future<bool> EngineLoader::submit(std::function<bool()> task) {
+  std::packaged_task<bool()> packagedTask(std::move(task));
+  std::shared_future<bool> future = packagedTask.get_future().share();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(packagedTask));
+  }
+  taskAvailable_.notify_one();
+  return future;
+}
+
+void EngineLoader::waitForAll() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  allDone_.wait(lock, [this] { return tasks_.empty() && runningTasks_ == 0; });
+}
+
+void EngineLoader::runWorker() {
+  while (true) {
+    std::packaged_task<bool()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      taskAvailable_.wait(lock,
+                          [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        // Only reachable when stopping; pending tasks are always drained.
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+      runningTasks_++;
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      runningTasks_--;
+      if (tasks_.empty() && runningTasks_ == 0) {
+        allDone_.notify_all();
+      }
+    }
+  }
+}
+
+}  // namespace McBopomofo
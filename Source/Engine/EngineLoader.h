@@ -0,0 +1,114 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_ENGINELOADER_H_
+#define SRC_ENGINE_ENGINELOADER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "McBopomofoLM.h"
+#include "VariantAnnotator.h"
+
+namespace McBopomofo {
+
+// Loads engine components concurrently on a small pool of worker threads.
+//
+// Each load* method marks the component as not ready on the calling thread,
+// queues the actual work, and returns a future that becomes ready once the
+// component has finished loading. The value of the future is whether the
+// component was loaded successfully. Meanwhile, lookups on the calling thread
+// keep working against the components that are already ready; see
+// McBopomofoLM::isComponentReady().
+//
+// A component must not be loaded again while a previous load of the same
+// component is still pending. The loader waits for all pending work when it
+// is destroyed, and the objects passed to it must outlive that work.
+class EngineLoader {
+ public:
+  // Uses up to kMaximumDefaultThreadCount threads, fewer if the machine has
+  // fewer cores.
+  EngineLoader();
+  explicit EngineLoader(size_t threadCount);
+  ~EngineLoader();
+
+  EngineLoader(const EngineLoader&) = delete;
+  EngineLoader(EngineLoader&&) = delete;
+  EngineLoader& operator=(const EngineLoader&) = delete;
+  EngineLoader& operator=(EngineLoader&&) = delete;
+
+  static constexpr size_t kMaximumDefaultThreadCount = 4;
+
+  std::shared_future<bool> loadLanguageModel(McBopomofoLM* lm,
+                                             std::string path);
+
+  std::shared_future<bool> loadAssociatedPhrasesV2(McBopomofoLM* lm,
+                                                   std::string path);
+
+  // Same as McBopomofoLM::loadUserPhrases(); a nullopt path is not loaded.
+  std::shared_future<bool> loadUserPhrases(
+      McBopomofoLM* lm, std::optional<std::string> userPhrasesPath,
+      std::optional<std::string> excludedPhrasesPath);
+
+  std::shared_future<bool> loadPhraseReplacementMap(McBopomofoLM* lm,
+                                                    std::string path);
+
+  // Loads both bpmfvs databases with VariantAnnotator::loadDatabaseFiles(),
+  // so the annotator reports loaded() only once both are in place. An
+  // annotator that is already loaded is left as is.
+  std::shared_future<bool> loadVariantAnnotator(
+      VariantAnnotator* annotator, std::filesystem::path puaPath,
+      std::filesystem::path variantsPath);
+
+  // Queues an arbitrary task.
+  std::shared_future<bool> submit(std::function<bool()> task);
+
+  // Blocks until every task submitted so far has finished.
+  void waitForAll();
+
+  size_t threadCount() const { return workers_.size(); }
+
+ private:
+  void runWorker();
+
+  std::mutex mutex_;
+  std::condition_variable taskAvailable_;
+  std::condition_variable allDone_;
+  std::deque<std::packaged_task<bool()>> tasks_;
+  size_t runningTasks_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_ENGINELOADER_H_
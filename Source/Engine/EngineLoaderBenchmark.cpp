@@ -0,0 +1,177 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "EngineLoader.h"
+#include "TestTempDir.h"
+
+namespace {
+
+using EngineLoader = McBopomofo::EngineLoader;
+using McBopomofoLM = McBopomofo::McBopomofoLM;
+
+// The "first keystroke" looks up a reading in the primary language model.
+static const char* kFirstKeystrokeKey = "k0000042";
+
+// Synthetic data files, sized after the real data and a heavy user's files.
+class BootstrapData {
+ public:
+  BootstrapData() {
+    char buf[64];
+    std::ofstream lm(lmPath());
+    lm << "# format org.openvanilla.mcbopomofo.sorted\n";
+    for (int i = 0; i < 200000; i++) {
+      snprintf(buf, sizeof(buf), "k%07d v%d -%d.5\n", i, i, i % 10);
+      lm << buf;
+    }
+
+    std::ofstream ap(associatedPhrasesPath());
+    ap << "# format org.openvanilla.mcbopomofo.sorted\n";
+    for (int i = 0; i < 200000; i++) {
+      snprintf(buf, sizeof(buf), "p%07d-r-q-s -%d.5\n", i, i % 10);
+      ap << buf;
+    }
+
+    std::ofstream up(userPhrasesPath());
+    for (int i = 0; i < 50000; i++) {
+      snprintf(buf, sizeof(buf), "u%d k%07d\n", i, i);
+      up << buf;
+    }
+
+    std::ofstream ep(excludedPhrasesPath());
+    for (int i = 0; i < 10000; i++) {
+      snprintf(buf, sizeof(buf), "v%d k%07d\n", i * 7, i * 7);
+      ep << buf;
+    }
+
+    std::ofstream pr(phraseReplacementPath());
+    for (int i = 0; i < 10000; i++) {
+      snprintf(buf, sizeof(buf), "v%d w%d\n", i * 3, i * 3);
+      pr << buf;
+    }
+  }
+
+  std::string lmPath() const { return dir_.pathOf("data.txt"); }
+  std::string associatedPhrasesPath() const {
+    return dir_.pathOf("associated-phrases-v2.txt");
+  }
+  std::string userPhrasesPath() const {
+    return dir_.pathOf("data.txt.user");
+  }
+  std::string excludedPhrasesPath() const {
+    return dir_.pathOf("exclude-phrases.txt");
+  }
+  std::string phraseReplacementPath() const {
+    return dir_.pathOf("phrase-replacement.txt");
+  }
+
+ private:
+  McBopomofo::TestTempDir dir_;
+};
+
+const BootstrapData& GetBootstrapData() {
+  static const BootstrapData data;
+  return data;
+}
+
+// The current behavior: every component is loaded before the first lookup.
+static void BM_SequentialBootstrapTimeToFirstKeystroke(
+    benchmark::State& state) {
+  const BootstrapData& data = GetBootstrapData();
+  for (auto _ : state) {
+    McBopomofoLM lm;
+    lm.loadLanguageModel(data.lmPath().c_str());
+    lm.loadAssociatedPhrasesV2(data.associatedPhrasesPath().c_str());
+    lm.loadUserPhrases(data.userPhrasesPath().c_str(),
+                       data.excludedPhrasesPath().c_str());
+    lm.loadPhraseReplacementMap(data.phraseReplacementPath().c_str());
+    auto unigrams = lm.getUnigrams(kFirstKeystrokeKey);
+    if (unigrams.empty()) {
+      state.SkipWithError("no unigrams for the first keystroke");
+      break;
+    }
+    benchmark::DoNotOptimize(unigrams);
+  }
+}
+BENCHMARK(BM_SequentialBootstrapTimeToFirstKeystroke)
+    ->Unit(benchmark::kMillisecond);
+
+// All components are loaded concurrently; the first lookup only waits for the
+// primary language model.
+static void BM_ParallelBootstrapTimeToFirstKeystroke(benchmark::State& state) {
+  const BootstrapData& data = GetBootstrapData();
+  for (auto _ : state) {
+    McBopomofoLM lm;
+    EngineLoader loader;
+    auto lmLoaded = loader.loadLanguageModel(&lm, data.lmPath());
+    loader.loadUserPhrases(&lm, data.userPhrasesPath(),
+                           data.excludedPhrasesPath());
+    loader.loadAssociatedPhrasesV2(&lm, data.associatedPhrasesPath());
+    loader.loadPhraseReplacementMap(&lm, data.phraseReplacementPath());
+    lmLoaded.wait();
+    auto unigrams = lm.getUnigrams(kFirstKeystrokeKey);
+    if (unigrams.empty()) {
+      state.SkipWithError("no unigrams for the first keystroke");
+      break;
+    }
+    benchmark::DoNotOptimize(unigrams);
+
+    state.PauseTiming();
+    loader.waitForAll();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_ParallelBootstrapTimeToFirstKeystroke)
+    ->Unit(benchmark::kMillisecond);
+
+// The time until every component is ready, loaded concurrently.
+static void BM_ParallelBootstrapAllComponents(benchmark::State& state) {
+  const BootstrapData& data = GetBootstrapData();
+  for (auto _ : state) {
+    McBopomofoLM lm;
+    EngineLoader loader;
+    loader.loadLanguageModel(&lm, data.lmPath());
+    loader.loadUserPhrases(&lm, data.userPhrasesPath(),
+                           data.excludedPhrasesPath());
+    loader.loadAssociatedPhrasesV2(&lm, data.associatedPhrasesPath());
+    loader.loadPhraseReplacementMap(&lm, data.phraseReplacementPath());
+    loader.waitForAll();
+    auto unigrams = lm.getUnigrams(kFirstKeystrokeKey);
+    if (unigrams.empty()) {
+      state.SkipWithError("no unigrams for the first keystroke");
+      break;
+    }
+    benchmark::DoNotOptimize(unigrams);
+  }
+}
+BENCHMARK(BM_ParallelBootstrapAllComponents)->Unit(benchmark::kMillisecond);
+
+};  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,168 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <future>
+#include <memory>
+#include <string>
+
+#include "EngineLoader.h"
+#include "TestTempDir.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+
+constexpr char kLMData[] =
+    "# format org.openvanilla.mcbopomofo.sorted\n"
+    "ㄇㄧㄥˊ 明 -3.07936356\n"
+    "ㄇㄧㄥˊ 名 -3.12166252\n"
+    "ㄇㄧㄥˊ-ㄘˊ 名詞 -4.61364867\n";
+
+constexpr char kAssociatedPhrasesData[] =
+    "# format org.openvanilla.mcbopomofo.sorted\n"
+    "名-ㄇㄧㄥˊ-下-ㄒㄧㄚˋ -5.7106\n";
+
+constexpr char kUserPhrasesData[] = "茗 ㄇㄧㄥˊ\n";
+
+constexpr char kExcludedPhrasesData[] = "明 ㄇㄧㄥˊ\n";
+
+constexpr char kPhraseReplacementData[] = "名 铭\n";
+
+constexpr char kVariantsData[] =
+    "# format org.openvanilla.mcbopomofo.sorted\n"
+    "個-ㄍㄜˋ 個\n";
+
+constexpr char kPUAData[] =
+    "# format org.openvanilla.mcbopomofo.sorted\n"
+    "ㄍㄚˋ \uF145\n";
+
+}  // namespace
+
+TEST(EngineLoaderTest, LoadsAllComponents) {
+  TestTempDir dir;
+  McBopomofoLM lm;
+  VariantAnnotator annotator;
+
+  EngineLoader loader(2);
+  auto lmLoaded = loader.loadLanguageModel(&lm, dir.write("lm", kLMData));
+  auto apLoaded = loader.loadAssociatedPhrasesV2(
+      &lm, dir.write("ap", kAssociatedPhrasesData));
+  auto upLoaded =
+      loader.loadUserPhrases(&lm, dir.write("up", kUserPhrasesData),
+                             dir.write("ep", kExcludedPhrasesData));
+  auto prLoaded = loader.loadPhraseReplacementMap(
+      &lm, dir.write("pr", kPhraseReplacementData));
+  auto vaLoaded = loader.loadVariantAnnotator(
+      &annotator, dir.write("pua", kPUAData), dir.write("va", kVariantsData));
+  loader.waitForAll();
+
+  EXPECT_TRUE(lmLoaded.get());
+  EXPECT_TRUE(apLoaded.get());
+  EXPECT_TRUE(upLoaded.get());
+  EXPECT_TRUE(prLoaded.get());
+  EXPECT_TRUE(vaLoaded.get());
+
+  EXPECT_TRUE(lm.isComponentReady(McBopomofoLM::Component::LANGUAGE_MODEL));
+  EXPECT_TRUE(
+      lm.isComponentReady(McBopomofoLM::Component::ASSOCIATED_PHRASES));
+  EXPECT_TRUE(lm.isComponentReady(McBopomofoLM::Component::USER_PHRASES));
+  EXPECT_TRUE(
+      lm.isComponentReady(McBopomofoLM::Component::PHRASE_REPLACEMENT_MAP));
+  EXPECT_TRUE(lm.isDataModelLoaded());
+  EXPECT_TRUE(lm.isAssociatedPhrasesV2Loaded());
+  EXPECT_TRUE(annotator.loaded());
+
+  lm.setPhraseReplacementEnabled(true);
+  auto unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[0].value(), "茗");
+  EXPECT_EQ(unigrams[1].value(), "铭");
+  EXPECT_FALSE(lm.findAssociatedPhrasesV2("名", {"ㄇㄧㄥˊ"}).empty());
+  EXPECT_EQ(annotator.annotateSingleCharacter("個", "ㄍㄜˋ").annotatedString,
+            "個");
+}
+
+TEST(EngineLoaderTest, LookupsUseReadyComponentsWhileOthersLoad) {
+  TestTempDir dir;
+  McBopomofoLM lm;
+  lm.loadLanguageModel(dir.write("lm", kLMData).c_str());
+  ASSERT_TRUE(lm.isDataModelLoaded());
+
+  // With a single worker, blocking it holds back the user phrases.
+  EngineLoader loader(1);
+  std::promise<void> gate;
+  std::shared_future<void> gateOpened = gate.get_future().share();
+  loader.submit([gateOpened] {
+    gateOpened.wait();
+    return true;
+  });
+  auto upLoaded = loader.loadUserPhrases(
+      &lm, dir.write("up", kUserPhrasesData), std::nullopt);
+
+  EXPECT_FALSE(lm.isComponentReady(McBopomofoLM::Component::USER_PHRASES));
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ"));
+  auto unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[0].value(), "明");
+
+  gate.set_value();
+  EXPECT_TRUE(upLoaded.get());
+  EXPECT_TRUE(lm.isComponentReady(McBopomofoLM::Component::USER_PHRASES));
+  unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_EQ(unigrams.size(), 3);
+  EXPECT_EQ(unigrams[0].value(), "茗");
+}
+
+TEST(EngineLoaderTest, FailedLoadsAreReported) {
+  TestTempDir dir;
+  McBopomofoLM lm;
+  VariantAnnotator annotator;
+
+  EngineLoader loader;
+  auto lmLoaded = loader.loadLanguageModel(&lm, dir.pathOf("missing"));
+  auto vaLoaded = loader.loadVariantAnnotator(
+      &annotator, dir.write("pua", kPUAData), dir.pathOf("missing"));
+
+  EXPECT_FALSE(lmLoaded.get());
+  EXPECT_FALSE(vaLoaded.get());
+  EXPECT_TRUE(lm.isComponentReady(McBopomofoLM::Component::LANGUAGE_MODEL));
+  EXPECT_FALSE(lm.isDataModelLoaded());
+  EXPECT_FALSE(lm.hasUnigrams("ㄇㄧㄥˊ"));
+  EXPECT_FALSE(annotator.loaded());
+}
+
+TEST(EngineLoaderTest, WaitForAllRunsEveryTask) {
+  std::atomic<int> counter = 0;
+  EngineLoader loader(3);
+  for (int i = 0; i < 100; i++) {
+    loader.submit([&counter] {
+      counter++;
+      return true;
+    });
+  }
+  loader.waitForAll();
+  EXPECT_EQ(counter.load(), 100);
+}
+
+}  // namespace McBopomofo
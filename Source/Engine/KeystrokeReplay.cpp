@@ -0,0 +1,575 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "KeystrokeReplay.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <utility>
+
+#include "Trace.h"
+#include "UTF8Helper.h"
+
+namespace McBopomofo {
+
+using Formosa::Gramambular2::ReadingGrid;
+using Formosa::Mandarin::BopomofoKeyboardLayout;
+using Formosa::Mandarin::BopomofoReadingBuffer;
+
+namespace {
+
+// Same as LanguageModelManager.mm.
+constexpr size_t kUserOverrideModelCapacity = 500;
+constexpr double kObservedOverrideHalflife = 5400.0;
+
+// KeyHandler.mm only lets the user override model observe a selection whose
+// node then scores above this.
+constexpr double kObservationScoreThreshold = -8;
+
+// Where the simulated clock starts, in seconds since the epoch.
+constexpr double kStartTime = 1000000000.0;
+
+std::string_view TrimWhitespace(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t' ||
+                        s.back() == '\r')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+}  // namespace
+
+const char* KeystrokeReplay::StageName(Stage stage) {
+  switch (stage) {
+    case kReadingBuffer:
+      return "reading_buffer";
+    case kHasUnigrams:
+      return "has_unigrams";
+    case kGrid:
+      return "grid";
+    case kWalk:
+      return "walk";
+    case kSuggest:
+      return "suggest";
+    case kCandidates:
+      return "candidates";
+    case kObserve:
+      return "observe";
+    case kAnnotate:
+      return "annotate";
+    case kCompose:
+      return "compose";
+    case kStageCount:
+      break;
+  }
+  return "";
+}
+
+const BopomofoKeyboardLayout* KeystrokeReplay::LayoutNamed(
+    std::string_view name) {
+  if (name == "standard") {
+    return BopomofoKeyboardLayout::StandardLayout();
+  }
+  if (name == "eten") {
+    return BopomofoKeyboardLayout::ETenLayout();
+  }
+  if (name == "hsu") {
+    return BopomofoKeyboardLayout::HsuLayout();
+  }
+  if (name == "eten26") {
+    return BopomofoKeyboardLayout::ETen26Layout();
+  }
+  if (name == "ibm") {
+    return BopomofoKeyboardLayout::IBMLayout();
+  }
+  if (name == "hanyupinyin") {
+    return BopomofoKeyboardLayout::HanyuPinyinLayout();
+  }
+  return nullptr;
+}
+
+KeystrokeReplay::Summary KeystrokeReplay::Summarize(
+    std::vector<double> samples) {
+  Summary summary;
+  summary.count = samples.size();
+  if (samples.empty()) {
+    return summary;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&samples](double p) {
+    size_t rank = static_cast<size_t>(
+        std::ceil(p * static_cast<double>(samples.size())));
+    return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+  };
+  double sum = 0;
+  for (double sample : samples) {
+    sum += sample;
+  }
+  summary.mean = sum / static_cast<double>(samples.size());
+  summary.p50 = percentile(0.5);
+  summary.p99 = percentile(0.99);
+  summary.p999 = percentile(0.999);
+  summary.max = samples.back();
+  return summary;
+}
+
+bool KeystrokeReplay::ParseLog(std::string_view log,
+                               std::vector<Event>* events,
+                               std::string* error) {
+  static constexpr std::pair<std::string_view, Event::Type> kNamedKeys[] = {
+      {"enter", Event::Type::kEnter},   {"backspace", Event::Type::kBackspace},
+      {"delete", Event::Type::kDelete}, {"left", Event::Type::kLeft},
+      {"right", Event::Type::kRight},   {"home", Event::Type::kHome},
+      {"end", Event::Type::kEnd},       {"esc", Event::Type::kEsc},
+  };
+  static constexpr std::string_view kKeysCommand = "keys ";
+
+  while (!log.empty()) {
+    size_t lineEnd = log.find('\n');
+    std::string_view rawLine = log.substr(0, lineEnd);
+    log.remove_prefix(lineEnd == std::string_view::npos ? log.size()
+                                                         : lineEnd + 1);
+
+    // The keys are taken verbatim, since a space may be a key.
+    if (rawLine.starts_with(kKeysCommand)) {
+      std::string_view keys = rawLine.substr(kKeysCommand.size());
+      if (!keys.empty() && keys.back() == '\r') {
+        keys.remove_suffix(1);
+      }
+      for (char key : keys) {
+        Event event;
+        event.type = Event::Type::kKey;
+        event.key = key;
+        events->push_back(event);
+      }
+      continue;
+    }
+
+    std::string_view line = TrimWhitespace(rawLine);
+    if (line.empty() || line.front() == '#') {
+      continue;
+    }
+
+    size_t space = line.find(' ');
+    std::string_view command = line.substr(0, space);
+    std::string_view argument =
+        space == std::string_view::npos
+            ? std::string_view()
+            : TrimWhitespace(line.substr(space + 1));
+
+    Event event;
+    if (command == "space" && argument.empty()) {
+      event.type = Event::Type::kKey;
+      event.key = ' ';
+      events->push_back(event);
+      continue;
+    }
+    if (command == "layout") {
+      event.type = Event::Type::kLayout;
+      event.layout = LayoutNamed(argument);
+      if (event.layout != nullptr) {
+        events->push_back(event);
+        continue;
+      }
+    } else if (command == "select") {
+      event.type = Event::Type::kSelect;
+      const char* end = argument.data() + argument.size();
+      auto [ptr, ec] =
+          std::from_chars(argument.data(), end, event.candidateIndex);
+      if (!argument.empty() && ec == std::errc() && ptr == end) {
+        events->push_back(event);
+        continue;
+      }
+    } else if (argument.empty()) {
+      auto it = std::find_if(
+          std::begin(kNamedKeys), std::end(kNamedKeys),
+          [command](const auto& named) { return named.first == command; });
+      if (it != std::end(kNamedKeys)) {
+        event.type = it->second;
+        events->push_back(event);
+        continue;
+      }
+    }
+
+    if (error != nullptr) {
+      *error = std::string(rawLine);
+    }
+    return false;
+  }
+  return true;
+}
+
+KeystrokeReplay::StageTimer::~StageTimer() {
+  double elapsed =
+      std::chrono::duration<double, std::micro>(Clock::now() - start_).count();
+  double& stage = timing_->stages[stage_];
+  stage = std::max(stage, 0.0) + elapsed;
+}
+
+KeystrokeReplay::KeystrokeReplay(std::shared_ptr<McBopomofoLM> lm,
+                                 const VariantAnnotator* annotator)
+    : lm_(std::move(lm)),
+      readingBuffer_(BopomofoKeyboardLayout::StandardLayout()),
+      grid_(lm_),
+      userOverrideModel_(kUserOverrideModelCapacity,
+                         kObservedOverrideHalflife),
+      annotate_(annotator != nullptr && annotator->loaded()),
+      variantAnnotator_(annotator),
+      now_(kStartTime) {
+  grid_.setReadingSeparator("-");
+}
+
+KeystrokeReplay::Timing KeystrokeReplay::handle(const Event& event) {
+  Timing timing;
+  timing.stages.fill(-1);
+
+  if (event.type == Event::Type::kLayout) {
+    // A new buffer, since switching a buffer away from Hanyu Pinyin keeps it
+    // in the Pinyin mode.
+    readingBuffer_ = BopomofoReadingBuffer(event.layout);
+    return timing;
+  }
+
+  MCBOPOMOFO_TRACE_SCOPE("KeystrokeReplay::handle");
+  Clock::time_point start = Clock::now();
+  if (event.type == Event::Type::kSelect) {
+    handleSelect(event.candidateIndex, &timing);
+  } else {
+    choosingCandidate_ = false;
+    switch (event.type) {
+      case Event::Type::kKey:
+        handleKey(event.key, &timing);
+        break;
+      case Event::Type::kEnter:
+        handleKey('\r', &timing);
+        break;
+      case Event::Type::kBackspace:
+        handleBackspace(&timing);
+        break;
+      case Event::Type::kDelete:
+        if (readingBuffer_.isEmpty() && grid_.cursor() != grid_.length()) {
+          {
+            StageTimer t(&timing, kGrid);
+            grid_.deleteReadingAfterCursor();
+          }
+          walk(&timing);
+          buildComposedString(&timing);
+        }
+        break;
+      case Event::Type::kLeft:
+        if (readingBuffer_.isEmpty() && grid_.cursor() > 0) {
+          {
+            StageTimer t(&timing, kGrid);
+            grid_.setCursor(grid_.cursor() - 1);
+          }
+          buildComposedString(&timing);
+        }
+        break;
+      case Event::Type::kRight:
+        if (readingBuffer_.isEmpty() && grid_.cursor() < grid_.length()) {
+          {
+            StageTimer t(&timing, kGrid);
+            grid_.setCursor(grid_.cursor() + 1);
+          }
+          buildComposedString(&timing);
+        }
+        break;
+      case Event::Type::kHome:
+        if (readingBuffer_.isEmpty() && grid_.cursor() > 0) {
+          {
+            StageTimer t(&timing, kGrid);
+            grid_.setCursor(0);
+          }
+          buildComposedString(&timing);
+        }
+        break;
+      case Event::Type::kEnd:
+        if (readingBuffer_.isEmpty() && grid_.cursor() < grid_.length()) {
+          {
+            StageTimer t(&timing, kGrid);
+            grid_.setCursor(grid_.length());
+          }
+          buildComposedString(&timing);
+        }
+        break;
+      case Event::Type::kEsc:
+        // Esc clears only the reading by default.
+        if (!readingBuffer_.isEmpty()) {
+          {
+            StageTimer t(&timing, kReadingBuffer);
+            readingBuffer_.clear();
+          }
+          buildComposedString(&timing);
+        }
+        break;
+      case Event::Type::kLayout:
+      case Event::Type::kSelect:
+        break;
+    }
+  }
+  timing.total =
+      std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  now_ += kSecondsPerKeystroke;
+  return timing;
+}
+
+void KeystrokeReplay::replay(const std::vector<Event>& events,
+                             std::vector<Timing>* timings) {
+  for (const Event& event : events) {
+    Timing timing = handle(event);
+    if (event.type != Event::Type::kLayout) {
+      timings->push_back(timing);
+    }
+  }
+}
+
+void KeystrokeReplay::handleKey(char key, Timing* timing) {
+  bool isValidKey = false;
+  bool composeReading = false;
+  std::string reading;
+  {
+    StageTimer t(timing, kReadingBuffer);
+    isValidKey = readingBuffer_.isValidKey(key);
+    if (isValidKey) {
+      readingBuffer_.combineKey(key);
+    }
+    composeReading = isValidKey && readingBuffer_.hasToneMarker() &&
+                     !readingBuffer_.hasToneMarkerOnly();
+    composeReading |= !readingBuffer_.isEmpty() && (key == ' ' || key == '\r');
+    if (composeReading) {
+      reading = readingBuffer_.syllable().composedString();
+    }
+  }
+
+  if (!composeReading) {
+    if (isValidKey) {
+      buildComposedString(timing);
+    } else if (readingBuffer_.isEmpty() && grid_.length() > 0) {
+      if (key == ' ') {
+        openCandidates(timing);
+      } else if (key == '\r') {
+        commit();
+      }
+    }
+    return;
+  }
+
+  bool hasUnigrams = false;
+  {
+    StageTimer t(timing, kHasUnigrams);
+    hasUnigrams = lm_->hasUnigrams(reading);
+  }
+  if (!hasUnigrams) {
+    readingBuffer_.clear();
+    buildComposedString(timing);
+    return;
+  }
+
+  {
+    StageTimer t(timing, kGrid);
+    grid_.insertReading(reading);
+  }
+  walk(timing);
+
+  UserOverrideModel::Suggestion suggestion;
+  {
+    StageTimer t(timing, kSuggest);
+    suggestion = userOverrideModel_.suggest(
+        latestWalk_, actualCandidateCursorIndex(), now_);
+  }
+  if (!suggestion.empty()) {
+    {
+      StageTimer t(timing, kGrid);
+      ReadingGrid::Node::OverrideType type =
+          suggestion.forceHighScoreOverride
+              ? ReadingGrid::Node::OverrideType::kOverrideValueWithHighScore
+              : ReadingGrid::Node::OverrideType::
+                    kOverrideValueWithScoreFromTopUnigram;
+      grid_.overrideCandidate(actualCandidateCursorIndex(),
+                              suggestion.candidate, type);
+    }
+    walk(timing);
+  }
+
+  readingBuffer_.clear();
+  buildComposedString(timing);
+}
+
+void KeystrokeReplay::handleBackspace(Timing* timing) {
+  if (readingBuffer_.isEmpty() && grid_.length() == 0) {
+    return;
+  }
+
+  if (readingBuffer_.hasToneMarkerOnly()) {
+    StageTimer t(timing, kReadingBuffer);
+    readingBuffer_.clear();
+  } else if (readingBuffer_.isEmpty()) {
+    if (grid_.cursor() == 0) {
+      return;
+    }
+    {
+      StageTimer t(timing, kGrid);
+      grid_.deleteReadingBeforeCursor();
+    }
+    walk(timing);
+  } else {
+    StageTimer t(timing, kReadingBuffer);
+    readingBuffer_.backspace();
+  }
+  buildComposedString(timing);
+}
+
+void KeystrokeReplay::openCandidates(Timing* timing) {
+  buildComposedString(timing);
+  StageTimer t(timing, kCandidates);
+  candidates_ = grid_.candidatesAt(actualCandidateCursorIndex());
+  choosingCandidate_ = true;
+}
+
+void KeystrokeReplay::handleSelect(size_t index, Timing* timing) {
+  if (!choosingCandidate_) {
+    if (!readingBuffer_.isEmpty() || grid_.length() == 0) {
+      return;
+    }
+    openCandidates(timing);
+  }
+  choosingCandidate_ = false;
+  if (index >= candidates_.size()) {
+    return;
+  }
+
+  // Same as fixNodeWithReading in KeyHandler.mm, which leaves the cursor
+  // where it was by default.
+  size_t originalCursor = grid_.cursor();
+  size_t actualCursor = actualCandidateCursorIndex();
+  {
+    StageTimer t(timing, kGrid);
+    if (!grid_.overrideCandidate(actualCursor, candidates_[index])) {
+      return;
+    }
+  }
+
+  ReadingGrid::WalkResult prevWalk = latestWalk_;
+  walk(timing);
+  {
+    StageTimer t(timing, kObserve);
+    auto nodeIter = latestWalk_.findNodeAt(actualCursor);
+    if (nodeIter != latestWalk_.nodes.cend() && *nodeIter != nullptr &&
+        (*nodeIter)->currentUnigram().score() > kObservationScoreThreshold) {
+      userOverrideModel_.observe(prevWalk, latestWalk_, actualCursor, now_);
+    }
+  }
+  {
+    StageTimer t(timing, kGrid);
+    grid_.setCursor(originalCursor);
+  }
+  buildComposedString(timing);
+}
+
+void KeystrokeReplay::walk(Timing* timing) {
+  StageTimer t(timing, kWalk);
+  latestWalk_ = grid_.walk();
+}
+
+void KeystrokeReplay::commit() {
+  committed_ += composed_;
+  clear();
+}
+
+void KeystrokeReplay::clear() {
+  readingBuffer_.clear();
+  grid_.clear();
+  latestWalk_ = ReadingGrid::WalkResult{};
+  composed_.clear();
+  composedCursor_ = 0;
+}
+
+void KeystrokeReplay::buildComposedString(Timing* timing) {
+  if (readingBuffer_.isEmpty() && grid_.length() == 0) {
+    composed_.clear();
+    composedCursor_ = 0;
+    return;
+  }
+
+  const std::vector<const VariantAnnotator::CombinedResult*>* annotations =
+      nullptr;
+  if (annotate_) {
+    StageTimer t(timing, kAnnotate);
+    annotations = &variantAnnotator_.annotate(latestWalk_);
+  }
+
+  // Same as buildInputtingState in KeyHandler.mm, less the tooltips.
+  StageTimer t(timing, kCompose);
+  size_t runningCursor = 0;
+  size_t builderCursor = grid_.cursor();
+  std::string composed;
+  size_t composedCursor = 0;
+  for (size_t i = 0, count = latestWalk_.nodes.size(); i < count; ++i) {
+    const auto& node = latestWalk_.nodes[i];
+    const std::string& value = node->value();
+    const VariantAnnotator::CombinedResult* annotation =
+        annotations != nullptr ? (*annotations)[i] : nullptr;
+    size_t composedValueLength = value.length();
+    if (annotation == nullptr) {
+      composed += value;
+    } else {
+      composed += annotation->annotatedString;
+      composedValueLength = annotation->annotatedString.length();
+    }
+
+    if (runningCursor == builderCursor) {
+      continue;
+    }
+    size_t readingLength = node->spanningLength();
+    if (runningCursor + readingLength <= builderCursor) {
+      composedCursor += composedValueLength;
+      runningCursor += readingLength;
+      continue;
+    }
+
+    size_t distance = builderCursor - runningCursor;
+    size_t cpLen = std::min(distance, CodePointCount(value));
+    composedCursor += annotation != nullptr
+                          ? annotation->accumulatedStringLength[cpLen]
+                          : CodePointPrefix(value, cpLen).length();
+    runningCursor += distance;
+  }
+
+  std::string reading = readingBuffer_.composedString();
+  composed_.assign(composed, 0, composedCursor);
+  composed_ += reading;
+  composed_.append(composed, composedCursor);
+  composedCursor_ = composedCursor + reading.length();
+}
+
+size_t KeystrokeReplay::actualCandidateCursorIndex() const {
+  // selectPhraseAfterCursorAsCandidate is off by default.
+  size_t cursor = grid_.cursor();
+  return cursor > 0 ? cursor - 1 : cursor;
+}
+
+}  // namespace McBopomofo
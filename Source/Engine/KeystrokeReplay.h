@@ -0,0 +1,205 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_KEYSTROKEREPLAY_H_
+#define SRC_ENGINE_KEYSTROKEREPLAY_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "McBopomofoLM.h"
+#include "Mandarin/Mandarin.h"
+#include "UserOverrideModel.h"
+#include "VariantAnnotator.h"
+#include "gramambular2/reading_grid.h"
+
+namespace McBopomofo {
+
+// Replays key logs through the engine the way KeyHandler.mm drives it in the
+// Bopomofo input mode with the default preferences, and times every
+// keystroke and the stages it goes through. This measures what a user waits
+// for between pressing a key and seeing the composing buffer, without the
+// input method and the UI.
+//
+// A key log is a text file of one command per line:
+//
+//   # A comment. Blank lines are ignored too.
+//   layout standard   Switches the layout: standard, eten, hsu, eten26, ibm
+//                     or hanyupinyin. Not a keystroke.
+//   keys su3cl3       Types each character after "keys " as one keystroke,
+//                     spaces included.
+//   space             The named keys: space, enter, backspace, delete, left,
+//   enter             right, home, end and esc.
+//   select 2          Picks the candidate at the index from the candidate
+//                     list, which a space opens when the reading buffer is
+//                     empty. Opens the list first if it is not open.
+//
+// Not replayed: associated phrases, changing the tone of the prior reading,
+// punctuation, and anything behind a non-default preference. Bopomofo
+// annotation runs whenever the annotator is loaded. The user override model
+// sees a simulated clock that advances a fixed step per keystroke, so that a
+// replay is deterministic. Not thread-safe.
+class KeystrokeReplay {
+ public:
+  enum Stage : size_t {
+    kReadingBuffer,  // BopomofoReadingBuffer
+    kHasUnigrams,    // Checking the composed reading against the model.
+    kGrid,           // Inserting, deleting, overriding, moving the cursor.
+    kWalk,
+    kSuggest,  // UserOverrideModel::suggest()
+    kCandidates,
+    kObserve,   // UserOverrideModel::observe()
+    kAnnotate,  // IncrementalVariantAnnotator
+    kCompose,   // Building the composed string and its cursor.
+    kStageCount
+  };
+
+  static const char* StageName(Stage stage);
+
+  struct Event {
+    enum class Type {
+      kLayout,
+      kKey,
+      kEnter,
+      kBackspace,
+      kDelete,
+      kLeft,
+      kRight,
+      kHome,
+      kEnd,
+      kEsc,
+      kSelect,
+    };
+    Type type = Type::kKey;
+    char key = 0;
+    size_t candidateIndex = 0;
+    const Formosa::Mandarin::BopomofoKeyboardLayout* layout = nullptr;
+  };
+
+  // Appends the events of the log. Returns false, with the offending line in
+  // error, if the log has a malformed line.
+  static bool ParseLog(std::string_view log, std::vector<Event>* events,
+                       std::string* error);
+
+  // Returns the layout with the name used in key logs, or nullptr.
+  static const Formosa::Mandarin::BopomofoKeyboardLayout* LayoutNamed(
+      std::string_view name);
+
+  // The distribution of keystroke times. The percentiles are nearest-rank:
+  // the smallest sample that is at least as large as p of all samples.
+  struct Summary {
+    size_t count = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double max = 0;
+  };
+
+  // Summarizes the samples. All fields are zero if there are no samples.
+  static Summary Summarize(std::vector<double> samples);
+
+  // The time a keystroke took in total and in each stage, in microseconds. A
+  // stage that the keystroke did not go through has a negative time.
+  struct Timing {
+    double total = 0;
+    std::array<double, kStageCount> stages;
+  };
+
+  // The annotator, if given, must outlive the replay.
+  KeystrokeReplay(std::shared_ptr<McBopomofoLM> lm,
+                  const VariantAnnotator* annotator);
+
+  // Handles the event and returns its timing. A layout event is not a
+  // keystroke and takes no time.
+  Timing handle(const Event& event);
+
+  // Handles the events in order and appends the timings of the keystrokes.
+  void replay(const std::vector<Event>& events, std::vector<Timing>* timings);
+
+  // The composing buffer after the last keystroke, with the reading being
+  // typed at the cursor, and the UTF-8 cursor in it.
+  [[nodiscard]] const std::string& composedString() const { return composed_; }
+  [[nodiscard]] size_t composedCursor() const { return composedCursor_; }
+
+  // Everything committed with enter so far.
+  [[nodiscard]] const std::string& committedString() const {
+    return committed_;
+  }
+
+  // The seconds the simulated clock advances per keystroke.
+  static constexpr double kSecondsPerKeystroke = 0.25;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // Adds the time from its construction to its destruction to a stage.
+  class StageTimer {
+   public:
+    StageTimer(Timing* timing, Stage stage)
+        : timing_(timing), stage_(stage), start_(Clock::now()) {}
+    ~StageTimer();
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+   private:
+    Timing* timing_;
+    Stage stage_;
+    Clock::time_point start_;
+  };
+
+  void handleKey(char key, Timing* timing);
+  void handleBackspace(Timing* timing);
+  void handleSelect(size_t index, Timing* timing);
+  void openCandidates(Timing* timing);
+  void walk(Timing* timing);
+  void commit();
+  void clear();
+  void buildComposedString(Timing* timing);
+  [[nodiscard]] size_t actualCandidateCursorIndex() const;
+
+  std::shared_ptr<McBopomofoLM> lm_;
+  Formosa::Mandarin::BopomofoReadingBuffer readingBuffer_;
+  Formosa::Gramambular2::ReadingGrid grid_;
+  Formosa::Gramambular2::ReadingGrid::WalkResult latestWalk_;
+  UserOverrideModel userOverrideModel_;
+  bool annotate_;
+  IncrementalVariantAnnotator variantAnnotator_;
+
+  bool choosingCandidate_ = false;
+  std::vector<Formosa::Gramambular2::ReadingGrid::Candidate> candidates_;
+  double now_ = 0;
+
+  std::string composed_;
+  size_t composedCursor_ = 0;
+  std::string committed_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_KEYSTROKEREPLAY_H_
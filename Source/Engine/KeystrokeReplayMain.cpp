@@ -0,0 +1,375 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Replays key logs through the engine and prints the keystroke latencies as
+// JSON. See KeystrokeReplay.h for the key log format.
+//
+// Usage: KeystrokeReplay [options] [key log ...]
+//
+//   --data=PATH       The data.txt to load. Defaults to $DATA_TXT_PATH, or
+//                     data.txt in the current directory.
+//   --bpmfvs-table=PATH
+//                     A bpmfvs-table.bin to annotate the composed strings with.
+//   --bpmfvs-pua=PATH --bpmfvs-variants=PATH
+//                     Or the bpmfvs-pua.txt and bpmfvs-variants.txt.
+//   --synthetic=N     Replays a synthetic key log of about N keystrokes when no
+//                     key log is given. Defaults to 20000.
+//   --layout=NAME     The layout of the synthetic key log. Defaults to
+//                     standard.
+//   --seed=N          The seed of the synthetic key log.
+//   --dump-log        Prints the synthetic key log instead of replaying it.
+//   --trace=PATH      Writes the trace of the replay to PATH in the Chrome
+//                     trace event format. Needs a build with ENABLE_TRACING.
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "KeystrokeReplay.h"
+#include "Mandarin/Mandarin.h"
+#include "McBopomofoLM.h"
+#include "Trace.h"
+#include "VariantAnnotator.h"
+#include "gramambular2/reading_grid.h"
+
+namespace {
+
+using Formosa::Mandarin::BopomofoKeyboardLayout;
+using Formosa::Mandarin::BopomofoReadingBuffer;
+using Formosa::Mandarin::BopomofoSyllable;
+using McBopomofo::KeystrokeReplay;
+
+constexpr char kDataPathVariable[] = "DATA_TXT_PATH";
+constexpr size_t kDefaultSyntheticKeystrokes = 20000;
+
+// The readings of a few everyday sentences, for the synthetic key log.
+constexpr const char* kSyntheticReadings[] = {
+    "ㄒㄧㄠˇ", "ㄇㄞˋ",  "ㄓㄨˋ",  "ㄧㄣ",   "ㄕㄨ",   "ㄖㄨˋ",  "ㄈㄚˇ",
+    "ㄕˋ",     "ㄧˊ",    "ㄍㄜˋ",  "ㄎㄞ",   "ㄈㄤˋ",  "ㄩㄢˊ",  "ㄇㄚˇ",
+    "ㄉㄜ˙",   "ㄊㄚ",   "ㄇㄣ˙",  "ㄒㄧㄝˇ", "ㄒㄧㄚˋ", "ㄌㄜ˙", "ㄓㄜˋ",
+    "ㄍㄜ˙",   "ㄔㄥˊ",  "ㄨㄛˇ",  "ㄐㄧㄣ", "ㄊㄧㄢ", "ㄒㄧㄤˇ", "ㄑㄩˋ",
+    "ㄊㄞˊ",   "ㄅㄟˇ",  "ㄔ",     "ㄈㄢˋ",  "ㄇㄧㄥˊ", "ㄏㄠˇ",  "ㄋㄧˇ",
+    "ㄅㄨˋ",   "ㄧㄠˋ",  "ㄨㄤˋ",  "ㄐㄧˋ",  "ㄉㄚˋ",  "ㄐㄧㄚ", "ㄧˋ",
+    "ㄑㄧˇ",   "ㄌㄞˊ",  "ㄍㄨㄥ", "ㄗㄨㄛˋ", "ㄕㄤˋ", "ㄅㄢ",   "ㄏㄨㄟˊ",
+    "ㄉㄧㄢˋ", "ㄋㄠˇ", "ㄕㄡˇ",  "ㄐㄧ",   "ㄒㄧㄣ", "ㄨㄣˊ",
+    "ㄊㄧˊ",   "ㄇㄨˋ",  "ㄒㄩㄝˊ", "ㄒㄧˊ", "ㄕㄥ",   "ㄏㄨㄛˊ", "ㄖㄣˊ",
+    "ㄓㄨㄥ",  "ㄗˋ",    "ㄉㄨㄛ", "ㄕㄠˇ",  "ㄑㄧㄢˊ", "ㄎㄨㄞˋ",
+    "ㄌㄜˋ",   "ㄉㄨㄥ", "ㄒㄧ",   "ㄆㄥˊ",  "ㄧㄡˇ",  "ㄒㄧㄝˋ", "ㄒㄧㄝ˙",
+};
+
+// Returns the keys that type the reading in the layout, composing it, or an
+// empty string if the layout cannot type it.
+std::string KeysForReading(const BopomofoKeyboardLayout* layout,
+                           const std::string& reading) {
+  BopomofoSyllable syllable = BopomofoSyllable::FromComposedString(reading);
+  std::string keys;
+  if (layout == BopomofoKeyboardLayout::HanyuPinyinLayout()) {
+    keys = syllable.HanyuPinyinString(false, false);
+    BopomofoSyllable::Component tone = syllable.toneMarkerComponent();
+    if (tone == BopomofoSyllable::Tone2) {
+      keys += '2';
+    } else if (tone == BopomofoSyllable::Tone3) {
+      keys += '3';
+    } else if (tone == BopomofoSyllable::Tone4) {
+      keys += '4';
+    } else if (tone == BopomofoSyllable::Tone5) {
+      keys += '5';
+    }
+  } else {
+    keys = layout->keySequenceFromSyllable(syllable);
+  }
+
+  BopomofoReadingBuffer buffer(layout);
+  for (char key : keys) {
+    if (!buffer.combineKey(key)) {
+      return "";
+    }
+  }
+  if (!buffer.hasToneMarker()) {
+    // The first tone, or a layout without a key for it, takes a space.
+    keys += ' ';
+  }
+  if (buffer.syllable().composedString() != syllable.composedString()) {
+    return "";
+  }
+  return keys;
+}
+
+// Writes a key log that types sentences of a few to a couple dozen readings,
+// now and then moving the cursor, picking a candidate or deleting a reading,
+// and commits each sentence with enter.
+std::string SyntheticLog(const std::string& layoutName,
+                         const BopomofoKeyboardLayout* layout,
+                         size_t keystrokes, uint64_t seed) {
+  std::vector<std::string> keySequences;
+  for (const char* reading : kSyntheticReadings) {
+    std::string keys = KeysForReading(layout, reading);
+    if (!keys.empty()) {
+      keySequences.push_back(std::move(keys));
+    }
+  }
+
+  // std::mt19937_64 is the same everywhere, unlike the distributions.
+  std::mt19937_64 random(seed);
+  std::ostringstream log;
+  log << "layout " << layoutName << "\n";
+  size_t written = 0;
+  size_t readings = 0;
+  size_t sentenceLength = 4 + random() % 20;
+  while (written < keystrokes && !keySequences.empty()) {
+    uint64_t dice = random() % 100;
+    if (readings == 0 || dice < 78) {
+      const std::string& keys = keySequences[random() % keySequences.size()];
+      log << "keys " << keys << "\n";
+      written += keys.size();
+      if (++readings >= sentenceLength) {
+        log << "enter\n";
+        ++written;
+        readings = 0;
+        sentenceLength = 4 + random() % 20;
+      }
+    } else if (dice < 84) {
+      log << "space\nselect " << random() % 4 << "\n";
+      written += 2;
+    } else if (dice < 88) {
+      log << "left\n";
+      ++written;
+    } else if (dice < 91) {
+      log << "right\n";
+      ++written;
+    } else if (dice < 95) {
+      log << "backspace\n";
+      ++written;
+      readings = readings > 0 ? readings - 1 : 0;
+    } else if (dice < 96) {
+      log << "home\n";
+      ++written;
+    } else if (dice < 98) {
+      log << "end\n";
+      ++written;
+    } else {
+      log << "delete\n";
+      ++written;
+    }
+  }
+  return log.str();
+}
+
+void PrintSummary(const char* name, const KeystrokeReplay::Summary& summary,
+                  const char* indent) {
+  printf(
+      "%s\"%s\": {\"count\": %zu, \"mean\": %.3f, \"p50\": %.3f, "
+      "\"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}",
+      indent, name, summary.count, summary.mean, summary.p50, summary.p99,
+      summary.p999, summary.max);
+}
+
+bool ReadFile(const char* path, std::string* contents) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  contents->assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool ParseOption(std::string_view arg, std::string_view name,
+                 std::string* value) {
+  if (!arg.starts_with(name) || arg.size() <= name.size() ||
+      arg[name.size()] != '=') {
+    return false;
+  }
+  *value = std::string(arg.substr(name.size() + 1));
+  return true;
+}
+
+int Usage() {
+  fprintf(stderr,
+          "usage: KeystrokeReplay [--data=PATH] [--bpmfvs-table=PATH] "
+          "[--bpmfvs-pua=PATH --bpmfvs-variants=PATH] [--synthetic=N] "
+          "[--layout=NAME] [--seed=N] [--dump-log] [--trace=PATH] "
+          "[key log ...]\n");
+  return 2;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const char* dataPathFromEnv = getenv(kDataPathVariable);
+  std::string dataPath = dataPathFromEnv != nullptr ? dataPathFromEnv
+                                                    : "data.txt";
+  std::string tablePath;
+  std::string puaPath;
+  std::string variantsPath;
+  std::string layoutName = "standard";
+  size_t syntheticKeystrokes = kDefaultSyntheticKeystrokes;
+  uint64_t seed = 0;
+  bool dumpLog = false;
+  std::string tracePath;
+  std::vector<std::string> logPaths;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    std::string value;
+    if (ParseOption(arg, "--data", &value)) {
+      dataPath = value;
+    } else if (ParseOption(arg, "--bpmfvs-table", &value)) {
+      tablePath = value;
+    } else if (ParseOption(arg, "--bpmfvs-pua", &value)) {
+      puaPath = value;
+    } else if (ParseOption(arg, "--bpmfvs-variants", &value)) {
+      variantsPath = value;
+    } else if (ParseOption(arg, "--synthetic", &value)) {
+      syntheticKeystrokes = strtoull(value.c_str(), nullptr, 10);
+    } else if (ParseOption(arg, "--layout", &value)) {
+      layoutName = value;
+    } else if (ParseOption(arg, "--seed", &value)) {
+      seed = strtoull(value.c_str(), nullptr, 10);
+    } else if (ParseOption(arg, "--trace", &value)) {
+      tracePath = value;
+    } else if (arg == "--dump-log") {
+      dumpLog = true;
+    } else if (arg.starts_with("--")) {
+      return Usage();
+    } else {
+      logPaths.emplace_back(arg);
+    }
+  }
+
+  const BopomofoKeyboardLayout* layout =
+      KeystrokeReplay::LayoutNamed(layoutName);
+  if (layout == nullptr) {
+    fprintf(stderr, "unknown layout: %s\n", layoutName.c_str());
+    return Usage();
+  }
+
+  std::vector<KeystrokeReplay::Event> events;
+  if (logPaths.empty()) {
+    std::string log =
+        SyntheticLog(layoutName, layout, syntheticKeystrokes, seed);
+    if (dumpLog) {
+      fputs(log.c_str(), stdout);
+      return 0;
+    }
+    std::string error;
+    if (!KeystrokeReplay::ParseLog(log, &events, &error)) {
+      fprintf(stderr, "bad synthetic log line: %s\n", error.c_str());
+      return 1;
+    }
+  }
+  for (const std::string& path : logPaths) {
+    std::string log;
+    if (!ReadFile(path.c_str(), &log)) {
+      fprintf(stderr, "cannot read %s\n", path.c_str());
+      return 1;
+    }
+    std::string error;
+    if (!KeystrokeReplay::ParseLog(log, &events, &error)) {
+      fprintf(stderr, "%s: bad line: %s\n", path.c_str(), error.c_str());
+      return 1;
+    }
+  }
+
+  auto lm = std::make_shared<McBopomofo::McBopomofoLM>();
+  lm->loadLanguageModel(dataPath.c_str());
+  if (!lm->isDataModelLoaded()) {
+    fprintf(stderr, "cannot load %s; set %s or pass --data\n",
+            dataPath.c_str(), kDataPathVariable);
+    return 1;
+  }
+
+  McBopomofo::VariantAnnotator annotator;
+  if (!tablePath.empty()) {
+    if (!annotator.loadTableFile(tablePath)) {
+      fprintf(stderr, "cannot load %s\n", tablePath.c_str());
+      return 1;
+    }
+  } else if (!puaPath.empty() || !variantsPath.empty()) {
+    if (!annotator.loadPUAFile(puaPath) ||
+        !annotator.loadVariantsFile(variantsPath)) {
+      fprintf(stderr, "cannot load %s and %s\n", puaPath.c_str(),
+              variantsPath.c_str());
+      return 1;
+    }
+  }
+
+  if (!tracePath.empty() && !McBopomofo::kTracingEnabled) {
+    fprintf(stderr, "--trace needs a build with ENABLE_TRACING\n");
+    return 1;
+  }
+
+  KeystrokeReplay replay(lm, &annotator);
+  std::vector<KeystrokeReplay::Timing> timings;
+  timings.reserve(events.size());
+  // The grid does not depend on the engine, so it reports its scopes through
+  // a hook.
+  Formosa::Gramambular2::ReadingGrid::setTraceHook(
+      &McBopomofo::Tracer::RecordScope);
+  McBopomofo::Tracer::Clear();
+  replay.replay(events, &timings);
+  if (!tracePath.empty()) {
+    std::ofstream trace(tracePath, std::ios::binary);
+    trace << McBopomofo::Tracer::ChromeTraceJSON();
+    if (!trace) {
+      fprintf(stderr, "cannot write %s\n", tracePath.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<double> totals;
+  totals.reserve(timings.size());
+  std::array<std::vector<double>, KeystrokeReplay::kStageCount> stages;
+  for (const KeystrokeReplay::Timing& timing : timings) {
+    totals.push_back(timing.total);
+    for (size_t i = 0; i < KeystrokeReplay::kStageCount; ++i) {
+      if (timing.stages[i] >= 0) {
+        stages[i].push_back(timing.stages[i]);
+      }
+    }
+  }
+
+  printf("{\n");
+  printf("  \"keystrokes\": %zu,\n", timings.size());
+  printf("  \"annotated\": %s,\n", annotator.loaded() ? "true" : "false");
+  PrintSummary("latency_us", KeystrokeReplay::Summarize(std::move(totals)),
+               "  ");
+  printf(",\n  \"stages_us\": {\n");
+  for (size_t i = 0; i < KeystrokeReplay::kStageCount; ++i) {
+    PrintSummary(
+        KeystrokeReplay::StageName(static_cast<KeystrokeReplay::Stage>(i)),
+        KeystrokeReplay::Summarize(std::move(stages[i])), "    ");
+    printf(i + 1 < KeystrokeReplay::kStageCount ? ",\n" : "\n");
+  }
+  printf("  }\n}\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "KeystrokeReplay.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+using Event = KeystrokeReplay::Event;
+
+TEST(KeystrokeReplayTest, ParseEmptyLog) {
+  std::vector<Event> events;
+  std::string error = "untouched";
+  EXPECT_TRUE(KeystrokeReplay::ParseLog("", &events, &error));
+  EXPECT_TRUE(KeystrokeReplay::ParseLog("\n\n# comment\n  \t\n", &events,
+                                        &error));
+  EXPECT_TRUE(events.empty());
+  EXPECT_EQ(error, "untouched");
+}
+
+TEST(KeystrokeReplayTest, ParseCommands) {
+  std::vector<Event> events;
+  std::string error;
+  ASSERT_TRUE(KeystrokeReplay::ParseLog(
+      "layout hsu\r\nkeys a b\nspace\n  select 12  \nbackspace\nesc", &events,
+      &error));
+  ASSERT_EQ(events.size(), 8);
+  EXPECT_EQ(events[0].type, Event::Type::kLayout);
+  EXPECT_EQ(events[0].layout, KeystrokeReplay::LayoutNamed("hsu"));
+  EXPECT_EQ(events[1].key, 'a');
+  EXPECT_EQ(events[2].key, ' ');
+  EXPECT_EQ(events[3].key, 'b');
+  EXPECT_EQ(events[4].type, Event::Type::kKey);
+  EXPECT_EQ(events[4].key, ' ');
+  EXPECT_EQ(events[5].type, Event::Type::kSelect);
+  EXPECT_EQ(events[5].candidateIndex, 12);
+  EXPECT_EQ(events[6].type, Event::Type::kBackspace);
+  EXPECT_EQ(events[7].type, Event::Type::kEsc);
+}
+
+TEST(KeystrokeReplayTest, ParseMalformedLines) {
+  const char* malformed[] = {
+      "layout",     "layout dvorak", "select",     "select -1",
+      "select 2x",  "select 1 2",    "enter now",  "space 2",
+      "keys",       "jump",          "Enter",
+  };
+  for (const char* line : malformed) {
+    std::vector<Event> events;
+    std::string error;
+    std::string log = std::string("enter\n") + line + "\nenter\n";
+    EXPECT_FALSE(KeystrokeReplay::ParseLog(log, &events, &error)) << line;
+    EXPECT_EQ(error, line);
+    // The events before the malformed line are kept.
+    EXPECT_EQ(events.size(), 1) << line;
+  }
+
+  std::vector<Event> events;
+  EXPECT_FALSE(KeystrokeReplay::ParseLog("jump", &events, nullptr));
+}
+
+TEST(KeystrokeReplayTest, SummarizeNoSamples) {
+  KeystrokeReplay::Summary summary = KeystrokeReplay::Summarize({});
+  EXPECT_EQ(summary.count, 0);
+  EXPECT_EQ(summary.mean, 0);
+  EXPECT_EQ(summary.p50, 0);
+  EXPECT_EQ(summary.p999, 0);
+  EXPECT_EQ(summary.max, 0);
+}
+
+TEST(KeystrokeReplayTest, SummarizeOneSample) {
+  KeystrokeReplay::Summary summary = KeystrokeReplay::Summarize({7});
+  EXPECT_EQ(summary.count, 1);
+  EXPECT_EQ(summary.mean, 7);
+  EXPECT_EQ(summary.p50, 7);
+  EXPECT_EQ(summary.p99, 7);
+  EXPECT_EQ(summary.p999, 7);
+  EXPECT_EQ(summary.max, 7);
+}
+
+TEST(KeystrokeReplayTest, SummarizeNearestRank) {
+  // 1 to 1000, in reverse order.
+  std::vector<double> samples;
+  for (int i = 1000; i >= 1; --i) {
+    samples.push_back(i);
+  }
+  KeystrokeReplay::Summary summary = KeystrokeReplay::Summarize(samples);
+  EXPECT_EQ(summary.count, 1000);
+  EXPECT_DOUBLE_EQ(summary.mean, 500.5);
+  EXPECT_EQ(summary.p50, 500);
+  EXPECT_EQ(summary.p99, 990);
+  EXPECT_EQ(summary.p999, 999);
+  EXPECT_EQ(summary.max, 1000);
+
+  // With fewer samples than 1/(1-p), the percentile is the maximum.
+  summary = KeystrokeReplay::Summarize({4, 1, 3, 2});
+  EXPECT_EQ(summary.p50, 2);
+  EXPECT_EQ(summary.p99, 4);
+  EXPECT_EQ(summary.p999, 4);
+
+  // An odd count rounds the rank up.
+  summary = KeystrokeReplay::Summarize({3, 1, 2});
+  EXPECT_EQ(summary.p50, 2);
+}
+
+}  // namespace McBopomofo
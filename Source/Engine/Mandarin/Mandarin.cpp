@@ -24,9 +24,14 @@
 #include "Mandarin.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace Formosa {
@@ -50,18 +55,8 @@ class PinyinParseHelper {
   }
 };
 
-class BopomofoCharacterMap {
- public:
-  static const BopomofoCharacterMap& SharedInstance();
-
-  std::map<BPMF::Component, std::string> componentToCharacter;
-  std::map<std::string, BPMF::Component> characterToComponent;
-
- protected:
-  BopomofoCharacterMap();
-};
-
-const BPMF BPMF::FromHanyuPinyin(const std::string& str) {
+// Parses Hanyu Pinyin by its spelling rules. See BPMF::FromHanyuPinyin().
+static BPMF ParseHanyuPinyin(const std::string& str) {
   if (str.empty()) {
     return BPMF();
   }
@@ -338,9 +333,8 @@ const BPMF BPMF::FromHanyuPinyin(const std::string& str) {
               toneComponent);
 }
 
-const std::string BPMF::HanyuPinyinString(bool includesTone,
-                                          bool useVForUUmlaut) const {
-  std::string consonant, middle, vowel, tone;
+std::string BPMF::composeHanyuPinyin(bool useVForUUmlaut) const {
+  std::string consonant, middle, vowel;
 
   Component cc = consonantComponent(), mvc = middleVowelComponent(),
             vc = vowelComponent();
@@ -557,141 +551,451 @@ const std::string BPMF::HanyuPinyinString(bool includesTone,
     vowel = "ui";
   }
 
+  return consonant + middle + vowel;
+}
+
+// The Bopomofo letters, U+3105 to U+3129, are encoded in UTF-8 as E3 84 85 to
+// E3 84 A9, and the tone markers ˊ, ˇ, ˋ and ˙ as CB 8A, CB 87, CB 8B and
+// CB 99.
+static constexpr unsigned char BopomofoLeadByte = 0xe3;
+static constexpr unsigned char BopomofoSecondByte = 0x84;
+static constexpr unsigned char ToneMarkerLeadByte = 0xcb;
+static constexpr unsigned char ToneMarkerSecondBytes[] = {0x8a, 0x87, 0x8b,
+                                                           0x99};
+
+// The last byte of the first consonant, vowel and middle vowel, less one. The
+// components of each kind are in the order of their code points.
+static constexpr unsigned char ConsonantBase = 0x84;
+static constexpr unsigned char VowelBase = 0x99;
+static constexpr unsigned char MiddleVowelBase = 0xa6;
+static constexpr BPMF::Component ConsonantCount = 21;
+static constexpr BPMF::Component MiddleVowelCount = 3;
+static constexpr BPMF::Component VowelCount = 13;
+static constexpr BPMF::Component ToneMarkerCount = 4;
+
+static constexpr int VowelShift = 7;
+static constexpr int MiddleVowelShift = 5;
+static constexpr int ToneMarkerShift = 11;
+
+// The component of each Bopomofo letter, indexed by its last byte less 0x80,
+// or 0 if the byte is not a letter.
+static constexpr std::array<BPMF::Component, 0x40> LetterComponents = [] {
+  std::array<BPMF::Component, 0x40> components{};
+  for (BPMF::Component i = 1; i <= ConsonantCount; ++i) {
+    components[ConsonantBase - 0x80 + i] = i;
+  }
+  for (BPMF::Component i = 1; i <= VowelCount; ++i) {
+    components[VowelBase - 0x80 + i] = i << VowelShift;
+  }
+  for (BPMF::Component i = 1; i <= MiddleVowelCount; ++i) {
+    components[MiddleVowelBase - 0x80 + i] = i << MiddleVowelShift;
+  }
+  return components;
+}();
+
+BPMF::Component BPMF::ComponentFromUTF8(std::string_view utf8,
+                                        size_t* length) {
+  if (utf8.length() >= 3 &&
+      static_cast<unsigned char>(utf8[0]) == BopomofoLeadByte &&
+      static_cast<unsigned char>(utf8[1]) == BopomofoSecondByte) {
+    auto last = static_cast<unsigned char>(utf8[2]);
+    Component component =
+        (last & 0xc0) == 0x80 ? LetterComponents[last & 0x3f] : 0;
+    *length = 3;
+    return component;
+  }
+
+  if (utf8.length() >= 2 &&
+      static_cast<unsigned char>(utf8[0]) == ToneMarkerLeadByte) {
+    auto second = static_cast<unsigned char>(utf8[1]);
+    for (Component t = 0; t < ToneMarkerCount; ++t) {
+      if (ToneMarkerSecondBytes[t] == second) {
+        *length = 2;
+        return (t + 1) << ToneMarkerShift;
+      }
+    }
+  }
+  return 0;
+}
+
+const BPMF BPMF::FromComposedString(const std::string& str) {
+  // Like BopomofoSyllable's operator+=, a later component replaces an earlier
+  // one of the same kind. Stops at anything else.
+  BPMF syllable;
+  std::string_view rest(str);
+  size_t length = 0;
+  while (Component component = ComponentFromUTF8(rest, &length)) {
+    syllable += BPMF(component);
+    rest.remove_prefix(length);
+  }
+  return syllable;
+}
+
+size_t BPMF::copyComposedString(char* buffer) const {
+  size_t length = 0;
+  auto appendLetter = [&](unsigned char last) {
+    buffer[length++] = static_cast<char>(BopomofoLeadByte);
+    buffer[length++] = static_cast<char>(BopomofoSecondByte);
+    buffer[length++] = static_cast<char>(last);
+  };
+
+  Component consonant = syllable_ & ConsonantMask;
+  Component middleVowel = (syllable_ & MiddleVowelMask) >> MiddleVowelShift;
+  Component vowel = (syllable_ & VowelMask) >> VowelShift;
+  Component tone = (syllable_ & ToneMarkerMask) >> ToneMarkerShift;
+  if (consonant && consonant <= ConsonantCount) {
+    appendLetter(ConsonantBase + consonant);
+  }
+  if (middleVowel) {
+    appendLetter(MiddleVowelBase + middleVowel);
+  }
+  if (vowel && vowel <= VowelCount) {
+    appendLetter(VowelBase + vowel);
+  }
+  if (tone && tone <= ToneMarkerCount) {
+    buffer[length++] = static_cast<char>(ToneMarkerLeadByte);
+    buffer[length++] = static_cast<char>(ToneMarkerSecondBytes[tone - 1]);
+  }
+  return length;
+}
+
+const std::string BPMF::composedString() const {
+  char buffer[MaxComposedStringLength];
+  return std::string(buffer, copyComposedString(buffer));
+}
+
+// The Hanyu Pinyin of every combination of a consonant, a middle vowel and a
+// vowel, and a minimal perfect hash from Hanyu Pinyin back to syllables, built
+// on first use.
+//
+// The hash holds the spellings, with and without tone digits, that
+// ParseHanyuPinyin() turns back into the syllables they spell, and maps them
+// to the same syllables; ParseHanyuPinyin() is left with everything else. The
+// hash uses hash-and-displace: a key's bucket picks a seed, and the seed
+// picks the key's slot, with the seeds chosen so that no two keys share one.
+class HanyuPinyinTable {
+ public:
+  static const HanyuPinyinTable& SharedInstance();
+
+  // Returns the Hanyu Pinyin, without a tone, of the consonant, middle vowel
+  // and vowel of the syllable.
+  std::string_view tonelessPinyin(BPMF syllable, bool useVForUUmlaut) const {
+    const PinyinString& pinyin =
+        pinyinStrings_[ComponentsWithoutTone(syllable)][useVForUUmlaut];
+    return {pinyin.text, pinyin.length};
+  }
+
+  // Returns the syllable of the lowercase Hanyu Pinyin, or false if the
+  // pinyin is not in the table.
+  bool find(std::string_view pinyin, BPMF* syllable) const {
+    if (pinyin.empty() || pinyin.length() > MaxKeyLength) {
+      return false;
+    }
+    uint64_t hash = Hash(pinyin);
+    const Entry& entry =
+        entries_[Slot(hash, seeds_[hash % seeds_.size()], entries_.size())];
+    if (std::string_view(entry.key, entry.length) != pinyin) {
+      return false;
+    }
+    *syllable = BPMF(entry.syllable);
+    return true;
+  }
+
+  static constexpr size_t MaxKeyLength = 7;
+
+ private:
+  HanyuPinyinTable();
+
+  struct PinyinString {
+    char text[MaxKeyLength];
+    uint8_t length;
+  };
+
+  struct Entry {
+    char key[MaxKeyLength];
+    // 0 for an empty slot.
+    uint8_t length;
+    BPMF::Component syllable;
+  };
+
+  static BPMF::Component ComponentsWithoutTone(BPMF syllable) {
+    return syllable.consonantComponent() | syllable.middleVowelComponent() |
+           syllable.vowelComponent();
+  }
+
+  // FNV-1a.
+  static uint64_t Hash(std::string_view key) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : key) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+  }
+
+  static size_t Slot(uint64_t hash, uint16_t seed, size_t slotCount) {
+    // The finalizer of SplitMix64.
+    uint64_t x = hash + (seed + 1) * 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return (x ^ (x >> 31)) % slotCount;
+  }
+
+  void buildHash(
+      const std::vector<std::pair<std::string, BPMF::Component>>& keys);
+
+  static constexpr size_t TonelessSyllableCount = 0x800;
+  std::array<std::array<PinyinString, 2>, TonelessSyllableCount>
+      pinyinStrings_{};
+
+  std::vector<uint16_t> seeds_;
+  std::vector<Entry> entries_;
+};
+
+const HanyuPinyinTable& HanyuPinyinTable::SharedInstance() {
+  static HanyuPinyinTable* table = new HanyuPinyinTable();
+  return *table;
+}
+
+HanyuPinyinTable::HanyuPinyinTable() {
+  std::vector<std::pair<std::string, BPMF::Component>> keys;
+  for (BPMF::Component c = 0; c <= ConsonantCount; ++c) {
+    for (BPMF::Component m = 0; m <= MiddleVowelCount; ++m) {
+      for (BPMF::Component v = 0; v <= VowelCount; ++v) {
+        BPMF syllable(c | m << MiddleVowelShift | v << VowelShift);
+        std::string previous;
+        for (bool useV : {false, true}) {
+          std::string pinyin = syllable.composeHanyuPinyin(useV);
+          PinyinString& entry =
+              pinyinStrings_[ComponentsWithoutTone(syllable)][useV];
+          entry.length = static_cast<uint8_t>(
+              std::min(pinyin.length(), sizeof(entry.text)));
+          std::copy_n(pinyin.data(), entry.length, entry.text);
+
+          bool seen = pinyin == previous;
+          previous = pinyin;
+          if (seen || pinyin.empty() || pinyin.length() + 1 > MaxKeyLength ||
+              ParseHanyuPinyin(pinyin) != syllable) {
+            continue;
+          }
+          keys.emplace_back(pinyin, ComponentsWithoutTone(syllable));
+          // Tone digits 1 to 5; tone 1 has no marker.
+          for (BPMF::Component t = 0; t <= ToneMarkerCount; ++t) {
+            keys.emplace_back(pinyin + static_cast<char>('1' + t),
+                              ComponentsWithoutTone(syllable) |
+                                  t << ToneMarkerShift);
+          }
+        }
+      }
+    }
+  }
+  buildHash(keys);
+}
+
+void HanyuPinyinTable::buildHash(
+    const std::vector<std::pair<std::string, BPMF::Component>>& keys) {
+  constexpr size_t KeysPerBucket = 4;
+  seeds_.assign(std::max<size_t>(1, keys.size() / KeysPerBucket), 0);
+  entries_.assign(std::max<size_t>(1, keys.size() + keys.size() / 4), Entry{});
+
+  std::vector<std::vector<size_t>> buckets(seeds_.size());
+  std::vector<uint64_t> hashes;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    hashes.push_back(Hash(keys[i].first));
+    buckets[hashes.back() % seeds_.size()].push_back(i);
+  }
+
+  // Places the largest buckets first, while most slots are free.
+  std::vector<size_t> order(buckets.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  std::vector<size_t> slots;
+  for (size_t b : order) {
+    const std::vector<size_t>& bucket = buckets[b];
+    for (uint32_t seed = 0; seed <= UINT16_MAX && !bucket.empty(); ++seed) {
+      slots.clear();
+      for (size_t key : bucket) {
+        size_t slot = Slot(hashes[key], static_cast<uint16_t>(seed),
+                           entries_.size());
+        if (entries_[slot].length ||
+            std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+          break;
+        }
+        slots.push_back(slot);
+      }
+      if (slots.size() != bucket.size()) {
+        continue;
+      }
+
+      seeds_[b] = static_cast<uint16_t>(seed);
+      for (size_t i = 0; i < bucket.size(); ++i) {
+        const auto& [key, syllable] = keys[bucket[i]];
+        Entry& entry = entries_[slots[i]];
+        std::copy(key.begin(), key.end(), entry.key);
+        entry.length = static_cast<uint8_t>(key.length());
+        entry.syllable = syllable;
+      }
+      break;
+    }
+    // A bucket without a seed is left out, and its keys are parsed instead.
+  }
+}
+
+const BPMF BPMF::FromHanyuPinyin(const std::string& str) {
+  if (str.empty()) {
+    return BPMF();
+  }
+
+  if (str.length() <= HanyuPinyinTable::MaxKeyLength) {
+    char lowercase[HanyuPinyinTable::MaxKeyLength];
+    for (size_t i = 0; i < str.length(); ++i) {
+      char c = str[i];
+      lowercase[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a')
+                                            : c;
+    }
+    BPMF syllable;
+    if (HanyuPinyinTable::SharedInstance().find(
+            std::string_view(lowercase, str.length()), &syllable)) {
+      return syllable;
+    }
+  }
+  return ParseHanyuPinyin(str);
+}
+
+size_t BPMF::copyHanyuPinyinString(char* buffer, bool includesTone,
+                                   bool useVForUUmlaut) const {
+  std::string_view pinyin = HanyuPinyinTable::SharedInstance().tonelessPinyin(
+      *this, useVForUUmlaut);
+  std::copy(pinyin.begin(), pinyin.end(), buffer);
+  size_t length = pinyin.length();
   if (includesTone) {
     switch (toneMarkerComponent()) {
       case Tone2:
-        tone = "2";
+        buffer[length++] = '2';
         break;
       case Tone3:
-        tone = "3";
+        buffer[length++] = '3';
         break;
       case Tone4:
-        tone = "4";
+        buffer[length++] = '4';
         break;
       case Tone5:
-        tone = "5";
+        buffer[length++] = '5';
         break;
     }
   }
-
-  return consonant + middle + vowel + tone;
+  return length;
 }
 
-const BPMF BPMF::FromComposedString(const std::string& str) {
-  BPMF syllable;
-  auto iter = str.begin();
-  while (iter != str.end()) {
-    // This is a naive implementation and we bail early at anything we don't
-    // recognize. A sound implementation would require to either use a trie for
-    // the Bopomofo character map or to split the input by codepoints. This
-    // suffices for now.
+const std::string BPMF::HanyuPinyinString(bool includesTone,
+                                          bool useVForUUmlaut) const {
+  char buffer[MaxHanyuPinyinLength];
+  return std::string(
+      buffer, copyHanyuPinyinString(buffer, includesTone, useVForUUmlaut));
+}
 
-    // disable for check for code points below
-    // NOLINTBEGIN(readability-magic-numbers)
+bool BPMF::FromExactHanyuPinyin(std::string_view pinyin, BPMF* syllable) {
+  return HanyuPinyinTable::SharedInstance().find(pinyin, syllable);
+}
 
-    // Illegal.
-    if (!(*iter & 0x80)) {
-      break;
-    }
+struct BopomofoKeyboardLayout::TransitionTable {
+  // Enough to index every combination of the components.
+  static constexpr size_t SyllableCount = 0x4000;
 
-    std::string::difference_type utf8_length = -1;
+  // The row of each syllable, indexed by its components, or nullptr if the
+  // row has not been decoded yet. A row holds the syllable after each key of
+  // keys_, followed by the syllable after removing the last key.
+  std::array<std::atomic<const BPMF::Component*>, SyllableCount> rows{};
 
-    // These are the code points for the tone markers.
-    if ((*iter & (0x80 | 0x40)) && !(*iter & 0x20)) {
-      utf8_length = 2;
-    } else if ((*iter & (0x80 | 0x40 | 0x20)) && !(*iter & 0x10)) {
-      utf8_length = 3;
-    } else {
-      // Illegal.
-      break;
+  ~TransitionTable() {
+    for (auto& row : rows) {
+      delete[] row.load(std::memory_order_relaxed);
     }
-    // NOLINTEND(readability-magic-numbers)
+  }
 
-    if (iter + (utf8_length - 1) == str.end()) {
-      break;
+  static BPMF::Component ComponentsOf(BPMF syllable) {
+    return syllable.consonantComponent() | syllable.middleVowelComponent() |
+           syllable.vowelComponent() | syllable.toneMarkerComponent();
+  }
+};
+
+BopomofoKeyboardLayout::BopomofoKeyboardLayout(
+    const BopomofoKeyToComponentMap& ktcm, const std::string& name)
+    : name_(name), keyToComponent_(ktcm) {
+  keyIndices_.fill(NoKey);
+  for (const auto& [key, components] : keyToComponent_) {
+    for (const auto& component : components) {
+      componentToKey_[component] = key;
     }
 
-    std::string component = std::string(iter, iter + utf8_length);
-    const std::map<std::string, BPMF::Component>& charToComp =
-        BopomofoCharacterMap::SharedInstance().characterToComponent;
-    std::map<std::string, BPMF::Component>::const_iterator result =
-        charToComp.find(component);
-    if (result == charToComp.end()) {
-      break;
+    auto index = static_cast<unsigned char>(key);
+    if (!components.empty() && index < keyIndices_.size()) {
+      keyIndices_[index] = static_cast<uint8_t>(keys_.size());
+      keys_ += key;
     }
-    syllable += BPMF((*result).second);
-    iter += utf8_length;
   }
-  return syllable;
 }
 
-const std::string BPMF::composedString() const {
-  std::string result;
-#define APPEND(c)                                                         \
-  if (syllable_ & (c))                                                    \
-  result +=                                                               \
-      (*BopomofoCharacterMap::SharedInstance().componentToCharacter.find( \
-           syllable_ & (c)))                                              \
-          .second
-  APPEND(ConsonantMask);
-  APPEND(MiddleVowelMask);
-  APPEND(VowelMask);
-  APPEND(ToneMarkerMask);
-#undef APPEND
-  return result;
-}
+BopomofoKeyboardLayout::~BopomofoKeyboardLayout() = default;
+
+const BPMF::Component* BopomofoKeyboardLayout::transitions(
+    BPMF syllable) const {
+  std::call_once(transitionTableOnce_, [this] {
+    transitionTable_ = std::make_unique<TransitionTable>();
+  });
+
+  std::atomic<const BPMF::Component*>& slot =
+      transitionTable_->rows[TransitionTable::ComponentsOf(syllable)];
+  const BPMF::Component* row = slot.load(std::memory_order_acquire);
+  if (row != nullptr) {
+    return row;
+  }
 
-const BopomofoCharacterMap& BopomofoCharacterMap::SharedInstance() {
-  static BopomofoCharacterMap* map = new BopomofoCharacterMap();
-  return *map;
+  // Decodes the key sequence of the syllable with every key added and with
+  // the last key removed, which is all a BopomofoReadingBuffer can do next.
+  auto* decoded = new BPMF::Component[keys_.size() + 1];
+  std::string sequence = keySequenceFromSyllable(syllable);
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    decoded[i] = TransitionTable::ComponentsOf(
+        syllableFromKeySequence(sequence + keys_[i]));
+  }
+  if (sequence.empty()) {
+    decoded[keys_.size()] = TransitionTable::ComponentsOf(syllable);
+  } else {
+    sequence.pop_back();
+    decoded[keys_.size()] =
+        TransitionTable::ComponentsOf(syllableFromKeySequence(sequence));
+  }
+
+  // Another thread may have decoded the same row; keep the first one.
+  if (!slot.compare_exchange_strong(row, decoded, std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+    delete[] decoded;
+    return row;
+  }
+  return decoded;
 }
 
-BopomofoCharacterMap::BopomofoCharacterMap() {
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄅ")] = BPMF::B;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄆ")] = BPMF::P;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄇ")] = BPMF::M;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄈ")] = BPMF::F;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄉ")] = BPMF::D;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄊ")] = BPMF::T;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄋ")] = BPMF::N;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄌ")] = BPMF::L;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄎ")] = BPMF::K;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄍ")] = BPMF::G;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄏ")] = BPMF::H;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄐ")] = BPMF::J;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄑ")] = BPMF::Q;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄒ")] = BPMF::X;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄓ")] = BPMF::ZH;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄔ")] = BPMF::CH;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄕ")] = BPMF::SH;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄖ")] = BPMF::R;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄗ")] = BPMF::Z;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄘ")] = BPMF::C;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄙ")] = BPMF::S;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄧ")] = BPMF::I;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄨ")] = BPMF::U;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄩ")] = BPMF::UE;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄚ")] = BPMF::A;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄛ")] = BPMF::O;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄜ")] = BPMF::ER;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄝ")] = BPMF::E;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄞ")] = BPMF::AI;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄟ")] = BPMF::EI;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄠ")] = BPMF::AO;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄡ")] = BPMF::OU;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄢ")] = BPMF::AN;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄣ")] = BPMF::EN;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄤ")] = BPMF::ANG;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄥ")] = BPMF::ENG;
-  characterToComponent[reinterpret_cast<const char*>(u8"ㄦ")] = BPMF::ERR;
-  characterToComponent[reinterpret_cast<const char*>(u8"ˊ")] = BPMF::Tone2;
-  characterToComponent[reinterpret_cast<const char*>(u8"ˇ")] = BPMF::Tone3;
-  characterToComponent[reinterpret_cast<const char*>(u8"ˋ")] = BPMF::Tone4;
-  characterToComponent[reinterpret_cast<const char*>(u8"˙")] = BPMF::Tone5;
-
-  for (const auto& [character, component] : characterToComponent) {
-    componentToCharacter[component] = character;
+BPMF BopomofoKeyboardLayout::syllableByAddingKey(BPMF syllable,
+                                                 char key) const {
+  auto index = static_cast<unsigned char>(key);
+  if (index >= keyIndices_.size()) {
+    return isKey(key) ? syllableFromKeySequence(
+                            keySequenceFromSyllable(syllable) + key)
+                      : syllable;
   }
+  if (keyIndices_[index] == NoKey) {
+    return syllable;
+  }
+  return BPMF(transitions(syllable)[keyIndices_[index]]);
+}
+
+BPMF BopomofoKeyboardLayout::syllableByRemovingLastKey(BPMF syllable) const {
+  return BPMF(transitions(syllable)[keys_.size()]);
 }
 
 // we don't need parentheses for these macros
@@ -24,10 +24,14 @@
 #ifndef SRC_ENGINE_MANDARIN_MANDARIN_H_
 #define SRC_ENGINE_MANDARIN_MANDARIN_H_
 
+#include <array>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace Formosa {
@@ -55,6 +59,32 @@ class BopomofoSyllable {
   static const BopomofoSyllable FromComposedString(const std::string& str);
   const std::string composedString() const;
 
+  // The longest composedString() and HanyuPinyinString(), in bytes.
+  static constexpr size_t MaxComposedStringLength = 11;
+  static constexpr size_t MaxHanyuPinyinLength = 8;
+
+  // Writes composedString() to the buffer, which must hold
+  // MaxComposedStringLength bytes, and returns the length.
+  size_t copyComposedString(char* buffer) const;
+
+  // Writes HanyuPinyinString() to the buffer, which must hold
+  // MaxHanyuPinyinLength bytes, and returns the length.
+  size_t copyHanyuPinyinString(char* buffer, bool includesTone,
+                               bool useVForUUmlaut) const;
+
+  // Returns the component of the Bopomofo letter or tone marker that the
+  // UTF-8 string starts with and sets length to its length in bytes, or
+  // returns 0 if the string starts with neither.
+  static Component ComponentFromUTF8(std::string_view utf8, size_t* length);
+
+  // Looks up lowercase Hanyu Pinyin spelled the way HanyuPinyinString() spells
+  // it, with either ü or v, and optionally followed by a tone digit from 1 to
+  // 5. Returns false for any other spelling, or for one that FromHanyuPinyin()
+  // reads as a different syllable. Unlike FromHanyuPinyin(), this does not
+  // parse or allocate.
+  static bool FromExactHanyuPinyin(std::string_view pinyin,
+                                   BopomofoSyllable* syllable);
+
   void clear() { syllable_ = 0; }
 
   bool isEmpty() const { return !syllable_; }
@@ -139,6 +169,7 @@ class BopomofoSyllable {
 
   friend std::ostream& operator<<(std::ostream& stream,
                                   const BopomofoSyllable& syllable);
+  friend class HanyuPinyinTable;
 
   static constexpr Component
       ConsonantMask = 0x001f,    // 0000 0000 0001 1111, 21 consonants
@@ -157,6 +188,10 @@ class BopomofoSyllable {
       Tone3 = 0x1000, Tone4 = 0x1800, Tone5 = 0x2000;
 
  protected:
+  // Spells the consonant, middle vowel and vowel in Hanyu Pinyin by the
+  // spelling rules. HanyuPinyinString() looks the spelling up instead.
+  std::string composeHanyuPinyin(bool useVForUUmlaut) const;
+
   Component syllable_;
 };
 
@@ -181,14 +216,11 @@ class BopomofoKeyboardLayout {
   static const BopomofoKeyboardLayout* HanyuPinyinLayout();
 
   BopomofoKeyboardLayout(const BopomofoKeyToComponentMap& ktcm,
-                         const std::string& name)
-      : name_(name), keyToComponent_(ktcm) {
-    for (const auto& [key, components] : keyToComponent_) {
-      for (const auto& component : components) {
-        componentToKey_[component] = key;
-      }
-    }
-  }
+                         const std::string& name);
+  ~BopomofoKeyboardLayout();
+
+  BopomofoKeyboardLayout(const BopomofoKeyboardLayout&) = delete;
+  BopomofoKeyboardLayout& operator=(const BopomofoKeyboardLayout&) = delete;
 
   const std::string name() const { return name_; }
 
@@ -204,6 +236,27 @@ class BopomofoKeyboardLayout {
                                            : (*iter).second;
   }
 
+  // Same as !keyToComponents(key).empty(), without the look-up.
+  bool isKey(char key) const {
+    auto index = static_cast<unsigned char>(key);
+    return index < keyIndices_.size() ? keyIndices_[index] != NoKey
+                                      : !keyToComponents(key).empty();
+  }
+
+  // Returns the syllable after typing the key with the syllable composed,
+  // which is syllableFromKeySequence(keySequenceFromSyllable(syllable) + key),
+  // or the syllable itself if the key is not in the layout.
+  //
+  // The layout keeps a transition table, indexed by syllable, whose row for a
+  // syllable is decoded the first time the syllable is used, so that this is
+  // an array look-up for any syllable composed before. This is thread-safe.
+  BPMF syllableByAddingKey(BPMF syllable, char key) const;
+
+  // Returns the syllable after removing the last key of the syllable's key
+  // sequence, or the syllable itself if the key sequence is empty. Like
+  // syllableByAddingKey(), this uses the transition table.
+  BPMF syllableByRemovingLastKey(BPMF syllable) const;
+
   const std::string keySequenceFromSyllable(BPMF syllable) const {
     std::string sequence;
 
@@ -355,9 +408,23 @@ class BopomofoKeyboardLayout {
     return false;
   }
 
+  struct TransitionTable;
+  // Returns the row of the transition table for the syllable, decoding it if
+  // needed.
+  const BPMF::Component* transitions(BPMF syllable) const;
+
   std::string name_;
   BopomofoKeyToComponentMap keyToComponent_;
   BopomofoComponentToKeyMap componentToKey_;
+
+  // The index of each ASCII key in keys_, or NoKey.
+  static constexpr uint8_t NoKey = 0xff;
+  std::array<uint8_t, 128> keyIndices_;
+  // The ASCII keys of the layout, in the order of the transition table.
+  std::string keys_;
+
+  mutable std::once_flag transitionTableOnce_;
+  mutable std::unique_ptr<TransitionTable> transitionTable_;
 };
 
 class BopomofoReadingBuffer {
@@ -383,7 +450,7 @@ class BopomofoReadingBuffer {
 
   bool isValidKey(char k) const {
     if (!pinyin_mode_) {
-      return layout_ ? (layout_->keyToComponents(k)).size() > 0 : false;
+      return layout_ ? layout_->isKey(k) : false;
     }
 
     char lk = tolower(k);
@@ -415,9 +482,7 @@ class BopomofoReadingBuffer {
       return true;
     }
 
-    std::string sequence =
-        layout_->keySequenceFromSyllable(syllable_) + std::string(1, k);
-    syllable_ = layout_->syllableFromKeySequence(sequence);
+    syllable_ = layout_->syllableByAddingKey(syllable_, k);
     return true;
   }
 
@@ -439,11 +504,7 @@ class BopomofoReadingBuffer {
       return;
     }
 
-    std::string sequence = layout_->keySequenceFromSyllable(syllable_);
-    if (sequence.length()) {
-      sequence = sequence.substr(0, sequence.length() - 1);
-      syllable_ = layout_->syllableFromKeySequence(sequence);
-    }
+    syllable_ = layout_->syllableByRemovingLastKey(syllable_);
   }
 
   bool isEmpty() const { return syllable_.isEmpty(); }
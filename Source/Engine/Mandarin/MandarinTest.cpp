@@ -21,7 +21,9 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <set>
 #include <string>
+#include <vector>
 
 #include "Mandarin.h"
 #include "gtest/gtest.h"
@@ -45,6 +47,73 @@ TEST(MandarinTest, FromComposedString) {
   ASSERT_EQ(RoundTrip("ㄅeㄆ"), "ㄅ");
 }
 
+TEST(MandarinTest, ComposedStringsOfAllSyllables) {
+  size_t count = 0;
+  for (BPMF::Component c = 0; c <= BPMF::S; ++c) {
+    for (BPMF::Component m = 0; m <= BPMF::UE; m += BPMF::I) {
+      for (BPMF::Component v = 0; v <= BPMF::ERR; v += BPMF::A) {
+        for (BPMF::Component t = 0; t <= BPMF::Tone5; t += BPMF::Tone2) {
+          BPMF syllable(c | m | v | t);
+          std::string composed = syllable.composedString();
+          ASSERT_EQ(BPMF::FromComposedString(composed), syllable) << composed;
+          ASSERT_EQ(BPMF::FromComposedString(composed + "e"), syllable);
+          ++count;
+        }
+      }
+    }
+  }
+  EXPECT_EQ(count, 22 * 4 * 14 * 5);
+
+  ASSERT_EQ(BPMF(BPMF::ZH | BPMF::U | BPMF::ANG | BPMF::Tone4).composedString(),
+            "ㄓㄨㄤˋ");
+  ASSERT_EQ(BPMF(BPMF::UE | BPMF::E | BPMF::Tone5).composedString(), "ㄩㄝ˙");
+  ASSERT_EQ(RoundTrip("ㄅ\xe3\x84"), "ㄅ");
+  ASSERT_EQ(RoundTrip("ㄅ\xcb"), "ㄅ");
+  ASSERT_EQ(RoundTrip("ㄅˉㄚ"), "ㄅ");
+  ASSERT_EQ(RoundTrip("ㄅㄭㄚ"), "ㄅ");
+}
+
+TEST(MandarinTest, HanyuPinyin) {
+  ASSERT_EQ(BPMF::FromHanyuPinyin("zhuang4").composedString(), "ㄓㄨㄤˋ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("ZHUANG4").composedString(), "ㄓㄨㄤˋ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("ma1").composedString(), "ㄇㄚ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("lv4").composedString(), "ㄌㄩˋ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("lü4").composedString(), "ㄌㄩˋ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("yuan2").composedString(), "ㄩㄢˊ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("zhi").composedString(), "ㄓ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("zhuang4er").composedString(), "ㄓㄨㄤˋ");
+  ASSERT_EQ(BPMF::FromHanyuPinyin("").composedString(), "");
+
+  BPMF syllable = BPMF::FromComposedString("ㄋㄩˇ");
+  ASSERT_EQ(syllable.HanyuPinyinString(true, false), "nü3");
+  ASSERT_EQ(syllable.HanyuPinyinString(true, true), "nv3");
+  ASSERT_EQ(syllable.HanyuPinyinString(false, true), "nv");
+}
+
+TEST(MandarinTest, HanyuPinyinLookUpsMatchTheSpellingRules) {
+  // Nothing after a tone digit is parsed, and a tone 1 digit changes
+  // nothing, so these strings are parsed by the spelling rules rather than
+  // looked up, and must give the same syllables as the looked-up spellings.
+  for (BPMF::Component c = 0; c <= BPMF::S; ++c) {
+    for (BPMF::Component m = 0; m <= BPMF::UE; m += BPMF::I) {
+      for (BPMF::Component v = 0; v <= BPMF::ERR; v += BPMF::A) {
+        for (BPMF::Component t = 0; t <= BPMF::Tone5; t += BPMF::Tone2) {
+          BPMF syllable(c | m | v | t);
+          for (bool useV : {false, true}) {
+            std::string pinyin = syllable.HanyuPinyinString(true, useV);
+            ASSERT_EQ(BPMF::FromHanyuPinyin(pinyin),
+                      BPMF::FromHanyuPinyin(pinyin + (t ? "x" : "1x")))
+                << pinyin;
+            ASSERT_EQ(BPMF::FromHanyuPinyin(pinyin + (t ? "" : "1")),
+                      BPMF::FromHanyuPinyin(pinyin + (t ? "x" : "1x")))
+                << pinyin;
+          }
+        }
+      }
+    }
+  }
+}
+
 TEST(MandarinTest, SimpleCompositions) {
   BopomofoSyllable syllable;
   syllable += BopomofoSyllable(BopomofoSyllable::X);
@@ -118,5 +187,71 @@ TEST(MandarinTest, IBMLayout) {
   ASSERT_EQ(buf.composedString(), "ㄍㄨㄛˊ");
 }
 
+TEST(MandarinTest, TransitionTablesMatchKeySequenceDecoding) {
+  const std::vector<const BopomofoKeyboardLayout*> layouts = {
+      BopomofoKeyboardLayout::StandardLayout(),
+      BopomofoKeyboardLayout::ETenLayout(),
+      BopomofoKeyboardLayout::HsuLayout(),
+      BopomofoKeyboardLayout::ETen26Layout(),
+      BopomofoKeyboardLayout::IBMLayout()};
+
+  for (const BopomofoKeyboardLayout* layout : layouts) {
+    // Every syllable that typing and backspacing can reach, found by decoding
+    // key sequences only.
+    std::vector<BPMF> syllables = {BPMF()};
+    std::set<std::string> seen = {""};
+    for (size_t i = 0; i < syllables.size(); ++i) {
+      BPMF syllable = syllables[i];
+      std::string sequence = layout->keySequenceFromSyllable(syllable);
+
+      for (int c = 0; c < 256; ++c) {
+        char key = static_cast<char>(c);
+        BPMF expected = syllable;
+        if (!layout->keyToComponents(key).empty()) {
+          expected = layout->syllableFromKeySequence(sequence + key);
+        }
+        ASSERT_EQ(layout->isKey(key), !layout->keyToComponents(key).empty());
+        ASSERT_EQ(layout->syllableByAddingKey(syllable, key), expected)
+            << layout->name() << " " << syllable << " " << key;
+        if (seen.insert(expected.composedString()).second) {
+          syllables.push_back(expected);
+        }
+      }
+
+      BPMF expected = syllable;
+      if (!sequence.empty()) {
+        expected = layout->syllableFromKeySequence(
+            sequence.substr(0, sequence.length() - 1));
+      }
+      ASSERT_EQ(layout->syllableByRemovingLastKey(syllable), expected)
+          << layout->name() << " " << syllable;
+      if (seen.insert(expected.composedString()).second) {
+        syllables.push_back(expected);
+      }
+    }
+    EXPECT_GT(syllables.size(), 1000) << layout->name();
+  }
+}
+
+TEST(MandarinTest, TransitionTablesMatchKeySequenceDecodingOfAnySyllable) {
+  // Including the syllables that no key sequence composes.
+  const BopomofoKeyboardLayout* layout = BopomofoKeyboardLayout::IBMLayout();
+  for (BPMF::Component c = 0; c <= 0x3fff; ++c) {
+    BPMF syllable(c);
+    std::string sequence = layout->keySequenceFromSyllable(syllable);
+    for (char key : std::string("19sgm,/-")) {
+      ASSERT_EQ(layout->syllableByAddingKey(syllable, key),
+                layout->syllableFromKeySequence(sequence + key))
+          << syllable << " " << key;
+    }
+    if (!sequence.empty()) {
+      ASSERT_EQ(layout->syllableByRemovingLastKey(syllable),
+                layout->syllableFromKeySequence(
+                    sequence.substr(0, sequence.length() - 1)))
+          << syllable;
+    }
+  }
+}
+
 }  // namespace Mandarin
 }  // namespace Formosa
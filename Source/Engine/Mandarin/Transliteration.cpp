@@ -0,0 +1,411 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "Transliteration.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#include "Mandarin.h"
+
+namespace Formosa {
+namespace Mandarin {
+
+namespace {
+
+constexpr uint64_t kLowBits = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+constexpr uint64_t kLowSevenBits = ~kHighBits;
+
+// The lead bytes of the Bopomofo letters (U+3105 to U+3129), the tone
+// markers (U+02C7 to U+02D9) and ü (U+00FC).
+constexpr unsigned char kBopomofoLeadByte = 0xe3;
+constexpr unsigned char kToneMarkerLeadByte = 0xcb;
+constexpr char kUUmlaut[] = "\xc3\xbc";
+
+// The longest UTF-8 sequence of a Bopomofo letter or tone marker.
+constexpr size_t kMaxComponentLength = 3;
+// The longest spelling of a syllable without a tone, in bytes.
+constexpr size_t kMaxPinyinLength = BPMF::MaxHanyuPinyinLength - 1;
+
+uint64_t LoadWord(const char* ptr) {
+  uint64_t word;
+  memcpy(&word, ptr, sizeof(word));
+  return word;
+}
+
+// Returns a word with the high bit set in each byte of the word that is b,
+// and possibly in bytes after one that is; the lowest set bit is exact.
+uint64_t MatchByte(uint64_t word, unsigned char b) {
+  const uint64_t x = word ^ (kLowBits * b);
+  return (x - kLowBits) & ~x & kHighBits;
+}
+
+// Returns a word with the high bit set in each byte of the word that is an
+// ASCII letter.
+uint64_t MatchLetters(uint64_t word) {
+  const uint64_t lower = word | (kLowBits * 0x20);
+  const uint64_t low = lower & kLowSevenBits;
+  // Each byte is at least 'a' and at most 'z', without carries across bytes.
+  const uint64_t atLeastA = low + kLowBits * (0x80 - 'a');
+  const uint64_t atMostZ = kLowBits * (0x80 + 'z') - low;
+  return atLeastA & atMostZ & ~word & kHighBits;
+}
+
+// Returns the index of the first byte in [i, size) for which the matcher
+// sets the high bit, or size.
+template <typename Matcher>
+size_t FindFirst(std::string_view text, size_t i, Matcher matcher) {
+  const char* data = text.data();
+  for (; i + sizeof(uint64_t) <= text.length(); i += sizeof(uint64_t)) {
+    uint64_t mask = matcher(LoadWord(data + i));
+    if (mask) {
+      return i + std::countr_zero(mask) / 8;
+    }
+  }
+  for (; i < text.length(); ++i) {
+    uint64_t word = static_cast<unsigned char>(data[i]);
+    if (matcher(word) & 0x80) {
+      return i;
+    }
+  }
+  return text.length();
+}
+
+size_t FindBopomofoLeadByte(std::string_view text, size_t i) {
+  return FindFirst(text, i, [](uint64_t word) {
+    return MatchByte(word, kBopomofoLeadByte) |
+           MatchByte(word, kToneMarkerLeadByte);
+  });
+}
+
+size_t FindPinyinLeadByte(std::string_view text, size_t i) {
+  return FindFirst(text, i, [](uint64_t word) {
+    return MatchLetters(word) |
+           MatchByte(word, static_cast<unsigned char>(kUUmlaut[0]));
+  });
+}
+
+bool IsLetter(char c) {
+  char lower = static_cast<char>(c | 0x20);
+  return lower >= 'a' && lower <= 'z';
+}
+
+bool IsToneDigit(char c) { return c >= '1' && c <= '5'; }
+
+// Returns the length of the letter at the start of the text, or 0.
+size_t LetterLength(std::string_view text) {
+  if (!text.empty() && IsLetter(text[0])) {
+    return 1;
+  }
+  return text.starts_with(kUUmlaut) ? 2 : 0;
+}
+
+// The order of the kinds of components in a syllable.
+int ComponentKind(BPMF::Component component) {
+  BPMF syllable(component);
+  if (syllable.hasConsonant()) {
+    return 1;
+  }
+  if (syllable.hasMiddleVowel()) {
+    return 2;
+  }
+  return syllable.hasVowel() ? 3 : 4;
+}
+
+constexpr int kToneMarkerKind = 4;
+
+// Whether the syllable, read from Hanyu Pinyin, is one. Lone consonants are
+// not, except those spelled with an i that does not sound like one.
+bool IsPinyinSyllable(BPMF syllable) {
+  return syllable.hasMiddleVowel() || syllable.hasVowel() ||
+         syllable.belongsToZCSRClass();
+}
+
+// Finds the longest spelling of a syllable at the start of the text,
+// including a tone digit that follows it. Returns its length, or 0.
+size_t ReadPinyinSyllable(std::string_view text, BPMF* syllable) {
+  char lowercase[kMaxPinyinLength + 1];
+  size_t length = 0;
+  size_t letterLength;
+  while ((letterLength = LetterLength(text.substr(length))) &&
+         length + letterLength <= kMaxPinyinLength) {
+    for (size_t i = 0; i < letterLength; ++i) {
+      lowercase[length + i] =
+          letterLength == 1 ? static_cast<char>(text[length] | 0x20)
+                            : text[length + i];
+    }
+    length += letterLength;
+  }
+
+  for (; length > 0; --length) {
+    if (length < text.length() &&
+        static_cast<unsigned char>(text[length]) == 0xbc &&
+        static_cast<unsigned char>(text[length - 1]) ==
+            static_cast<unsigned char>(kUUmlaut[0])) {
+      // Would split a ü.
+      continue;
+    }
+    if (!BPMF::FromExactHanyuPinyin(std::string_view(lowercase, length),
+                                    syllable) ||
+        !IsPinyinSyllable(*syllable)) {
+      continue;
+    }
+    if (length < text.length() && IsToneDigit(text[length])) {
+      lowercase[length] = text[length];
+      BPMF::FromExactHanyuPinyin(std::string_view(lowercase, length + 1),
+                                 syllable);
+      return length + 1;
+    }
+    return length;
+  }
+  return 0;
+}
+
+// Returns the end of the run of letters and tone digits that starts with a
+// letter at the start of the text.
+size_t PinyinRunLength(std::string_view text) {
+  size_t i = 0;
+  while (i < text.length()) {
+    if (size_t length = LetterLength(text.substr(i))) {
+      i += length;
+    } else if (IsToneDigit(text[i])) {
+      ++i;
+    } else {
+      break;
+    }
+  }
+  return i;
+}
+
+// A syllable read from a run, and the length of its spelling.
+struct RunSyllable {
+  BPMF syllable;
+  size_t length;
+};
+
+// The number of syllables of a run kept while checking it. Most runs are a
+// word of a few syllables; the syllables after these are read again.
+constexpr size_t kMaxRunSyllables = 16;
+
+// Whether the run splits into syllables. The first syllables, up to
+// kMaxRunSyllables, are stored, and their number is set to count.
+bool ReadPinyinRun(std::string_view run, RunSyllable* syllables,
+                   size_t* count) {
+  *count = 0;
+  BPMF syllable;
+  while (!run.empty()) {
+    size_t length = ReadPinyinSyllable(run, &syllable);
+    if (!length) {
+      return false;
+    }
+    if (*count < kMaxRunSyllables) {
+      syllables[(*count)++] = {syllable, length};
+    }
+    run.remove_prefix(length);
+  }
+  return true;
+}
+
+}  // namespace
+
+TransliterationResult TransliterateBopomofoToHanyuPinyin(
+    std::string_view input, bool endOfInput, char* output,
+    size_t outputCapacity, bool includesTone, bool useVForUUmlaut) {
+  size_t i = 0;
+  size_t written = 0;
+  while (i < input.length() && written < outputCapacity) {
+    // Only looks as far as the bytes copied before it can fit.
+    size_t limit = std::min(input.length(), i + (outputCapacity - written));
+    size_t next = FindBopomofoLeadByte(input.substr(0, limit), i);
+    if (next > i) {
+      memcpy(output + written, input.data() + i, next - i);
+      written += next - i;
+      i = next;
+      continue;
+    }
+
+    if (!endOfInput && input.length() - i < kMaxComponentLength) {
+      break;
+    }
+
+    // Reads a syllable, component by component.
+    BPMF syllable;
+    int kind = 0;
+    size_t end = i;
+    size_t length = 0;
+    while (BPMF::Component component =
+               BPMF::ComponentFromUTF8(input.substr(end), &length)) {
+      int componentKind = ComponentKind(component);
+      if (componentKind <= kind) {
+        break;
+      }
+      syllable += BPMF(component);
+      kind = componentKind;
+      end += length;
+      if (kind == kToneMarkerKind) {
+        break;
+      }
+    }
+
+    if (end == i) {
+      // Not a Bopomofo letter or tone marker.
+      if (written == outputCapacity) {
+        break;
+      }
+      output[written++] = input[i++];
+      continue;
+    }
+    if (!endOfInput && kind != kToneMarkerKind &&
+        input.length() - end < kMaxComponentLength) {
+      // The syllable may continue in the next chunk.
+      break;
+    }
+
+    if (!syllable.hasConsonant() && !syllable.hasMiddleVowel() &&
+        !syllable.hasVowel()) {
+      // A lone tone marker.
+      if (outputCapacity - written < end - i) {
+        break;
+      }
+      memcpy(output + written, input.data() + i, end - i);
+      written += end - i;
+    } else {
+      if (outputCapacity - written < BPMF::MaxHanyuPinyinLength) {
+        break;
+      }
+      written += syllable.copyHanyuPinyinString(output + written, includesTone,
+                                                useVForUUmlaut);
+    }
+    i = end;
+  }
+  return {i, written};
+}
+
+TransliterationResult TransliterateHanyuPinyinToBopomofo(
+    std::string_view input, bool endOfInput, char* output,
+    size_t outputCapacity) {
+  size_t i = 0;
+  size_t written = 0;
+  while (i < input.length() && written < outputCapacity) {
+    // Only looks as far as the bytes copied before it can fit.
+    size_t limit = std::min(input.length(), i + (outputCapacity - written));
+    size_t next = FindPinyinLeadByte(input.substr(0, limit), i);
+    if (next > i) {
+      memcpy(output + written, input.data() + i, next - i);
+      written += next - i;
+      i = next;
+      continue;
+    }
+
+    if (!LetterLength(input.substr(i))) {
+      // A lead byte that is not of a ü.
+      if (!endOfInput && input.length() - i < 2) {
+        break;
+      }
+      if (written == outputCapacity) {
+        break;
+      }
+      output[written++] = input[i++];
+      continue;
+    }
+
+    size_t end = i + PinyinRunLength(input.substr(i));
+    if (!endOfInput && end + 1 >= input.length()) {
+      // The run, or a ü that ends it, may continue in the next chunk.
+      break;
+    }
+
+    std::string_view run = input.substr(i, end - i);
+    RunSyllable syllables[kMaxRunSyllables];
+    size_t syllableCount;
+    if (!ReadPinyinRun(run, syllables, &syllableCount)) {
+      // Copied whole when it fits, so that its tail is not read as a run of
+      // its own; a run longer than the output buffer is copied in parts.
+      if (outputCapacity - written < run.length() && written > 0) {
+        break;
+      }
+      size_t count = std::min(run.length(), outputCapacity - written);
+      memcpy(output + written, run.data(), count);
+      i += count;
+      written += count;
+      continue;
+    }
+
+    size_t k = 0;
+    while (i < end &&
+           outputCapacity - written >= BPMF::MaxComposedStringLength) {
+      BPMF syllable;
+      if (k < syllableCount) {
+        syllable = syllables[k].syllable;
+        i += syllables[k++].length;
+      } else {
+        i += ReadPinyinSyllable(input.substr(i, end - i), &syllable);
+      }
+      written += syllable.copyComposedString(output + written);
+    }
+    if (i < end) {
+      break;
+    }
+  }
+  return {i, written};
+}
+
+namespace {
+
+template <typename Transliterate>
+std::string TransliterateText(std::string_view text,
+                              Transliterate transliterate) {
+  std::string result;
+  char buffer[4096];
+  while (!text.empty()) {
+    TransliterationResult r = transliterate(text, buffer, sizeof(buffer));
+    result.append(buffer, r.written);
+    text.remove_prefix(r.consumed);
+  }
+  return result;
+}
+
+}  // namespace
+
+std::string BopomofoToHanyuPinyin(std::string_view text, bool includesTone,
+                                  bool useVForUUmlaut) {
+  return TransliterateText(text, [&](std::string_view input, char* output,
+                                     size_t capacity) {
+    return TransliterateBopomofoToHanyuPinyin(input, true, output, capacity,
+                                              includesTone, useVForUUmlaut);
+  });
+}
+
+std::string HanyuPinyinToBopomofo(std::string_view text) {
+  return TransliterateText(
+      text, [](std::string_view input, char* output, size_t capacity) {
+        return TransliterateHanyuPinyinToBopomofo(input, true, output,
+                                                  capacity);
+      });
+}
+
+}  // namespace Mandarin
+}  // namespace Formosa
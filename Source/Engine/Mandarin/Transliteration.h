@@ -0,0 +1,88 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_MANDARIN_TRANSLITERATION_H_
+#define SRC_ENGINE_MANDARIN_TRANSLITERATION_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace Formosa {
+namespace Mandarin {
+
+// Transliteration of whole UTF-8 texts between Bopomofo and Hanyu Pinyin.
+// Only the syllables are converted; everything else, including separators
+// such as the "-" in "ㄕㄨ-ㄖㄨˋ", is copied as is.
+//
+// Bopomofo is read as runs of syllables, each of which ends before a
+// component that cannot follow the previous ones in the order of consonant,
+// middle vowel, vowel and tone marker, so "ㄇㄚˇㄇㄚ" is two syllables. A run
+// of only tone markers is copied as is.
+//
+// Hanyu Pinyin is read as runs of letters, where ü is a letter, each of
+// which may be followed by a tone digit from 1 to 5. A run is split from the
+// left into the longest spellings of syllables, as HanyuPinyinString() spells
+// them in either case, each optionally followed by a tone digit, so
+// "zhong1guo2" and "zhongguo" are both two syllables. Lone consonants other
+// than those of zhi, chi, shi, ri, zi, ci and si do not count as syllables.
+// A run that does not split into syllables, such as "hello", is copied as is.
+// Words of other languages that do split, such as "men", are converted.
+
+struct TransliterationResult {
+  // The number of input bytes converted.
+  size_t consumed = 0;
+  // The number of bytes written to the output.
+  size_t written = 0;
+};
+
+// The smallest output buffer that a transliteration always makes progress
+// with.
+constexpr size_t MinimumTransliterationOutputCapacity = 32;
+
+// Converts the Bopomofo in the input to Hanyu Pinyin, writing to the output,
+// until the input is consumed or the output is full.
+//
+// To convert a text in chunks, pass endOfInput = false for all but the last
+// chunk, and prepend the unconsumed bytes of each chunk to the next; the
+// syllable or UTF-8 sequence at the end of a chunk is left unconsumed in case
+// it continues in the next chunk.
+TransliterationResult TransliterateBopomofoToHanyuPinyin(
+    std::string_view input, bool endOfInput, char* output,
+    size_t outputCapacity, bool includesTone, bool useVForUUmlaut);
+
+// Converts the Hanyu Pinyin in the input to Bopomofo. Like
+// TransliterateBopomofoToHanyuPinyin(), this can be called in chunks.
+TransliterationResult TransliterateHanyuPinyinToBopomofo(
+    std::string_view input, bool endOfInput, char* output,
+    size_t outputCapacity);
+
+// Convenience for converting a whole text.
+std::string BopomofoToHanyuPinyin(std::string_view text, bool includesTone,
+                                  bool useVForUUmlaut);
+std::string HanyuPinyinToBopomofo(std::string_view text);
+
+}  // namespace Mandarin
+}  // namespace Formosa
+
+#endif  // SRC_ENGINE_MANDARIN_TRANSLITERATION_H_
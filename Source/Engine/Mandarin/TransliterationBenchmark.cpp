@@ -0,0 +1,145 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Mandarin.h"
+#include "Transliteration.h"
+
+namespace {
+
+using Formosa::Mandarin::BopomofoSyllable;
+
+constexpr size_t kDocumentSize = 4 * 1024 * 1024;
+
+// Returns readable syllables in a random order, composed as Bopomofo or
+// spelled in Hanyu Pinyin with tone numbers.
+std::vector<std::string> MakeReadings(bool pinyin) {
+  std::vector<std::string> readings;
+  for (BopomofoSyllable::Component c = 0; c <= BopomofoSyllable::S; ++c) {
+    for (BopomofoSyllable::Component v = BopomofoSyllable::A;
+         v <= BopomofoSyllable::ENG; v += BopomofoSyllable::A) {
+      BopomofoSyllable syllable(c | v | BopomofoSyllable::Tone4);
+      readings.push_back(pinyin ? syllable.HanyuPinyinString(true, false)
+                                : syllable.composedString());
+    }
+  }
+  std::shuffle(readings.begin(), readings.end(),
+               std::mt19937(std::mt19937::default_seed));
+  return readings;
+}
+
+// A document of the given kind of text, about kDocumentSize bytes long.
+std::string MakeDocument(const std::vector<std::string>& pieces,
+                         const std::string& separator) {
+  std::string document;
+  document.reserve(kDocumentSize + 64);
+  for (size_t i = 0; document.size() < kDocumentSize; ++i) {
+    document += pieces[i % pieces.size()];
+    document += separator;
+  }
+  return document;
+}
+
+const std::string& CJKDocument() {
+  static const std::string document = MakeDocument(
+      {"中文輸入法", "小麥注音", "，", "以及", "不同的", "詞彙", "。"}, "");
+  return document;
+}
+
+const std::string& ASCIIDocument() {
+  static const std::string document = MakeDocument(
+      {"The", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog"},
+      " ");
+  return document;
+}
+
+const std::string& BopomofoDocument() {
+  static const std::string document = MakeDocument(MakeReadings(false), "-");
+  return document;
+}
+
+const std::string& PinyinDocument() {
+  static const std::string document = MakeDocument(MakeReadings(true), " ");
+  return document;
+}
+
+void BM_BopomofoToHanyuPinyin(benchmark::State& state,
+                              const std::string& document) {
+  for (auto _ : state) {
+    std::string result = Formosa::Mandarin::BopomofoToHanyuPinyin(
+        document, true, false);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(document.size()));
+}
+
+void BM_HanyuPinyinToBopomofo(benchmark::State& state,
+                              const std::string& document) {
+  for (auto _ : state) {
+    std::string result = Formosa::Mandarin::HanyuPinyinToBopomofo(document);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(document.size()));
+}
+
+void BM_BopomofoToHanyuPinyinCJK(benchmark::State& state) {
+  BM_BopomofoToHanyuPinyin(state, CJKDocument());
+}
+BENCHMARK(BM_BopomofoToHanyuPinyinCJK);
+
+void BM_BopomofoToHanyuPinyinASCII(benchmark::State& state) {
+  BM_BopomofoToHanyuPinyin(state, ASCIIDocument());
+}
+BENCHMARK(BM_BopomofoToHanyuPinyinASCII);
+
+void BM_BopomofoToHanyuPinyinReadings(benchmark::State& state) {
+  BM_BopomofoToHanyuPinyin(state, BopomofoDocument());
+}
+BENCHMARK(BM_BopomofoToHanyuPinyinReadings);
+
+void BM_HanyuPinyinToBopomofoCJK(benchmark::State& state) {
+  BM_HanyuPinyinToBopomofo(state, CJKDocument());
+}
+BENCHMARK(BM_HanyuPinyinToBopomofoCJK);
+
+void BM_HanyuPinyinToBopomofoASCII(benchmark::State& state) {
+  BM_HanyuPinyinToBopomofo(state, ASCIIDocument());
+}
+BENCHMARK(BM_HanyuPinyinToBopomofoASCII);
+
+void BM_HanyuPinyinToBopomofoReadings(benchmark::State& state) {
+  BM_HanyuPinyinToBopomofo(state, PinyinDocument());
+}
+BENCHMARK(BM_HanyuPinyinToBopomofoReadings);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,157 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "Transliteration.h"
+
+#include <string>
+
+#include "Mandarin.h"
+#include "gtest/gtest.h"
+
+namespace Formosa {
+namespace Mandarin {
+
+namespace {
+
+// Converts the text in chunks of the given size with the given output
+// capacity, the way TransliterateBopomofoToHanyuPinyin() documents.
+template <typename Transliterate>
+std::string TransliterateInChunks(const std::string& text, size_t chunkSize,
+                                  size_t outputCapacity,
+                                  Transliterate transliterate) {
+  std::string result;
+  std::string pending;
+  std::string output(outputCapacity, '\0');
+  size_t fed = 0;
+  while (fed < text.length() || !pending.empty()) {
+    size_t count = std::min(chunkSize, text.length() - fed);
+    pending += text.substr(fed, count);
+    fed += count;
+    bool endOfInput = fed == text.length();
+    TransliterationResult r =
+        transliterate(pending, endOfInput, output.data(), output.size());
+    result.append(output.data(), r.written);
+    pending.erase(0, r.consumed);
+    if (endOfInput && r.consumed == 0 && r.written == 0 && !pending.empty()) {
+      ADD_FAILURE() << "no progress";
+      break;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(TransliterationTest, BopomofoToHanyuPinyin) {
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄓㄨㄤˋ", true, false), "zhuang4");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄕㄨ-ㄖㄨˋ-ㄈㄚˇ", true, false),
+            "shu-ru4-fa3");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄇㄚˇㄇㄚ", true, false), "ma3ma");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄇㄚˇㄇㄚ", false, false), "mama");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄋㄩˇ", true, false), "nü3");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄋㄩˇ", true, true), "nv3");
+  EXPECT_EQ(BopomofoToHanyuPinyin("中文（ㄓㄨㄥ ㄨㄣˊ）、ok", true, false),
+            "中文（zhong wen2）、ok");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ˊ˙ㄅ", true, false), "ˊ˙b");
+  EXPECT_EQ(BopomofoToHanyuPinyin("", true, false), "");
+  EXPECT_EQ(BopomofoToHanyuPinyin("\xe3\x84", true, false), "\xe3\x84");
+  EXPECT_EQ(BopomofoToHanyuPinyin("ㄅ\xe3", true, false), "b\xe3");
+}
+
+TEST(TransliterationTest, HanyuPinyinToBopomofo) {
+  EXPECT_EQ(HanyuPinyinToBopomofo("zhuang4"), "ㄓㄨㄤˋ");
+  EXPECT_EQ(HanyuPinyinToBopomofo("Zhong1guo2"), "ㄓㄨㄥㄍㄨㄛˊ");
+  EXPECT_EQ(HanyuPinyinToBopomofo("zhongguo"), "ㄓㄨㄥㄍㄨㄛ");
+  EXPECT_EQ(HanyuPinyinToBopomofo("shu-ru4-fa3"), "ㄕㄨ-ㄖㄨˋ-ㄈㄚˇ");
+  EXPECT_EQ(HanyuPinyinToBopomofo("ma1 ma5"), "ㄇㄚ ㄇㄚ˙");
+  EXPECT_EQ(HanyuPinyinToBopomofo("lü4 lv4 nü3"), "ㄌㄩˋ ㄌㄩˋ ㄋㄩˇ");
+  EXPECT_EQ(HanyuPinyinToBopomofo("zhi shi ri"), "ㄓ ㄕ ㄖ");
+  EXPECT_EQ(HanyuPinyinToBopomofo("hello, x86 h2o ma12"),
+            "hello, x86 h2o ma12");
+  EXPECT_EQ(HanyuPinyinToBopomofo("中文（zhong wen2）"), "中文（ㄓㄨㄥ ㄨㄣˊ）");
+  EXPECT_EQ(HanyuPinyinToBopomofo("b"), "b");
+  EXPECT_EQ(HanyuPinyinToBopomofo(""), "");
+  EXPECT_EQ(HanyuPinyinToBopomofo("\xc3"), "\xc3");
+}
+
+TEST(TransliterationTest, RoundTripsAllSyllables) {
+  std::string bopomofo;
+  std::string pinyin;
+  for (BPMF::Component c = 0; c <= BPMF::S; ++c) {
+    for (BPMF::Component m = 0; m <= BPMF::UE; m += BPMF::I) {
+      for (BPMF::Component v = 0; v <= BPMF::ERR; v += BPMF::A) {
+        for (BPMF::Component t = 0; t <= BPMF::Tone5; t += BPMF::Tone2) {
+          BPMF syllable(c | m | v | t);
+          // Lone tone markers are copied as they are.
+          if (!c && !m && !v) {
+            continue;
+          }
+          std::string spelled = syllable.HanyuPinyinString(true, false);
+          EXPECT_EQ(BopomofoToHanyuPinyin(syllable.composedString(), true,
+                                          false),
+                    spelled);
+
+          BPMF exact;
+          if (BPMF::FromExactHanyuPinyin(spelled, &exact) &&
+              (exact.hasMiddleVowel() || exact.hasVowel())) {
+            EXPECT_EQ(HanyuPinyinToBopomofo(spelled), exact.composedString())
+                << spelled;
+          }
+          bopomofo += syllable.composedString() + " ";
+          pinyin += spelled + " ";
+        }
+      }
+    }
+  }
+  EXPECT_EQ(BopomofoToHanyuPinyin(bopomofo, true, false), pinyin);
+}
+
+TEST(TransliterationTest, ChunkedConversionMatchesWholeConversion) {
+  std::string bopomofo =
+      "中文（ㄓㄨㄥ ㄨㄣˊ）、ㄇㄚˇㄇㄚ ok? ˊ ㄕㄨ-ㄖㄨˋ-ㄈㄚˇ ㄋㄩˇ\xe3\x84ㄦ";
+  std::string pinyin =
+      "中文（zhong1 wen2）、Zhong1guo2 hello lü4 x86 shu-ru4-fa3 ma12 "
+      "supercalifragilisticexpialidocious zhi";
+  for (size_t chunkSize : {1, 2, 3, 5, 7, 16, 1024}) {
+    for (size_t capacity : {MinimumTransliterationOutputCapacity,
+                            size_t{64}, size_t{4096}}) {
+      EXPECT_EQ(
+          TransliterateInChunks(
+              bopomofo, chunkSize, capacity,
+              [](std::string_view input, bool endOfInput, char* output,
+                 size_t outputCapacity) {
+                return TransliterateBopomofoToHanyuPinyin(
+                    input, endOfInput, output, outputCapacity, true, false);
+              }),
+          BopomofoToHanyuPinyin(bopomofo, true, false))
+          << chunkSize << " " << capacity;
+      EXPECT_EQ(TransliterateInChunks(pinyin, chunkSize, capacity,
+                                      TransliterateHanyuPinyinToBopomofo),
+                HanyuPinyinToBopomofo(pinyin))
+          << chunkSize << " " << capacity;
+    }
+  }
+}
+
+}  // namespace Mandarin
+}  // namespace Formosa
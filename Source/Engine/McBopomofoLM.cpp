@@ -24,13 +24,19 @@
 #include "McBopomofoLM.h"
 
 #include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "Trace.h"
 #include "gramambular2/reading_grid.h"
 
 namespace McBopomofo {
@@ -38,19 +44,45 @@ namespace McBopomofo {
 static constexpr std::string_view kMacroPrefix = "MACRO@";
 static constexpr double kMacroScore = -8.0;
 
+class McBopomofoLM::ScopedComponentLoad {
+ public:
+  ScopedComponentLoad(McBopomofoLM* lm, Component component)
+      : lm_(lm),
+        component_(component),
+        lock_(lm->componentMutex(component)) {
+    lm_->markComponentLoading(component_);
+  }
+  ~ScopedComponentLoad() { lm_->markComponentReady(component_); }
+
+  ScopedComponentLoad(const ScopedComponentLoad&) = delete;
+  ScopedComponentLoad& operator=(const ScopedComponentLoad&) = delete;
+
+ private:
+  McBopomofoLM* lm_;
+  Component component_;
+  std::unique_lock<std::shared_mutex> lock_;
+};
+
+std::shared_mutex& McBopomofoLM::componentMutex(Component component) const {
+  return componentMutexes_[std::countr_zero(static_cast<uint32_t>(component))];
+}
+
 void McBopomofoLM::loadLanguageModel(const char* languageModelDataPath) {
   if (languageModelDataPath) {
+    ScopedComponentLoad load(this, Component::LANGUAGE_MODEL);
     languageModel_.close();
     languageModel_.open(languageModelDataPath);
   }
 }
 
 bool McBopomofoLM::isDataModelLoaded() const {
-  return languageModel_.isLoaded();
+  return isComponentReady(Component::LANGUAGE_MODEL) &&
+         languageModel_.isLoaded();
 }
 
 void McBopomofoLM::loadAssociatedPhrasesV2(const char* associatedPhrasesPath) {
   if (associatedPhrasesPath) {
+    ScopedComponentLoad load(this, Component::ASSOCIATED_PHRASES);
     associatedPhrasesV2_.close();
     associatedPhrasesV2_.open(associatedPhrasesPath);
   }
@@ -58,39 +90,155 @@ void McBopomofoLM::loadAssociatedPhrasesV2(const char* associatedPhrasesPath) {
 
 void McBopomofoLM::loadUserPhrases(const char* userPhrasesDataPath,
                                    const char* excludedPhrasesDataPath) {
-  userPhrases_.close();
-  excludedPhrases_.close();
+  ScopedComponentLoad load(this, Component::USER_PHRASES);
 
-  if (userPhrasesDataPath) {
-    userPhrasesDataPath_ = userPhrasesDataPath;
-    userPhrases_.open(userPhrasesDataPath);
+  // Reloading the same file only parses what has been appended to it, which
+  // is the common case after the user adds a phrase.
+  if (userPhrasesDataPath && userPhrasesDataPath_ == userPhrasesDataPath) {
+    userPhrases_.reload(userPhrasesDataPath);
   } else {
-    userPhrasesDataPath_.reset();
+    userPhrases_.close();
+    if (userPhrasesDataPath) {
+      userPhrasesDataPath_ = userPhrasesDataPath;
+      userPhrases_.open(userPhrasesDataPath,
+                        snapshotPathFor(userPhrasesDataPath));
+    } else {
+      userPhrasesDataPath_.reset();
+    }
   }
 
-  if (excludedPhrasesDataPath) {
-    excludedPhrasesDataPath_ = excludedPhrasesDataPath;
-    excludedPhrases_.open(excludedPhrasesDataPath);
+  if (excludedPhrasesDataPath &&
+      excludedPhrasesDataPath_ == excludedPhrasesDataPath) {
+    excludedPhrases_.reload(excludedPhrasesDataPath);
   } else {
-    excludedPhrasesDataPath_.reset();
+    excludedPhrases_.close();
+    if (excludedPhrasesDataPath) {
+      excludedPhrasesDataPath_ = excludedPhrasesDataPath;
+      excludedPhrases_.open(excludedPhrasesDataPath,
+                            snapshotPathFor(excludedPhrasesDataPath));
+    } else {
+      excludedPhrasesDataPath_.reset();
+    }
   }
 }
 
+bool McBopomofoLM::addUserPhrase(const std::string& reading,
+                                 const std::string& value) {
+  if (!isComponentReady(Component::USER_PHRASES)) {
+    return false;
+  }
+  std::unique_lock<std::shared_mutex> lock(
+      componentMutex(Component::USER_PHRASES));
+  userPhrases_.addPhrase(reading, value);
+  return true;
+}
+
+bool McBopomofoLM::removeUserPhrase(const std::string& reading,
+                                    const std::string& value) {
+  if (!isComponentReady(Component::USER_PHRASES)) {
+    return false;
+  }
+  std::unique_lock<std::shared_mutex> lock(
+      componentMutex(Component::USER_PHRASES));
+  userPhrases_.removePhrase(reading, value);
+  return true;
+}
+
 bool McBopomofoLM::isAssociatedPhrasesV2Loaded() const {
-  return associatedPhrasesV2_.isLoaded();
+  return isComponentReady(Component::ASSOCIATED_PHRASES) &&
+         associatedPhrasesV2_.isLoaded();
 }
 
 void McBopomofoLM::loadPhraseReplacementMap(const char* phraseReplacementPath) {
+  ScopedComponentLoad load(this, Component::PHRASE_REPLACEMENT_MAP);
   phraseReplacement_.close();
 
   if (phraseReplacementPath) {
     phraseReplacementPath_ = phraseReplacementPath;
-    phraseReplacement_.open(phraseReplacementPath);
+    phraseReplacement_.open(phraseReplacementPath,
+                            snapshotPathFor(phraseReplacementPath));
   } else {
     phraseReplacementPath_.reset();
   }
 }
 
+void McBopomofoLM::setSnapshotDirectory(
+    const std::optional<std::filesystem::path>& directory) {
+  snapshotDirectory_ = directory;
+}
+
+std::filesystem::path McBopomofoLM::snapshotPathFor(
+    const std::filesystem::path& dataPath) const {
+  if (!snapshotDirectory_.has_value()) {
+    return {};
+  }
+  // Files with the same name in different directories need their own
+  // snapshots, so the name includes a hash of the full path.
+  std::error_code ec;
+  std::filesystem::path fullPath =
+      std::filesystem::weakly_canonical(dataPath, ec);
+  if (ec) {
+    fullPath = std::filesystem::absolute(dataPath, ec);
+  }
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016llx",
+           static_cast<unsigned long long>(
+               std::hash<std::string>()(fullPath.string())));
+  std::filesystem::path name = dataPath.filename();
+  name += ".";
+  name += hash;
+  name += ".snapshot";
+  return *snapshotDirectory_ / name;
+}
+
+bool McBopomofoLM::isComponentReady(Component component) const {
+  return (readyComponents_.load(std::memory_order_acquire) &
+          static_cast<uint32_t>(component)) != 0;
+}
+
+MemoryUsage McBopomofoLM::memoryUsage(Component component) const {
+  std::shared_lock<std::shared_mutex> lock(componentMutex(component),
+                                           std::try_to_lock);
+  if (!lock.owns_lock() || !isComponentReady(component)) {
+    return {};
+  }
+  switch (component) {
+    case Component::LANGUAGE_MODEL:
+      return languageModel_.memoryUsage();
+    case Component::ASSOCIATED_PHRASES:
+      return associatedPhrasesV2_.memoryUsage();
+    case Component::USER_PHRASES:
+      return userPhrases_.memoryUsage() + excludedPhrases_.memoryUsage();
+    case Component::PHRASE_REPLACEMENT_MAP:
+      return phraseReplacement_.memoryUsage();
+  }
+  return {};
+}
+
+MemoryUsage McBopomofoLM::memoryUsage() const {
+  return memoryUsage(Component::LANGUAGE_MODEL) +
+         memoryUsage(Component::ASSOCIATED_PHRASES) +
+         memoryUsage(Component::USER_PHRASES) +
+         memoryUsage(Component::PHRASE_REPLACEMENT_MAP);
+}
+
+MemoryUsage McBopomofoLM::GridMemoryUsage(
+    const Formosa::Gramambular2::ReadingGrid& grid) {
+  MemoryUsage usage;
+  usage.heapBytes = grid.memoryUsage().heapBytes;
+  return usage;
+}
+
+void McBopomofoLM::markComponentLoading(Component component) {
+  readyComponents_.fetch_and(~static_cast<uint32_t>(component),
+                             std::memory_order_acq_rel);
+}
+
+void McBopomofoLM::markComponentReady(Component component) {
+  readyComponents_.fetch_or(static_cast<uint32_t>(component),
+                            std::memory_order_release);
+}
+
 static McBopomofoLM::IssueType TranslateIssue(
     ByteBlockBackedDictionary::Issue::Type t) {
   switch (t) {
@@ -108,7 +256,8 @@ std::vector<McBopomofoLM::UserFileIssue> McBopomofoLM::getUserFileIssues()
     const {
   std::vector<McBopomofoLM::UserFileIssue> issues;
 
-  if (userPhrasesDataPath_.has_value()) {
+  bool userPhrasesReady = isComponentReady(Component::USER_PHRASES);
+  if (userPhrasesReady && userPhrasesDataPath_.has_value()) {
     for (const auto& issue : userPhrases_.getParsingIssues()) {
       issues.emplace_back(McBopomofoLM::UserFileType::USER_PHRASES,
                           userPhrasesDataPath_.value(),
@@ -116,7 +265,7 @@ std::vector<McBopomofoLM::UserFileIssue> McBopomofoLM::getUserFileIssues()
     }
   }
 
-  if (excludedPhrasesDataPath_.has_value()) {
+  if (userPhrasesReady && excludedPhrasesDataPath_.has_value()) {
     for (const auto& issue : excludedPhrases_.getParsingIssues()) {
       issues.emplace_back(McBopomofoLM::UserFileType::EXCLUDED_PHRASES,
                           excludedPhrasesDataPath_.value(),
@@ -124,7 +273,8 @@ std::vector<McBopomofoLM::UserFileIssue> McBopomofoLM::getUserFileIssues()
     }
   }
 
-  if (phraseReplacementPath_.has_value()) {
+  if (isComponentReady(Component::PHRASE_REPLACEMENT_MAP) &&
+      phraseReplacementPath_.has_value()) {
     for (const auto& issue : phraseReplacement_.getParsingIssues()) {
       issues.emplace_back(McBopomofoLM::UserFileType::PHRASE_REPLACEMENT_MAP,
                           phraseReplacementPath_.value(),
@@ -137,6 +287,7 @@ std::vector<McBopomofoLM::UserFileIssue> McBopomofoLM::getUserFileIssues()
 
 std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
 McBopomofoLM::getUnigrams(const std::string& key) {
+  MCBOPOMOFO_TRACE_SCOPE("McBopomofoLM::getUnigrams");
   if (key == " ") {
     std::vector<Formosa::Gramambular2::LanguageModel::Unigram> spaceUnigrams;
     spaceUnigrams.emplace_back(" ", 0);
@@ -149,7 +300,8 @@ McBopomofoLM::getUnigrams(const std::string& key) {
   std::unordered_set<std::string> excludedValues;
   std::unordered_set<std::string> insertedValues;
 
-  if (excludedPhrases_.hasUnigrams(key)) {
+  bool userPhrasesReady = isComponentReady(Component::USER_PHRASES);
+  if (userPhrasesReady && excludedPhrases_.hasUnigrams(key)) {
     std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
         excludedUnigrams = excludedPhrases_.getUnigrams(key);
     std::transform(excludedUnigrams.begin(), excludedUnigrams.end(),
@@ -159,14 +311,15 @@ McBopomofoLM::getUnigrams(const std::string& key) {
                    });
   }
 
-  if (userPhrases_.hasUnigrams(key)) {
+  if (userPhrasesReady && userPhrases_.hasUnigrams(key)) {
     std::vector<Formosa::Gramambular2::LanguageModel::Unigram> rawUserUnigrams =
         userPhrases_.getUnigrams(key);
     userUnigrams = filterAndTransformUnigrams(rawUserUnigrams, excludedValues,
                                               insertedValues);
   }
 
-  if (languageModel_.hasUnigrams(key)) {
+  if (isComponentReady(Component::LANGUAGE_MODEL) &&
+      languageModel_.hasUnigrams(key)) {
     std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
         rawGlobalUnigrams = languageModel_.getUnigrams(key);
     allUnigrams = filterAndTransformUnigrams(rawGlobalUnigrams, excludedValues,
@@ -223,14 +376,20 @@ bool McBopomofoLM::hasUnigrams(const std::string& key) {
     return true;
   }
 
-  if (!excludedPhrases_.hasUnigrams(key)) {
-    return userPhrases_.hasUnigrams(key) || languageModel_.hasUnigrams(key);
+  bool userPhrasesReady = isComponentReady(Component::USER_PHRASES);
+  if (!userPhrasesReady || !excludedPhrases_.hasUnigrams(key)) {
+    return (userPhrasesReady && userPhrases_.hasUnigrams(key)) ||
+           (isComponentReady(Component::LANGUAGE_MODEL) &&
+            languageModel_.hasUnigrams(key));
   }
 
   return !getUnigrams(key).empty();
 }
 
 std::string McBopomofoLM::getReading(const std::string& value) const {
+  if (!isComponentReady(Component::LANGUAGE_MODEL)) {
+    return {};
+  }
   std::vector<ParselessLM::FoundReading> foundReadings =
       languageModel_.getReadings(value);
   double topScore = std::numeric_limits<double>::lowest();
@@ -247,6 +406,9 @@ std::string McBopomofoLM::getReading(const std::string& value) const {
 std::vector<AssociatedPhrasesV2::Phrase> McBopomofoLM::findAssociatedPhrasesV2(
     const std::string& prefixValue,
     const std::vector<std::string>& prefixReadings) const {
+  if (!isComponentReady(Component::ASSOCIATED_PHRASES)) {
+    return {};
+  }
   return associatedPhrasesV2_.findPhrases(prefixValue, prefixReadings);
 }
 
@@ -299,7 +461,8 @@ McBopomofoLM::filterAndTransformUnigrams(
     }
 
     std::string value = rawValue;
-    if (phraseReplacementEnabled_) {
+    if (phraseReplacementEnabled_ &&
+        isComponentReady(Component::PHRASE_REPLACEMENT_MAP)) {
       std::string replacement = phraseReplacement_.valueForKey(value);
       if (!replacement.empty()) {
         if (value != replacement) {
@@ -335,27 +498,32 @@ McBopomofoLM::filterAndTransformUnigrams(
 }
 
 void McBopomofoLM::loadLanguageModel(std::unique_ptr<ParselessPhraseDB> db) {
+  ScopedComponentLoad load(this, Component::LANGUAGE_MODEL);
   languageModel_.close();
   languageModel_.open(std::move(db));
 }
 
 void McBopomofoLM::loadAssociatedPhrasesV2(
     std::unique_ptr<ParselessPhraseDB> db) {
+  ScopedComponentLoad load(this, Component::ASSOCIATED_PHRASES);
   associatedPhrasesV2_.close();
   associatedPhrasesV2_.open(std::move(db));
 }
 
 void McBopomofoLM::loadUserPhrases(const char* data, size_t length) {
+  ScopedComponentLoad load(this, Component::USER_PHRASES);
   userPhrases_.close();
   userPhrases_.load(data, length);
 }
 
 void McBopomofoLM::loadExcludedPhrases(const char* data, size_t length) {
+  ScopedComponentLoad load(this, Component::USER_PHRASES);
   excludedPhrases_.close();
   excludedPhrases_.load(data, length);
 }
 
 void McBopomofoLM::loadPhraseReplacementMap(const char* data, size_t length) {
+  ScopedComponentLoad load(this, Component::PHRASE_REPLACEMENT_MAP);
   phraseReplacement_.close();
   phraseReplacement_.load(data, length);
 }
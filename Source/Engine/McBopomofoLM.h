@@ -24,19 +24,25 @@
 #ifndef SRC_ENGINE_MCBOPOMOFOLM_H_
 #define SRC_ENGINE_MCBOPOMOFOLM_H_
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <shared_mutex>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
 #include "AssociatedPhrasesV2.h"
+#include "MemoryUsage.h"
 #include "ParselessLM.h"
 #include "PhraseReplacementMap.h"
 #include "UserPhrasesLM.h"
 #include "gramambular2/language_model.h"
+#include "gramambular2/reading_grid.h"
 
 namespace McBopomofo {
 
@@ -82,9 +88,55 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   void loadUserPhrases(const char* userPhrasesDataPath,
                        const char* excludedPhrasesDataPath);
 
+  // Adds or removes a user phrase. The change takes effect on the next lookup
+  // and is written to the user phrases file in the background. Returns false
+  // if the user phrases are still being loaded.
+  bool addUserPhrase(const std::string& reading, const std::string& value);
+  bool removeUserPhrase(const std::string& reading, const std::string& value);
+
   // Loads (or reloads if already loaded) the phrase replacement mapping file.
   void loadPhraseReplacementMap(const char* phraseReplacementPath);
 
+  // Sets the directory where the parsed user phrases, excluded phrases, and
+  // phrase replacement files are cached as snapshots, which lets the next
+  // launch skip parsing files that have not changed. Takes effect on the next
+  // load. The default, std::nullopt, disables snapshots.
+  void setSnapshotDirectory(
+      const std::optional<std::filesystem::path>& directory);
+
+  // The parts of the model that are loaded separately. A component that is not
+  // ready is skipped by lookups, so that the model can serve what it already
+  // has while the other components are still being loaded.
+  enum class Component : uint32_t {
+    LANGUAGE_MODEL = 1 << 0,
+    ASSOCIATED_PHRASES = 1 << 1,
+    // Both the user phrases and the excluded phrases.
+    USER_PHRASES = 1 << 2,
+    PHRASE_REPLACEMENT_MAP = 1 << 3,
+  };
+
+  // Whether the component has finished loading (successfully or not) and is
+  // consulted by lookups. Safe to call from any thread.
+  bool isComponentReady(Component component) const;
+
+  // Marks the component as not ready, so that lookups stop consulting it.
+  // This must be called on the thread that performs lookups before the
+  // component is reloaded on another thread, which is what EngineLoader does.
+  // The matching load* method marks the component ready again once done.
+  void markComponentLoading(Component component);
+
+  // The memory the component takes, or nothing if it is not ready or is
+  // being loaded. Safe to call from any thread; it does not wait for a load.
+  MemoryUsage memoryUsage(Component component) const;
+
+  // The total of all components.
+  MemoryUsage memoryUsage() const;
+
+  // The memory of a reading grid in the engine's terms. The grid's nodes
+  // hold copies of the unigrams, so this is all heap.
+  static MemoryUsage GridMemoryUsage(
+      const Formosa::Gramambular2::ReadingGrid& grid);
+
   // Returns a list of unigrams for the reading. For example, if the reading is
   // "ㄇㄚ", the return may be [unigram("嗎"), unigram("媽") and so on.
   std::vector<Formosa::Gramambular2::LanguageModel::Unigram> getUnigrams(
@@ -154,6 +206,19 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
       const std::unordered_set<std::string>& excludedValues,
       std::unordered_set<std::string>& insertedValues) const;
 
+  void markComponentReady(Component component);
+
+  // Marks the component loading, and holds its mutex exclusively, for its
+  // lifetime, then marks the component ready.
+  class ScopedComponentLoad;
+
+  std::shared_mutex& componentMutex(Component component) const;
+
+  // The snapshot path for a data file, named after the file and a hash of its
+  // canonical path, or an empty path without a snapshot directory.
+  std::filesystem::path snapshotPathFor(
+      const std::filesystem::path& dataPath) const;
+
   ParselessLM languageModel_;
   UserPhrasesLM userPhrases_;
   UserPhrasesLM excludedPhrases_;
@@ -163,6 +228,7 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   std::optional<std::filesystem::path> userPhrasesDataPath_;
   std::optional<std::filesystem::path> excludedPhrasesDataPath_;
   std::optional<std::filesystem::path> phraseReplacementPath_;
+  std::optional<std::filesystem::path> snapshotDirectory_;
 
   bool phraseReplacementEnabled_ = false;
 
@@ -170,6 +236,14 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   std::function<std::string(const std::string&)> externalConverter_;
 
   std::function<std::string(const std::string&)> macroConverter_;
+
+  // A bit set of Component values.
+  std::atomic<uint32_t> readyComponents_ = 0;
+
+  // One per Component, held exclusively while the component is replaced or
+  // changed, so that memoryUsage() never reads a component in the middle of a
+  // load or of a user phrase edit.
+  mutable std::array<std::shared_mutex, 4> componentMutexes_;
 };
 
 }  // namespace McBopomofo
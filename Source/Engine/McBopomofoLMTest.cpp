@@ -21,9 +21,11 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <atomic>
 #include <cmath>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 
 #include "McBopomofoLM.h"
@@ -114,6 +116,88 @@ TEST(McBopomofoLMTest, UserPhrases) {
   EXPECT_EQ(unigrams[0].value(), "茗");
 }
 
+TEST(McBopomofoLMTest, MemoryUsageAddsUpComponents) {
+  McBopomofoLM lm;
+  EXPECT_EQ(lm.memoryUsage(), MemoryUsage{});
+
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  lm.loadExcludedPhrases(kExcludedPhrasesData, sizeof(kExcludedPhrasesData));
+  lm.loadPhraseReplacementMap(kPhreaseReplacementMapData,
+                              sizeof(kPhreaseReplacementMapData));
+
+  MemoryUsage userPhrases =
+      lm.memoryUsage(McBopomofoLM::Component::USER_PHRASES);
+  MemoryUsage phraseReplacement =
+      lm.memoryUsage(McBopomofoLM::Component::PHRASE_REPLACEMENT_MAP);
+  EXPECT_GT(userPhrases.heapBytes, 0);
+  EXPECT_GT(phraseReplacement.heapBytes, 0);
+  EXPECT_EQ(lm.memoryUsage(),
+            lm.memoryUsage(McBopomofoLM::Component::LANGUAGE_MODEL) +
+                lm.memoryUsage(McBopomofoLM::Component::ASSOCIATED_PHRASES) +
+                userPhrases + phraseReplacement);
+
+  // A component being loaded is not counted.
+  lm.markComponentLoading(McBopomofoLM::Component::USER_PHRASES);
+  EXPECT_EQ(lm.memoryUsage(McBopomofoLM::Component::USER_PHRASES),
+            MemoryUsage{});
+}
+
+TEST(McBopomofoLMTest, MemoryUsageWhileLoadingOnAnotherThread) {
+  McBopomofoLM lm;
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  MemoryUsage loaded = lm.memoryUsage(McBopomofoLM::Component::USER_PHRASES);
+  ASSERT_GT(loaded.heapBytes, 0);
+
+  std::atomic<bool> done = false;
+  std::thread loader([&lm, &done] {
+    for (int i = 0; i < 200; ++i) {
+      lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+    }
+    done = true;
+  });
+  // A component is either skipped while it is loaded, or counted in full.
+  while (!done) {
+    MemoryUsage usage =
+        lm.memoryUsage(McBopomofoLM::Component::USER_PHRASES);
+    EXPECT_TRUE(usage == MemoryUsage{} || usage == loaded);
+  }
+  loader.join();
+}
+
+TEST(McBopomofoLMTest, MemoryUsageWhileEditingUserPhrases) {
+  McBopomofoLM lm;
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+
+  std::atomic<bool> done = false;
+  std::thread reader([&lm, &done] {
+    while (!done) {
+      lm.memoryUsage(McBopomofoLM::Component::USER_PHRASES);
+    }
+  });
+  for (int i = 0; i < 200; ++i) {
+    std::string value = "冥" + std::to_string(i);
+    EXPECT_TRUE(lm.addUserPhrase("ㄇㄧㄥˊ", value));
+    EXPECT_TRUE(lm.removeUserPhrase("ㄇㄧㄥˊ", value));
+  }
+  done = true;
+  reader.join();
+}
+
+TEST(McBopomofoLMTest, GridMemoryUsage) {
+  auto lm = std::make_shared<McBopomofoLM>();
+  lm->loadLanguageModel(std::make_unique<ParselessPhraseDB>(
+      kPrimaryLMData, sizeof(kPrimaryLMData)));
+  Formosa::Gramambular2::ReadingGrid grid(lm);
+  grid.insertReading("ㄇㄧㄥˊ");
+
+  MemoryUsage usage = McBopomofoLM::GridMemoryUsage(grid);
+  EXPECT_EQ(usage.heapBytes, grid.memoryUsage().heapBytes);
+  EXPECT_EQ(usage.mappedBytes, 0);
+}
+
 TEST(McBopomofoLMTest, ExcludedPhrases) {
   McBopomofoLM lm;
   auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
@@ -285,4 +369,25 @@ TEST(McBopomofoLMTest, MacroValueNotRecognizedByMacroConverterIsFiltered) {
   EXPECT_EQ(unigrams[1].value(), "6/10/21");
 }
 
+TEST(McBopomofoLMTest, AddAndRemoveUserPhrases) {
+  McBopomofoLM lm;
+  EXPECT_FALSE(lm.addUserPhrase("ㄇㄧㄥˊ", "茗"));
+
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+
+  EXPECT_TRUE(lm.addUserPhrase("ㄇㄧㄥˊ", "冥"));
+  auto unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_GE(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[0].value(), "茗");
+  EXPECT_EQ(unigrams[1].value(), "冥");
+
+  EXPECT_TRUE(lm.removeUserPhrase("ㄇㄧㄥˊ", "茗"));
+  unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_FALSE(unigrams.empty());
+  EXPECT_EQ(unigrams[0].value(), "冥");
+}
+
 }  // namespace McBopomofo
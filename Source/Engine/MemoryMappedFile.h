@@ -26,6 +26,8 @@
 
 #include <cstddef>
 
+#include "MemoryUsage.h"
+
 namespace McBopomofo {
 
 // A wrapper for managing a memory-mapped file.
@@ -57,6 +59,10 @@ class MemoryMappedFile {
   // Returns the length of the data, which is the length of the file upon open.
   [[nodiscard]] size_t length() const { return length_; }
 
+  [[nodiscard]] MemoryUsage memoryUsage() const {
+    return MappedMemoryUsage(data_, length_);
+  }
+
  private:
   int fd_ = -1;           // POSIX file descriptor used by the mmap call
   void* data_ = nullptr;  // actual mapped data
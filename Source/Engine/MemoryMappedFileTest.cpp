@@ -30,6 +30,7 @@
 #include <utility>
 
 #include "MemoryMappedFile.h"
+#include "TestTempDir.h"
 #include "gtest/gtest.h"
 
 namespace McBopomofo {
@@ -64,30 +65,6 @@ class TempFile {
   std::string path_;
 };
 
-class TempDir {
- public:
-  TempDir() {
-    std::filesystem::path p = std::filesystem::temp_directory_path() /
-                              "org.openvanilla.mcbopomofo.XXXXXX";
-    path_ = p.native();
-    char* result = mkdtemp(path_.data());
-    assert(result != nullptr);
-    fprintf(stderr, "TEMPDIR: %s\n", result);
-  }
-
-  ~TempDir() {
-    std::error_code ec;
-    bool result = std::filesystem::remove(path_, ec);
-    assert(result);
-    (void)result;
-  }
-
-  const char* path() const { return path_.c_str(); }
-
- protected:
-  std::string path_;
-};
-
 TEST(MemoryMappedFileTest, UnopenedInstance) {
   MemoryMappedFile mf;
   EXPECT_FALSE(mf.isOpen());
@@ -204,9 +181,9 @@ TEST(MemoryMappedFileTest, OpenFailureOnEmptyFile) {
 }
 
 TEST(MemoryMappedFileTest, OpenFailureOnDirectory) {
-  TempDir dir;
+  TestTempDir dir;
   MemoryMappedFile mf;
-  EXPECT_FALSE(mf.open(dir.path()));
+  EXPECT_FALSE(mf.open(dir.path().c_str()));
   EXPECT_FALSE(mf.isOpen());
   EXPECT_EQ(mf.length(), 0);
   EXPECT_EQ(mf.data(), nullptr);
@@ -217,4 +194,28 @@ TEST(MemoryMappedFileTest, OpenFailureOnDirectory) {
   EXPECT_FALSE(mf.isOpen());
 }
 
+TEST(MemoryMappedFileTest, MemoryUsage) {
+  MemoryMappedFile mf;
+  EXPECT_EQ(mf.memoryUsage(), MemoryUsage{});
+
+  std::string content(3 * 4096 + 100, 'x');
+  TempFile temp(content.data(), content.size());
+  ASSERT_TRUE(mf.open(temp.path()));
+
+  // Touch every byte so that all the pages are resident.
+  size_t sum = 0;
+  for (size_t i = 0; i < mf.length(); ++i) {
+    sum += static_cast<unsigned char>(mf.data()[i]);
+  }
+  EXPECT_EQ(sum, content.size() * 'x');
+
+  MemoryUsage usage = mf.memoryUsage();
+  EXPECT_EQ(usage.mappedBytes, content.size());
+  EXPECT_EQ(usage.residentMappedBytes, content.size());
+  EXPECT_EQ(usage.heapBytes, 0);
+
+  mf.close();
+  EXPECT_EQ(mf.memoryUsage(), MemoryUsage{});
+}
+
 }  // namespace McBopomofo
@@ -0,0 +1,76 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "MemoryUsage.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace McBopomofo {
+
+MemoryUsage MappedMemoryUsage(const void* data, size_t length) {
+  MemoryUsage usage;
+  if (data == nullptr || length == 0) {
+    return usage;
+  }
+  usage.mappedBytes = length;
+
+  long pageSizeResult = sysconf(_SC_PAGESIZE);
+  if (pageSizeResult <= 0) {
+    return usage;
+  }
+  auto pageSize = static_cast<uintptr_t>(pageSizeResult);
+  auto begin = reinterpret_cast<uintptr_t>(data);
+  uintptr_t end = begin + length;
+  uintptr_t firstPage = begin & ~(pageSize - 1);
+  size_t pageCount = (end - firstPage + pageSize - 1) / pageSize;
+
+  // mincore() takes a char vector on Darwin and an unsigned char one on
+  // Linux.
+#if defined(__APPLE__)
+  std::vector<char> residency(pageCount);
+#else
+  std::vector<unsigned char> residency(pageCount);
+#endif
+  if (mincore(reinterpret_cast<void*>(firstPage), end - firstPage,
+              residency.data()) != 0) {
+    return usage;
+  }
+
+  for (size_t i = 0; i < pageCount; ++i) {
+    if ((residency[i] & 1) == 0) {
+      continue;
+    }
+    uintptr_t pageBegin = firstPage + i * pageSize;
+    uintptr_t pageEnd = pageBegin + pageSize;
+    usage.residentMappedBytes +=
+        std::min(pageEnd, end) - std::max(pageBegin, begin);
+  }
+  return usage;
+}
+
+}  // namespace McBopomofo
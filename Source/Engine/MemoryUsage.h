@@ -0,0 +1,93 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_MEMORYUSAGE_H_
+#define SRC_ENGINE_MEMORYUSAGE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace McBopomofo {
+
+// The memory an engine object takes, by category. See memoryUsage() of the
+// engine classes.
+struct MemoryUsage {
+  // The bytes of the files the object has mapped into memory. The pages are
+  // backed by the files and shared with other processes that map them.
+  size_t mappedBytes = 0;
+
+  // The bytes of the mapped files that are in physical memory right now, as
+  // reported by mincore(2). At most mappedBytes.
+  size_t residentMappedBytes = 0;
+
+  // The bytes the object has allocated on the heap, counted from the sizes
+  // and capacities of its containers. Allocator overhead is not included.
+  size_t heapBytes = 0;
+
+  MemoryUsage& operator+=(const MemoryUsage& other) {
+    mappedBytes += other.mappedBytes;
+    residentMappedBytes += other.residentMappedBytes;
+    heapBytes += other.heapBytes;
+    return *this;
+  }
+
+  friend MemoryUsage operator+(MemoryUsage a, const MemoryUsage& b) {
+    a += b;
+    return a;
+  }
+
+  bool operator==(const MemoryUsage&) const = default;
+};
+
+// Returns the usage of the mapped memory from data to data + length.
+MemoryUsage MappedMemoryUsage(const void* data, size_t length);
+
+// The heap bytes of a string, which are none if the string is short enough to
+// be stored inside the string object.
+inline size_t StringHeapBytes(const std::string& s) {
+  const char* object = reinterpret_cast<const char*>(&s);
+  if (s.data() >= object && s.data() < object + sizeof(s)) {
+    return 0;
+  }
+  return s.capacity() + 1;
+}
+
+template <typename T>
+size_t VectorHeapBytes(const std::vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+// The heap bytes of a node-based unordered container, not counting what its
+// elements allocate: the bucket array, and one node per element holding the
+// element, the link to the next node and the cached hash.
+template <typename UnorderedContainer>
+size_t UnorderedContainerHeapBytes(const UnorderedContainer& c) {
+  return c.bucket_count() * sizeof(void*) +
+         c.size() * (sizeof(typename UnorderedContainer::value_type) +
+                     sizeof(void*) + sizeof(size_t));
+}
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_MEMORYUSAGE_H_
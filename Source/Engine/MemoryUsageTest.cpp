@@ -0,0 +1,68 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "MemoryUsage.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+TEST(MemoryUsageTest, Addition) {
+  MemoryUsage a{1, 2, 3};
+  MemoryUsage b{10, 20, 30};
+  EXPECT_EQ(a + b, (MemoryUsage{11, 22, 33}));
+  a += b;
+  EXPECT_EQ(a, (MemoryUsage{11, 22, 33}));
+}
+
+TEST(MemoryUsageTest, StringHeapBytes) {
+  EXPECT_EQ(StringHeapBytes(std::string()), 0);
+  EXPECT_EQ(StringHeapBytes(std::string("short")), 0);
+
+  std::string longString(100, 'x');
+  EXPECT_EQ(StringHeapBytes(longString), longString.capacity() + 1);
+}
+
+TEST(MemoryUsageTest, ContainerHeapBytes) {
+  std::vector<int> v;
+  EXPECT_EQ(VectorHeapBytes(v), 0);
+  v.reserve(16);
+  EXPECT_EQ(VectorHeapBytes(v), 16 * sizeof(int));
+
+  std::unordered_map<int, int> m;
+  size_t emptyBytes = UnorderedContainerHeapBytes(m);
+  m[1] = 1;
+  m[2] = 2;
+  EXPECT_GE(UnorderedContainerHeapBytes(m),
+            emptyBytes + 2 * sizeof(std::pair<const int, int>));
+}
+
+TEST(MemoryUsageTest, UnmappedMemory) {
+  EXPECT_EQ(MappedMemoryUsage(nullptr, 0), MemoryUsage{});
+}
+
+}  // namespace McBopomofo
@@ -38,6 +38,14 @@ namespace McBopomofo {
 
 bool ParselessLM::isLoaded() const { return db_ != nullptr; }
 
+MemoryUsage ParselessLM::memoryUsage() const {
+  MemoryUsage usage = mmapedFile_.memoryUsage();
+  if (db_ != nullptr) {
+    usage.heapBytes += sizeof(ParselessPhraseDB);
+  }
+  return usage;
+}
+
 bool ParselessLM::open(const char* path) {
   if (!mmapedFile_.open(path)) {
     return false;
@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "MemoryMappedFile.h"
+#include "MemoryUsage.h"
 #include "ParselessPhraseDB.h"
 #include "gramambular2/language_model.h"
 
@@ -61,6 +62,9 @@ class ParselessLM : public Formosa::Gramambular2::LanguageModel {
   // Look up reading by value. This is specific to ParselessLM only.
   std::vector<FoundReading> getReadings(const std::string& value) const;
 
+  // The mapped file. A db passed to open() is not counted.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
  private:
   MemoryMappedFile mmapedFile_;
   std::unique_ptr<ParselessPhraseDB> db_;
@@ -28,6 +28,8 @@
 #include <string>
 #include <vector>
 
+#include "Trace.h"
+
 #ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
 #if defined(__ARM_NEON)
 #include <arm_neon.h>
@@ -160,6 +162,7 @@ std::vector<std::string_view> ParselessPhraseDB::findRows(
 // the current line is the first matching line.
 const char* ParselessPhraseDB::findFirstMatchingLine(
     const std::string_view& key) const {
+  MCBOPOMOFO_TRACE_SCOPE("ParselessPhraseDB::findFirstMatchingLine");
   if (key.empty()) {
     return begin_;
   }
@@ -215,8 +218,20 @@ const char* ParselessPhraseDB::findFirstMatchingLine(
   return nullptr;
 }
 
+std::string_view ParselessPhraseDB::rowAt(const char* lineStart) const {
+  if (lineStart >= end_) {
+    return {};
+  }
+  const char* eol = lineStart;
+  while (eol != end_ && *eol != '\n') {
+    ++eol;
+  }
+  return {lineStart, static_cast<size_t>(eol - lineStart)};
+}
+
 std::vector<std::string> ParselessPhraseDB::reverseFindRows(
     const std::string_view& value) const {
+  MCBOPOMOFO_TRACE_SCOPE("ParselessPhraseDB::reverseFindRows");
   std::vector<std::string> rows;
 
   const char* recordBegin = begin_;
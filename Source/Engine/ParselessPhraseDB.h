@@ -57,6 +57,11 @@ class ParselessPhraseDB {
 
   const char* findFirstMatchingLine(const std::string_view& key) const;
 
+  // Returns the row that begins at the given line start, without the line
+  // feed, or an empty row if the line start is at or past the end. The next
+  // row begins at row.data() + row.size() + 1.
+  std::string_view rowAt(const char* lineStart) const;
+
   // Find the rows whose text past the key column plus the field separator
   // is a prefix match of the given value. For example, if the row is
   // "foo bar -1.00", the values "b", "ba", "bar", "bar ", "bar -1.00" are
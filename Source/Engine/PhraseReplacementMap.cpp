@@ -33,16 +33,40 @@
 
 namespace McBopomofo {
 
-bool PhraseReplacementMap::open(const char* path) {
+bool PhraseReplacementMap::open(const char* path) { return open(path, {}); }
+
+bool PhraseReplacementMap::open(const char* path,
+                                const std::filesystem::path& snapshotPath) {
+  if (!snapshotPath.empty() &&
+      snapshot_.open(snapshotPath, path,
+                     ByteBlockBackedDictionary::ColumnOrder::KEY_THEN_VALUE)) {
+    return true;
+  }
+
+  struct stat sb;
+  if (stat(path, &sb) == -1) {
+    return false;
+  }
+
   if (!mmapedFile_.open(path)) {
     return false;
   }
 
   // MemoryMappedFile self-closes, and so this is fine.
-  return load(mmapedFile_.data(), mmapedFile_.length());
+  if (!load(mmapedFile_.data(), mmapedFile_.length())) {
+    return false;
+  }
+  if (!snapshotPath.empty()) {
+    DictionarySnapshot::Write(
+        snapshotPath, dictionary_,
+        ByteBlockBackedDictionary::ColumnOrder::KEY_THEN_VALUE, sb,
+        mmapedFile_.data(), mmapedFile_.length());
+  }
+  return true;
 }
 
 void PhraseReplacementMap::close() {
+  snapshot_.close();
   dictionary_.clear();
   mmapedFile_.close();
 }
@@ -55,7 +79,9 @@ bool PhraseReplacementMap::load(const char* data, size_t length) {
 }
 
 std::string PhraseReplacementMap::valueForKey(const std::string& key) const {
-  std::vector<std::string_view> values = dictionary_.getValues(key);
+  std::vector<std::string_view> values = snapshot_.isOpen()
+                                             ? snapshot_.getValues(key)
+                                             : dictionary_.getValues(key);
   if (!values.empty()) {
     return std::string(values[0]);
   }
@@ -64,7 +90,15 @@ std::string PhraseReplacementMap::valueForKey(const std::string& key) const {
 
 std::vector<ByteBlockBackedDictionary::Issue>
 PhraseReplacementMap::getParsingIssues() const {
+  if (snapshot_.isOpen()) {
+    return snapshot_.issues();
+  }
   return dictionary_.issues();
 }
 
+MemoryUsage PhraseReplacementMap::memoryUsage() const {
+  return mmapedFile_.memoryUsage() + snapshot_.memoryUsage() +
+         dictionary_.memoryUsage();
+}
+
 }  // namespace McBopomofo
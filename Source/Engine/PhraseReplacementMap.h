@@ -24,11 +24,14 @@
 #ifndef SRC_ENGINE_PHRASEREPLACEMENTMAP_H_
 #define SRC_ENGINE_PHRASEREPLACEMENTMAP_H_
 
+#include <filesystem>
 #include <map>
 #include <string>
 
 #include "ByteBlockBackedDictionary.h"
+#include "DictionarySnapshot.h"
 #include "MemoryMappedFile.h"
+#include "MemoryUsage.h"
 
 namespace McBopomofo {
 
@@ -41,6 +44,10 @@ class PhraseReplacementMap {
   PhraseReplacementMap& operator=(PhraseReplacementMap&&) = delete;
 
   bool open(const char* path);
+
+  // Opens the file through a snapshot at snapshotPath, which is rewritten if
+  // it is no longer valid for the file. See UserPhrasesLM::open().
+  bool open(const char* path, const std::filesystem::path& snapshotPath);
   void close();
 
   // Allows loading existing in-memory data. It's the caller's responsibility
@@ -51,9 +58,14 @@ class PhraseReplacementMap {
 
   std::vector<ByteBlockBackedDictionary::Issue> getParsingIssues() const;
 
+  // The mapped file or snapshot and the parsed dictionary. Data passed to
+  // load() is not counted.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
  protected:
   ByteBlockBackedDictionary dictionary_;
   MemoryMappedFile mmapedFile_;
+  DictionarySnapshot snapshot_;
 };
 
 }  // namespace McBopomofo
@@ -0,0 +1,365 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ParselessLM.h"
+#include "gramambular2/reading_grid.h"
+
+namespace {
+
+using Formosa::Gramambular2::LanguageModel;
+using Formosa::Gramambular2::ReadingGrid;
+
+// Set this to the path of a built data.txt to use instead of the one in the
+// current directory.
+constexpr char kDataPathVariable[] = "DATA_TXT_PATH";
+
+// The readings of 小麥注音輸入法是一個開放原始碼的注音輸入法，他們寫下了這個
+// 程式. A buffer of any length cycles through them.
+const std::vector<std::string>& RealReadings() {
+  static const std::vector<std::string> readings = {
+      "ㄒㄧㄠˇ", "ㄇㄞˋ", "ㄓㄨˋ", "ㄧㄣ",  "ㄕㄨ",  "ㄖㄨˋ", "ㄈㄚˇ",
+      "ㄕˋ",     "ㄧˊ",   "ㄍㄜˋ", "ㄎㄞ",  "ㄈㄤˋ", "ㄩㄢˊ", "ㄕˇ",
+      "ㄇㄚˇ",   "ㄉㄜ˙", "ㄓㄨˋ", "ㄧㄣ",  "ㄕㄨ",  "ㄖㄨˋ", "ㄈㄚˇ",
+      "ㄊㄚ",    "ㄇㄣ˙", "ㄒㄧㄝˇ", "ㄒㄧㄚˋ", "ㄌㄜ˙", "ㄓㄜˋ",
+      "ㄍㄜ˙",   "ㄔㄥˊ", "ㄕˋ",
+  };
+  return readings;
+}
+
+// A language model of made-up phrases: every reading of one syllable has
+// unigrams, and longer readings have them in a decreasing, fixed fraction of
+// cases, about as often as in the real data.
+class SyntheticLM : public LanguageModel {
+ public:
+  static constexpr size_t kSyllableCount = 400;
+
+  static std::string Syllable(size_t i) {
+    return "s" + std::to_string(i % kSyllableCount);
+  }
+
+  std::vector<Unigram> getUnigrams(const std::string& reading) override {
+    std::vector<Unigram> unigrams;
+    if (!hasUnigrams(reading)) {
+      return unigrams;
+    }
+    uint64_t hash = Hash(reading);
+    size_t count = 1 + hash % 8;
+    for (size_t i = 0; i < count; ++i) {
+      unigrams.emplace_back(reading + "/" + std::to_string(i),
+                            -2.0 - static_cast<double>((hash >> 8) % 100) / 10 -
+                                static_cast<double>(i));
+    }
+    return unigrams;
+  }
+
+  bool hasUnigrams(const std::string& reading) override {
+    size_t syllables = 1;
+    for (char c : reading) {
+      syllables += c == '-';
+    }
+    // 1, 1/4, 1/16, ... of the readings of 1, 2, 3, ... syllables.
+    uint64_t mask = (uint64_t{1} << (2 * (syllables - 1))) - 1;
+    return (Hash(reading) & mask) == 0;
+  }
+
+ private:
+  // FNV-1a.
+  static uint64_t Hash(std::string_view s) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : s) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+  }
+};
+
+// Counts the calls to the language model it wraps.
+class CountingLM : public LanguageModel {
+ public:
+  explicit CountingLM(std::shared_ptr<LanguageModel> lm) : lm_(std::move(lm)) {}
+
+  std::vector<Unigram> getUnigrams(const std::string& reading) override {
+    ++getUnigramsCalls;
+    return lm_->getUnigrams(reading);
+  }
+
+  bool hasUnigrams(const std::string& reading) override {
+    ++hasUnigramsCalls;
+    return lm_->hasUnigrams(reading);
+  }
+
+  size_t getUnigramsCalls = 0;
+  size_t hasUnigramsCalls = 0;
+
+ private:
+  std::shared_ptr<LanguageModel> lm_;
+};
+
+enum class Model { kSynthetic, kReal };
+
+// Returns the language model, or nullptr if the real one cannot be loaded.
+std::shared_ptr<LanguageModel> MakeLM(Model model) {
+  if (model == Model::kSynthetic) {
+    return std::make_shared<SyntheticLM>();
+  }
+  static std::shared_ptr<McBopomofo::ParselessLM> lm = [] {
+    const char* path = getenv(kDataPathVariable);
+    auto parselessLM = std::make_shared<McBopomofo::ParselessLM>();
+    if (!parselessLM->open(path != nullptr ? path : "data.txt")) {
+      return std::shared_ptr<McBopomofo::ParselessLM>();
+    }
+    return parselessLM;
+  }();
+  return lm;
+}
+
+std::string ReadingAt(Model model, size_t i) {
+  if (model == Model::kSynthetic) {
+    return SyntheticLM::Syllable(i * 7919);
+  }
+  const std::vector<std::string>& readings = RealReadings();
+  return readings[i % readings.size()];
+}
+
+// A grid over a counting language model, with the readings inserted and
+// walked.
+struct Session {
+  std::shared_ptr<CountingLM> lm;
+  ReadingGrid grid;
+  // The reading deleted by an operation, to put back afterwards.
+  std::string deletedReading;
+
+  Session(std::shared_ptr<LanguageModel> model, Model kind, size_t length)
+      : lm(std::make_shared<CountingLM>(std::move(model))), grid(lm) {
+    for (size_t i = 0; i < length; ++i) {
+      grid.insertReading(ReadingAt(kind, i));
+    }
+    grid.walk();
+  }
+};
+
+enum class Position { kEnd, kMiddle };
+
+using Operation = std::function<void(Session*)>;
+
+// Times the operation on a grid of state.range(0) readings, with the cursor
+// at the position, and reports the average LM calls per operation. The undo,
+// which is not timed, restores the grid for the next iteration.
+void RunOperation(benchmark::State& state, Model model, Position position,
+                  const Operation& operation, const Operation& undo) {
+  std::shared_ptr<LanguageModel> lm = MakeLM(model);
+  if (lm == nullptr) {
+    state.SkipWithError("data.txt not found; set DATA_TXT_PATH");
+    return;
+  }
+  Session session(lm, model, static_cast<size_t>(state.range(0)));
+  size_t getUnigramsCalls = 0;
+  size_t hasUnigramsCalls = 0;
+  for (auto _ : state) {
+    size_t length = session.grid.length();
+    // The middle rounds up, so that there is a reading before the cursor.
+    session.grid.setCursor(position == Position::kEnd ? length
+                                                      : (length + 1) / 2);
+    session.lm->getUnigramsCalls = 0;
+    session.lm->hasUnigramsCalls = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    operation(&session);
+    auto end = std::chrono::steady_clock::now();
+    state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+
+    getUnigramsCalls += session.lm->getUnigramsCalls;
+    hasUnigramsCalls += session.lm->hasUnigramsCalls;
+    undo(&session);
+  }
+  state.counters["getUnigrams"] =
+      benchmark::Counter(static_cast<double>(getUnigramsCalls),
+                         benchmark::Counter::kAvgIterations);
+  state.counters["hasUnigrams"] =
+      benchmark::Counter(static_cast<double>(hasUnigramsCalls),
+                         benchmark::Counter::kAvgIterations);
+}
+
+void NoUndo(Session*) {}
+
+// Typing a reading, and walking, as on every keystroke.
+void BM_InsertReading(benchmark::State& state, Model model,
+                      Position position) {
+  RunOperation(
+      state, model, position,
+      [model](Session* session) {
+        session->grid.insertReading(ReadingAt(model, 3));
+        session->grid.walk();
+      },
+      [](Session* session) { session->grid.deleteReadingBeforeCursor(); });
+}
+
+// Backspace, and walking.
+void BM_DeleteReading(benchmark::State& state, Model model,
+                      Position position) {
+  RunOperation(
+      state, model, position,
+      [](Session* session) {
+        const ReadingGrid& grid = session->grid;
+        session->deletedReading = grid.readings()[grid.cursor() - 1];
+        session->grid.deleteReadingBeforeCursor();
+        session->grid.walk();
+      },
+      [](Session* session) {
+        session->grid.insertReading(session->deletedReading);
+      });
+}
+
+void BM_Walk(benchmark::State& state, Model model) {
+  RunOperation(
+      state, model, Position::kEnd,
+      [](Session* session) { session->grid.walk(); }, NoUndo);
+}
+
+void BM_CandidatesAt(benchmark::State& state, Model model,
+                     Position position) {
+  RunOperation(
+      state, model, position,
+      [](Session* session) {
+        std::vector<ReadingGrid::Candidate> candidates =
+            session->grid.candidatesAt(session->grid.cursor());
+        benchmark::DoNotOptimize(candidates);
+      },
+      NoUndo);
+}
+
+// Picking a candidate, and walking. Each iteration picks the candidate that
+// is not the one picked last.
+void BM_OverrideCandidate(benchmark::State& state, Model model,
+                          Position position) {
+  size_t pick = 0;
+  RunOperation(
+      state, model, position,
+      [&pick](Session* session) {
+        size_t cursor = session->grid.cursor();
+        std::vector<ReadingGrid::Candidate> candidates =
+            session->grid.candidatesAt(cursor);
+        session->grid.overrideCandidate(cursor,
+                                        candidates[pick % candidates.size()]);
+        session->grid.walk();
+        ++pick;
+      },
+      NoUndo);
+}
+
+// Typing state.range(0) readings from an empty buffer, picking the second
+// candidate at the cursor after each, as with a user who corrects nearly
+// every character. The time and the LM calls are per session.
+void BM_OverrideHeavySession(benchmark::State& state, Model model) {
+  size_t sessionLength = static_cast<size_t>(state.range(0));
+  RunOperation(
+      state, model, Position::kEnd,
+      [model, sessionLength](Session* session) {
+        for (size_t i = 0; i < sessionLength; ++i) {
+          session->grid.insertReading(ReadingAt(model, i));
+          session->grid.walk();
+          size_t cursor = session->grid.cursor();
+          std::vector<ReadingGrid::Candidate> candidates =
+              session->grid.candidatesAt(cursor);
+          session->grid.overrideCandidate(cursor,
+                                          candidates[1 % candidates.size()]);
+          session->grid.walk();
+        }
+      },
+      [](Session* session) { session->grid.clear(); });
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+void BufferLengths(benchmark::internal::Benchmark* b) {
+  b->Arg(1)->Arg(10)->Arg(100)->Arg(1000)->UseManualTime();
+}
+
+void SessionLengths(benchmark::internal::Benchmark* b) {
+  b->Arg(10)->Arg(100)->UseManualTime();
+}
+
+BENCHMARK_CAPTURE(BM_InsertReading, SyntheticAtEnd, Model::kSynthetic,
+                  Position::kEnd)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_InsertReading, SyntheticInMiddle, Model::kSynthetic,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_InsertReading, RealAtEnd, Model::kReal, Position::kEnd)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_InsertReading, RealInMiddle, Model::kReal,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+
+BENCHMARK_CAPTURE(BM_DeleteReading, SyntheticAtEnd, Model::kSynthetic,
+                  Position::kEnd)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_DeleteReading, SyntheticInMiddle, Model::kSynthetic,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_DeleteReading, RealAtEnd, Model::kReal, Position::kEnd)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_DeleteReading, RealInMiddle, Model::kReal,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+
+BENCHMARK_CAPTURE(BM_Walk, Synthetic, Model::kSynthetic)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_Walk, Real, Model::kReal)->Apply(BufferLengths);
+
+BENCHMARK_CAPTURE(BM_CandidatesAt, SyntheticAtEnd, Model::kSynthetic,
+                  Position::kEnd)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_CandidatesAt, RealInMiddle, Model::kReal,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+
+BENCHMARK_CAPTURE(BM_OverrideCandidate, SyntheticAtEnd, Model::kSynthetic,
+                  Position::kEnd)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_OverrideCandidate, SyntheticInMiddle, Model::kSynthetic,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+BENCHMARK_CAPTURE(BM_OverrideCandidate, RealInMiddle, Model::kReal,
+                  Position::kMiddle)
+    ->Apply(BufferLengths);
+
+BENCHMARK_CAPTURE(BM_OverrideHeavySession, Synthetic, Model::kSynthetic)
+    ->Apply(SessionLengths);
+BENCHMARK_CAPTURE(BM_OverrideHeavySession, Real, Model::kReal)
+    ->Apply(SessionLengths);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,83 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_TESTTEMPDIR_H_
+#define SRC_ENGINE_TESTTEMPDIR_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+namespace McBopomofo {
+
+// A new directory under the system temporary directory, removed with
+// everything in it when the object is destroyed. For tests and benchmarks;
+// aborts if the directory cannot be created.
+class TestTempDir {
+ public:
+  TestTempDir() {
+    std::string p = (std::filesystem::temp_directory_path() /
+                     "org.openvanilla.mcbopomofo.XXXXXX")
+                        .native();
+    if (mkdtemp(p.data()) == nullptr) {
+      perror("mkdtemp");
+      abort();
+    }
+    path_ = p;
+  }
+
+  ~TestTempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path_, ec);
+  }
+
+  TestTempDir(const TestTempDir&) = delete;
+  TestTempDir& operator=(const TestTempDir&) = delete;
+
+  const std::filesystem::path& path() const { return path_; }
+
+  std::filesystem::path pathOf(const std::string& name) const {
+    return path_ / name;
+  }
+
+  // Writes the file, replacing it if it exists, and returns its path.
+  std::filesystem::path write(const std::string& name,
+                              std::string_view data) const {
+    std::filesystem::path p = pathOf(name);
+    std::ofstream(p, std::ios::binary | std::ios::trunc)
+        .write(data.data(), static_cast<std::streamsize>(data.size()));
+    return p;
+  }
+
+ private:
+  std::filesystem::path path_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_TESTTEMPDIR_H_
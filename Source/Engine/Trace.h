@@ -0,0 +1,292 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_TRACE_H_
+#define SRC_ENGINE_TRACE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped tracing of the engine's hot paths.
+//
+// MCBOPOMOFO_TRACE_SCOPE("Name") records how long the enclosing scope took
+// into a ring buffer of the calling thread. Tracer::ChromeTraceJSON() dumps
+// the buffers of all threads in the Chrome trace event format, which
+// chrome://tracing and ui.perfetto.dev open, and nested scopes show up as
+// nested slices.
+//
+// The macro compiles to nothing unless ENABLE_TRACING is defined, which the
+// CMake option of the same name does, so a regular build pays nothing. The
+// classes below are always available; they are only instantiated by the
+// macro.
+#if defined(ENABLE_TRACING)
+#define MCBOPOMOFO_TRACE_CONCAT_INNER(a, b) a##b
+#define MCBOPOMOFO_TRACE_CONCAT(a, b) MCBOPOMOFO_TRACE_CONCAT_INNER(a, b)
+#define MCBOPOMOFO_TRACE_SCOPE(name)                                   \
+  ::McBopomofo::ScopedTrace MCBOPOMOFO_TRACE_CONCAT(mcbopomofoTraceScope, \
+                                                    __LINE__)(name)
+#else
+#define MCBOPOMOFO_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace McBopomofo {
+
+#if defined(ENABLE_TRACING)
+inline constexpr bool kTracingEnabled = true;
+#else
+inline constexpr bool kTracingEnabled = false;
+#endif
+
+struct TraceEvent {
+  // Must outlive the trace; the macro takes a string literal.
+  const char* name = nullptr;
+  uint64_t startNanoseconds = 0;
+  uint64_t durationNanoseconds = 0;
+};
+
+// Keeps the latest kCapacity events of one thread. Only the owning thread
+// records, but any thread may read, so a record takes an uncontended lock.
+class TraceBuffer {
+ public:
+  static constexpr size_t kCapacity = 8192;
+
+  // Reserves the whole ring up front so that recording never allocates.
+  explicit TraceBuffer(uint64_t threadId) : threadId_(threadId) {
+    events_.reserve(kCapacity);
+  }
+
+  TraceBuffer(const TraceBuffer&) = delete;
+  TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+  void record(const TraceEvent& event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (events_.size() < kCapacity) {
+      events_.push_back(event);
+    } else {
+      events_[recordedCount_ % kCapacity] = event;
+    }
+    ++recordedCount_;
+  }
+
+  // Returns the events kept, oldest first.
+  [[nodiscard]] std::vector<TraceEvent> events() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (events_.size() < kCapacity) {
+      return events_;
+    }
+    std::vector<TraceEvent> ordered;
+    ordered.reserve(kCapacity);
+    size_t oldest = recordedCount_ % kCapacity;
+    ordered.insert(ordered.end(), events_.begin() + oldest, events_.end());
+    ordered.insert(ordered.end(), events_.begin(), events_.begin() + oldest);
+    return ordered;
+  }
+
+  // The number of events recorded since the last clear(), including the
+  // ones that have been overwritten.
+  [[nodiscard]] uint64_t recordedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recordedCount_;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    recordedCount_ = 0;
+  }
+
+  // A small number that tells apart the threads tracing at the same time.
+  [[nodiscard]] uint64_t threadId() const { return threadId_; }
+
+ private:
+  mutable std::mutex mutex_;
+  const uint64_t threadId_;
+  uint64_t recordedCount_ = 0;
+  std::vector<TraceEvent> events_;
+};
+
+class Tracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Returns the buffer of the calling thread, creating it on first use. When
+  // the thread exits, its buffer is kept with its events for the next dump,
+  // and is handed to the next thread that starts tracing, so that a process
+  // that keeps starting threads needs only as many buffers as it has threads
+  // tracing at once.
+  static TraceBuffer& CurrentThreadBuffer() {
+    thread_local BufferLease lease;
+    return *lease.buffer;
+  }
+
+  // Nanoseconds since the first call in the process.
+  static uint64_t NowNanoseconds() {
+    return NanosecondsSinceEpoch(Clock::now());
+  }
+
+  // Records a scope timed by other code, such as the reading grid, which
+  // reports its scopes through ReadingGrid::setTraceHook().
+  static void RecordScope(const char* name, Clock::time_point start,
+                          Clock::time_point end) {
+    uint64_t startNanoseconds = NanosecondsSinceEpoch(start);
+    uint64_t endNanoseconds = NanosecondsSinceEpoch(end);
+    CurrentThreadBuffer().record(
+        {name, startNanoseconds, endNanoseconds - startNanoseconds});
+  }
+
+  // Returns the events of all threads as a Chrome trace event JSON object,
+  // with one complete ("X") event per traced scope.
+  static std::string ChromeTraceJSON() {
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+      Registry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      buffers = registry.buffers;
+    }
+
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    char number[96];
+    for (const auto& buffer : buffers) {
+      unsigned long long tid = buffer->threadId();
+      for (const TraceEvent& event : buffer->events()) {
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "{\"name\":\"";
+        AppendEscaped(event.name, &json);
+        snprintf(number, sizeof(number),
+                 "\",\"cat\":\"engine\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,"
+                 "\"ts\":%.3f,\"dur\":%.3f}",
+                 tid, static_cast<double>(event.startNanoseconds) / 1000.0,
+                 static_cast<double>(event.durationNanoseconds) / 1000.0);
+        json += number;
+      }
+    }
+    json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return json;
+  }
+
+  // Empties the buffers of all threads.
+  static void Clear() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& buffer : registry.buffers) {
+      buffer->clear();
+    }
+  }
+
+ private:
+  struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    // The buffers of the threads that have exited.
+    std::vector<std::shared_ptr<TraceBuffer>> released;
+  };
+
+  // Holds a buffer for the lifetime of a thread.
+  struct BufferLease {
+    BufferLease() {
+      Registry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      if (!registry.released.empty()) {
+        buffer = std::move(registry.released.back());
+        registry.released.pop_back();
+      } else {
+        buffer = std::make_shared<TraceBuffer>(registry.buffers.size() + 1);
+        registry.buffers.push_back(buffer);
+      }
+    }
+    ~BufferLease() {
+      Registry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      registry.released.push_back(std::move(buffer));
+    }
+    BufferLease(const BufferLease&) = delete;
+    BufferLease& operator=(const BufferLease&) = delete;
+
+    std::shared_ptr<TraceBuffer> buffer;
+  };
+
+  // A time before the epoch, which a scope that started before the first
+  // call can have, counts as the epoch.
+  static uint64_t NanosecondsSinceEpoch(Clock::time_point time) {
+    static const Clock::time_point epoch = Clock::now();
+    if (time < epoch) {
+      return 0;
+    }
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch)
+            .count());
+  }
+
+  // Never destroyed, since threads may still trace during exit.
+  static Registry& GetRegistry() {
+    static Registry* registry = new Registry;
+    return *registry;
+  }
+
+  static void AppendEscaped(const char* s, std::string* out) {
+    for (; s != nullptr && *s != 0; ++s) {
+      char c = *s;
+      if (c == '"' || c == '\\') {
+        *out += '\\';
+        *out += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        *out += escaped;
+      } else {
+        *out += c;
+      }
+    }
+  }
+};
+
+// Records the time from its construction to its destruction. Use
+// MCBOPOMOFO_TRACE_SCOPE() instead, which compiles out.
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* name)
+      : name_(name), start_(Tracer::NowNanoseconds()) {}
+  ~ScopedTrace() {
+    uint64_t end = Tracer::NowNanoseconds();
+    Tracer::CurrentThreadBuffer().record({name_, start_, end - start_});
+  }
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+ private:
+  const char* name_;
+  uint64_t start_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_TRACE_H_
@@ -0,0 +1,162 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Trace.h"
+#include "gramambular2/reading_grid.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+TEST(TraceTest, RecordsNestedScopes) {
+  Tracer::Clear();
+  {
+    ScopedTrace outer("Outer");
+    ScopedTrace inner("Inner");
+  }
+
+  std::vector<TraceEvent> events = Tracer::CurrentThreadBuffer().events();
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_STREQ(events[0].name, "Inner");
+  EXPECT_STREQ(events[1].name, "Outer");
+  EXPECT_LE(events[1].startNanoseconds, events[0].startNanoseconds);
+  EXPECT_GE(events[1].startNanoseconds + events[1].durationNanoseconds,
+            events[0].startNanoseconds + events[0].durationNanoseconds);
+}
+
+TEST(TraceTest, MacroRecordsOnlyWhenEnabled) {
+  Tracer::Clear();
+  { MCBOPOMOFO_TRACE_SCOPE("Macro"); }
+  EXPECT_EQ(Tracer::CurrentThreadBuffer().recordedCount(),
+            kTracingEnabled ? 1 : 0);
+}
+
+TEST(TraceTest, RingBufferKeepsLatestEvents) {
+  constexpr size_t kExtra = 10;
+  TraceBuffer buffer(1);
+  for (size_t i = 0; i < TraceBuffer::kCapacity + kExtra; ++i) {
+    buffer.record({"Event", i, 1});
+  }
+
+  std::vector<TraceEvent> events = buffer.events();
+  ASSERT_EQ(events.size(), TraceBuffer::kCapacity);
+  EXPECT_EQ(buffer.recordedCount(), TraceBuffer::kCapacity + kExtra);
+  for (size_t i = 0; i < events.size(); ++i) {
+    ASSERT_EQ(events[i].startNanoseconds, i + kExtra);
+  }
+
+  buffer.clear();
+  EXPECT_TRUE(buffer.events().empty());
+  EXPECT_EQ(buffer.recordedCount(), 0);
+}
+
+TEST(TraceTest, ChromeTraceJSONHasEventsOfAllThreads) {
+  Tracer::Clear();
+  { ScopedTrace trace("MainThread"); }
+  uint64_t mainThreadId = Tracer::CurrentThreadBuffer().threadId();
+
+  uint64_t workerThreadId = 0;
+  std::thread worker([&workerThreadId] {
+    { ScopedTrace trace("WorkerThread"); }
+    workerThreadId = Tracer::CurrentThreadBuffer().threadId();
+  });
+  worker.join();
+  ASSERT_NE(mainThreadId, workerThreadId);
+
+  std::string json = Tracer::ChromeTraceJSON();
+  EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0);
+  EXPECT_NE(json.find("\"displayTimeUnit\":\"ns\"}"), std::string::npos);
+  EXPECT_NE(json.find("{\"name\":\"MainThread\",\"cat\":\"engine\","
+                      "\"ph\":\"X\",\"pid\":1,\"tid\":" +
+                      std::to_string(mainThreadId) + ","),
+            std::string::npos);
+  EXPECT_NE(json.find("{\"name\":\"WorkerThread\",\"cat\":\"engine\","
+                      "\"ph\":\"X\",\"pid\":1,\"tid\":" +
+                      std::to_string(workerThreadId) + ","),
+            std::string::npos);
+}
+
+TEST(TraceTest, ExitedThreadBufferIsReused) {
+  Tracer::Clear();
+  TraceBuffer* firstBuffer = nullptr;
+  std::thread first([&firstBuffer] {
+    { ScopedTrace trace("FirstThread"); }
+    firstBuffer = &Tracer::CurrentThreadBuffer();
+  });
+  first.join();
+
+  // The events of the exited thread are still dumped.
+  EXPECT_NE(Tracer::ChromeTraceJSON().find("\"name\":\"FirstThread\""),
+            std::string::npos);
+
+  TraceBuffer* secondBuffer = nullptr;
+  std::thread second(
+      [&secondBuffer] { secondBuffer = &Tracer::CurrentThreadBuffer(); });
+  second.join();
+  EXPECT_EQ(firstBuffer, secondBuffer);
+}
+
+TEST(TraceTest, RecordsReadingGridScopesThroughHook) {
+  class EmptyLM : public Formosa::Gramambular2::LanguageModel {
+   public:
+    std::vector<Formosa::Gramambular2::LanguageModel::Unigram> getUnigrams(
+        const std::string&) override {
+      return {};
+    }
+    bool hasUnigrams(const std::string&) override { return false; }
+  };
+
+  Tracer::Clear();
+  Formosa::Gramambular2::ReadingGrid::setTraceHook(&Tracer::RecordScope);
+  Formosa::Gramambular2::ReadingGrid grid(std::make_shared<EmptyLM>());
+  grid.walk();
+  Formosa::Gramambular2::ReadingGrid::setTraceHook(nullptr);
+  grid.walk();
+
+  std::vector<TraceEvent> events = Tracer::CurrentThreadBuffer().events();
+  ASSERT_EQ(events.size(), kTracingEnabled ? 1 : 0);
+  if (kTracingEnabled) {
+    EXPECT_STREQ(events[0].name, "ReadingGrid::walk");
+  }
+}
+
+TEST(TraceTest, ChromeTraceJSONEscapesNames) {
+  Tracer::Clear();
+  { ScopedTrace trace("A \"quoted\\name\"\n"); }
+  std::string json = Tracer::ChromeTraceJSON();
+  EXPECT_NE(json.find("\"name\":\"A \\\"quoted\\\\name\\\"\\u000a\""),
+            std::string::npos);
+}
+
+TEST(TraceTest, ClearEmptiesAllBuffers) {
+  { ScopedTrace trace("Event"); }
+  Tracer::Clear();
+  EXPECT_EQ(Tracer::ChromeTraceJSON(),
+            "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+}  // namespace McBopomofo
@@ -23,137 +23,166 @@
 
 #include "UTF8Helper.h"
 
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace McBopomofo {
 // NOLINTBEGIN(readability-magic-numbers)
 
-// Adapted from https://github.com/lua/lua/blob/master/lutf8lib.c
+namespace {
 
-constexpr char32_t kMaxUnicode = 0x10FFFF;
-static inline bool IsContinuationByte(char32_t c) { return (c & 0xC0) == 0x80; }
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
 
-// Decodes one UTF-8 code point and advances the iterator `i` past the code
-// point. Returns false if `i` is already at the end, or if the iterated UTF-8
-// sequence is not valid.
-static inline bool DecodeUTF8(std::string::const_iterator& i,
-                              const std::string::const_iterator& end) {
-  static const char32_t limits[] = {~(char32_t)0, 0x80,     0x800,
-                                    0x10000,      0x200000, 0x4000000};
-  if (i == end) {
-    return false;
-  }
+uint64_t LoadWord(const char* ptr) {
+  uint64_t word;
+  memcpy(&word, ptr, sizeof(word));
+  return word;
+}
 
-  char32_t c = static_cast<unsigned char>(*i);
-  // Consumes the continuation bytes if c is not ASCII.
-  if (c >= 0x80) {
-    char32_t res = 0;
-    size_t count = 0;  // to count number of continuation bytes
-
-    std::string::const_iterator next = i;
-    for (; c & 0x40; c <<= 1) {
-      ++next;
-      if (next == end) {
-        // Sequence terminates prematurely. Bail.
-        return false;
-      }
+bool IsContinuationByte(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// Returns the length of the valid UTF-8 sequence at the start of [p, end), or
+// 0 if there is none. The ranges of the second byte that rule out overlong
+// sequences, surrogates and code points above U+10FFFF are those of the
+// table of well-formed byte sequences in the Unicode Standard, section 3.9.
+size_t SequenceLength(const unsigned char* p, const unsigned char* end) {
+  const unsigned char lead = p[0];
+  const size_t available = end - p;
+  // Three-byte sequences, which include the common CJK ideographs, come
+  // first.
+  if ((lead & 0xF0) == 0xE0) {
+    unsigned char low = lead == 0xE0 ? 0xA0 : 0x80;
+    unsigned char high = lead == 0xED ? 0x9F : 0xBF;
+    return available >= 3 && p[1] >= low && p[1] <= high &&
+                   IsContinuationByte(p[2])
+               ? 3
+               : 0;
+  }
+  if (lead < 0x80) {
+    return 1;
+  }
+  if (lead < 0xC2) {
+    // A continuation byte, or the lead byte of an overlong sequence.
+    return 0;
+  }
+  if (lead < 0xE0) {
+    return available >= 2 && IsContinuationByte(p[1]) ? 2 : 0;
+  }
+  if (lead < 0xF5) {
+    unsigned char low = lead == 0xF0 ? 0x90 : 0x80;
+    unsigned char high = lead == 0xF4 ? 0x8F : 0xBF;
+    return available >= 4 && p[1] >= low && p[1] <= high &&
+                   IsContinuationByte(p[2]) && IsContinuationByte(p[3])
+               ? 4
+               : 0;
+  }
+  return 0;
+}
 
-      ++count;
-      char32_t cc = static_cast<unsigned char>(*next);
-      if (!IsContinuationByte(cc)) {
-        return false;
+// Scans the valid UTF-8 sequences at the start of s, up to maxCodePoints of
+// them, and returns their length in bytes. The number of code points scanned
+// is set to codePoints.
+size_t Scan(std::string_view s, size_t maxCodePoints, size_t* codePoints) {
+  const char* begin = s.data();
+  const auto* p = reinterpret_cast<const unsigned char*>(begin);
+  const auto* end = p + s.length();
+  size_t count = 0;
+  while (p != end && count < maxCodePoints) {
+    if (*p < 0x80) {
+      // Skips ASCII a word at a time.
+      if (static_cast<size_t>(end - p) >= sizeof(uint64_t) &&
+          maxCodePoints - count >= sizeof(uint64_t)) {
+        uint64_t nonASCII =
+            LoadWord(reinterpret_cast<const char*>(p)) & kHighBits;
+        size_t ascii = nonASCII == 0 ? sizeof(uint64_t)
+                                     : std::countr_zero(nonASCII) / 8;
+        p += ascii;
+        count += ascii;
+      } else {
+        ++p;
+        ++count;
       }
-      // Add lower 6 bits from the continuous byte.
-      res = (res << 6) | (cc & 0x3F);
-    }
-    // Add first byte. Recall c has already been left-shifted (count * 1) times,
-    // and so we need to left-shift another (count * 5) bits so the net effect
-    // is left-shifting (count * 6) bits.
-    res |= ((char32_t)(c & 0x7F) << (count * 5));
-
-    bool invalid = count > 5 || res > kMaxUnicode || res < limits[count] ||
-                   (0xd800 <= res && res <= 0xdfff);
-    if (invalid) {
-      return false;
+      continue;
     }
-    for (size_t j = 0; j < count && i != end; j++) {
-      ++i;
+
+    size_t length = SequenceLength(p, end);
+    if (length == 0) {
+      break;
     }
+    p += length;
+    ++count;
   }
+  *codePoints = count;
+  return reinterpret_cast<const char*>(p) - begin;
+}
 
-  // Sequence terminates prematurely.
-  if (i == end) {
-    return false;
-  }
+constexpr size_t kNoLimit = std::numeric_limits<size_t>::max();
 
-  ++i;
-  return true;
-}
+}  // namespace
 
-size_t CodePointCount(const std::string& s) {
-  size_t c = 0;
-  std::string::const_iterator i = s.cbegin();
-  std::string::const_iterator end = s.cend();
-  while (i != end) {
-    bool r = DecodeUTF8(i, end);
-    if (!r) {
-      break;
-    }
-    ++c;
-  }
+size_t ValidUTF8Length(std::string_view s) {
+  size_t codePoints;
+  return Scan(s, kNoLimit, &codePoints);
+}
 
-  return c;
+size_t CodePointCount(std::string_view s) {
+  size_t codePoints;
+  Scan(s, kNoLimit, &codePoints);
+  return codePoints;
 }
 
-std::string SubstringToCodePoints(const std::string& s, size_t cp) {
-  size_t c = 0;
-  std::string::const_iterator i = s.cbegin();
-  std::string::const_iterator end = s.cend();
-  while (i != end && c < cp) {
-    bool r = DecodeUTF8(i, end);
-    if (!r) {
-      break;
-    }
-    ++c;
-  }
+std::string_view CodePointPrefix(std::string_view s, size_t cp) {
+  size_t codePoints;
+  return s.substr(0, Scan(s, cp, &codePoints));
+}
 
-  return {s.cbegin(), i};
+std::string SubstringToCodePoints(std::string_view s, size_t cp) {
+  return std::string(CodePointPrefix(s, cp));
 }
 
-std::string GetCodePoint(const std::string& s, size_t cp) {
-  size_t c = 0;
-  std::string::const_iterator i = s.cbegin();
-  std::string::const_iterator lastUsed = s.cbegin();
-  std::string::const_iterator end = s.cend();
-  while (i != end && c <= cp) {
-    lastUsed = i;
-    bool r = DecodeUTF8(i, end);
-    if (!r) {
-      break;
-    }
-    ++c;
+std::string GetCodePoint(std::string_view s, size_t cp) {
+  size_t codePoints;
+  size_t start = Scan(s, cp, &codePoints);
+  std::string_view rest = s.substr(start);
+  if (!rest.empty()) {
+    // The code point at the index, or an invalid sequence before it.
+    size_t length = codePoints == cp ? Scan(rest, 1, &codePoints) : 0;
+    return std::string(rest.substr(0, length));
   }
-
-  return {lastUsed, i};
+  // If there are not as many code points, this is the last one.
+  size_t last = start == 0 ? 0 : start - 1;
+  while (last > 0 &&
+         IsContinuationByte(static_cast<unsigned char>(s[last]))) {
+    --last;
+  }
+  return std::string(s.substr(last));
 }
 
-std::vector<std::string> Split(const std::string& s) {
-  std::vector<std::string> output;
-  std::string::const_iterator i = s.cbegin();
-  std::string::const_iterator lastUsed = s.cbegin();
-  std::string::const_iterator end = s.cend();
-  while (i != end) {
-    lastUsed = i;
-    bool r = DecodeUTF8(i, end);
-    if (!r) {
-      break;
-    }
-    output.emplace_back(std::string({lastUsed, i}));
+std::vector<std::string_view> SplitViews(std::string_view s) {
+  size_t codePoints;
+  std::string_view valid = s.substr(0, Scan(s, kNoLimit, &codePoints));
+  std::vector<std::string_view> output;
+  output.reserve(codePoints);
+  // The sequences are known to be valid, so their lengths follow from their
+  // lead bytes.
+  for (size_t i = 0; i < valid.length();) {
+    const auto lead = static_cast<unsigned char>(valid[i]);
+    size_t length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    output.push_back(valid.substr(i, length));
+    i += length;
   }
-
   return output;
 }
 
+std::vector<std::string> Split(std::string_view s) {
+  std::vector<std::string_view> views = SplitViews(s);
+  return {views.begin(), views.end()};
+}
+
 // NOLINTEND(readability-magic-numbers)
 }  // namespace McBopomofo
@@ -25,25 +25,40 @@
 #define SRC_ENGINE_UTF8HELPER_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace McBopomofo {
 
+// All of these read the string as a sequence of valid UTF-8 sequences that
+// ends before the first invalid one, if any. A valid sequence is one that
+// encodes a Unicode scalar value in the fewest bytes. Runs of ASCII are read
+// a word at a time.
+
+// Returns the length in bytes of the valid part of the string.
+size_t ValidUTF8Length(std::string_view s);
+
 // Count the number of code points of a string encoded in UTF-8. If it
 // encounters an invalid UTF-8 sequence, the returned value is the number of
 // code points up to before that invalid sequence.
-size_t CodePointCount(const std::string& s);
+size_t CodePointCount(std::string_view s);
 
 // Clamp the string by the cp code points. If the string is shorter, the result
 // is a copy of s. If s contains some invalid UTF-8 sequence, the returned value
 // will be the string clamped up to before that invalid sequence.
-std::string SubstringToCodePoints(const std::string& s, size_t cp);
+std::string SubstringToCodePoints(std::string_view s, size_t cp);
+
+// Same as SubstringToCodePoints(), but returns a view of s.
+std::string_view CodePointPrefix(std::string_view s, size_t cp);
 
 // Gets the code point at the given index.
-std::string GetCodePoint(const std::string& s, size_t cp);
+std::string GetCodePoint(std::string_view s, size_t cp);
 
 // Splits the string.
-std::vector<std::string> Split(const std::string& s);
+std::vector<std::string> Split(std::string_view s);
+
+// Same as Split(), but returns views of s, without a string per code point.
+std::vector<std::string_view> SplitViews(std::string_view s);
 
 }  // namespace McBopomofo
 
@@ -0,0 +1,103 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "UTF8Helper.h"
+
+namespace {
+
+// A node value, such as those split per node when building a state.
+constexpr char kPhrase[] = "小麥注音輸入法";
+
+std::string MakeText(std::string_view piece, size_t size) {
+  std::string text;
+  while (text.size() < size) {
+    text += piece;
+  }
+  return text;
+}
+
+const std::string& ASCIIText() {
+  static const std::string text =
+      MakeText("The quick brown fox jumps over the lazy dog. ", 64 * 1024);
+  return text;
+}
+
+const std::string& CJKText() {
+  static const std::string text =
+      MakeText("中文輸入法，以及不同的詞彙。", 64 * 1024);
+  return text;
+}
+
+void BM_CodePointCount(benchmark::State& state, const std::string& text) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(McBopomofo::CodePointCount(text));
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(text.size()));
+}
+
+void BM_CodePointCountASCII(benchmark::State& state) {
+  BM_CodePointCount(state, ASCIIText());
+}
+BENCHMARK(BM_CodePointCountASCII);
+
+void BM_CodePointCountCJK(benchmark::State& state) {
+  BM_CodePointCount(state, CJKText());
+}
+BENCHMARK(BM_CodePointCountCJK);
+
+void BM_SubstringToCodePoints(benchmark::State& state) {
+  std::string phrase = kPhrase;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(McBopomofo::SubstringToCodePoints(phrase, 4));
+  }
+}
+BENCHMARK(BM_SubstringToCodePoints);
+
+void BM_Split(benchmark::State& state) {
+  std::string phrase = kPhrase;
+  for (auto _ : state) {
+    std::vector<std::string> characters = McBopomofo::Split(phrase);
+    benchmark::DoNotOptimize(characters);
+  }
+}
+BENCHMARK(BM_Split);
+
+void BM_SplitViews(benchmark::State& state) {
+  std::string phrase = kPhrase;
+  for (auto _ : state) {
+    std::vector<std::string_view> characters = McBopomofo::SplitViews(phrase);
+    benchmark::DoNotOptimize(characters);
+  }
+}
+BENCHMARK(BM_SplitViews);
+
+}  // namespace
+
+BENCHMARK_MAIN();
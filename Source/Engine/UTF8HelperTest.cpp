@@ -22,6 +22,7 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "UTF8Helper.h"
@@ -105,4 +106,101 @@ TEST(UTF8HelperTest, Split) {
   ASSERT_EQ(output[6], "行");
 }
 
+TEST(UTF8HelperTest, SplitViews) {
+  std::string input = "a落魄🂡é";
+  std::vector<std::string_view> output = SplitViews(input);
+  ASSERT_EQ(output.size(), 5);
+  ASSERT_EQ(output[0], "a");
+  ASSERT_EQ(output[1], "落");
+  ASSERT_EQ(output[2], "魄");
+  ASSERT_EQ(output[3], "🂡");
+  ASSERT_EQ(output[4], "é");
+  ASSERT_EQ(output[1].data(), input.data() + 1);
+
+  ASSERT_TRUE(SplitViews("").empty());
+  output = SplitViews("ab\xe7\x81火");
+  ASSERT_EQ(output.size(), 2);
+  ASSERT_EQ(output[1], "b");
+  ASSERT_EQ(Split("ab\xe7\x81火"), std::vector<std::string>({"a", "b"}));
+}
+
+TEST(UTF8HelperTest, GettingCodePoints) {
+  std::string s = "café🂡火";
+  ASSERT_EQ(GetCodePoint(s, 0), "c");
+  ASSERT_EQ(GetCodePoint(s, 3), "é");
+  ASSERT_EQ(GetCodePoint(s, 4), "🂡");
+  ASSERT_EQ(GetCodePoint(s, 5), "火");
+  // Past the end, this is the last code point.
+  ASSERT_EQ(GetCodePoint(s, 6), "火");
+  ASSERT_EQ(GetCodePoint("", 0), "");
+
+  s = "caf\xa9火";
+  ASSERT_EQ(GetCodePoint(s, 2), "f");
+  ASSERT_EQ(GetCodePoint(s, 3), "");
+  ASSERT_EQ(GetCodePoint(s, 4), "");
+}
+
+TEST(UTF8HelperTest, CodePointPrefix) {
+  std::string s = "café🂡火";
+  ASSERT_EQ(CodePointPrefix(s, 4), "café");
+  ASSERT_EQ(CodePointPrefix(s, 4).data(), s.data());
+  ASSERT_EQ(CodePointPrefix(s, 10), s);
+  ASSERT_EQ(CodePointPrefix("caf\xa9火", 10), "caf");
+}
+
+TEST(UTF8HelperTest, ValidatingBoundarySequences) {
+  // The lowest and highest code points of each length.
+  ASSERT_EQ(ValidUTF8Length(std::string_view("\0", 1)), 1);
+  ASSERT_EQ(ValidUTF8Length("\x7f"), 1);
+  ASSERT_EQ(ValidUTF8Length("\xc2\x80"), 2);
+  ASSERT_EQ(ValidUTF8Length("\xdf\xbf"), 2);
+  ASSERT_EQ(ValidUTF8Length("\xe0\xa0\x80"), 3);
+  ASSERT_EQ(ValidUTF8Length("\xef\xbf\xbf"), 3);
+  ASSERT_EQ(ValidUTF8Length("\xf0\x90\x80\x80"), 4);
+  ASSERT_EQ(ValidUTF8Length("\xf4\x8f\xbf\xbf"), 4);
+  // Around the surrogates.
+  ASSERT_EQ(ValidUTF8Length("\xed\x9f\xbf"), 3);
+  ASSERT_EQ(ValidUTF8Length("\xed\xa0\x80"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xed\xbf\xbf"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xee\x80\x80"), 3);
+
+  // Overlong sequences.
+  ASSERT_EQ(ValidUTF8Length("\xc0\x80"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xc1\xbf"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xe0\x9f\xbf"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xf0\x8f\xbf\xbf"), 0);
+  // Above U+10FFFF.
+  ASSERT_EQ(ValidUTF8Length("\xf4\x90\x80\x80"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xf5\x80\x80\x80"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xf8\x88\x80\x80\x80"), 0);
+  ASSERT_EQ(ValidUTF8Length("\xff"), 0);
+  // Truncated and interrupted sequences.
+  ASSERT_EQ(ValidUTF8Length("a\xf0\x90\x80"), 1);
+  ASSERT_EQ(ValidUTF8Length("a\xe7\x81" "a"), 1);
+}
+
+TEST(UTF8HelperTest, CountingLongStrings) {
+  // Long enough for the ASCII to be read a word at a time.
+  std::string ascii(37, 'a');
+  std::string mixed;
+  for (size_t i = 0; i < 10; ++i) {
+    mixed += "ab火é🂡xyzw";
+  }
+  ASSERT_EQ(CodePointCount(ascii), 37);
+  ASSERT_EQ(CodePointCount(mixed), 90);
+  ASSERT_EQ(SubstringToCodePoints(mixed, 11), "ab火é🂡xyzwab");
+  ASSERT_EQ(SplitViews(mixed).size(), 90);
+
+  // An invalid byte at every position.
+  for (size_t i = 0; i < ascii.length(); ++i) {
+    std::string s = ascii;
+    s[i] = '\xa9';
+    ASSERT_EQ(CodePointCount(s), i);
+    ASSERT_EQ(ValidUTF8Length(s), i);
+    ASSERT_EQ(SubstringToCodePoints(s, 100), ascii.substr(0, i));
+    ASSERT_EQ(SubstringToCodePoints(s, i / 2), ascii.substr(0, i / 2));
+    ASSERT_EQ(Split(s).size(), i);
+  }
+}
+
 }  // namespace McBopomofo
@@ -24,13 +24,17 @@
 
 #include "UserOverrideModel.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
-#include <list>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
+#include "Trace.h"
 #include "gramambular2/reading_grid.h"
 
 namespace McBopomofo {
@@ -38,6 +42,11 @@ namespace McBopomofo {
 // Fully decay after about 20 generations.
 static constexpr double kDecayThreshold = 1.0 / 1048576.0;
 
+// A cached best candidate is not trusted within this many seconds of its
+// expiry, where rounding might disagree with Score() on whether it has fully
+// decayed.
+static constexpr double kExpiryMargin = 1.0;
+
 static constexpr char kEmptyNodeString[] = "()";
 
 // A scoring function that balances between "recent but infrequently observed"
@@ -45,20 +54,53 @@ static constexpr char kEmptyNodeString[] = "()";
 static double Score(size_t eventCount, size_t totalCount, double eventTimestamp,
                     double timestamp, double lambda);
 
-// Form the observation key from the nodes of a walk. This goes backward, but
-// we are using a const_iterator, the "end" here should be a .cbegin() of a
-// vector.
-static std::string FormObservationKey(
+namespace {
+
+// Computes MurmurHash3 x64_128 over a sequence of appended pieces, as if they
+// were one string.
+class ObservationKeyHasher {
+ public:
+  void append(std::string_view piece);
+  UserOverrideModel::ObservationKey finish();
+
+ private:
+  void mixBlock(const char* block);
+
+  uint64_t h1_ = 0;
+  uint64_t h2_ = 0;
+  size_t length_ = 0;
+  char buffer_[16];
+  size_t bufferLength_ = 0;
+};
+
+class StringSink {
+ public:
+  explicit StringSink(std::string* s) : s_(s) {}
+  void append(std::string_view piece) { s_->append(piece); }
+
+ private:
+  std::string* s_;
+};
+
+}  // namespace
+
+// Form the observation key from the nodes of a walk, appending its pieces to
+// the sink. This goes backward, but we are using a const_iterator, the "end"
+// here should be a .cbegin() of a vector.
+template <typename Sink>
+static void FormObservationKey(
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
         head,
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
-        end);
+        end,
+    Sink* sink);
 
 UserOverrideModel::UserOverrideModel(size_t capacity, double decayConstant)
     : capacity_(capacity) {
   assert(capacity_ > 0);
   // NOLINTNEXTLINE(readability-magic-numbers)
   decayExponent_ = log(0.5) / decayConstant;
+  decayLifetime_ = log(kDecayThreshold) / decayExponent_;
 }
 
 void UserOverrideModel::observe(
@@ -66,28 +108,43 @@ void UserOverrideModel::observe(
         walkBeforeUserOverride,
     const Formosa::Gramambular2::ReadingGrid::WalkResult& walkAfterUserOverride,
     size_t cursor, double timestamp) {
+  MCBOPOMOFO_TRACE_SCOPE("UserOverrideModel::observe");
+  auto inferred =
+      InferObservation(walkBeforeUserOverride, walkAfterUserOverride, cursor);
+  if (inferred.has_value()) {
+    observe(inferred->key, inferred->candidate, timestamp,
+            inferred->forceHighScoreOverride);
+  }
+}
+
+std::optional<UserOverrideModel::InferredObservation>
+UserOverrideModel::InferObservation(
+    const Formosa::Gramambular2::ReadingGrid::WalkResult&
+        walkBeforeUserOverride,
+    const Formosa::Gramambular2::ReadingGrid::WalkResult& walkAfterUserOverride,
+    size_t cursor) {
   // Sanity check.
   if (walkBeforeUserOverride.nodes.empty() ||
       walkAfterUserOverride.nodes.empty()) {
-    return;
+    return std::nullopt;
   }
 
   if (walkBeforeUserOverride.totalReadings !=
       walkAfterUserOverride.totalReadings) {
-    return;
+    return std::nullopt;
   }
 
   // We first infer what the user override is.
   size_t actualCursor = 0;
   auto currentNodeIt = walkAfterUserOverride.findNodeAt(cursor, &actualCursor);
   if (currentNodeIt == walkAfterUserOverride.nodes.cend()) {
-    return;
+    return std::nullopt;
   }
 
   // Based on previous analysis, we found it meaningless to handle phrases
   // over 3 characters.
   if ((*currentNodeIt)->spanningLength() > 3) {
-    return;
+    return std::nullopt;
   }
 
   // Now we need to find the head node in the previous walk (that is, before
@@ -95,12 +152,12 @@ void UserOverrideModel::observe(
   // the current node, so we need to decrement by 1.
   if (actualCursor == 0) {
     // Shouldn't happen.
-    return;
+    return std::nullopt;
   }
   --actualCursor;
   auto prevHeadNodeIt = walkBeforeUserOverride.findNodeAt(actualCursor);
   if (prevHeadNodeIt == walkBeforeUserOverride.nodes.cend()) {
-    return;
+    return std::nullopt;
   }
 
   // Now we have everything. We want to handle the following cases:
@@ -142,68 +199,120 @@ void UserOverrideModel::observe(
   auto endPoint = breakingUp ? walkAfterUserOverride.nodes.begin()
                              : walkBeforeUserOverride.nodes.begin();
 
-  std::string key = FormObservationKey(nodeIter, endPoint);
-  observe(key, currentNode->currentUnigram().value(), timestamp,
-          forceHighScoreOverride);
+  ObservationKeyHasher hasher;
+  FormObservationKey(nodeIter, endPoint, &hasher);
+  return InferredObservation{hasher.finish(),
+                             currentNode->currentUnigram().value(),
+                             forceHighScoreOverride};
 }
 
 UserOverrideModel::Suggestion UserOverrideModel::suggest(
     const Formosa::Gramambular2::ReadingGrid::WalkResult& currentWalk,
     size_t cursor, double timestamp) {
-  auto nodeIter = currentWalk.findNodeAt(cursor);
-  std::string key = FormObservationKey(nodeIter, currentWalk.nodes.begin());
-  return suggest(key, timestamp);
+  MCBOPOMOFO_TRACE_SCOPE("UserOverrideModel::suggest");
+  auto key = MakeObservationKey(currentWalk, cursor);
+  if (!key.has_value()) {
+    return UserOverrideModel::Suggestion{};
+  }
+  return suggest(*key, timestamp);
+}
+
+UserOverrideModel::ObservationKey UserOverrideModel::MakeObservationKey(
+    std::string_view keyString) {
+  ObservationKeyHasher hasher;
+  hasher.append(keyString);
+  return hasher.finish();
+}
+
+std::optional<UserOverrideModel::ObservationKey>
+UserOverrideModel::MakeObservationKey(
+    const Formosa::Gramambular2::ReadingGrid::WalkResult& walk,
+    size_t cursor) {
+  auto nodeIter = walk.findNodeAt(cursor);
+  if (nodeIter == walk.nodes.cend()) {
+    return std::nullopt;
+  }
+  ObservationKeyHasher hasher;
+  FormObservationKey(nodeIter, walk.nodes.begin(), &hasher);
+  return hasher.finish();
 }
 
-void UserOverrideModel::observe(const std::string& key,
+std::string UserOverrideModel::ObservationKeyString(
+    const Formosa::Gramambular2::ReadingGrid::WalkResult& walk,
+    size_t cursor) {
+  auto nodeIter = walk.findNodeAt(cursor);
+  if (nodeIter == walk.nodes.cend()) {
+    return {};
+  }
+  std::string key;
+  StringSink sink(&key);
+  FormObservationKey(nodeIter, walk.nodes.begin(), &sink);
+  return key;
+}
+
+void UserOverrideModel::observe(const ObservationKey& key,
                                 const std::string& candidate, double timestamp,
                                 bool forceHighScoreOverride) {
-  auto mapIter = lruMap_.find(key);
-  if (mapIter == lruMap_.end()) {
-    auto keyValuePair = KeyObservationPair(key, Observation());
-    Observation& observation = keyValuePair.second;
-    observation.update(candidate, timestamp, forceHighScoreOverride);
-
-    lruList_.push_front(keyValuePair);
-    auto listIter = lruList_.begin();
-    auto lruKeyValue =
-        std::pair<std::string, std::list<KeyObservationPair>::iterator>(
-            key, listIter);
-    lruMap_.insert(lruKeyValue);
-
-    if (lruList_.size() > capacity_) {
-      auto lastKeyValuePair = lruList_.end();
-      --lastKeyValuePair;
-      lruMap_.erase(lastKeyValuePair->first);
-      lruList_.pop_back();
-    }
-  } else {
-    auto listIter = mapIter->second;
-    lruList_.splice(lruList_.begin(), lruList_, listIter);
-
-    auto& keyValuePair = *listIter;
-    Observation& observation = keyValuePair.second;
-    observation.update(candidate, timestamp, forceHighScoreOverride);
+  const uint32_t node = acquireNode(key);
+  Node& n = nodes_[node];
+  n.observation.update(candidate, timestamp, forceHighScoreOverride);
+  updateBest(&n.observation, timestamp);
+  n.lastObserved = ++observationSequence_;
+  if (!n.changed) {
+    n.changed = true;
+    changedNodes_.push_back(node);
   }
 }
 
-UserOverrideModel::Suggestion UserOverrideModel::suggest(const std::string& key,
-                                                         double timestamp) {
-  auto mapIter = lruMap_.find(key);
-  if (mapIter == lruMap_.end()) {
+UserOverrideModel::Suggestion UserOverrideModel::suggest(
+    const ObservationKey& key, double timestamp) {
+  const uint32_t node = find(key);
+  if (node == kNil) {
     return UserOverrideModel::Suggestion{};
   }
+  Observation& observation = nodes_[node].observation;
+  // Move the cache forward once the best candidate has expired, so that the
+  // following calls take the fast path again.
+  if (timestamp >= observation.bestExpiresAt) {
+    updateBest(&observation, timestamp);
+  }
+  return suggest(observation, timestamp);
+}
+
+const UserOverrideModel::Observation* UserOverrideModel::findObservation(
+    const ObservationKey& key) const {
+  const uint32_t node = find(key);
+  return node == kNil ? nullptr : &nodes_[node].observation;
+}
+
+std::optional<UserOverrideModel::ObservationKey>
+UserOverrideModel::evictionCandidate() const {
+  if (nodes_.size() < capacity_) {
+    return std::nullopt;
+  }
+  return nodes_[tail_].key;
+}
 
-  auto listIter = mapIter->second;
-  auto& keyValuePair = *listIter;
-  const Observation& observation = keyValuePair.second;
+UserOverrideModel::Suggestion UserOverrideModel::suggest(
+    const Observation& observation, double timestamp) const {
+  size_t best = observation.best;
+  if (timestamp < observation.bestComputedAt ||
+      timestamp >= observation.bestExpiresAt) {
+    best = findBest(observation, timestamp);
+  }
+  if (best == kMaxOverridesPerObservation) {
+    return UserOverrideModel::Suggestion{};
+  }
+  const Override& o = observation.overrides[best];
+  return UserOverrideModel::Suggestion{o.candidate, o.forceHighScoreOverride};
+}
 
-  std::string candidate;
-  bool forceHighScoreOverride = false;
+size_t UserOverrideModel::findBest(const Observation& observation,
+                                   double timestamp) const {
+  size_t best = kMaxOverridesPerObservation;
   double score = 0;
-  for (auto i = observation.overrides.begin(); i != observation.overrides.end();
-       ++i) {
-    const Override& o = i->second;
+  for (size_t i = 0; i < observation.overrideCount; ++i) {
+    const Override& o = observation.overrides[i];
     double overrideScore = Score(o.count, observation.count, o.timestamp,
                                  timestamp, decayExponent_);
     if (overrideScore == 0.0) {
@@ -211,22 +320,430 @@ UserOverrideModel::Suggestion UserOverrideModel::suggest(const std::string& key,
     }
 
     if (overrideScore > score) {
-      candidate = i->first;
-      forceHighScoreOverride = o.forceHighScoreOverride;
+      best = i;
       score = overrideScore;
     }
   }
-  return UserOverrideModel::Suggestion{candidate, forceHighScoreOverride};
+  return best;
+}
+
+void UserOverrideModel::updateBest(Observation* observation,
+                                   double timestamp) const {
+  observation->best = findBest(*observation, timestamp);
+  observation->bestComputedAt = timestamp;
+  if (observation->best == kMaxOverridesPerObservation) {
+    // Nothing comes back from full decay.
+    observation->bestExpiresAt = std::numeric_limits<double>::infinity();
+  } else {
+    observation->bestExpiresAt =
+        observation->overrides[observation->best].timestamp + decayLifetime_ -
+        kExpiryMargin;
+  }
+}
+
+MemoryUsage UserOverrideModel::memoryUsage() const {
+  MemoryUsage usage;
+  usage.heapBytes = VectorHeapBytes(nodes_) + VectorHeapBytes(index_) +
+                    VectorHeapBytes(changedNodes_);
+  for (const Node& node : nodes_) {
+    for (const Override& entry : node.observation.overrides) {
+      usage.heapBytes += StringHeapBytes(entry.candidate);
+    }
+  }
+  return usage;
+}
+
+size_t UserOverrideModel::evictExpired(
+    double timestamp, std::vector<ObservationKey>* removedKeys) {
+  size_t removed = 0;
+  uint32_t node = 0;
+  while (node < nodes_.size()) {
+    Observation& observation = nodes_[node].observation;
+    if (timestamp >= observation.bestExpiresAt ||
+        timestamp < observation.bestComputedAt) {
+      updateBest(&observation, timestamp);
+    }
+    if (observation.best != kMaxOverridesPerObservation) {
+      ++node;
+      continue;
+    }
+    if (removedKeys != nullptr) {
+      removedKeys->push_back(nodes_[node].key);
+    }
+    // This moves the last node here, which is checked next.
+    removeNode(node);
+    ++removed;
+  }
+  return removed;
 }
 
 void UserOverrideModel::Observation::update(const std::string& candidate,
                                             double timestamp,
                                             bool forceHighScoreOverride) {
   count++;
-  auto& o = overrides[candidate];
-  o.timestamp = timestamp;
-  o.count++;
-  o.forceHighScoreOverride = forceHighScoreOverride;
+  auto begin = overrides.begin();
+  auto end = begin + static_cast<ptrdiff_t>(overrideCount);
+  auto it = std::lower_bound(
+      begin, end, candidate,
+      [](const Override& o, const std::string& c) { return o.candidate < c; });
+  if (it == end || it->candidate != candidate) {
+    if (overrideCount == kMaxOverridesPerObservation) {
+      // Drop the least observed candidate, or the older one in a tie.
+      auto victim = std::min_element(
+          begin, end, [](const Override& a, const Override& b) {
+            return a.count != b.count ? a.count < b.count
+                                      : a.timestamp < b.timestamp;
+          });
+      std::move(victim + 1, end, victim);
+      --overrideCount;
+      --end;
+      it = std::lower_bound(begin, end, candidate,
+                            [](const Override& o, const std::string& c) {
+                              return o.candidate < c;
+                            });
+    }
+    std::move_backward(it, end, end + 1);
+    *it = Override{candidate, 0, 0, false};
+    ++overrideCount;
+  }
+  it->timestamp = timestamp;
+  it->count++;
+  it->forceHighScoreOverride = forceHighScoreOverride;
+}
+
+// A record is laid out as follows, in native byte order, with no padding:
+//
+//   uint32_t  payload length, not including this field and the checksum
+//   uint64_t  low half of the observation key
+//   uint64_t  high half of the observation key
+//   uint64_t  observation count
+//   uint8_t   number of candidates
+//   For each candidate:
+//     uint64_t  count
+//     double    timestamp
+//     uint8_t   1 if forcing a high score override, otherwise 0
+//     uint16_t  candidate length in bytes
+//     char[]    candidate
+//   uint32_t  FNV-1a hash of the payload
+static constexpr size_t kRecordLengthSize = sizeof(uint32_t);
+static constexpr size_t kRecordChecksumSize = sizeof(uint32_t);
+
+static uint32_t RecordChecksum(const char* data, size_t size) {
+  uint32_t hash = 0x811c9dc5U;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x01000193U;
+  }
+  return hash;
+}
+
+template <typename T>
+static void Append(std::string* out, T value) {
+  char bytes[sizeof(T)];
+  memcpy(bytes, &value, sizeof(T));
+  out->append(bytes, sizeof(T));
+}
+
+namespace {
+
+// Reads values from a bounded buffer; once a read goes past the end, all
+// subsequent reads fail.
+class RecordReader {
+ public:
+  RecordReader(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+  template <typename T>
+  bool read(T* value) {
+    if (static_cast<size_t>(end_ - p_) < sizeof(T)) {
+      p_ = end_;
+      ok_ = false;
+      return false;
+    }
+    memcpy(value, p_, sizeof(T));
+    p_ += sizeof(T);
+    return ok_;
+  }
+
+  bool read(std::string* value, size_t length) {
+    if (static_cast<size_t>(end_ - p_) < length) {
+      p_ = end_;
+      ok_ = false;
+      return false;
+    }
+    value->assign(p_, length);
+    p_ += length;
+    return ok_;
+  }
+
+  [[nodiscard]] bool atEnd() const { return ok_ && p_ == end_; }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool ok_ = true;
+};
+
+}  // namespace
+
+void UserOverrideModel::encodeRecord(uint32_t node, std::string* out) const {
+  const Node& n = nodes_[node];
+  const size_t lengthOffset = out->size();
+  Append<uint32_t>(out, 0);
+  const size_t payloadOffset = out->size();
+  Append<uint64_t>(out, n.key.low);
+  Append<uint64_t>(out, n.key.high);
+  Append<uint64_t>(out, n.observation.count);
+  Append<uint8_t>(out, static_cast<uint8_t>(n.observation.overrideCount));
+  for (size_t i = 0; i < n.observation.overrideCount; ++i) {
+    const Override& o = n.observation.overrides[i];
+    const size_t length = std::min<size_t>(o.candidate.size(), UINT16_MAX);
+    Append<uint64_t>(out, o.count);
+    Append<double>(out, o.timestamp);
+    Append<uint8_t>(out, o.forceHighScoreOverride ? 1 : 0);
+    Append<uint16_t>(out, static_cast<uint16_t>(length));
+    out->append(o.candidate, 0, length);
+  }
+  const auto payloadSize = static_cast<uint32_t>(out->size() - payloadOffset);
+  memcpy(out->data() + lengthOffset, &payloadSize, sizeof(payloadSize));
+  Append<uint32_t>(out,
+                   RecordChecksum(out->data() + payloadOffset, payloadSize));
+}
+
+size_t UserOverrideModel::encodeChangedObservations(std::string* out) {
+  std::sort(changedNodes_.begin(), changedNodes_.end(),
+            [this](uint32_t a, uint32_t b) {
+              return nodes_[a].lastObserved < nodes_[b].lastObserved;
+            });
+  for (uint32_t node : changedNodes_) {
+    encodeRecord(node, out);
+    nodes_[node].changed = false;
+  }
+  const size_t count = changedNodes_.size();
+  changedNodes_.clear();
+  return count;
+}
+
+size_t UserOverrideModel::encodeAllObservations(std::string* out) {
+  size_t count = 0;
+  for (uint32_t node = tail_; node != kNil; node = nodes_[node].prev) {
+    encodeRecord(node, out);
+    nodes_[node].changed = false;
+    ++count;
+  }
+  changedNodes_.clear();
+  return count;
+}
+
+size_t UserOverrideModel::decodeObservations(const char* data, size_t size,
+                                             size_t* recordCount) {
+  size_t consumed = 0;
+  size_t records = 0;
+  while (size - consumed >= kRecordLengthSize + kRecordChecksumSize) {
+    const char* record = data + consumed;
+    uint32_t payloadSize;
+    memcpy(&payloadSize, record, sizeof(payloadSize));
+    const size_t recordSize =
+        kRecordLengthSize + size_t{payloadSize} + kRecordChecksumSize;
+    if (size - consumed < recordSize) {
+      break;
+    }
+    const char* payload = record + kRecordLengthSize;
+    uint32_t checksum;
+    memcpy(&checksum, payload + payloadSize, sizeof(checksum));
+    if (checksum != RecordChecksum(payload, payloadSize)) {
+      break;
+    }
+
+    RecordReader reader(payload, payloadSize);
+    ObservationKey key;
+    uint64_t count = 0;
+    uint8_t overrideCount = 0;
+    reader.read(&key.low);
+    reader.read(&key.high);
+    reader.read(&count);
+    reader.read(&overrideCount);
+    if (overrideCount > kMaxOverridesPerObservation) {
+      break;
+    }
+    Observation observation;
+    observation.count = count;
+    observation.overrideCount = overrideCount;
+    for (size_t i = 0; i < overrideCount; ++i) {
+      Override& o = observation.overrides[i];
+      uint64_t candidateCount = 0;
+      uint8_t force = 0;
+      uint16_t length = 0;
+      reader.read(&candidateCount);
+      reader.read(&o.timestamp);
+      reader.read(&force);
+      reader.read(&length);
+      reader.read(&o.candidate, length);
+      o.count = candidateCount;
+      o.forceHighScoreOverride = force != 0;
+    }
+    if (!reader.atEnd()) {
+      break;
+    }
+
+    Node& node = nodes_[acquireNode(key)];
+    node.observation = std::move(observation);
+    node.lastObserved = ++observationSequence_;
+    consumed += recordSize;
+    ++records;
+  }
+  if (recordCount != nullptr) {
+    *recordCount = records;
+  }
+  return consumed;
+}
+
+uint32_t UserOverrideModel::acquireNode(const ObservationKey& key) {
+  uint32_t node = find(key);
+  if (node != kNil) {
+    unlink(node);
+  } else if (nodes_.size() < capacity_) {
+    if ((nodes_.size() + 1) * 2 > index_.size()) {
+      rebuildIndex(std::max<size_t>(index_.size() * 2, 16));
+    }
+    node = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(Node{key, kNil, kNil, Observation(), 0, false});
+    insertIntoIndex(node);
+  } else {
+    // Reuse the least recently observed node. If it has unencoded changes,
+    // it stays on the list of changed nodes, now for the new key.
+    node = tail_;
+    unlink(node);
+    eraseFromIndex(nodes_[node].key);
+    nodes_[node].key = key;
+    nodes_[node].observation = Observation();
+    insertIntoIndex(node);
+  }
+  pushFront(node);
+  return node;
+}
+
+uint32_t UserOverrideModel::find(const ObservationKey& key) const {
+  if (index_.empty()) {
+    return kNil;
+  }
+  const size_t mask = index_.size() - 1;
+  for (size_t i = key.low & mask;; i = (i + 1) & mask) {
+    const uint32_t node = index_[i];
+    if (node == kNil || nodes_[node].key == key) {
+      return node;
+    }
+  }
+}
+
+void UserOverrideModel::insertIntoIndex(uint32_t node) {
+  const size_t mask = index_.size() - 1;
+  size_t i = nodes_[node].key.low & mask;
+  while (index_[i] != kNil) {
+    i = (i + 1) & mask;
+  }
+  index_[i] = node;
+}
+
+void UserOverrideModel::eraseFromIndex(const ObservationKey& key) {
+  const size_t mask = index_.size() - 1;
+  size_t i = key.low & mask;
+  while (index_[i] != kNil && !(nodes_[index_[i]].key == key)) {
+    i = (i + 1) & mask;
+  }
+  if (index_[i] == kNil) {
+    return;
+  }
+
+  // Shift back the entries after the hole that would otherwise become
+  // unreachable from their home slots.
+  size_t hole = i;
+  for (size_t j = (i + 1) & mask; index_[j] != kNil; j = (j + 1) & mask) {
+    const size_t home = nodes_[index_[j]].key.low & mask;
+    const bool homeInHoleToJ =
+        hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+    if (!homeInHoleToJ) {
+      index_[hole] = index_[j];
+      hole = j;
+    }
+  }
+  index_[hole] = kNil;
+}
+
+void UserOverrideModel::rebuildIndex(size_t size) {
+  index_.assign(size, kNil);
+  for (uint32_t node = 0; node < nodes_.size(); ++node) {
+    insertIntoIndex(node);
+  }
+}
+
+void UserOverrideModel::removeNode(uint32_t node) {
+  unlink(node);
+  eraseFromIndex(nodes_[node].key);
+  if (nodes_[node].changed) {
+    changedNodes_.erase(
+        std::find(changedNodes_.begin(), changedNodes_.end(), node));
+  }
+
+  const auto last = static_cast<uint32_t>(nodes_.size() - 1);
+  if (node != last) {
+    // Move the last node into the hole and repoint everything at it.
+    const ObservationKey lastKey = nodes_[last].key;
+    const bool lastWasHead = head_ == last;
+    const bool lastWasTail = tail_ == last;
+    nodes_[node] = std::move(nodes_[last]);
+    Node& n = nodes_[node];
+    if (n.prev != kNil) {
+      nodes_[n.prev].next = node;
+    }
+    if (n.next != kNil) {
+      nodes_[n.next].prev = node;
+    }
+    if (lastWasHead) {
+      head_ = node;
+    }
+    if (lastWasTail) {
+      tail_ = node;
+    }
+    const size_t mask = index_.size() - 1;
+    size_t i = lastKey.low & mask;
+    while (index_[i] != last) {
+      i = (i + 1) & mask;
+    }
+    index_[i] = node;
+    if (n.changed) {
+      *std::find(changedNodes_.begin(), changedNodes_.end(), last) = node;
+    }
+  }
+  nodes_.pop_back();
+}
+
+void UserOverrideModel::unlink(uint32_t node) {
+  Node& n = nodes_[node];
+  if (n.prev != kNil) {
+    nodes_[n.prev].next = n.next;
+  } else {
+    head_ = n.next;
+  }
+  if (n.next != kNil) {
+    nodes_[n.next].prev = n.prev;
+  } else {
+    tail_ = n.prev;
+  }
+  n.prev = kNil;
+  n.next = kNil;
+}
+
+void UserOverrideModel::pushFront(uint32_t node) {
+  Node& n = nodes_[node];
+  n.prev = kNil;
+  n.next = head_;
+  if (head_ != kNil) {
+    nodes_[head_].prev = node;
+  }
+  head_ = node;
+  if (tail_ == kNil) {
+    tail_ = node;
+  }
 }
 
 static double Score(size_t eventCount, size_t totalCount, double eventTimestamp,
@@ -241,9 +758,99 @@ static double Score(size_t eventCount, size_t totalCount, double eventTimestamp,
   return prob * decay;
 }
 
-static std::string CombineReadingValue(const std::string& reading,
-                                       const std::string& value) {
-  return std::string("(") + reading + "," + value + ")";
+static constexpr uint64_t kMurmurC1 = 0x87c37b91114253d5ULL;
+static constexpr uint64_t kMurmurC2 = 0x4cf5ad432745937fULL;
+
+static inline uint64_t RotateLeft(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t FinalMix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+void ObservationKeyHasher::mixBlock(const char* block) {
+  uint64_t k1;
+  uint64_t k2;
+  memcpy(&k1, block, sizeof(k1));
+  memcpy(&k2, block + sizeof(k1), sizeof(k2));
+
+  k1 *= kMurmurC1;
+  k1 = RotateLeft(k1, 31);
+  k1 *= kMurmurC2;
+  h1_ ^= k1;
+  h1_ = RotateLeft(h1_, 27);
+  h1_ += h2_;
+  h1_ = h1_ * 5 + 0x52dce729;
+
+  k2 *= kMurmurC2;
+  k2 = RotateLeft(k2, 33);
+  k2 *= kMurmurC1;
+  h2_ ^= k2;
+  h2_ = RotateLeft(h2_, 31);
+  h2_ += h1_;
+  h2_ = h2_ * 5 + 0x38495ab5;
+}
+
+void ObservationKeyHasher::append(std::string_view piece) {
+  // The pieces are mostly a few bytes long, for which copying byte by byte
+  // is cheaper than calling memcpy.
+  length_ += piece.size();
+  for (char c : piece) {
+    buffer_[bufferLength_++] = c;
+    if (bufferLength_ == sizeof(buffer_)) {
+      mixBlock(buffer_);
+      bufferLength_ = 0;
+    }
+  }
+}
+
+UserOverrideModel::ObservationKey ObservationKeyHasher::finish() {
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (size_t i = bufferLength_; i > 8; --i) {
+    k2 = (k2 << 8) | static_cast<unsigned char>(buffer_[i - 1]);
+  }
+  for (size_t i = std::min<size_t>(bufferLength_, 8); i > 0; --i) {
+    k1 = (k1 << 8) | static_cast<unsigned char>(buffer_[i - 1]);
+  }
+  if (bufferLength_ > 8) {
+    k2 *= kMurmurC2;
+    k2 = RotateLeft(k2, 33);
+    k2 *= kMurmurC1;
+    h2_ ^= k2;
+  }
+  if (bufferLength_ > 0) {
+    k1 *= kMurmurC1;
+    k1 = RotateLeft(k1, 31);
+    k1 *= kMurmurC2;
+    h1_ ^= k1;
+  }
+
+  h1_ ^= length_;
+  h2_ ^= length_;
+  h1_ += h2_;
+  h2_ += h1_;
+  h1_ = FinalMix(h1_);
+  h2_ = FinalMix(h2_);
+  h1_ += h2_;
+  h2_ += h1_;
+  return UserOverrideModel::ObservationKey{h1_, h2_};
+}
+
+template <typename Sink>
+static void AppendReadingValue(const std::string& reading,
+                               const std::string& value, Sink* sink) {
+  sink->append("(");
+  sink->append(reading);
+  sink->append(",");
+  sink->append(value);
+  sink->append(")");
 }
 
 static bool IsPunctuation(
@@ -252,49 +859,47 @@ static bool IsPunctuation(
   return !reading.empty() && reading[0] == '_';
 }
 
-static std::string FormObservationKey(
+template <typename Sink>
+static void FormObservationKey(
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
         head,
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
-        end) {
+        end,
+    Sink* sink) {
   // Using the top unigram from the head node. Recall that this is an
   // observation for *before* the user override, and when we provide
   // a suggestion, this head node is never overridden yet.
-  std::string headStr =
-      CombineReadingValue((*head)->reading(), (*head)->unigrams()[0].value());
+  const auto& headNode = *head;
 
   // For the next two nodes, use their current unigram values. If it's a
   // punctuation, we ignore the reading and the value altogether and treat
   // it as if it's like the beginning of the sentence.
-  std::string prevStr;
-  bool prevIsPunctuation = false;
+  const Formosa::Gramambular2::ReadingGrid::Node* prevNode = nullptr;
+  const Formosa::Gramambular2::ReadingGrid::Node* anteriorNode = nullptr;
   if (head != end) {
     --head;
-    prevIsPunctuation = IsPunctuation(*head);
-    if (prevIsPunctuation) {
-      prevStr = kEmptyNodeString;
-    } else {
-      prevStr = CombineReadingValue((*head)->reading(),
-                                    (*head)->currentUnigram().value());
+    if (!IsPunctuation(*head)) {
+      prevNode = head->get();
+      if (head != end) {
+        --head;
+        if (!IsPunctuation(*head)) {
+          anteriorNode = head->get();
+        }
+      }
     }
-  } else {
-    prevStr = kEmptyNodeString;
   }
 
-  std::string anteriorStr;
-  if (head != end && !prevIsPunctuation) {
-    --head;
-    if (IsPunctuation((*head))) {
-      anteriorStr = kEmptyNodeString;
+  for (const auto* node : {anteriorNode, prevNode}) {
+    if (node == nullptr) {
+      sink->append(kEmptyNodeString);
     } else {
-      anteriorStr = CombineReadingValue((*head)->reading(),
-                                        (*head)->currentUnigram().value());
+      AppendReadingValue(node->reading(), node->currentUnigram().value(),
+                         sink);
     }
-  } else {
-    anteriorStr = kEmptyNodeString;
+    sink->append("-");
   }
-
-  return anteriorStr + "-" + prevStr + "-" + headStr;
+  AppendReadingValue(headNode->reading(), headNode->unigrams()[0].value(),
+                     sink);
 }
 
 }  // namespace McBopomofo
@@ -24,15 +24,30 @@
 #ifndef SRC_ENGINE_USEROVERRIDEMODEL_H_
 #define SRC_ENGINE_USEROVERRIDEMODEL_H_
 
-#include <list>
-#include <map>
+#include <array>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
+#include "MemoryUsage.h"
 #include "gramambular2/reading_grid.h"
 
 namespace McBopomofo {
 
+// Learns which candidates the user picks over the walk's own choices, keyed by
+// the context of up to three nodes, and keeps the most recently observed
+// contexts up to the capacity.
+//
+// The observations live in one array and form an LRU list linked by array
+// indices. They are found through an open-addressing index of their
+// ObservationKey, a 128-bit hash of the key string. The key strings are never
+// built or stored, so two strings with the same hash would share an
+// observation unnoticed; the tests check with a subclass that keeps the
+// strings. Each observation keeps at most a few candidates inline, so
+// observe() and suggest() take constant time at any capacity.
 class UserOverrideModel {
  public:
   UserOverrideModel(size_t capacity, double decayConstant);
@@ -47,6 +62,49 @@ class UserOverrideModel {
     [[nodiscard]] bool empty() const { return candidate.empty(); }
   };
 
+  // Identifies an observation. This is a 128-bit hash of the observation key
+  // string, "(r1,v1)-(r2,v2)-(r3,v3)", formed from the readings and values of
+  // the node at the cursor (last) and the two nodes before it. The walk
+  // overloads of observe() and suggest() hash the pieces of the string as
+  // they go, without allocating.
+  struct ObservationKey {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const ObservationKey&) const = default;
+  };
+
+  static ObservationKey MakeObservationKey(std::string_view keyString);
+
+  // Returns the key of the observation at the cursor of the walk, or
+  // std::nullopt if the cursor is out of the walk.
+  static std::optional<ObservationKey> MakeObservationKey(
+      const Formosa::Gramambular2::ReadingGrid::WalkResult& walk,
+      size_t cursor);
+
+  // Returns the observation key string that suggest() would use for the walk
+  // and the cursor. For debugging.
+  static std::string ObservationKeyString(
+      const Formosa::Gramambular2::ReadingGrid::WalkResult& walk,
+      size_t cursor);
+
+  // What to observe when the user overrides a walk.
+  struct InferredObservation {
+    ObservationKey key;
+    std::string candidate;
+    bool forceHighScoreOverride = false;
+  };
+
+  // Infers the observation from the walks before and after the user picked a
+  // candidate at the cursor, or returns std::nullopt if there is nothing
+  // worth observing.
+  static std::optional<InferredObservation> InferObservation(
+      const Formosa::Gramambular2::ReadingGrid::WalkResult&
+          walkBeforeUserOverride,
+      const Formosa::Gramambular2::ReadingGrid::WalkResult&
+          walkAfterUserOverride,
+      size_t cursor);
+
   void observe(const Formosa::Gramambular2::ReadingGrid::WalkResult&
                    walkBeforeUserOverride,
                const Formosa::Gramambular2::ReadingGrid::WalkResult&
@@ -57,33 +115,158 @@ class UserOverrideModel {
       const Formosa::Gramambular2::ReadingGrid::WalkResult& currentWalk,
       size_t cursor, double timestamp);
 
-  void observe(const std::string& key, const std::string& candidate,
+  void observe(const ObservationKey& key, const std::string& candidate,
                double timestamp, bool forceHighScoreOverride = false);
 
-  Suggestion suggest(const std::string& key, double timestamp);
+  Suggestion suggest(const ObservationKey& key, double timestamp);
+
+  void observe(const std::string& key, const std::string& candidate,
+               double timestamp, bool forceHighScoreOverride = false) {
+    observe(MakeObservationKey(key), candidate, timestamp,
+            forceHighScoreOverride);
+  }
+
+  Suggestion suggest(const std::string& key, double timestamp) {
+    return suggest(MakeObservationKey(key), timestamp);
+  }
+
+  // The number of observations held.
+  [[nodiscard]] size_t size() const { return nodes_.size(); }
+  [[nodiscard]] size_t capacity() const { return capacity_; }
 
- private:
   struct Override {
+    std::string candidate;
     size_t count = 0;
     double timestamp = 0;
     bool forceHighScoreOverride = false;
   };
 
+  // The number of candidates an observation keeps. When a new candidate is
+  // observed in a full observation, the least observed candidate is dropped.
+  static constexpr size_t kMaxOverridesPerObservation = 4;
+
   struct Observation {
-    size_t count;
-    std::map<std::string, Override> overrides;
+    size_t count = 0;
+    size_t overrideCount = 0;
+
+    // Sorted by candidate, so that a tie in scores goes to the same
+    // candidate regardless of the order of observation.
+    std::array<Override, kMaxOverridesPerObservation> overrides;
+
+    // The index of the best candidate as of bestComputedAt, or
+    // kMaxOverridesPerObservation if no candidate has a score. As every
+    // candidate decays at the same rate, the ranking does not change over
+    // time until the best candidate fully decays, so this stays the best
+    // candidate from bestComputedAt until bestExpiresAt.
+    size_t best = kMaxOverridesPerObservation;
+    double bestComputedAt = 0;
+    double bestExpiresAt = 0;
 
-    Observation() : count(0) {}
     void update(const std::string& candidate, double timestamp,
                 bool forceHighScoreOverride);
   };
 
-  typedef std::pair<std::string, Observation> KeyObservationPair;
+  // Returns the observation of the key, or nullptr. The pointer is valid
+  // until the next observe() or decodeObservations().
+  [[nodiscard]] const Observation* findObservation(
+      const ObservationKey& key) const;
+
+  // Returns the key of the observation that the next observe() of a new key
+  // would evict, or std::nullopt if the model is not full.
+  [[nodiscard]] std::optional<ObservationKey> evictionCandidate() const;
+
+  // Returns the best candidate of the observation at the timestamp. This only
+  // reads the observation and the model's constant decay settings, so it may
+  // be called on an observation copied out of the model from any thread.
+  [[nodiscard]] Suggestion suggest(const Observation& observation,
+                                   double timestamp) const;
+
+  // Removes the observations whose candidates have all fully decayed at the
+  // timestamp, and returns the number removed. The keys of the removed
+  // observations are appended to removedKeys if given. This takes time
+  // proportional to size(); call it once in a while, such as when saving.
+  size_t evictExpired(double timestamp,
+                      std::vector<ObservationKey>* removedKeys = nullptr);
+
+  // The observations, their candidates and the index. This grows with size()
+  // up to the capacity.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
+  // Persistence, used by UserOverrideModelStore. An observation is encoded as
+  // a self-contained, checksummed record, and decoding a sequence of records
+  // in order reproduces the observations and their LRU order.
+
+  // Appends the records of the observations changed since the last encoding,
+  // least recently observed first, and returns the number of records.
+  size_t encodeChangedObservations(std::string* out);
+
+  // Appends the records of all observations, least recently observed first,
+  // and returns the number of records. This also clears the changes.
+  size_t encodeAllObservations(std::string* out);
+
+  // Decodes records from the buffer, stopping at the end or at the first
+  // incomplete or damaged record. Returns the number of bytes consumed and
+  // sets recordCount, if given, to the number of records decoded. Decoded
+  // observations are not considered changed.
+  size_t decodeObservations(const char* data, size_t size,
+                            size_t* recordCount = nullptr);
+
+ private:
+  // A node of the LRU list, linked by indices into nodes_.
+  struct Node {
+    ObservationKey key;
+    uint32_t prev;
+    uint32_t next;
+    Observation observation;
+    // The value of observationSequence_ when last observed.
+    uint64_t lastObserved;
+    // Whether the observation changed since the last encoding.
+    bool changed;
+  };
+
+  static constexpr uint32_t kNil = UINT32_MAX;
+
+  // Returns the node of the key at the front of the LRU list, adding one with
+  // an empty observation, or reusing the least recently observed one, if
+  // there is no such node.
+  uint32_t acquireNode(const ObservationKey& key);
+
+  void encodeRecord(uint32_t node, std::string* out) const;
+
+  // Returns the node of the key, or kNil.
+  uint32_t find(const ObservationKey& key) const;
+  void insertIntoIndex(uint32_t node);
+  void eraseFromIndex(const ObservationKey& key);
+  void rebuildIndex(size_t size);
+
+  // Returns the index of the best candidate of the observation at the
+  // timestamp, or kMaxOverridesPerObservation if there is none.
+  [[nodiscard]] size_t findBest(const Observation& observation,
+                                double timestamp) const;
+  void updateBest(Observation* observation, double timestamp) const;
+
+  // Removes the node, moving the last node into its place.
+  void removeNode(uint32_t node);
+
+  void unlink(uint32_t node);
+  void pushFront(uint32_t node);
 
   size_t capacity_;
   double decayExponent_;
-  std::list<KeyObservationPair> lruList_;
-  std::map<std::string, std::list<KeyObservationPair>::iterator> lruMap_;
+  // The time it takes a candidate to fully decay.
+  double decayLifetime_;
+
+  std::vector<Node> nodes_;
+  // The most and the least recently observed nodes.
+  uint32_t head_ = kNil;
+  uint32_t tail_ = kNil;
+
+  // A linear-probing table of node indices, kept at most half full.
+  std::vector<uint32_t> index_;
+
+  uint64_t observationSequence_ = 0;
+  // The nodes whose changed flag is set.
+  std::vector<uint32_t> changedNodes_;
 };
 
 }  // namespace McBopomofo
@@ -0,0 +1,208 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ConcurrentUserOverrideModel.h"
+#include "UserOverrideModel.h"
+#include "gramambular2/reading_grid.h"
+
+namespace {
+
+using UserOverrideModel = McBopomofo::UserOverrideModel;
+
+constexpr double kHalflife = 5400.0;
+constexpr double kNow = 1657772432;
+
+// Keys shaped like real observation keys, which share long prefixes.
+std::string ObservationKey(uint64_t i) {
+  return "(ㄋㄧˇ,你)-(ㄏㄠˇ," + std::to_string(i % 1000) + ")-(ㄇㄚ˙," +
+         std::to_string(i) + ")";
+}
+
+std::vector<std::string> MakeKeys(size_t count) {
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    // Scatter the keys so that consecutive lookups are not neighbors.
+    keys.push_back(ObservationKey((i * 2654435761ULL) % (count * 4)));
+  }
+  return keys;
+}
+
+// Observing new keys in a full model, which evicts one entry each time.
+static void BM_ObserveWithEviction(benchmark::State& state) {
+  const auto capacity = static_cast<size_t>(state.range(0));
+  std::vector<std::string> keys = MakeKeys(capacity * 2);
+  UserOverrideModel uom(capacity, kHalflife);
+  for (size_t i = 0; i < capacity; ++i) {
+    uom.observe(keys[i], "候選", kNow);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    uom.observe(keys[i % keys.size()], "候選", kNow + static_cast<double>(i));
+    ++i;
+  }
+}
+BENCHMARK(BM_ObserveWithEviction)->Arg(500)->Arg(100000)->Arg(1000000);
+
+// Suggesting from a full model, half of the lookups being misses.
+static void BM_Suggest(benchmark::State& state) {
+  const auto capacity = static_cast<size_t>(state.range(0));
+  std::vector<std::string> keys = MakeKeys(capacity * 2);
+  UserOverrideModel uom(capacity, kHalflife);
+  for (size_t i = 0; i < capacity; ++i) {
+    uom.observe(keys[i], "候選", kNow);
+    uom.observe(keys[i], "後選", kNow);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    auto suggestion = uom.suggest(keys[i % keys.size()], kNow + 1);
+    benchmark::DoNotOptimize(suggestion);
+    ++i;
+  }
+}
+BENCHMARK(BM_Suggest)->Arg(500)->Arg(100000)->Arg(1000000);
+
+// Suggesting for one frequently used key that has the maximum number of
+// candidates, where the cost is mostly in scoring the candidates.
+static void BM_SuggestHotKey(benchmark::State& state) {
+  UserOverrideModel uom(500, kHalflife);
+  const std::string key = ObservationKey(0);
+  for (const char* candidate : {"候選", "後選", "厚選", "猴選"}) {
+    uom.observe(key, candidate, kNow);
+  }
+
+  double timestamp = kNow;
+  for (auto _ : state) {
+    auto suggestion = uom.suggest(key, timestamp);
+    benchmark::DoNotOptimize(suggestion);
+    timestamp += 1;
+  }
+}
+BENCHMARK(BM_SuggestHotKey);
+
+// Suggesting for a walk, which includes forming the observation key from the
+// walk's nodes.
+static void BM_SuggestFromWalk(benchmark::State& state) {
+  using ReadingGrid = Formosa::Gramambular2::ReadingGrid;
+  using Unigram = Formosa::Gramambular2::LanguageModel::Unigram;
+  ReadingGrid::WalkResult walk;
+  for (const char* value : {"你", "好", "嗎"}) {
+    walk.nodes.push_back(std::make_shared<ReadingGrid::Node>(
+        "ㄋㄧˇ", 1, std::vector<Unigram>{Unigram(value, -1)}));
+  }
+  walk.totalReadings = walk.nodes.size();
+
+  UserOverrideModel uom(500, kHalflife);
+  uom.observe(UserOverrideModel::ObservationKeyString(walk, 2), "麼", kNow);
+  for (auto _ : state) {
+    auto suggestion = uom.suggest(walk, 2, kNow + 1);
+    benchmark::DoNotOptimize(suggestion);
+  }
+}
+BENCHMARK(BM_SuggestFromWalk);
+
+// A shared model behind one mutex, the baseline for the concurrent model.
+class LockedUserOverrideModel {
+ public:
+  LockedUserOverrideModel(size_t capacity, double decayConstant)
+      : model_(capacity, decayConstant) {}
+
+  void observe(const std::string& key, const std::string& candidate,
+               double timestamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    model_.observe(key, candidate, timestamp);
+  }
+
+  UserOverrideModel::Suggestion suggest(const std::string& key,
+                                        double timestamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return model_.suggest(key, timestamp);
+  }
+
+ private:
+  std::mutex mutex_;
+  UserOverrideModel model_;
+};
+
+constexpr size_t kSharedCapacity = 100000;
+
+// Sessions sharing one model, where one in 16 operations is an observe and the
+// rest are suggests.
+template <typename Model>
+void RunSharedWorkload(benchmark::State& state, Model* model,
+                       const std::vector<std::string>& keys) {
+  auto i = static_cast<size_t>(state.thread_index()) * 7919;
+  for (auto _ : state) {
+    const std::string& key = keys[i % keys.size()];
+    if (i % 16 == 0) {
+      model->observe(key, "候選", kNow + static_cast<double>(i));
+    } else {
+      auto suggestion = model->suggest(key, kNow + static_cast<double>(i));
+      benchmark::DoNotOptimize(suggestion);
+    }
+    ++i;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Model>
+Model* MakeSharedModel(const std::vector<std::string>& keys) {
+  auto* model = new Model(kSharedCapacity, kHalflife);
+  for (size_t i = 0; i < kSharedCapacity; ++i) {
+    model->observe(keys[i], "候選", kNow);
+  }
+  return model;
+}
+
+const std::vector<std::string>& SharedKeys() {
+  static const std::vector<std::string> keys = MakeKeys(kSharedCapacity * 2);
+  return keys;
+}
+
+static void BM_SharedLockedModel(benchmark::State& state) {
+  static LockedUserOverrideModel* model =
+      MakeSharedModel<LockedUserOverrideModel>(SharedKeys());
+  RunSharedWorkload(state, model, SharedKeys());
+}
+BENCHMARK(BM_SharedLockedModel)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_SharedConcurrentModel(benchmark::State& state) {
+  static McBopomofo::ConcurrentUserOverrideModel* model =
+      MakeSharedModel<McBopomofo::ConcurrentUserOverrideModel>(SharedKeys());
+  RunSharedWorkload(state, model, SharedKeys());
+}
+BENCHMARK(BM_SharedConcurrentModel)->ThreadRange(1, 8)->UseRealTime();
+
+};  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,176 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "UserOverrideModelStore.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "MemoryMappedFile.h"
+
+namespace McBopomofo {
+
+UserOverrideModelStore::UserOverrideModelStore(UserOverrideModel* model,
+                                               std::filesystem::path path)
+    : model_(model), path_(std::move(path)) {
+  writer_ = std::thread([this] { runWriter(); });
+}
+
+UserOverrideModelStore::~UserOverrideModelStore() {
+  save();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  jobQueued_.notify_one();
+  writer_.join();
+}
+
+bool UserOverrideModelStore::load() {
+  flush();
+
+  MemoryMappedFile file;
+  if (!file.open(path_.c_str()) || file.length() < kHeaderSize) {
+    needsRewrite_ = true;
+    return false;
+  }
+  const char* data = file.data();
+  uint32_t version;
+  uint32_t byteOrderMark;
+  memcpy(&version, data + sizeof(kMagic), sizeof(version));
+  memcpy(&byteOrderMark, data + sizeof(kMagic) + sizeof(version),
+         sizeof(byteOrderMark));
+  if (memcmp(data, kMagic, sizeof(kMagic)) != 0 || version != kVersion ||
+      byteOrderMark != kByteOrderMark) {
+    needsRewrite_ = true;
+    return false;
+  }
+
+  const size_t recordsSize = file.length() - kHeaderSize;
+  size_t recordCount = 0;
+  size_t consumed =
+      model_->decodeObservations(data + kHeaderSize, recordsSize, &recordCount);
+  fileRecordCount_ = recordCount;
+  // Drop the damaged tail with the next save.
+  needsRewrite_ = consumed != recordsSize;
+  return true;
+}
+
+void UserOverrideModelStore::saveIfDue(double timestamp) {
+  if (timestamp - lastSaveTimestamp_ < kSaveInterval) {
+    return;
+  }
+  lastSaveTimestamp_ = timestamp;
+  // Removed observations are left in the file until it is compacted; they
+  // are fully decayed when loaded, and are removed again at the next save.
+  model_->evictExpired(timestamp);
+  save();
+}
+
+void UserOverrideModelStore::save() {
+  Job job{false, std::string()};
+  size_t recordCount = model_->encodeChangedObservations(&job.bytes);
+  if (needsRewrite_.exchange(false) ||
+      fileRecordCount_ + recordCount > 2 * model_->size()) {
+    job.rewrite = true;
+    job.bytes.assign(kMagic, sizeof(kMagic));
+    job.bytes.append(reinterpret_cast<const char*>(&kVersion),
+                     sizeof(kVersion));
+    job.bytes.append(reinterpret_cast<const char*>(&kByteOrderMark),
+                     sizeof(kByteOrderMark));
+    fileRecordCount_ = model_->encodeAllObservations(&job.bytes);
+  } else if (recordCount == 0) {
+    return;
+  } else {
+    fileRecordCount_ += recordCount;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  jobQueued_.notify_one();
+}
+
+void UserOverrideModelStore::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobsDone_.wait(lock, [this] { return jobs_.empty() && !writing_; });
+}
+
+void UserOverrideModelStore::runWriter() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    jobQueued_.wait(lock, [this] { return !jobs_.empty() || stopping_; });
+    if (jobs_.empty()) {
+      return;
+    }
+    Job job = std::move(jobs_.front());
+    jobs_.pop_front();
+    writing_ = true;
+    lock.unlock();
+
+    if (!write(job)) {
+      // The changes are already cleared from the model, so have the next
+      // save write the whole model again.
+      needsRewrite_ = true;
+    }
+
+    lock.lock();
+    writing_ = false;
+    if (jobs_.empty()) {
+      jobsDone_.notify_all();
+    }
+  }
+}
+
+bool UserOverrideModelStore::write(const Job& job) const {
+  if (!job.rewrite) {
+    // Do not start a headerless file if the file was removed.
+    std::error_code ec;
+    if (!std::filesystem::exists(path_, ec)) {
+      return false;
+    }
+    std::ofstream out(path_, std::ios::binary | std::ios::app);
+    out.write(job.bytes.data(), static_cast<std::streamsize>(job.bytes.size()));
+    return static_cast<bool>(out);
+  }
+
+  std::filesystem::path tmpPath = path_;
+  tmpPath += ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(job.bytes.data(), static_cast<std::streamsize>(job.bytes.size()));
+    if (!out) {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path_, ec);
+  return !ec;
+}
+
+}  // namespace McBopomofo
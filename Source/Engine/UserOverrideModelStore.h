@@ -0,0 +1,118 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_USEROVERRIDEMODELSTORE_H_
+#define SRC_ENGINE_USEROVERRIDEMODELSTORE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "UserOverrideModel.h"
+
+namespace McBopomofo {
+
+// Keeps a UserOverrideModel in a binary file across restarts.
+//
+// The file is a short header followed by the model's observation records (see
+// UserOverrideModel::encodeChangedObservations()), least recently observed
+// first. Loading maps the file and replays the records in order, which
+// reproduces the observations and their LRU order. A save appends the records
+// of the observations changed since the previous save, and once the file holds
+// more than twice as many records as the model, a save instead writes all
+// observations to a new file that atomically replaces the old one. A file that
+// was cut short, such as by a crash during an append, loads up to its last
+// complete record, and the next save rewrites it.
+//
+// The records are encoded on the calling thread, which is cheap, and the file
+// is written on a background thread, so that saving never blocks on I/O. The
+// model is not synchronized; load() and the save methods must be called on
+// the thread that uses the model.
+class UserOverrideModelStore {
+ public:
+  UserOverrideModelStore(UserOverrideModel* model, std::filesystem::path path);
+  UserOverrideModelStore(const UserOverrideModelStore&) = delete;
+  UserOverrideModelStore(UserOverrideModelStore&&) = delete;
+  UserOverrideModelStore& operator=(const UserOverrideModelStore&) = delete;
+  UserOverrideModelStore& operator=(UserOverrideModelStore&&) = delete;
+
+  // Saves the pending changes and waits for them to be written.
+  ~UserOverrideModelStore();
+
+  // Replays the file into the model. Returns false if the file is missing or
+  // is not a user override model file of this version.
+  bool load();
+
+  // Saves if at least kSaveInterval seconds have passed since the last save,
+  // first removing the observations that have fully decayed.
+  void saveIfDue(double timestamp);
+
+  // Hands the changes made since the last save to the background thread.
+  void save();
+
+  // Waits until everything saved so far is written.
+  void flush();
+
+  static constexpr double kSaveInterval = 30.0;
+
+  static constexpr char kMagic[8] = {'M', 'c', 'B', 'P', 'U', 'O', 'M', 'F'};
+  static constexpr uint32_t kVersion = 2;
+  // Written in native byte order, to reject a file from a different platform.
+  static constexpr uint32_t kByteOrderMark = 0x01020304;
+  static constexpr size_t kHeaderSize = sizeof(kMagic) + 2 * sizeof(uint32_t);
+
+ private:
+  struct Job {
+    // Whether bytes are a whole file rather than records to append.
+    bool rewrite;
+    std::string bytes;
+  };
+
+  void runWriter();
+  bool write(const Job& job) const;
+
+  UserOverrideModel* model_;
+  std::filesystem::path path_;
+  double lastSaveTimestamp_ = 0;
+  // The number of records the file will have once the queued jobs are done.
+  size_t fileRecordCount_ = 0;
+  // Set when the file is missing or damaged, or when a write fails.
+  std::atomic<bool> needsRewrite_ = true;
+
+  std::mutex mutex_;
+  std::condition_variable jobQueued_;
+  std::condition_variable jobsDone_;
+  std::deque<Job> jobs_;
+  bool writing_ = false;
+  bool stopping_ = false;
+  std::thread writer_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_USEROVERRIDEMODELSTORE_H_
@@ -0,0 +1,229 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "UserOverrideModelStore.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "UserOverrideModel.h"
+#include "TestTempDir.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+constexpr double kFakeNow = 1657772432;
+constexpr double kHalflife = 5400.0;  // 1.5 hr.
+
+std::string Key(int i) { return "(k" + std::to_string(i) + ",v)"; }
+
+}  // namespace
+
+TEST(UserOverrideModelStoreTest, SavedModelLoadsBack) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  {
+    UserOverrideModel uom(10, kHalflife);
+    UserOverrideModelStore store(&uom, path);
+    EXPECT_FALSE(store.load());
+    uom.observe("a", "x", kFakeNow);
+    uom.observe("a", "y", kFakeNow + 1, true);
+    uom.observe("a", "y", kFakeNow + 2, true);
+    uom.observe("b", "z", kFakeNow + 3);
+    store.save();
+    store.flush();
+  }
+
+  UserOverrideModel uom(10, kHalflife);
+  UserOverrideModelStore store(&uom, path);
+  ASSERT_TRUE(store.load());
+  EXPECT_EQ(uom.size(), 2);
+  auto s = uom.suggest("a", kFakeNow + 3);
+  EXPECT_EQ(s.candidate, "y");
+  EXPECT_TRUE(s.forceHighScoreOverride);
+  s = uom.suggest("b", kFakeNow + 3);
+  EXPECT_EQ(s.candidate, "z");
+  EXPECT_FALSE(s.forceHighScoreOverride);
+  EXPECT_TRUE(uom.suggest("c", kFakeNow + 3).empty());
+}
+
+TEST(UserOverrideModelStoreTest, DestructorSavesPendingChanges) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  {
+    UserOverrideModel uom(10, kHalflife);
+    UserOverrideModelStore store(&uom, path);
+    uom.observe("a", "x", kFakeNow);
+  }
+
+  UserOverrideModel uom(10, kHalflife);
+  UserOverrideModelStore store(&uom, path);
+  ASSERT_TRUE(store.load());
+  EXPECT_EQ(uom.suggest("a", kFakeNow).candidate, "x");
+}
+
+TEST(UserOverrideModelStoreTest, IncrementalSavesKeepTheLRUOrder) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  constexpr int kCapacity = 100;
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(&uom, path);
+    store.load();
+    for (int i = 0; i < kCapacity; ++i) {
+      uom.observe(Key(i), "v" + std::to_string(i), kFakeNow);
+    }
+    store.save();
+    store.flush();
+    auto fullSize = std::filesystem::file_size(path);
+
+    // Touch the older half again, then let the new keys evict the rest.
+    for (int i = 0; i < kCapacity / 2; ++i) {
+      uom.observe(Key(i), "w" + std::to_string(i), kFakeNow + 1);
+    }
+    store.save();
+    store.flush();
+    EXPECT_GT(std::filesystem::file_size(path), fullSize);
+
+    for (int i = kCapacity; i < kCapacity + kCapacity / 2; ++i) {
+      uom.observe(Key(i), "v" + std::to_string(i), kFakeNow + 2);
+    }
+  }
+
+  UserOverrideModel uom(kCapacity, kHalflife);
+  UserOverrideModelStore store(&uom, path);
+  ASSERT_TRUE(store.load());
+  EXPECT_EQ(uom.size(), kCapacity);
+  for (int i = 0; i < kCapacity / 2; ++i) {
+    EXPECT_EQ(uom.suggest(Key(i), kFakeNow + 2).candidate,
+              "w" + std::to_string(i));
+  }
+  for (int i = kCapacity / 2; i < kCapacity; ++i) {
+    EXPECT_TRUE(uom.suggest(Key(i), kFakeNow + 2).empty());
+  }
+  for (int i = kCapacity; i < kCapacity + kCapacity / 2; ++i) {
+    EXPECT_EQ(uom.suggest(Key(i), kFakeNow + 2).candidate,
+              "v" + std::to_string(i));
+  }
+}
+
+TEST(UserOverrideModelStoreTest, LongLogIsCompacted) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  UserOverrideModel uom(10, kHalflife);
+  UserOverrideModelStore store(&uom, path);
+  store.load();
+  uom.observe("a", "x", kFakeNow);
+  store.save();
+  store.flush();
+  auto compactSize = std::filesystem::file_size(path);
+
+  for (int i = 0; i < 10; ++i) {
+    uom.observe("a", "x", kFakeNow + i);
+    store.save();
+  }
+  store.flush();
+  EXPECT_EQ(std::filesystem::file_size(path), compactSize);
+  EXPECT_FALSE(std::filesystem::exists(dir.pathOf("uom.bin.tmp")));
+
+  UserOverrideModel loaded(10, kHalflife);
+  UserOverrideModelStore loadedStore(&loaded, path);
+  ASSERT_TRUE(loadedStore.load());
+  EXPECT_EQ(loaded.size(), 1);
+  EXPECT_EQ(loaded.suggest("a", kFakeNow + 10).candidate, "x");
+}
+
+TEST(UserOverrideModelStoreTest, DamagedTailIsIgnoredAndRewritten) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  uintmax_t firstSaveSize = 0;
+  {
+    UserOverrideModel uom(10, kHalflife);
+    UserOverrideModelStore store(&uom, path);
+    store.load();
+    uom.observe("a", "x", kFakeNow);
+    store.save();
+    store.flush();
+    firstSaveSize = std::filesystem::file_size(path);
+    uom.observe("b", "y", kFakeNow);
+    store.save();
+    store.flush();
+  }
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+
+  UserOverrideModel uom(10, kHalflife);
+  {
+    UserOverrideModelStore store(&uom, path);
+    ASSERT_TRUE(store.load());
+    EXPECT_EQ(uom.size(), 1);
+    EXPECT_EQ(uom.suggest("a", kFakeNow).candidate, "x");
+    EXPECT_TRUE(uom.suggest("b", kFakeNow).empty());
+    store.save();
+  }
+  EXPECT_EQ(std::filesystem::file_size(path), firstSaveSize);
+}
+
+TEST(UserOverrideModelStoreTest, RejectsOtherFiles) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  std::ofstream(path, std::ios::binary) << "not a user override model file";
+
+  UserOverrideModel uom(10, kHalflife);
+  UserOverrideModelStore store(&uom, path);
+  EXPECT_FALSE(store.load());
+  EXPECT_EQ(uom.size(), 0);
+
+  // The next save replaces the file.
+  uom.observe("a", "x", kFakeNow);
+  store.save();
+  store.flush();
+  UserOverrideModel loaded(10, kHalflife);
+  UserOverrideModelStore loadedStore(&loaded, path);
+  ASSERT_TRUE(loadedStore.load());
+  EXPECT_EQ(loaded.suggest("a", kFakeNow).candidate, "x");
+}
+
+TEST(UserOverrideModelStoreTest, SaveIfDueWaitsForTheInterval) {
+  TestTempDir dir;
+  auto path = dir.pathOf("uom.bin");
+  UserOverrideModel uom(10, kHalflife);
+  UserOverrideModelStore store(&uom, path);
+  store.load();
+  uom.observe("a", "x", kFakeNow);
+  store.saveIfDue(kFakeNow);
+  store.flush();
+  auto size = std::filesystem::file_size(path);
+
+  uom.observe("b", "y", kFakeNow + 1);
+  store.saveIfDue(kFakeNow + 1);
+  store.flush();
+  EXPECT_EQ(std::filesystem::file_size(path), size);
+
+  store.saveIfDue(kFakeNow + UserOverrideModelStore::kSaveInterval);
+  store.flush();
+  EXPECT_GT(std::filesystem::file_size(path), size);
+}
+
+}  // namespace McBopomofo
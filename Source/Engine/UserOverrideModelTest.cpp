@@ -21,9 +21,15 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "UserOverrideModel.h"
+#include "gramambular2/reading_grid.h"
 #include "gtest/gtest.h"
 
 namespace McBopomofo {
@@ -32,6 +38,58 @@ namespace {
 constexpr double kFakeNow = 1657772432;
 constexpr int kCapacity = 5;
 constexpr double kHalflife = 5400.0;  // 1.5 hr.
+
+using ReadingGrid = Formosa::Gramambular2::ReadingGrid;
+using Unigram = Formosa::Gramambular2::LanguageModel::Unigram;
+
+// Makes a walk of single-reading nodes from (reading, value) pairs.
+ReadingGrid::WalkResult MakeWalk(
+    const std::vector<std::pair<std::string, std::string>>& readingValues) {
+  ReadingGrid::WalkResult walk;
+  for (const auto& [reading, value] : readingValues) {
+    walk.nodes.push_back(std::make_shared<ReadingGrid::Node>(
+        reading, 1, std::vector<Unigram>{Unigram(value, -1)}));
+  }
+  walk.totalReadings = readingValues.size();
+  return walk;
+}
+
+// Keeps the string that each observation key was hashed from, so that a test
+// can tell when two strings share a key. The model itself stores no strings
+// and would never notice.
+class KeyCheckingUserOverrideModel : public UserOverrideModel {
+ public:
+  using UserOverrideModel::UserOverrideModel;
+
+  void observe(const std::string& key, const std::string& candidate,
+               double timestamp) {
+    EXPECT_TRUE(checkKeyString(MakeObservationKey(key), key)) << key;
+    UserOverrideModel::observe(key, candidate, timestamp);
+  }
+
+  Suggestion suggest(const ReadingGrid::WalkResult& walk, size_t cursor,
+                     double timestamp) {
+    auto key = MakeObservationKey(walk, cursor);
+    if (key.has_value()) {
+      std::string keyString = ObservationKeyString(walk, cursor);
+      EXPECT_TRUE(checkKeyString(*key, keyString)) << keyString;
+    }
+    return UserOverrideModel::suggest(walk, cursor, timestamp);
+  }
+
+  // Records the string of the key, and returns false if the key was hashed
+  // from a different string before.
+  bool checkKeyString(const ObservationKey& key, const std::string& keyString) {
+    auto [it, inserted] =
+        keyStrings_.try_emplace({key.low, key.high}, keyString);
+    return inserted || it->second == keyString;
+  }
+
+  [[nodiscard]] size_t keyStringCount() const { return keyStrings_.size(); }
+
+ private:
+  std::map<std::pair<uint64_t, uint64_t>, std::string> keyStrings_;
+};
 }  // namespace
 
 TEST(UserOverrideModelTest, BasicOperation) {
@@ -57,6 +115,22 @@ TEST(UserOverrideModelTest, BasicOperation) {
   ASSERT_TRUE(v.empty());
 }
 
+TEST(UserOverrideModelTest, MemoryUsageGrowsWithObservations) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  size_t emptyBytes = uom.memoryUsage().heapBytes;
+  EXPECT_EQ(uom.memoryUsage().mappedBytes, 0);
+
+  uom.observe("a", "short", kFakeNow);
+  size_t oneObservationBytes = uom.memoryUsage().heapBytes;
+  EXPECT_GT(oneObservationBytes, emptyBytes);
+
+  // A candidate too long to be stored inline takes heap of its own.
+  std::string longCandidate(64, 'x');
+  uom.observe("a", longCandidate, kFakeNow);
+  EXPECT_GE(uom.memoryUsage().heapBytes,
+            oneObservationBytes + longCandidate.size());
+}
+
 TEST(UserOverrideModelTest, FreshVsFrequent) {
   UserOverrideModel uom(kCapacity, kHalflife);
   std::string key = "abc";
@@ -119,4 +193,175 @@ TEST(UserOverrideModelTest, LRUBehavior) {
   ASSERT_TRUE(v.empty());
 }
 
+TEST(UserOverrideModelTest, LRUBehaviorAtLargeCapacity) {
+  constexpr size_t capacity = 1000;
+  UserOverrideModel uom(capacity, kHalflife);
+  for (size_t i = 0; i < capacity * 3; ++i) {
+    uom.observe("key" + std::to_string(i), std::to_string(i), kFakeNow);
+
+    // Keep key0 alive by observing it again all the time.
+    if (i % 100 == 0) {
+      uom.observe("key0", "0", kFakeNow);
+    }
+  }
+
+  ASSERT_EQ(uom.suggest("key0", kFakeNow).candidate, "0");
+  for (size_t i = 1; i < capacity * 2 + 1; ++i) {
+    ASSERT_TRUE(uom.suggest("key" + std::to_string(i), kFakeNow).empty())
+        << i;
+  }
+  for (size_t i = capacity * 2 + 1; i < capacity * 3; ++i) {
+    ASSERT_EQ(uom.suggest("key" + std::to_string(i), kFakeNow).candidate,
+              std::to_string(i));
+  }
+}
+
+TEST(UserOverrideModelTest, TiesGoToTheSameCandidate) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  uom.observe("abc", "b", kFakeNow);
+  uom.observe("abc", "a", kFakeNow);
+  ASSERT_EQ(uom.suggest("abc", kFakeNow).candidate, "a");
+
+  uom.observe("def", "a", kFakeNow);
+  uom.observe("def", "b", kFakeNow);
+  ASSERT_EQ(uom.suggest("def", kFakeNow).candidate, "a");
+}
+
+TEST(UserOverrideModelTest, LeastObservedCandidateIsDropped) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  for (int i = 0; i < 3; ++i) {
+    uom.observe("abc", "frequent", kFakeNow);
+  }
+  uom.observe("abc", "c1", kFakeNow + 1);
+  uom.observe("abc", "c2", kFakeNow + 2);
+  uom.observe("abc", "c3", kFakeNow + 3);
+  uom.observe("abc", "c4", kFakeNow + 4);
+  uom.observe("abc", "c5", kFakeNow + 5);
+  ASSERT_EQ(uom.suggest("abc", kFakeNow + 5).candidate, "frequent");
+
+  // The oldest of the least observed candidates, c1 and then c2, were
+  // dropped; re-observing c2 starts it over.
+  uom.observe("abc", "c2", kFakeNow + 6);
+  uom.observe("abc", "c2", kFakeNow + 6);
+  uom.observe("abc", "c2", kFakeNow + 6);
+  ASSERT_EQ(uom.suggest("abc", kFakeNow + 6).candidate, "c2");
+}
+
+TEST(UserOverrideModelTest, ObservationKeyStringFromWalk) {
+  auto walk = MakeWalk({{"ㄊㄚ", "他"}, {"ㄒㄧㄥˋ", "姓"}, {"ㄓㄨㄥ", "中"}});
+  EXPECT_EQ(UserOverrideModel::ObservationKeyString(walk, 2),
+            "(ㄊㄚ,他)-(ㄒㄧㄥˋ,姓)-(ㄓㄨㄥ,中)");
+  EXPECT_EQ(UserOverrideModel::ObservationKeyString(walk, 1),
+            "()-(ㄊㄚ,他)-(ㄒㄧㄥˋ,姓)");
+  EXPECT_EQ(UserOverrideModel::ObservationKeyString(walk, 0),
+            "()-()-(ㄊㄚ,他)");
+
+  auto punctuated =
+      MakeWalk({{"ㄊㄚ", "他"}, {"_punctuation_,", "，"}, {"ㄓㄨㄥ", "中"}});
+  EXPECT_EQ(UserOverrideModel::ObservationKeyString(punctuated, 2),
+            "()-()-(ㄓㄨㄥ,中)");
+}
+
+TEST(UserOverrideModelTest, WalkAndStringKeysAgree) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  auto walk = MakeWalk({{"ㄊㄚ", "他"}, {"ㄒㄧㄥˋ", "姓"}, {"ㄓㄨㄥ", "中"}});
+  std::string key = UserOverrideModel::ObservationKeyString(walk, 2);
+  EXPECT_EQ(UserOverrideModel::MakeObservationKey(key),
+            UserOverrideModel::MakeObservationKey(
+                "(ㄊㄚ,他)-(ㄒㄧㄥˋ,姓)-(ㄓㄨㄥ,中)"));
+  EXPECT_FALSE(UserOverrideModel::MakeObservationKey(key) ==
+               UserOverrideModel::MakeObservationKey(
+                   "(ㄊㄚ,他)-(ㄒㄧㄥˋ,姓)-(ㄓㄨㄥ,鍾)"));
+
+  uom.observe(key, "鍾", kFakeNow);
+  EXPECT_EQ(uom.suggest(walk, 2, kFakeNow).candidate, "鍾");
+  EXPECT_TRUE(uom.suggest(walk, 1, kFakeNow).empty());
+}
+
+TEST(UserOverrideModelTest, ObservationKeysDoNotCollide) {
+  const std::vector<std::pair<std::string, std::string>> syllables = {
+      {"ㄊㄚ", "他"},   {"ㄊㄚ", "她"},   {"ㄒㄧㄥˋ", "姓"}, {"ㄒㄧㄥˋ", "性"},
+      {"ㄓㄨㄥ", "中"}, {"ㄓㄨㄥ", "鍾"}, {"ㄓㄨㄥ", "忠"}, {"ㄓ", "之"},
+      {"ㄨㄥ", "翁"},   {"ㄗ", "子"},     {"ㄗˇ", "子"},   {"ㄗˋ", "字"}};
+  // Every three-node context, and every shorter one at the start of a walk.
+  size_t n = syllables.size();
+  size_t contexts = n * n * n + n * n + n;
+  KeyCheckingUserOverrideModel uom(contexts, kHalflife);
+  for (const auto& a : syllables) {
+    for (const auto& b : syllables) {
+      for (const auto& c : syllables) {
+        auto walk = MakeWalk({a, b, c});
+        for (size_t cursor = 0; cursor < 3; ++cursor) {
+          uom.observe(UserOverrideModel::ObservationKeyString(walk, cursor),
+                      "v", kFakeNow);
+          EXPECT_EQ(uom.suggest(walk, cursor, kFakeNow).candidate, "v");
+        }
+      }
+    }
+  }
+  EXPECT_EQ(uom.keyStringCount(), contexts);
+  EXPECT_EQ(uom.size(), contexts);
+}
+
+TEST(UserOverrideModelTest, KeyCheckingModelCatchesSharedKeys) {
+  KeyCheckingUserOverrideModel uom(kCapacity, kHalflife);
+  auto key = UserOverrideModel::MakeObservationKey("()-()-(ㄓㄨㄥ,中)");
+  EXPECT_TRUE(uom.checkKeyString(key, "()-()-(ㄓㄨㄥ,中)"));
+  EXPECT_TRUE(uom.checkKeyString(key, "()-()-(ㄓㄨㄥ,中)"));
+  EXPECT_FALSE(uom.checkKeyString(key, "()-()-(ㄓㄨㄥ,忠)"));
+}
+
+TEST(UserOverrideModelTest, BestCandidateChangesAsCandidatesDecay) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  for (int i = 0; i < 20; ++i) {
+    uom.observe("abc", "frequent", kFakeNow);
+  }
+  uom.observe("abc", "recent", kFakeNow + kHalflife * 3);
+
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + kHalflife * 3).candidate,
+            "frequent");
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + kHalflife * 20).candidate,
+            "frequent");
+  // "frequent" has fully decayed, while "recent" has not.
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + kHalflife * 21).candidate,
+            "recent");
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + kHalflife * 22).candidate,
+            "recent");
+  // Going back in time still gives the answer for that time.
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + kHalflife * 4).candidate,
+            "frequent");
+  EXPECT_TRUE(uom.suggest("abc", kFakeNow + kHalflife * 24).empty());
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + kHalflife * 22).candidate,
+            "recent");
+}
+
+TEST(UserOverrideModelTest, EvictExpiredKeepsTheLRUOrder) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  const double later = kFakeNow + kHalflife * 30;
+  uom.observe("k0", "v", later);
+  uom.observe("k1", "v", kFakeNow);
+  uom.observe("k2", "v", later);
+  uom.observe("k3", "v", kFakeNow);
+  uom.observe("k4", "v", later);
+
+  std::vector<UserOverrideModel::ObservationKey> removed;
+  EXPECT_EQ(uom.evictExpired(later, &removed), 2);
+  EXPECT_EQ(uom.size(), 3);
+  ASSERT_EQ(removed.size(), 2);
+  EXPECT_TRUE(removed[0] == UserOverrideModel::MakeObservationKey("k1") ||
+              removed[1] == UserOverrideModel::MakeObservationKey("k1"));
+  EXPECT_EQ(uom.evictExpired(later), 0);
+
+  // k0 is now the least recently observed, and is evicted by the third new
+  // key.
+  uom.observe("k5", "v", later);
+  uom.observe("k6", "v", later);
+  uom.observe("k7", "v", later);
+  EXPECT_EQ(uom.size(), kCapacity);
+  EXPECT_TRUE(uom.suggest("k0", later).empty());
+  for (const char* key : {"k2", "k4", "k5", "k6", "k7"}) {
+    EXPECT_EQ(uom.suggest(key, later).candidate, "v") << key;
+  }
+}
+
 }  // namespace McBopomofo
@@ -28,24 +28,318 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace McBopomofo {
 
-bool UserPhrasesLM::open(const char* path) {
+static bool Contains(const std::vector<std::string>& values,
+                     const std::string_view& value) {
+  return std::find(values.begin(), values.end(), value) != values.end();
+}
+
+static bool Erase(std::unordered_map<std::string, std::vector<std::string>>& map,
+                  const std::string& reading, const std::string& value) {
+  auto it = map.find(reading);
+  if (it == map.end()) {
+    return false;
+  }
+  auto vit = std::find(it->second.begin(), it->second.end(), value);
+  if (vit == it->second.end()) {
+    return false;
+  }
+  it->second.erase(vit);
+  if (it->second.empty()) {
+    map.erase(it);
+  }
+  return true;
+}
+
+static bool IsWhitespace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Whether the line, in the value-then-key format of the file, is the phrase.
+static bool LineIsPhrase(std::string_view line, const std::string& reading,
+                         const std::string& value) {
+  while (!line.empty() && IsWhitespace(line.back())) {
+    line.remove_suffix(1);
+  }
+  while (!line.empty() && IsWhitespace(line.front())) {
+    line.remove_prefix(1);
+  }
+  size_t keyStart = line.size();
+  while (keyStart > 0 && !IsWhitespace(line[keyStart - 1])) {
+    --keyStart;
+  }
+  if (line.substr(keyStart) != reading) {
+    return false;
+  }
+  line = line.substr(0, keyStart);
+  while (!line.empty() && IsWhitespace(line.back())) {
+    line.remove_suffix(1);
+  }
+  return line == value;
+}
+
+static void AppendPhrase(const std::string& path, const std::string& reading,
+                         const std::string& value) {
+  bool needsLineBreak = false;
+  {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (in && in.tellg() > 0) {
+      in.seekg(-1, std::ios::end);
+      needsLineBreak = in.get() != '\n';
+    }
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::app);
+  if (needsLineBreak) {
+    out << '\n';
+  }
+  out << value << ' ' << reading << '\n';
+}
+
+static void RemovePhrase(const std::string& path, const std::string& reading,
+                         const std::string& value) {
+  std::string content;
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      return;
+    }
+    std::stringstream sst;
+    sst << in.rdbuf();
+    content = sst.str();
+  }
+
+  std::string kept;
+  kept.reserve(content.size());
+  bool removed = false;
+  std::string_view rest(content);
+  while (!rest.empty()) {
+    size_t lineEnd = rest.find('\n');
+    size_t next = lineEnd == std::string_view::npos ? rest.size() : lineEnd + 1;
+    std::string_view line = rest.substr(0, next);
+    if (LineIsPhrase(line.substr(0, lineEnd), reading, value)) {
+      removed = true;
+    } else {
+      kept += line;
+    }
+    rest.remove_prefix(next);
+  }
+  if (!removed) {
+    return;
+  }
+
+  // Replace the file atomically, so that readers see either version. The
+  // replacement is a new file, so it takes the mode and, where permitted, the
+  // owner of the original. Its new inode makes the next reload a full one,
+  // which a file that shrank needs anyway.
+  struct stat sb;
+  if (stat(path.c_str(), &sb) == -1) {
+    return;
+  }
+  std::string tmp = path + ".tmp";
+  std::error_code ec;
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << kept;
+    out.close();
+    if (!out) {
+      std::filesystem::remove(tmp, ec);
+      return;
+    }
+  }
+  struct stat tmpStat;
+  if (stat(tmp.c_str(), &tmpStat) == -1 ||
+      chmod(tmp.c_str(), sb.st_mode & 07777) == -1 ||
+      ((tmpStat.st_uid != sb.st_uid || tmpStat.st_gid != sb.st_gid) &&
+       chown(tmp.c_str(), sb.st_uid, sb.st_gid) == -1)) {
+    std::filesystem::remove(tmp, ec);
+    return;
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+}
+
+UserPhrasesLM::~UserPhrasesLM() {
+  {
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    stopping_ = true;
+  }
+  writerWakeUp_.notify_all();
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+bool UserPhrasesLM::open(const char* path) { return open(path, {}); }
+
+bool UserPhrasesLM::open(const char* path,
+                         const std::filesystem::path& snapshotPath) {
+  snapshotPath_ = snapshotPath;
+
+  struct stat sb;
+  if (stat(path, &sb) == -1) {
+    return false;
+  }
+
   if (!mmapedFile_.open(path)) {
     return false;
   }
 
+  device_ = sb.st_dev;
+  inode_ = sb.st_ino;
+  path_ = path;
+
+  // The file is mapped even when the snapshot is used, so that a later reload
+  // can parse only the appended lines.
+  if (!snapshotPath.empty() &&
+      snapshot_.open(snapshotPath, path,
+                     ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY)) {
+    // The snapshot was checked against the file as it is now, so make sure
+    // that the mapping is of the same file.
+    struct stat current;
+    if (stat(path, &current) == 0 && current.st_dev == device_ &&
+        current.st_ino == inode_ &&
+        static_cast<size_t>(current.st_size) == mmapedFile_.length()) {
+      dictionary_.setNextLineNumber(snapshot_.nextLineNumber());
+      parsedContentHash_ = snapshot_.sourceContentHash();
+      return true;
+    }
+    snapshot_.close();
+  }
+
   // MemoryMappedFile self-closes, and so this is fine.
-  return load(mmapedFile_.data(), mmapedFile_.length());
+  if (!load(mmapedFile_.data(), mmapedFile_.length())) {
+    return false;
+  }
+  parsedContentHash_ = DictionarySnapshot::ContentHash(mmapedFile_.data(),
+                                                     mmapedFile_.length());
+  if (!snapshotPath.empty()) {
+    // A snapshot is only a cache, and so a failed write is not an error.
+    DictionarySnapshot::Write(
+        snapshotPath, dictionary_,
+        ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY, sb,
+        mmapedFile_.data(), mmapedFile_.length());
+  }
+  return true;
 }
 
 void UserPhrasesLM::close() {
+  flush();
+  addedPhrases_.clear();
+  removedPhrases_.clear();
+  path_.clear();
+  snapshot_.close();
+  snapshotPath_.clear();
   dictionary_.clear();
   mmapedFile_.close();
+  retainedMappings_.clear();
+  device_ = 0;
+  inode_ = 0;
+  parsedContentHash_ = 0;
+}
+
+bool UserPhrasesLM::reload(const char* path) {
+  if (reloadAppended(path)) {
+    pruneOverlay();
+    return true;
+  }
+
+  // Keep the changes that are not yet in the file across the reload.
+  flush();
+  auto addedPhrases = std::move(addedPhrases_);
+  auto removedPhrases = std::move(removedPhrases_);
+  std::filesystem::path snapshotPath = snapshotPath_;
+  close();
+  bool result = open(path, snapshotPath);
+  addedPhrases_ = std::move(addedPhrases);
+  removedPhrases_ = std::move(removedPhrases);
+  pruneOverlay();
+  return result;
+}
+
+bool UserPhrasesLM::reloadAppended(const char* path) {
+  if (!mmapedFile_.isOpen() ||
+      retainedMappings_.size() >= kMaxRetainedMappings) {
+    return false;
+  }
+
+  // Only a file that ends with a complete line can be continued; otherwise
+  // the appended bytes may belong to the last parsed line.
+  size_t parsedLength = mmapedFile_.length();
+  if (parsedLength == 0 || mmapedFile_.data()[parsedLength - 1] != '\n') {
+    return false;
+  }
+
+  struct stat sb;
+  if (stat(path, &sb) == -1 || sb.st_dev != device_ || sb.st_ino != inode_ ||
+      static_cast<size_t>(sb.st_size) < parsedLength) {
+    return false;
+  }
+
+  MemoryMappedFile file;
+  if (!file.open(path) || file.length() < parsedLength) {
+    return false;
+  }
+
+  // The mapping is shared, so an in-place edit would have changed the parsed
+  // bytes too, and the dictionary's views into them. The whole parsed prefix
+  // is hashed, since an edit that keeps the length of the file shifts nothing
+  // and can be anywhere in it; hashing is still much cheaper than a reparse.
+  if (DictionarySnapshot::ContentHash(file.data(), parsedLength) !=
+      parsedContentHash_) {
+    return false;
+  }
+
+  if (file.length() == parsedLength) {
+    return true;
+  }
+
+  if (!dictionary_.parseAppended(
+          file.data() + parsedLength, file.length() - parsedLength,
+          ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY)) {
+    return false;
+  }
+
+  parsedContentHash_ = DictionarySnapshot::ContentHash(
+      file.data() + parsedLength, file.length() - parsedLength,
+      parsedContentHash_);
+  retainedMappings_.push_back(std::move(mmapedFile_));
+  mmapedFile_ = std::move(file);
+
+  // The snapshot no longer matches the file. It cannot be rewritten without
+  // parsing the whole file, so remove it, and the next open rebuilds it.
+  if (!snapshotPath_.empty()) {
+    std::error_code ec;
+    std::filesystem::remove(snapshotPath_, ec);
+  }
+  return true;
+}
+
+std::vector<std::string_view> UserPhrasesLM::fileValues(
+    const std::string& key) const {
+  if (!snapshot_.isOpen()) {
+    return dictionary_.getValues(key);
+  }
+  // The dictionary holds the lines appended since the snapshot.
+  std::vector<std::string_view> values = snapshot_.getValues(key);
+  std::vector<std::string_view> appended = dictionary_.getValues(key);
+  values.insert(values.end(), appended.begin(), appended.end());
+  return values;
+}
+
+bool UserPhrasesLM::fileHasValue(const std::string& key,
+                                 const std::string& value) const {
+  return (snapshot_.isOpen() && snapshot_.hasValue(key, value)) ||
+         dictionary_.hasValue(key, value);
 }
 
 bool UserPhrasesLM::load(const char* data, size_t length) {
@@ -60,21 +354,168 @@ std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
 UserPhrasesLM::getUnigrams(const std::string& key) {
   std::vector<Formosa::Gramambular2::LanguageModel::Unigram> v;
 
-  std::vector<std::string_view> values = dictionary_.getValues(key);
+  std::vector<std::string_view> values = fileValues(key);
+  if (addedPhrases_.empty() && removedPhrases_.empty()) {
+    for (const auto& value : values) {
+      v.emplace_back(std::string(value), kUserUnigramScore);
+    }
+    return v;
+  }
+
+  auto removed = removedPhrases_.find(key);
   for (const auto& value : values) {
+    if (removed != removedPhrases_.end() && Contains(removed->second, value)) {
+      continue;
+    }
     v.emplace_back(std::string(value), kUserUnigramScore);
   }
 
+  // Added phrases come last, which is where they will be after the file is
+  // written and reloaded.
+  auto added = addedPhrases_.find(key);
+  if (added != addedPhrases_.end()) {
+    for (const auto& value : added->second) {
+      if (std::find(values.begin(), values.end(), value) == values.end()) {
+        v.emplace_back(value, kUserUnigramScore);
+      }
+    }
+  }
+
   return v;
 }
 
 bool UserPhrasesLM::hasUnigrams(const std::string& key) {
-  return dictionary_.hasKey(key);
+  if (addedPhrases_.empty() && removedPhrases_.empty()) {
+    return (snapshot_.isOpen() && snapshot_.hasKey(key)) ||
+           dictionary_.hasKey(key);
+  }
+  return !getUnigrams(key).empty();
 }
 
 std::vector<ByteBlockBackedDictionary::Issue> UserPhrasesLM::getParsingIssues()
     const {
-  return dictionary_.issues();
+  if (!snapshot_.isOpen()) {
+    return dictionary_.issues();
+  }
+  std::vector<ByteBlockBackedDictionary::Issue> issues = snapshot_.issues();
+  for (const auto& issue : dictionary_.issues()) {
+    issues.push_back(issue);
+  }
+  return issues;
+}
+
+MemoryUsage UserPhrasesLM::memoryUsage() const {
+  MemoryUsage usage = mmapedFile_.memoryUsage() + snapshot_.memoryUsage() +
+                      dictionary_.memoryUsage();
+  usage.heapBytes += VectorHeapBytes(retainedMappings_);
+  for (const MemoryMappedFile& mapping : retainedMappings_) {
+    usage += mapping.memoryUsage();
+  }
+  for (const auto* overlay : {&addedPhrases_, &removedPhrases_}) {
+    usage.heapBytes += UnorderedContainerHeapBytes(*overlay);
+    for (const auto& [reading, values] : *overlay) {
+      usage.heapBytes += StringHeapBytes(reading) + VectorHeapBytes(values);
+      for (const std::string& value : values) {
+        usage.heapBytes += StringHeapBytes(value);
+      }
+    }
+  }
+  usage.heapBytes += StringHeapBytes(path_);
+  return usage;
+}
+
+void UserPhrasesLM::addPhrase(const std::string& reading,
+                              const std::string& value) {
+  bool wasRemoved = Erase(removedPhrases_, reading, value);
+  bool inFile = fileHasValue(reading, value);
+  if (inFile && !wasRemoved) {
+    return;
+  }
+  if (!inFile) {
+    auto& added = addedPhrases_[reading];
+    if (Contains(added, value)) {
+      return;
+    }
+    added.push_back(value);
+  }
+  schedule({path_, false, reading, value});
+}
+
+void UserPhrasesLM::removePhrase(const std::string& reading,
+                                 const std::string& value) {
+  Erase(addedPhrases_, reading, value);
+  if (fileHasValue(reading, value)) {
+    auto& removed = removedPhrases_[reading];
+    if (!Contains(removed, value)) {
+      removed.push_back(value);
+    }
+  }
+  schedule({path_, true, reading, value});
+}
+
+void UserPhrasesLM::flush() {
+  std::unique_lock<std::mutex> lock(writerMutex_);
+  writerIdle_.wait(lock,
+                   [this] { return pendingWrites_.empty() && !writing_; });
+}
+
+void UserPhrasesLM::schedule(PendingWrite write) {
+  if (write.path.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    pendingWrites_.push_back(std::move(write));
+    if (!writer_.joinable()) {
+      writer_ = std::thread([this] { runWriter(); });
+    }
+  }
+  writerWakeUp_.notify_one();
+}
+
+void UserPhrasesLM::runWriter() {
+  std::unique_lock<std::mutex> lock(writerMutex_);
+  while (true) {
+    writerWakeUp_.wait(
+        lock, [this] { return stopping_ || !pendingWrites_.empty(); });
+    if (pendingWrites_.empty()) {
+      return;
+    }
+
+    std::deque<PendingWrite> writes = std::move(pendingWrites_);
+    pendingWrites_.clear();
+    writing_ = true;
+    lock.unlock();
+    for (const auto& write : writes) {
+      if (write.remove) {
+        RemovePhrase(write.path, write.reading, write.value);
+      } else {
+        AppendPhrase(write.path, write.reading, write.value);
+      }
+    }
+    lock.lock();
+    writing_ = false;
+    if (pendingWrites_.empty()) {
+      writerIdle_.notify_all();
+    }
+  }
+}
+
+void UserPhrasesLM::pruneOverlay() {
+  for (auto it = addedPhrases_.begin(); it != addedPhrases_.end();) {
+    std::vector<std::string_view> values = fileValues(it->first);
+    std::erase_if(it->second, [&values](const std::string& v) {
+      return std::find(values.begin(), values.end(), v) != values.end();
+    });
+    it = it->second.empty() ? addedPhrases_.erase(it) : std::next(it);
+  }
+  for (auto it = removedPhrases_.begin(); it != removedPhrases_.end();) {
+    std::vector<std::string_view> values = fileValues(it->first);
+    std::erase_if(it->second, [&values](const std::string& v) {
+      return std::find(values.begin(), values.end(), v) == values.end();
+    });
+    it = it->second.empty() ? removedPhrases_.erase(it) : std::next(it);
+  }
 }
 
 }  // namespace McBopomofo
@@ -24,12 +24,23 @@
 #ifndef SRC_ENGINE_USERPHRASESLM_H_
 #define SRC_ENGINE_USERPHRASESLM_H_
 
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "ByteBlockBackedDictionary.h"
+#include "DictionarySnapshot.h"
 #include "MemoryMappedFile.h"
+#include "MemoryUsage.h"
 #include "gramambular2/language_model.h"
 
 namespace McBopomofo {
@@ -41,10 +52,25 @@ class UserPhrasesLM : public Formosa::Gramambular2::LanguageModel {
   UserPhrasesLM(UserPhrasesLM&&) = delete;
   UserPhrasesLM& operator=(const UserPhrasesLM&) = delete;
   UserPhrasesLM& operator=(UserPhrasesLM&&) = delete;
+  ~UserPhrasesLM() override;
 
   bool open(const char* path);
+
+  // Opens the file through a snapshot at snapshotPath. If the snapshot is
+  // still valid for the file, the file is mapped but neither read nor parsed;
+  // otherwise, the file is parsed and the snapshot is rewritten. A reload
+  // after lines are appended parses only those lines and removes the now
+  // stale snapshot; any other reload parses the file and rewrites it.
+  bool open(const char* path, const std::filesystem::path& snapshotPath);
+
+  // Also waits for pending writes from addPhrase() and removePhrase().
   void close();
 
+  // Reloads the file previously opened from the same path. If the file has
+  // only been appended to since, only the new lines are parsed; otherwise,
+  // this is the same as close() followed by open().
+  bool reload(const char* path);
+
   // Allows loading existing in-memory data. It's the caller's responsibility
   // to make sure that data outlives this instance.
   bool load(const char* data, size_t length);
@@ -55,11 +81,87 @@ class UserPhrasesLM : public Formosa::Gramambular2::LanguageModel {
 
   std::vector<ByteBlockBackedDictionary::Issue> getParsingIssues() const;
 
+  // Adds a phrase, which the next lookup returns. If the instance was opened
+  // from a file, the phrase is appended to the file on a background thread.
+  void addPhrase(const std::string& reading, const std::string& value);
+
+  // Removes a phrase, which the next lookup no longer returns. If the instance
+  // was opened from a file, the lines of the phrase are removed from the file
+  // on a background thread.
+  void removePhrase(const std::string& reading, const std::string& value);
+
+  // Blocks until the changes made by addPhrase() and removePhrase() are
+  // written to the file.
+  void flush();
+
+  // The mapped file or snapshot, the earlier mappings kept by reloads, the
+  // parsed dictionary, and the phrases added or removed since. Data passed to
+  // load() and changes not yet written are not counted.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
   static constexpr double kUserUnigramScore = 0;
 
+  // How many earlier mappings of the file can be kept alive by appended
+  // reloads before a reload reparses the whole file.
+  static constexpr size_t kMaxRetainedMappings = 8;
+
  protected:
+  // Parses only the bytes appended to the file since it was last parsed.
+  // Returns false if the file is not a pure append of what was parsed.
+  bool reloadAppended(const char* path);
+
+  struct PendingWrite {
+    std::string path;
+    bool remove;
+    std::string reading;
+    std::string value;
+  };
+
+  void schedule(PendingWrite write);
+  void runWriter();
+
+  // Drops the overlay entries that the parsed file already reflects.
+  void pruneOverlay();
+
+  // The values of the key in the file, from the snapshot if one is open.
+  std::vector<std::string_view> fileValues(const std::string& key) const;
+
+  // Whether the file has the phrase, from the snapshot if one is open.
+  bool fileHasValue(const std::string& key, const std::string& value) const;
+
   MemoryMappedFile mmapedFile_;
   ByteBlockBackedDictionary dictionary_;
+
+  // When open, holds what the file had when it was opened, and dictionary_
+  // only holds the lines appended since.
+  DictionarySnapshot snapshot_;
+  std::filesystem::path snapshotPath_;
+
+  // Earlier mappings of the file that dictionary_ still refers to.
+  std::vector<MemoryMappedFile> retainedMappings_;
+
+  // The identity of the opened file and the DictionarySnapshot::ContentHash()
+  // of its parsed content, used to tell whether the file has only been
+  // appended to.
+  dev_t device_ = 0;
+  ino_t inode_ = 0;
+  uint64_t parsedContentHash_ = 0;
+
+  // Phrases added or removed since the file was parsed, keyed by reading.
+  std::unordered_map<std::string, std::vector<std::string>> addedPhrases_;
+  std::unordered_map<std::string, std::vector<std::string>> removedPhrases_;
+
+  // The opened file, which is where the phrase changes go.
+  std::string path_;
+
+  // The writer thread state, which is shared with the writer thread.
+  std::mutex writerMutex_;
+  std::condition_variable writerWakeUp_;
+  std::condition_variable writerIdle_;
+  std::deque<PendingWrite> pendingWrites_;
+  bool writing_ = false;
+  bool stopping_ = false;
+  std::thread writer_;
 };
 
 }  // namespace McBopomofo
@@ -0,0 +1,100 @@
+// Copyright (c) 2025 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "TestTempDir.h"
+#include "UserPhrasesLM.h"
+
+namespace {
+
+using UserPhrasesLM = McBopomofo::UserPhrasesLM;
+
+constexpr int kUserPhraseLines = 50000;
+
+// A user phrases file in its own temporary directory.
+class UserPhrasesFile {
+ public:
+  UserPhrasesFile() {
+    path_ = dir_.pathOf("data.txt.user").native();
+
+    std::ofstream out(path_);
+    char buf[64];
+    for (int i = 0; i < kUserPhraseLines; i++) {
+      snprintf(buf, sizeof(buf), "phrase%d ㄅㄚ-ㄅㄚ%d\n", i, i % 5000);
+      out << buf;
+    }
+  }
+
+  const char* path() const { return path_.c_str(); }
+
+  void appendLine(int i) const {
+    std::ofstream(path_, std::ios::app) << "added" << i << " ㄅㄚ-ㄅㄚ\n";
+  }
+
+ private:
+  McBopomofo::TestTempDir dir_;
+  std::string path_;
+};
+
+// What reloading cost before: the whole file is parsed again.
+static void BM_UserPhrasesLMFullReloadAfterAppend(benchmark::State& state) {
+  UserPhrasesFile file;
+  UserPhrasesLM lm;
+  lm.open(file.path());
+  int i = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    file.appendLine(i++);
+    state.ResumeTiming();
+    lm.close();
+    lm.open(file.path());
+  }
+}
+BENCHMARK(BM_UserPhrasesLMFullReloadAfterAppend)
+    ->Unit(benchmark::kMicrosecond);
+
+// Only the appended line is parsed, except when too many earlier mappings are
+// retained, which costs one full parse every kMaxRetainedMappings reloads.
+static void BM_UserPhrasesLMReloadAfterAppend(benchmark::State& state) {
+  UserPhrasesFile file;
+  UserPhrasesLM lm;
+  lm.open(file.path());
+  int i = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    file.appendLine(i++);
+    state.ResumeTiming();
+    lm.reload(file.path());
+  }
+}
+BENCHMARK(BM_UserPhrasesLMReloadAfterAppend)->Unit(benchmark::kMicrosecond);
+
+};  // namespace
+
+BENCHMARK_MAIN();
@@ -23,14 +23,65 @@
 
 #include <cstdio>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <string>
 #include <vector>
 
+#include "TestTempDir.h"
 #include "UserPhrasesLM.h"
 #include "gtest/gtest.h"
 
 namespace McBopomofo {
 
+namespace {
+
+// A user phrases file in its own temporary directory.
+class TestUserFile {
+ public:
+  TestUserFile() {
+    path_ = dir_.pathOf("data.txt.user").native();
+  }
+
+  const char* path() const { return path_.c_str(); }
+
+  // Rewrites the file in place, keeping its inode.
+  void write(const std::string& content) const {
+    std::ofstream(path_, std::ios::binary | std::ios::trunc) << content;
+  }
+
+  void append(const std::string& content) const {
+    std::ofstream(path_, std::ios::binary | std::ios::app) << content;
+  }
+
+  // Replaces the file with a new one, as editors that save atomically do.
+  void replace(const std::string& content) const {
+    std::string tmp = path_ + ".tmp";
+    std::ofstream(tmp, std::ios::binary) << content;
+    std::filesystem::rename(tmp, path_);
+  }
+
+ private:
+  TestTempDir dir_;
+  std::string path_;
+};
+
+std::string ReadFile(const char* path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+std::vector<std::string> Values(UserPhrasesLM& lm, const std::string& key) {
+  std::vector<std::string> values;
+  for (const auto& unigram : lm.getUnigrams(key)) {
+    values.push_back(unigram.value());
+  }
+  return values;
+}
+
+}  // namespace
+
 TEST(UserPhrasesLMTest, LenientReading) {
   constexpr char kTestData[] = "value1 reading1\nvalue2 \nvalue3 reading2";
 
@@ -59,4 +110,238 @@ TEST(UserPhrasesLMTest, ValuesContainingSpaces) {
   EXPECT_EQ(results[0].score(), UserPhrasesLM::kUserUnigramScore);
 }
 
+TEST(UserPhrasesLMTest, ReloadParsesAppendedLines) {
+  TestUserFile file;
+  file.write("value1 reading1\nvalue2\n");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  file.append("value3 reading1\nvalue4\nvalue5 reading2\n");
+  ASSERT_TRUE(lm.reload(file.path()));
+
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value3"}));
+  EXPECT_EQ(Values(lm, "reading2"), (std::vector<std::string>{"value5"}));
+  ASSERT_EQ(lm.getParsingIssues().size(), 2);
+  EXPECT_EQ(lm.getParsingIssues()[0].lineNumber, 2);
+  EXPECT_EQ(lm.getParsingIssues()[1].lineNumber, 4);
+
+  // Repeated appends keep earlier entries valid.
+  for (size_t i = 0; i < 2 * UserPhrasesLM::kMaxRetainedMappings; i++) {
+    file.append("value" + std::to_string(i) + " reading3\n");
+    ASSERT_TRUE(lm.reload(file.path()));
+  }
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value3"}));
+  EXPECT_EQ(Values(lm, "reading3").size(),
+            2 * UserPhrasesLM::kMaxRetainedMappings);
+}
+
+TEST(UserPhrasesLMTest, ReloadUnchangedFile) {
+  TestUserFile file;
+  file.write("value1 reading1\n");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_EQ(Values(lm, "reading1"), (std::vector<std::string>{"value1"}));
+}
+
+TEST(UserPhrasesLMTest, ReloadReplacedFile) {
+  TestUserFile file;
+  file.write("value1 reading1\n");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  file.replace("value1 reading1\nvalue2 reading1\n");
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value2"}));
+}
+
+TEST(UserPhrasesLMTest, ReloadFileRewrittenInPlace) {
+  TestUserFile file;
+  file.write("value1 reading1\n");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  file.write("value9 reading9\nvalue2 reading1\n");
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_EQ(Values(lm, "reading1"), (std::vector<std::string>{"value2"}));
+  EXPECT_EQ(Values(lm, "reading9"), (std::vector<std::string>{"value9"}));
+}
+
+TEST(UserPhrasesLMTest, ReloadLongFileWithLineInsertedInPlace) {
+  std::string lines;
+  while (lines.size() <= 8192) {
+    lines += "value" + std::to_string(lines.size()) + " reading2\n";
+  }
+  TestUserFile file;
+  file.write("value1 reading1\n" + lines);
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  // The file grows, but the insertion shifts the parsed bytes.
+  file.write("value9 reading1\nvalue1 reading1\n" + lines);
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value9", "value1"}));
+}
+
+TEST(UserPhrasesLMTest, ReloadLongFileWithSameLengthEditInPlace) {
+  std::string lines;
+  while (lines.size() <= 8192) {
+    lines += "value" + std::to_string(lines.size()) + " reading2\n";
+  }
+
+  for (bool append : {false, true}) {
+    TestUserFile file;
+    file.write("value1 reading1\n" + lines);
+
+    UserPhrasesLM lm;
+    ASSERT_TRUE(lm.open(file.path()));
+    // The edit is far from the end and keeps every byte after it in place,
+    // but the dictionary has to rehash the edited key.
+    std::string edited = "value1 reading7\n" + lines;
+    if (append) {
+      edited += "value3 reading3\n";
+    }
+    file.write(edited);
+    ASSERT_TRUE(lm.reload(file.path()));
+    EXPECT_FALSE(lm.hasUnigrams("reading1")) << append;
+    EXPECT_EQ(Values(lm, "reading7"), (std::vector<std::string>{"value1"}))
+        << append;
+    EXPECT_EQ(lm.hasUnigrams("reading3"), append);
+  }
+}
+
+TEST(UserPhrasesLMTest, ReloadFileWithoutTrailingLineBreak) {
+  TestUserFile file;
+  file.write("value1 reading");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  file.append("1\n");
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_FALSE(lm.hasUnigrams("reading"));
+  EXPECT_EQ(Values(lm, "reading1"), (std::vector<std::string>{"value1"}));
+  EXPECT_TRUE(lm.getParsingIssues().empty());
+}
+
+TEST(UserPhrasesLMTest, AddAndRemovePhrasesInMemory) {
+  constexpr char kTestData[] = "value1 reading1\nvalue2 reading1\n";
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.load(kTestData, sizeof(kTestData)));
+  lm.addPhrase("reading1", "value3");
+  lm.addPhrase("reading1", "value1");
+  lm.addPhrase("reading2", "value4");
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value2", "value3"}));
+  EXPECT_TRUE(lm.hasUnigrams("reading2"));
+
+  lm.removePhrase("reading1", "value1");
+  lm.removePhrase("reading2", "value4");
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value2", "value3"}));
+  EXPECT_FALSE(lm.hasUnigrams("reading2"));
+
+  lm.addPhrase("reading1", "value1");
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value2", "value3"}));
+}
+
+TEST(UserPhrasesLMTest, MemoryUsage) {
+  const std::string content = "value1 reading1\nvalue2 reading2\n";
+  TestUserFile file;
+  file.write(content);
+
+  UserPhrasesLM lm;
+  EXPECT_EQ(lm.memoryUsage().mappedBytes, 0);
+  ASSERT_TRUE(lm.open(file.path()));
+  MemoryUsage opened = lm.memoryUsage();
+  EXPECT_EQ(opened.mappedBytes, content.size());
+  EXPECT_LE(opened.residentMappedBytes, opened.mappedBytes);
+  EXPECT_GT(opened.heapBytes, 0);
+
+  lm.addPhrase("reading3", std::string(64, 'x'));
+  lm.flush();
+  EXPECT_GE(lm.memoryUsage().heapBytes, opened.heapBytes + 64);
+
+  lm.close();
+  EXPECT_EQ(lm.memoryUsage().mappedBytes, 0);
+}
+
+TEST(UserPhrasesLMTest, AddedPhrasesArePersisted) {
+  TestUserFile file;
+  file.write("value1 reading1");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  lm.addPhrase("reading1", "value2");
+  lm.addPhrase("reading2", "value 3");
+  lm.addPhrase("reading1", "value1");
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value2"}));
+
+  lm.flush();
+  EXPECT_EQ(ReadFile(file.path()),
+            "value1 reading1\nvalue2 reading1\nvalue 3 reading2\n");
+
+  // Reloading picks up the written lines without duplicating them.
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_EQ(Values(lm, "reading1"),
+            (std::vector<std::string>{"value1", "value2"}));
+  EXPECT_EQ(Values(lm, "reading2"), (std::vector<std::string>{"value 3"}));
+}
+
+TEST(UserPhrasesLMTest, RemovedPhrasesArePersisted) {
+  TestUserFile file;
+  file.write("# comment\nvalue1 reading1\n value2  reading1 \nvalue1 reading1\n");
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  lm.removePhrase("reading1", "value1");
+  lm.addPhrase("reading2", "value3");
+  lm.removePhrase("reading2", "value3");
+  EXPECT_EQ(Values(lm, "reading1"), (std::vector<std::string>{"value2"}));
+  EXPECT_FALSE(lm.hasUnigrams("reading2"));
+
+  lm.flush();
+  EXPECT_EQ(ReadFile(file.path()), "# comment\n value2  reading1 \n");
+
+  ASSERT_TRUE(lm.reload(file.path()));
+  EXPECT_EQ(Values(lm, "reading1"), (std::vector<std::string>{"value2"}));
+  EXPECT_FALSE(lm.hasUnigrams("reading2"));
+}
+
+TEST(UserPhrasesLMTest, RemovingPhrasesKeepsFileMode) {
+  TestUserFile file;
+  file.write("value1 reading1\nvalue2 reading1\n");
+  std::filesystem::permissions(file.path(),
+                               std::filesystem::perms::owner_read |
+                                   std::filesystem::perms::owner_write);
+
+  UserPhrasesLM lm;
+  ASSERT_TRUE(lm.open(file.path()));
+  lm.removePhrase("reading1", "value1");
+  lm.flush();
+  EXPECT_EQ(ReadFile(file.path()), "value2 reading1\n");
+  EXPECT_EQ(std::filesystem::status(file.path()).permissions(),
+            std::filesystem::perms::owner_read |
+                std::filesystem::perms::owner_write);
+  EXPECT_FALSE(std::filesystem::exists(std::string(file.path()) + ".tmp"));
+}
+
+TEST(UserPhrasesLMTest, CloseWritesPendingChanges) {
+  TestUserFile file;
+  file.write("value1 reading1\n");
+  {
+    UserPhrasesLM lm;
+    ASSERT_TRUE(lm.open(file.path()));
+    lm.addPhrase("reading2", "value2");
+  }
+  EXPECT_EQ(ReadFile(file.path()), "value1 reading1\nvalue2 reading2\n");
+}
+
 }  // namespace McBopomofo
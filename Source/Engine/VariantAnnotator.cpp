@@ -24,6 +24,12 @@
 #include "VariantAnnotator.h"
 
 #include <cassert>
+#include <optional>
+#include <utility>
+
+#include "AssociatedPhrasesV2.h"
+#include "Trace.h"
+#include "UTF8Helper.h"
 
 static constexpr char kDelimiterChar = ' ';
 static constexpr char kSeparatorChar = '-';
@@ -55,8 +61,11 @@ bool VariantAnnotator::loadPUAFile(const std::filesystem::path& bpmfvsPUAPath) {
     return false;
   }
 
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
   puaMap_ = std::move(db);
   bpmfvsPUAFile_ = std::move(file);
+  compileTable();
+  updateLoadedState();
   return true;
 }
 
@@ -73,32 +82,181 @@ bool VariantAnnotator::loadVariantsFile(
     return false;
   }
 
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
   variantsMap_ = std::move(db);
   bpmfvsVariantsFile_ = std::move(file);
+  compileTable();
+  updateLoadedState();
+  return true;
+}
+
+bool VariantAnnotator::loadDatabaseFiles(
+    const std::filesystem::path& bpmfvsPUAPath,
+    const std::filesystem::path& bpmfvsVariantsPath) {
+  MemoryMappedFile puaFile;
+  MemoryMappedFile variantsFile;
+  if (!puaFile.open(bpmfvsPUAPath.c_str()) ||
+      !variantsFile.open(bpmfvsVariantsPath.c_str())) {
+    return false;
+  }
+
+  auto puaMap =
+      ParselessPhraseDB::CreateValidatedDB(puaFile.data(), puaFile.length());
+  auto variantsMap = ParselessPhraseDB::CreateValidatedDB(
+      variantsFile.data(), variantsFile.length());
+  if (!puaMap || !variantsMap) {
+    return false;
+  }
+
+  // If a row cannot be compiled, the databases are searched instead.
+  std::string compiledTable;
+  if (!BopomofoVariantTable::Compile(*variantsMap, *puaMap, &compiledTable)) {
+    compiledTable.clear();
+  }
+
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
+  puaMap_ = std::move(puaMap);
+  variantsMap_ = std::move(variantsMap);
+  bpmfvsPUAFile_ = std::move(puaFile);
+  bpmfvsVariantsFile_ = std::move(variantsFile);
+  table_.close();
+  bpmfvsTableFile_.close();
+  // Moving the string keeps its buffer, which is far too large to be inline.
+  compiledTable_ = std::move(compiledTable);
+  if (!compiledTable_.empty()) {
+    table_.open(compiledTable_.data(), compiledTable_.size());
+  }
+  updateLoadedState();
+  return true;
+}
+
+bool VariantAnnotator::loadTableFile(
+    const std::filesystem::path& bpmfvsTablePath) {
+  MemoryMappedFile file;
+  if (!file.open(bpmfvsTablePath.c_str())) {
+    return false;
+  }
+
+  BopomofoVariantTable table;
+  if (!table.open(file.data(), file.length())) {
+    file.close();
+    return false;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
+  table_.open(file.data(), file.length());
+  bpmfvsTableFile_ = std::move(file);
+  compiledTable_.clear();
+  updateLoadedState();
   return true;
 }
 
 void VariantAnnotator::loadPUAMap(std::unique_ptr<ParselessPhraseDB> puaMap) {
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
   bpmfvsPUAFile_.close();
   puaMap_ = std::move(puaMap);
+  compileTable();
+  updateLoadedState();
 }
 
 void VariantAnnotator::loadVariantsMap(
     std::unique_ptr<ParselessPhraseDB> variantsMap) {
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
   bpmfvsVariantsFile_.close();
   variantsMap_ = std::move(variantsMap);
+  compileTable();
+  updateLoadedState();
 }
 
 bool VariantAnnotator::loaded() const {
-  return variantsMap_ != nullptr && puaMap_ != nullptr;
+  return loaded_.load(std::memory_order_acquire);
+}
+
+uint64_t VariantAnnotator::generation() const {
+  return generation_.load(std::memory_order_acquire);
+}
+
+MemoryUsage VariantAnnotator::memoryUsage() const {
+  std::shared_lock<std::shared_mutex> dataLock(dataMutex_);
+  MemoryUsage usage = bpmfvsPUAFile_.memoryUsage() +
+                      bpmfvsVariantsFile_.memoryUsage() +
+                      bpmfvsTableFile_.memoryUsage();
+  usage.heapBytes += StringHeapBytes(compiledTable_);
+  for (const auto* map : {&puaMap_, &variantsMap_}) {
+    if (*map != nullptr) {
+      usage.heapBytes += sizeof(ParselessPhraseDB);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(memoMutex_);
+  usage.heapBytes += UnorderedContainerHeapBytes(memo_);
+  for (const auto& [key, result] : memo_) {
+    usage.heapBytes +=
+        StringHeapBytes(key) + StringHeapBytes(result.annotatedString);
+  }
+  return usage;
+}
+
+void VariantAnnotator::updateLoadedState() {
+  {
+    std::lock_guard<std::mutex> lock(memoMutex_);
+    memo_.clear();
+  }
+  generation_.fetch_add(1, std::memory_order_acq_rel);
+  loaded_.store(
+      table_.isOpen() || (variantsMap_ != nullptr && puaMap_ != nullptr),
+      std::memory_order_release);
+}
+
+void VariantAnnotator::compileTable() {
+  table_.close();
+  bpmfvsTableFile_.close();
+  compiledTable_.clear();
+  if (variantsMap_ == nullptr || puaMap_ == nullptr) {
+    return;
+  }
+
+  // If a row cannot be compiled, the databases are searched instead.
+  if (BopomofoVariantTable::Compile(*variantsMap_, *puaMap_, &compiledTable_)) {
+    table_.open(compiledTable_.data(), compiledTable_.size());
+  } else {
+    compiledTable_.clear();
+  }
 }
 
 VariantAnnotator::Result VariantAnnotator::annotateSingleCharacter(
     const std::string& value, const std::string& reading) const {
+  // Held until the result is memoized, so that a result looked up in data
+  // that is being replaced is not memoized after the memo is cleared.
+  std::shared_lock<std::shared_mutex> dataLock(dataMutex_);
   if (!loaded()) {
     return {};
   }
 
+  std::string key;
+  key.reserve(value.size() + 1 + reading.size());
+  key += value;
+  key += kDelimiterChar;
+  key += reading;
+  {
+    std::lock_guard<std::mutex> lock(memoMutex_);
+    auto it = memo_.find(key);
+    if (it != memo_.end()) {
+      return it->second;
+    }
+  }
+
+  Result result = lookUpSingleCharacter(value, reading);
+  std::lock_guard<std::mutex> lock(memoMutex_);
+  if (memo_.size() >= kMaxMemoizedResults) {
+    memo_.clear();
+  }
+  memo_.emplace(std::move(key), result);
+  return result;
+}
+
+VariantAnnotator::Result VariantAnnotator::lookUpSingleCharacter(
+    const std::string& value, const std::string& reading) const {
   std::string variant = findDefaultOrAnnotatedVariant(value, reading);
   if (!variant.empty()) {
     // If variant != value, a variant selector must have been used.
@@ -125,6 +283,7 @@ VariantAnnotator::Result VariantAnnotator::annotateSingleCharacter(
 VariantAnnotator::CombinedResult VariantAnnotator::annotate(
     const std::vector<std::string>& values,
     const std::vector<std::string>& readings) const {
+  MCBOPOMOFO_TRACE_SCOPE("VariantAnnotator::annotate");
   assert(values.size() == readings.size());
 
   CombinedResult combinedResult;
@@ -147,6 +306,16 @@ VariantAnnotator::CombinedResult VariantAnnotator::annotate(
 
 std::string VariantAnnotator::findCombinedPUABopomofoReading(
     const std::string& reading) const {
+  if (table_.isOpen()) {
+    std::string block;
+    std::optional<uint16_t> packed = BopomofoVariantTable::PackReading(reading);
+    if (packed.has_value() &&
+        *packed != BopomofoVariantTable::kUnannotatedReading) {
+      table_.appendPUABlock(*packed, &block);
+    }
+    return block;
+  }
+
   if (puaMap_ == nullptr) {
     return {};
   }
@@ -161,6 +330,15 @@ std::string VariantAnnotator::findCombinedPUABopomofoReading(
 
 std::string VariantAnnotator::findDefaultOrAnnotatedVariant(
     const std::string& value, const std::string& reading) const {
+  if (table_.isOpen()) {
+    std::string variant;
+    std::optional<uint16_t> packed = BopomofoVariantTable::PackReading(reading);
+    if (packed.has_value()) {
+      table_.appendVariant(value, *packed, &variant);
+    }
+    return variant;
+  }
+
   if (variantsMap_ == nullptr) {
     return {};
   }
@@ -179,10 +357,93 @@ std::string VariantAnnotator::findUnannotatedVariant(
 }
 
 void VariantAnnotator::closeMemoryMapFiles() {
+  std::unique_lock<std::shared_mutex> lock(dataMutex_);
+  loaded_.store(false, std::memory_order_release);
   puaMap_ = nullptr;
   variantsMap_ = nullptr;
   bpmfvsPUAFile_.close();
   bpmfvsVariantsFile_.close();
+  compileTable();
+  updateLoadedState();
+}
+
+const std::vector<const VariantAnnotator::CombinedResult*>&
+IncrementalVariantAnnotator::annotate(
+    const Formosa::Gramambular2::ReadingGrid::WalkResult& walk) {
+  MCBOPOMOFO_TRACE_SCOPE("IncrementalVariantAnnotator::annotate");
+  results_.assign(walk.nodes.size(), nullptr);
+  if (annotator_ == nullptr || !annotator_->loaded()) {
+    nodes_.clear();
+    return results_;
+  }
+
+  uint64_t generation = annotator_->generation();
+  if (generation != generation_) {
+    nodes_.clear();
+    generation_ = generation;
+  }
+
+  // A node of the previous walk can be reused if it has the same value and
+  // reading. An edit changes the nodes around the cursor, so the nodes before
+  // it keep their positions, and the nodes after it keep their distance from
+  // the end of the walk.
+  auto reusable = [](const NodeAnnotation& annotation, const std::string& value,
+                     const std::string& reading) {
+    return !annotation.value.empty() && annotation.value == value &&
+           annotation.reading == reading;
+  };
+
+  std::vector<NodeAnnotation> nodes;
+  nodes.reserve(walk.nodes.size());
+  const size_t previousSize = nodes_.size();
+  const size_t size = walk.nodes.size();
+  for (size_t i = 0; i < size; ++i) {
+    const auto& node = walk.nodes[i];
+    // Node::value() returns a copy.
+    const std::string& value = node->currentUnigram().value();
+    const std::string& reading = node->reading();
+
+    NodeAnnotation* previous = nullptr;
+    if (i < previousSize && reusable(nodes_[i], value, reading)) {
+      previous = &nodes_[i];
+    } else if (size - i <= previousSize &&
+               reusable(nodes_[previousSize - (size - i)], value, reading)) {
+      previous = &nodes_[previousSize - (size - i)];
+    }
+    if (previous != nullptr) {
+      nodes.push_back(std::move(*previous));
+      // Make sure that the moved-from annotation is not reused again.
+      previous->value.clear();
+      continue;
+    }
+
+    NodeAnnotation annotation;
+    annotation.value = value;
+    annotation.reading = reading;
+    size_t codePointCount = CodePointCount(value);
+    if (codePointCount == node->spanningLength()) {
+      std::vector<std::string> readings =
+          AssociatedPhrasesV2::SplitReadings(reading);
+      if (readings.size() == codePointCount) {
+        annotation.result = annotator_->annotate(Split(value), readings);
+        annotation.annotated = true;
+      }
+    }
+    nodes.push_back(std::move(annotation));
+  }
+
+  nodes_ = std::move(nodes);
+  for (size_t i = 0; i < size; ++i) {
+    if (nodes_[i].annotated) {
+      results_[i] = &nodes_[i].result;
+    }
+  }
+  return results_;
+}
+
+void IncrementalVariantAnnotator::reset() {
+  nodes_.clear();
+  results_.clear();
 }
 
 }  // namespace McBopomofo
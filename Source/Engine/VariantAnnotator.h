@@ -24,12 +24,21 @@
 #ifndef SRC_ENGINE_VARIANTANNOTATOR_H_
 #define SRC_ENGINE_VARIANTANNOTATOR_H_
 
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "BopomofoVariantTable.h"
 #include "MemoryMappedFile.h"
+#include "MemoryUsage.h"
 #include "ParselessPhraseDB.h"
+#include "gramambular2/reading_grid.h"
 
 namespace McBopomofo {
 
@@ -42,13 +51,36 @@ class VariantAnnotator {
   [[nodiscard]] bool loadVariantsFile(
       const std::filesystem::path& bpmfvsVariantsPath);
 
+  // Loads both bpmfvs databases and compiles them on the calling thread, then
+  // replaces the loaded data all at once, so that another thread annotating
+  // at the same time sees either the old data or the new, never a mix of
+  // the two. Nothing is replaced if either database fails to load.
+  [[nodiscard]] bool loadDatabaseFiles(
+      const std::filesystem::path& bpmfvsPUAPath,
+      const std::filesystem::path& bpmfvsVariantsPath);
+
+  // Loads the bpmfvs table compiled by bpmfvs_table_compiler.py, which
+  // replaces both databases. When the databases are loaded instead, they are
+  // compiled into the same table in memory, so either way a character is
+  // annotated without searching the databases.
+  [[nodiscard]] bool loadTableFile(const std::filesystem::path& bpmfvsTablePath);
+
   // Utility functions to allow loading in-memory data for testing purposes.
   void loadPUAMap(std::unique_ptr<ParselessPhraseDB> puaMap);
   void loadVariantsMap(std::unique_ptr<ParselessPhraseDB> variantsMap);
 
-  // Whether both databases are loaded and the instance is ready to use.
+  // Whether both databases are loaded and the instance is ready to use. Safe
+  // to call while another thread is loading an unloaded instance.
   [[nodiscard]] bool loaded() const;
 
+  // Changes whenever a database is loaded, so that annotations kept from an
+  // earlier generation can be told apart.
+  [[nodiscard]] uint64_t generation() const;
+
+  // The mapped databases or table, the table compiled from the databases,
+  // and the memoized results.
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
   struct Result {
     // The string with maybe a variant selector and/or a code point in the PUA.
     std::string annotatedString;
@@ -60,6 +92,9 @@ class VariantAnnotator {
     bool hasPUACodePoints = false;
   };
 
+  // Annotates a character. The results of recently annotated characters are
+  // memoized, so annotating the same character again does not look up the
+  // databases.
   [[nodiscard]] Result annotateSingleCharacter(
       const std::string& value, const std::string& reading) const;
 
@@ -88,6 +123,7 @@ class VariantAnnotator {
       const std::vector<std::string>& readings) const;
 
  protected:
+  // The find* and lookUp* methods must be called with dataMutex_ held.
   [[nodiscard]] std::string findCombinedPUABopomofoReading(
       const std::string& reading) const;
 
@@ -97,13 +133,83 @@ class VariantAnnotator {
   [[nodiscard]] std::string findUnannotatedVariant(
       const std::string& value) const;
 
+  [[nodiscard]] Result lookUpSingleCharacter(const std::string& value,
+                                             const std::string& reading) const;
+
   void closeMemoryMapFiles();
 
+  // Compiles the loaded databases into table_, replacing any loaded table.
+  void compileTable();
+
+  // Must be called with dataMutex_ held exclusively.
+  void updateLoadedState();
+
+  // The number of memoized results; the memo is cleared when it is full.
+  static constexpr size_t kMaxMemoizedResults = 1024;
+
+  // Memoized results keyed by the value and the reading, separated by a space.
+  mutable std::mutex memoMutex_;
+  mutable std::unordered_map<std::string, Result> memo_;
+  std::atomic<uint64_t> generation_ = 0;
+
+  // Guards the data below. Loading holds it exclusively while replacing the
+  // data, and annotating holds it shared.
+  mutable std::shared_mutex dataMutex_;
+
   std::unique_ptr<ParselessPhraseDB> variantsMap_;
   std::unique_ptr<ParselessPhraseDB> puaMap_;
 
   MemoryMappedFile bpmfvsVariantsFile_;
   MemoryMappedFile bpmfvsPUAFile_;
+
+  // Backed by either bpmfvsTableFile_ or compiledTable_.
+  BopomofoVariantTable table_;
+  MemoryMappedFile bpmfvsTableFile_;
+  std::string compiledTable_;
+
+  std::atomic<bool> loaded_ = false;
+};
+
+// Annotates the successive walks of a composition, one node at a time. A
+// keystroke usually changes only a few nodes of the walk, and the results of
+// the other nodes are carried over from the previous walk, so annotating the
+// walk costs about the number of changed nodes rather than the length of the
+// composition. Not thread-safe.
+class IncrementalVariantAnnotator {
+ public:
+  explicit IncrementalVariantAnnotator(const VariantAnnotator* annotator)
+      : annotator_(annotator) {}
+
+  IncrementalVariantAnnotator(const IncrementalVariantAnnotator&) = delete;
+  IncrementalVariantAnnotator(IncrementalVariantAnnotator&&) = delete;
+  IncrementalVariantAnnotator& operator=(const IncrementalVariantAnnotator&) =
+      delete;
+  IncrementalVariantAnnotator& operator=(IncrementalVariantAnnotator&&) =
+      delete;
+
+  // Annotates the nodes of the walk and returns one result per node. The
+  // result of a node is nullptr if the node is not annotated, which is the
+  // case when the annotator is not loaded or when the node's value does not
+  // have one code point per reading. The results are valid until the next
+  // call.
+  const std::vector<const VariantAnnotator::CombinedResult*>& annotate(
+      const Formosa::Gramambular2::ReadingGrid::WalkResult& walk);
+
+  // Forgets the results of the previous walk.
+  void reset();
+
+ private:
+  struct NodeAnnotation {
+    std::string value;
+    std::string reading;
+    bool annotated = false;
+    VariantAnnotator::CombinedResult result;
+  };
+
+  const VariantAnnotator* annotator_;
+  uint64_t generation_ = 0;
+  std::vector<NodeAnnotation> nodes_;
+  std::vector<const VariantAnnotator::CombinedResult*> results_;
 };
 
 }  // namespace McBopomofo
@@ -21,6 +21,15 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AssociatedPhrasesV2.h"
+#include "BopomofoVariantTable.h"
 #include "VariantAnnotator.h"
 #include "gtest/gtest.h"
 
@@ -185,4 +194,174 @@ TEST(VariantAnnotatorTest, AnnotateCharactersWithVariant0ButNoPUA) {
   EXPECT_FALSE(result.hasPUACodePoints);
 }
 
+TEST(VariantAnnotatorTest, MemoizedResultsAreDroppedOnReload) {
+  auto annotator = CreateLoadedAnnotator();
+  EXPECT_EQ(annotator->annotateSingleCharacter("個", "ㄍㄜ˙").annotatedString,
+            reinterpret_cast<const char*>(u8"個\U000E01E1"));
+  EXPECT_EQ(annotator->annotateSingleCharacter("個", "ㄍㄜ˙").annotatedString,
+            reinterpret_cast<const char*>(u8"個\U000E01E1"));
+
+  uint64_t generation = annotator->generation();
+  const char* variantsData =
+      "# format org.openvanilla.mcbopomofo.sorted\n個-ㄍㄜ˙ 個\n";
+  annotator->loadVariantsMap(
+      ParselessPhraseDB::CreateValidatedDB(variantsData, strlen(variantsData)));
+  EXPECT_NE(annotator->generation(), generation);
+  EXPECT_EQ(annotator->annotateSingleCharacter("個", "ㄍㄜ˙").annotatedString,
+            "個");
+}
+
+TEST(VariantAnnotatorTest, AnnotationWithCompiledTableFile) {
+  const char* variantsData = reinterpret_cast<const char*>(kTestVariantsData);
+  const char* puaData = reinterpret_cast<const char*>(kTestPUAData);
+  auto variantsDB =
+      ParselessPhraseDB::CreateValidatedDB(variantsData, strlen(variantsData));
+  auto puaDB = ParselessPhraseDB::CreateValidatedDB(puaData, strlen(puaData));
+  std::string table;
+  ASSERT_TRUE(BopomofoVariantTable::Compile(*variantsDB, *puaDB, &table));
+
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               "org.openvanilla.mcbopomofo.bpmfvs-table-test";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << table;
+  }
+
+  VariantAnnotator annotator;
+  EXPECT_TRUE(annotator.loadTableFile(path));
+  EXPECT_TRUE(annotator.loaded());
+
+  auto textAnnotator = CreateLoadedAnnotator();
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"個", "ㄍㄜ˙"}, {"個", "ㄍㄜˋ"}, {"一", "ㄧˋ"}, {"個", "ㄍㄜ"},
+      {"嘎", "ㄍㄚˋ"}, {"人", "ㄖㄣˊ"}};
+  for (const auto& [value, reading] : cases) {
+    VariantAnnotator::Result expected =
+        textAnnotator->annotateSingleCharacter(value, reading);
+    VariantAnnotator::Result result =
+        annotator.annotateSingleCharacter(value, reading);
+    EXPECT_EQ(result.annotatedString, expected.annotatedString) << reading;
+    EXPECT_EQ(result.hasPUACodePoints, expected.hasPUACodePoints) << reading;
+    EXPECT_EQ(result.hasVariantSelectors, expected.hasVariantSelectors)
+        << reading;
+  }
+
+  std::filesystem::remove(path);
+
+  VariantAnnotator missingAnnotator;
+  EXPECT_FALSE(missingAnnotator.loadTableFile(path));
+  EXPECT_FALSE(missingAnnotator.loaded());
+}
+
+TEST(VariantAnnotatorTest, LoadDatabaseFilesReplacesAllOrNothing) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path();
+  std::filesystem::path puaPath =
+      dir / "org.openvanilla.mcbopomofo.bpmfvs-pua-test";
+  std::filesystem::path variantsPath =
+      dir / "org.openvanilla.mcbopomofo.bpmfvs-variants-test";
+  std::filesystem::path missingPath =
+      dir / "org.openvanilla.mcbopomofo.bpmfvs-missing-test";
+  {
+    std::ofstream out(puaPath, std::ios::binary);
+    out << reinterpret_cast<const char*>(kTestPUAData);
+  }
+  {
+    std::ofstream out(variantsPath, std::ios::binary);
+    out << "# format org.openvanilla.mcbopomofo.sorted\n個-ㄍㄜ˙ 個\n";
+  }
+
+  auto annotator = CreateLoadedAnnotator();
+  uint64_t generation = annotator->generation();
+  EXPECT_FALSE(annotator->loadDatabaseFiles(puaPath, missingPath));
+  EXPECT_TRUE(annotator->loaded());
+  EXPECT_EQ(annotator->generation(), generation);
+  EXPECT_EQ(annotator->annotateSingleCharacter("個", "ㄍㄜ˙").annotatedString,
+            reinterpret_cast<const char*>(u8"個\U000E01E1"));
+
+  EXPECT_TRUE(annotator->loadDatabaseFiles(puaPath, variantsPath));
+  EXPECT_TRUE(annotator->loaded());
+  EXPECT_NE(annotator->generation(), generation);
+  EXPECT_EQ(annotator->annotateSingleCharacter("個", "ㄍㄜ˙").annotatedString,
+            "個");
+
+  VariantAnnotator unloadedAnnotator;
+  EXPECT_FALSE(unloadedAnnotator.loadDatabaseFiles(puaPath, missingPath));
+  EXPECT_FALSE(unloadedAnnotator.loaded());
+
+  std::filesystem::remove(puaPath);
+  std::filesystem::remove(variantsPath);
+}
+
+namespace {
+using Formosa::Gramambular2::LanguageModel;
+using Formosa::Gramambular2::ReadingGrid;
+
+ReadingGrid::WalkResult MakeWalk(
+    const std::vector<std::pair<std::string, std::string>>& readingValues) {
+  ReadingGrid::WalkResult walk;
+  for (const auto& [reading, value] : readingValues) {
+    size_t spanningLength = AssociatedPhrasesV2::SplitReadings(reading).size();
+    walk.nodes.push_back(std::make_shared<ReadingGrid::Node>(
+        reading, spanningLength,
+        std::vector<LanguageModel::Unigram>{
+            LanguageModel::Unigram(value, -1)}));
+    walk.totalReadings += spanningLength;
+  }
+  return walk;
+}
+}  // namespace
+
+TEST(VariantAnnotatorTest, IncrementalAnnotation) {
+  auto annotator = CreateLoadedAnnotator();
+  IncrementalVariantAnnotator incremental(annotator.get());
+
+  auto walk = MakeWalk({{"ㄧ-ㄍㄜ˙", "一個"}, {"ㄖㄣˊ", "人"}});
+  const auto& results = incremental.annotate(walk);
+  ASSERT_EQ(results.size(), 2);
+  ASSERT_NE(results[0], nullptr);
+  EXPECT_EQ(results[0]->annotatedString,
+            reinterpret_cast<const char*>(u8"一個\U000E01E1"));
+  EXPECT_EQ(results[0]->accumulatedStringLength,
+            (std::vector<size_t>{0, 3, 10}));
+  ASSERT_NE(results[1], nullptr);
+  EXPECT_EQ(results[1]->annotatedString, "人");
+
+  // Insert a node in the middle, and change the value of the last one.
+  walk = MakeWalk({{"ㄧ-ㄍㄜ˙", "一個"},
+                   {"ㄍㄚˋ", "個"},
+                   {"ㄖㄣˊ", "仁"},
+                   {"ㄧ", "ABC"}});
+  const auto& updated = incremental.annotate(walk);
+  ASSERT_EQ(updated.size(), 4);
+  ASSERT_NE(updated[0], nullptr);
+  EXPECT_EQ(updated[0]->annotatedString,
+            reinterpret_cast<const char*>(u8"一個\U000E01E1"));
+  ASSERT_NE(updated[1], nullptr);
+  EXPECT_EQ(updated[1]->annotatedString,
+            reinterpret_cast<const char*>(u8"個\U000E01E0\uF145"));
+  EXPECT_TRUE(updated[1]->hasPUACodePoints);
+  ASSERT_NE(updated[2], nullptr);
+  EXPECT_EQ(updated[2]->annotatedString, "仁");
+  // The value has more code points than readings.
+  EXPECT_EQ(updated[3], nullptr);
+
+  // Reloading the data annotates every node again.
+  const char* variantsData =
+      "# format org.openvanilla.mcbopomofo.sorted\n個-ㄍㄜ˙ 個\n";
+  annotator->loadVariantsMap(
+      ParselessPhraseDB::CreateValidatedDB(variantsData, strlen(variantsData)));
+  const auto& reloaded = incremental.annotate(walk);
+  ASSERT_NE(reloaded[0], nullptr);
+  EXPECT_EQ(reloaded[0]->annotatedString, "一個");
+}
+
+TEST(VariantAnnotatorTest, IncrementalAnnotationWithoutData) {
+  VariantAnnotator annotator;
+  IncrementalVariantAnnotator incremental(&annotator);
+  const auto& results =
+      incremental.annotate(MakeWalk({{"ㄧ-ㄍㄜ˙", "一個"}, {"ㄖㄣˊ", "人"}}));
+  EXPECT_EQ(results, (std::vector<const VariantAnnotator::CombinedResult*>{
+                         nullptr, nullptr}));
+}
+
 }  // namespace McBopomofo
@@ -24,6 +24,7 @@
 #include "reading_grid.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <limits>
 #include <memory>
@@ -34,12 +35,94 @@
 
 namespace Formosa::Gramambular2 {
 
+namespace {
+
+std::atomic<ReadingGrid::TraceHook> gTraceHook = nullptr;
+
+// The heap bytes of a string, which are none if the string is short enough to
+// be stored inside the string object.
+size_t StringHeapBytes(const std::string& s) {
+  const char* object = reinterpret_cast<const char*>(&s);
+  if (s.data() >= object && s.data() < object + sizeof(s)) {
+    return 0;
+  }
+  return s.capacity() + 1;
+}
+
+template <typename T>
+size_t VectorHeapBytes(const std::vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+#if defined(ENABLE_TRACING)
+// Reports the time from its construction to its destruction to the trace
+// hook, if there is one.
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* name)
+      : name_(name), start_(std::chrono::steady_clock::now()) {}
+  ~ScopedTrace() {
+    ReadingGrid::TraceHook hook = gTraceHook.load(std::memory_order_relaxed);
+    if (hook != nullptr) {
+      hook(name_, start_, std::chrono::steady_clock::now());
+    }
+  }
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+ private:
+  const char* name_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+#define GRAMAMBULAR2_TRACE_SCOPE(name) ScopedTrace gramambular2TraceScope(name)
+#else
+#define GRAMAMBULAR2_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+}  // namespace
+
+void ReadingGrid::setTraceHook(TraceHook hook) {
+  gTraceHook.store(hook, std::memory_order_relaxed);
+}
+
 void ReadingGrid::clear() {
   cursor_ = 0;
   readings_.clear();
   spans_.clear();
 }
 
+ReadingGrid::MemoryUsage ReadingGrid::memoryUsage() const {
+  // make_shared puts the reference counts next to the node.
+  constexpr size_t kNodeAllocationBytes = sizeof(Node) + 2 * sizeof(long);
+
+  MemoryUsage usage;
+  usage.heapBytes = StringHeapBytes(separator_) + VectorHeapBytes(readings_) +
+                    VectorHeapBytes(spans_);
+  for (const std::string& reading : readings_) {
+    usage.heapBytes += StringHeapBytes(reading);
+  }
+  for (const Span& span : spans_) {
+    for (size_t length = 1; length <= span.maxLength(); ++length) {
+      const NodePtr& node = span.nodeOf(length);
+      if (node == nullptr) {
+        continue;
+      }
+      ++usage.nodeCount;
+      usage.unigramCount += node->unigrams().size();
+      usage.heapBytes += kNodeAllocationBytes +
+                         StringHeapBytes(node->reading()) +
+                         VectorHeapBytes(node->unigrams());
+      for (const LanguageModel::Unigram& unigram : node->unigrams()) {
+        usage.heapBytes += StringHeapBytes(unigram.value()) +
+                           StringHeapBytes(unigram.rawValue());
+      }
+    }
+  }
+  return usage;
+}
+
 void ReadingGrid::setCursor(size_t cursor) {
   assert(cursor <= readings_.size());
   cursor_ = cursor;
@@ -131,6 +214,7 @@ int64_t GetEpochNowInMicroseconds() {
 // O(|V| + |E|) time for G = (V, E) where G is a DAG. This means the walk is
 // fairly economical even when the grid is large.
 ReadingGrid::WalkResult ReadingGrid::walk() {
+  GRAMAMBULAR2_TRACE_SCOPE("ReadingGrid::walk");
   WalkResult result;
   if (spans_.empty()) {
     return result;
@@ -334,6 +418,7 @@ bool ReadingGrid::hasNodeAt(size_t loc, size_t readingLen,
 }
 
 void ReadingGrid::update() {
+  GRAMAMBULAR2_TRACE_SCOPE("ReadingGrid::update");
   size_t begin =
       (cursor_ <= kMaximumSpanLength) ? 0 : cursor_ - kMaximumSpanLength;
   size_t end = cursor_ + kMaximumSpanLength;
@@ -435,8 +520,9 @@ std::vector<ReadingGrid::NodeInSpan> ReadingGrid::overlappingNodesAt(
   return results;
 }
 
-LanguageModel::Unigram ReadingGrid::Node::currentUnigram() const {
-  return unigrams_.empty() ? LanguageModel::Unigram{} : *unigramIter_;
+const LanguageModel::Unigram& ReadingGrid::Node::currentUnigram() const {
+  static const LanguageModel::Unigram kEmptyUnigram;
+  return unigrams_.empty() ? kEmptyUnigram : *unigramIter_;
 }
 
 std::string ReadingGrid::Node::value() const {
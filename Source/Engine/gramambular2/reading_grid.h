@@ -26,6 +26,7 @@
 
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -120,7 +121,7 @@ class ReadingGrid {
     }
 
     // Returns the top or overridden unigram.
-    [[nodiscard]] LanguageModel::Unigram currentUnigram() const;
+    [[nodiscard]] const LanguageModel::Unigram& currentUnigram() const;
 
     [[nodiscard]] std::string value() const;
 
@@ -244,6 +245,25 @@ class ReadingGrid {
     return readings_;
   }
 
+  // The heap taken by the readings, the spans and the nodes, including the
+  // unigrams each node copies from the language model. A node that a walk
+  // result still holds after the grid has dropped it is not counted.
+  struct MemoryUsage {
+    size_t nodeCount = 0;
+    size_t unigramCount = 0;
+    size_t heapBytes = 0;
+  };
+
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
+  // Receives the name and the start and end time of every walk() and
+  // update() in builds with ENABLE_TRACING, so that the host can record them
+  // with its own tracer. There is no hook by default.
+  using TraceHook = void (*)(const char* name,
+                             std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end);
+  static void setTraceHook(TraceHook hook);
+
  protected:
   size_t cursor_ = 0;
   std::string separator_ = kDefaultSeparator;
@@ -342,6 +342,27 @@ TEST(ReadingGridTest, MultipleSpans) {
   ASSERT_EQ(grid.spans()[2].nodeOf(1)->reading(), "c");
 }
 
+TEST(ReadingGridTest, MemoryUsage) {
+  ReadingGrid grid(std::make_shared<MockLM>());
+  ReadingGrid::MemoryUsage empty = grid.memoryUsage();
+  ASSERT_EQ(empty.nodeCount, 0);
+  ASSERT_EQ(empty.unigramCount, 0);
+
+  grid.insertReading("a");
+  grid.insertReading("b");
+  grid.insertReading("c");
+  ReadingGrid::MemoryUsage usage = grid.memoryUsage();
+  ASSERT_EQ(usage.nodeCount, 6);
+  ASSERT_EQ(usage.unigramCount, 6);
+  ASSERT_GT(usage.heapBytes, empty.heapBytes + 6 * sizeof(ReadingGrid::Node));
+
+  grid.deleteReadingBeforeCursor();
+  ASSERT_EQ(grid.memoryUsage().nodeCount, 3);
+
+  grid.clear();
+  ASSERT_EQ(grid.memoryUsage().nodeCount, 0);
+}
+
 TEST(ReadingGridTest, SpanDeletionSimple) {
   ReadingGrid grid(std::make_shared<MockLM>());
   grid.setReadingSeparator(";");
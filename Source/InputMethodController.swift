@@ -185,6 +185,7 @@ class McBopomofoInputMethodController: IMKInputController {
         currentClient = nil
         keyHandler.clear()
         self.handle(state: .Deactivated(), client: client)
+        LanguageModelManager.saveUserOverrideModel(waitUntilWritten: false)
     }
 
     override func setValue(_ value: Any!, forTag tag: Int, client: Any!) {
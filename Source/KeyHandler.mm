@@ -34,6 +34,7 @@
 #import <optional>
 #import <sstream>
 #import <string>
+#import <string_view>
 #import <unordered_map>
 #import <utility>
 #import <vector>
@@ -63,6 +64,9 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
     Formosa::Gramambular2::ReadingGrid *_grid;
     Formosa::Gramambular2::ReadingGrid::WalkResult _latestWalk;
 
+    // Bopomofo annotation of the nodes of the latest walk
+    McBopomofo::IncrementalVariantAnnotator *_variantAnnotator;
+
     NSString *_inputMode;
 }
 
@@ -116,6 +120,7 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
 {
     delete _bpmfReadingBuffer;
     delete _grid;
+    delete _variantAnnotator;
 }
 
 - (instancetype)init
@@ -134,6 +139,8 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
         _grid = new Formosa::Gramambular2::ReadingGrid(lm);
         _grid->setReadingSeparator("-");
 
+        _variantAnnotator = new McBopomofo::IncrementalVariantAnnotator(LanguageModelManager.variantAnnotator);
+
         _inputMode = InputModeBopomofo;
     }
     return self;
@@ -188,6 +195,7 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
     Formosa::Gramambular2::ReadingGrid::NodePtr currentNode = *nodeIter;
     if (currentNode != nullptr && currentNode->currentUnigram().score() > -8) {
         _userOverrideModel->observe(prevWalk, _latestWalk, self.actualCandidateCursorIndex, [NSDate date].timeIntervalSince1970);
+        [LanguageModelManager saveUserOverrideModelIfDue];
     }
 
     if (currentNode != nullptr && flag && Preferences.moveCursorAfterSelectingCandidate) {
@@ -2256,7 +2264,8 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
 
     // Validate that the value's codepoint count is the same as the number
     // of readings. This is a strict requirement for the associated phrases.
-    std::vector<std::string> codepoints = McBopomofo::Split((*nodePtrIt)->value());
+    std::string nodeValue = (*nodePtrIt)->value();
+    std::vector<std::string_view> codepoints = McBopomofo::SplitViews(nodeValue);
     std::vector<std::string> readings = McBopomofo::AssociatedPhrasesV2::SplitReadings((*nodePtrIt)->reading());
     if (codepoints.size() != readings.size()) {
         errorCallback();
@@ -2313,7 +2322,7 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
         auto cpEnd = codepoints.cbegin();
         std::advance(cpBegin, startIndex);
         std::advance(cpEnd, maxPrefixLength);
-        auto cpSlice = std::vector<std::string>(cpBegin, cpEnd);
+        auto cpSlice = std::vector<std::string_view>(cpBegin, cpEnd);
 
         auto rdBegin = readings.cbegin();
         auto rdEnd = readings.cbegin();
@@ -2322,7 +2331,7 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
         auto rdSlice = std::vector<std::string>(rdBegin, rdEnd);
 
         std::stringstream value;
-        for (const std::string& cp : cpSlice) {
+        for (std::string_view cp : cpSlice) {
             value << cp;
         }
 
@@ -2374,35 +2383,32 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
     bool bopomofoAnnotationHasPUAs = false;
     bool bopomofoAnnotationHasVariants = false;
 
-    for (const auto& node : _latestWalk.nodes) {
-        std::string value = node->value();
+    // Only the nodes that changed since the previous walk are annotated anew.
+    const std::vector<const McBopomofo::VariantAnnotator::CombinedResult *> *nodeAnnotationResults = nullptr;
+    if (Preferences.bopomofoFontAnnotationSupportEnabled && _inputMode != InputModePlainBopomofo) {
+        nodeAnnotationResults = &_variantAnnotator->annotate(_latestWalk);
+    } else {
+        _variantAnnotator->reset();
+    }
+
+    for (size_t nodeIndex = 0, nodeCount = _latestWalk.nodes.size(); nodeIndex < nodeCount; nodeIndex++) {
+        const auto& node = _latestWalk.nodes[nodeIndex];
+        const std::string& value = node->value();
         size_t composedValueLength = value.length();
 
-        bool nodeHasBopomofoAnnotation = false;
-        McBopomofo::VariantAnnotator::CombinedResult nodeAnnotationResult;
-        if (!Preferences.bopomofoFontAnnotationSupportEnabled || _inputMode == InputModePlainBopomofo) {
-            composed += value;
-        } else if (!LanguageModelManager.variantAnnotator->loaded()) {
+        const McBopomofo::VariantAnnotator::CombinedResult *nodeAnnotationResult = nullptr;
+        if (nodeAnnotationResults != nullptr) {
+            nodeAnnotationResult = (*nodeAnnotationResults)[nodeIndex];
+        }
+        bool nodeHasBopomofoAnnotation = nodeAnnotationResult != nullptr;
+        if (!nodeHasBopomofoAnnotation) {
             composed += value;
         } else {
-            size_t cpLen = McBopomofo::CodePointCount(value);
-            if (cpLen != node->spanningLength()) {
-                composed += value;
-            } else {
-                std::vector<std::string> characters = McBopomofo::Split(value);
-                std::vector<std::string> readings = McBopomofo::AssociatedPhrasesV2::SplitReadings(node->reading());
-                if (readings.size() != cpLen) {
-                    composed += value;
-                } else {
-                    nodeAnnotationResult = LanguageModelManager.variantAnnotator->annotate(characters, readings);
-                    nodeHasBopomofoAnnotation = true;
-                    bopomofoAnnotationUsed = true;
-                    bopomofoAnnotationHasPUAs |= nodeAnnotationResult.hasPUACodePoints;
-                    bopomofoAnnotationHasVariants |= nodeAnnotationResult.hasVariantSelectors;
-                    composed += nodeAnnotationResult.annotatedString;
-                    composedValueLength = nodeAnnotationResult.annotatedString.length();
-                }
-            }
+            bopomofoAnnotationUsed = true;
+            bopomofoAnnotationHasPUAs |= nodeAnnotationResult->hasPUACodePoints;
+            bopomofoAnnotationHasVariants |= nodeAnnotationResult->hasVariantSelectors;
+            composed += nodeAnnotationResult->annotatedString;
+            composedValueLength = nodeAnnotationResult->annotatedString.length();
         }
 
         // No work if runningCursor has already caught up with builderCursor.
@@ -2428,7 +2434,7 @@ InputMode InputModePlainBopomofo = @"org.openvanilla.inputmethod.McBopomofo.Plai
         std::string actualValue = McBopomofo::SubstringToCodePoints(value, cpLen);
 
         if (nodeHasBopomofoAnnotation) {
-            composedCursor += nodeAnnotationResult.accumulatedStringLength[cpLen];
+            composedCursor += nodeAnnotationResult->accumulatedStringLength[cpLen];
         } else {
             composedCursor += actualValue.length();
         }
@@ -33,6 +33,10 @@ NS_ASSUME_NONNULL_BEGIN
 @property (class, readonly, nonatomic) McBopomofo::McBopomofoLM *languageModelPlainBopomofo;
 @property (class, readonly, nonatomic) McBopomofo::UserOverrideModel *userOverrideModel;
 @property (class, readonly, nonatomic) McBopomofo::VariantAnnotator *variantAnnotator;
+
+/// Saves what the user override model has learned, if some time has passed
+/// since the last save. The file is written on a background thread.
++ (void)saveUserOverrideModelIfDue;
 @end
 
 NS_ASSUME_NONNULL_END
@@ -40,6 +40,11 @@ NS_ASSUME_NONNULL_BEGIN
 
 + (nullable NSString *)readingFor:(NSString *)phrase;
 
+/// Saves what the user override model has learned since the last save. The
+/// file is written on a background thread; pass YES to wait for the write,
+/// such as when the app is about to terminate.
++ (void)saveUserOverrideModelWaitingUntilWritten:(BOOL)wait NS_SWIFT_NAME(saveUserOverrideModel(waitUntilWritten:));
+
 @property (class, readonly, nonatomic) NSString *dataFolderPath;
 @property (class, readonly, nonatomic) NSString *userPhrasesDataPathMcBopomofo;
 @property (class, readonly, nonatomic) NSString *userPhrasesDataPathPlainBopomofo;
@@ -27,6 +27,7 @@
 
 #include "UTF8Helper.h"
 #include "AssociatedPhrasesV2.h"
+#include "UserOverrideModelStore.h"
 
 @import OpenCCBridge;
 
@@ -37,6 +38,9 @@ static McBopomofo::McBopomofoLM gLanguageModelMcBopomofo;
 static McBopomofo::McBopomofoLM gLanguageModelPlainBopomofo;
 static McBopomofo::UserOverrideModel gUserOverrideModel(kUserOverrideModelCapacity, kObservedOverrideHalflife);
 static McBopomofo::VariantAnnotator gVariantAnnotator;
+// Never destroyed, so that its writer thread outlives the static destructors;
+// the app saves the model on deactivation and termination instead.
+static McBopomofo::UserOverrideModelStore *gUserOverrideModelStore = nullptr;
 
 static NSString *const kUserDataTemplateName = @"template-data";
 static NSString *const kUserDataPlainBopomofoTemplateName = @"template-data-plain-bpmf";
@@ -44,6 +48,7 @@ static NSString *const kExcludedPhrasesMcBopomofoTemplateName = @"template-exclu
 static NSString *const kExcludedPhrasesPlainBopomofoTemplateName = @"template-exclude-phrases-plain-bpmf";
 static NSString *const kPhraseReplacementTemplateName = @"template-phrases-replacement";
 static NSString *const kTemplateExtension = @".txt";
+static NSString *const kUserOverrideModelFilename = @"user-override-model.bin";
 
 @implementation LanguageModelManager
 
@@ -64,6 +69,11 @@ static void LTLoadAssociatedPhrases(McBopomofo::McBopomofoLM& lm)
 static void LTLoadVariantAnnotatorData()
 {
     Class cls = NSClassFromString(@"McBopomofoInputMethodController");
+    NSString *tableDataPath = [[NSBundle bundleForClass:cls] pathForResource:@"bpmfvs-table" ofType:@"bin"];
+    if (tableDataPath != nil && gVariantAnnotator.loadTableFile(tableDataPath.UTF8String)) {
+        return;
+    }
+
     NSString *puaDataPath = [[NSBundle bundleForClass:cls] pathForResource:@"bpmfvs-pua" ofType:@"txt"];
     if (puaDataPath == nil) {
         NSLog(@"Error: No PUA data found in bundle");
@@ -76,10 +86,8 @@ static void LTLoadVariantAnnotatorData()
         return;
     }
 
-    BOOL puaLoaded = gVariantAnnotator.loadPUAFile(puaDataPath.UTF8String);
-    BOOL variantsLoaded = gVariantAnnotator.loadVariantsFile(variantsDataPath.UTF8String);
-    if (!gVariantAnnotator.loaded()) {
-        NSLog(@"Error: VariantAnnotator not ready, puaLoaded: %d, variantsLoaded: %d", puaLoaded, variantsLoaded);
+    if (!gVariantAnnotator.loadDatabaseFiles(puaDataPath.UTF8String, variantsDataPath.UTF8String)) {
+        NSLog(@"Error: VariantAnnotator not ready, failed to load the PUA and variants data");
     }
 }
 
@@ -462,9 +470,36 @@ static void LTLoadVariantAnnotatorData()
 
 + (McBopomofo::UserOverrideModel *)userOverrideModel
 {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // The learned data is not meant to be edited, so it always stays in
+        // the default location even if the user phrases are elsewhere.
+        NSString *folderPath = [UserPhraseLocationHelper defaultUserPhraseLocation];
+        [[NSFileManager defaultManager] createDirectoryAtPath:folderPath withIntermediateDirectories:YES attributes:nil error:nil];
+        NSString *path = [folderPath stringByAppendingPathComponent:kUserOverrideModelFilename];
+        gUserOverrideModelStore = new McBopomofo::UserOverrideModelStore(&gUserOverrideModel, path.fileSystemRepresentation);
+        gUserOverrideModelStore->load();
+    });
     return &gUserOverrideModel;
 }
 
++ (void)saveUserOverrideModelIfDue
+{
+    if (gUserOverrideModelStore) {
+        gUserOverrideModelStore->saveIfDue([NSDate date].timeIntervalSince1970);
+    }
+}
+
++ (void)saveUserOverrideModelWaitingUntilWritten:(BOOL)wait
+{
+    if (gUserOverrideModelStore) {
+        gUserOverrideModelStore->save();
+        if (wait) {
+            gUserOverrideModelStore->flush();
+        }
+    }
+}
+
 + (McBopomofo::VariantAnnotator *)variantAnnotator
 {
     return &gVariantAnnotator;